@@ -0,0 +1,154 @@
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include <boost/optional.hpp>
+#include <boost/thread.hpp>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+/**
+ * A thread-safe map that keeps at most maxSize entries, evicting the least recently used one when
+ * full. A max size of zero disables the cache; nothing is stored and every lookup is a miss.
+ */
+template <typename K, typename V, typename Hasher = std::hash<K>>
+class LRUCache
+{
+    using ListType = std::list<std::pair<K, V>>;
+
+    ListType                                                   entries; // most recently used first
+    std::unordered_map<K, typename ListType::iterator, Hasher> index;
+    std::size_t                                                maxSize;
+    uint64_t                                                   hits   = 0;
+    uint64_t                                                   misses = 0;
+    mutable boost::mutex                                       mtx;
+
+    void evictExcess();
+
+public:
+    explicit LRUCache(std::size_t MaxSize);
+
+    [[nodiscard]] boost::optional<V> get(const K& key);
+    void                             insert(const K& key, const V& value);
+    std::size_t                      erase(const K& key);
+    void                             clear();
+    [[nodiscard]] std::size_t        size() const;
+    [[nodiscard]] std::size_t        getMaxSize() const;
+    void                             setMaxSize(std::size_t MaxSize);
+    [[nodiscard]] uint64_t           getHits() const;
+    [[nodiscard]] uint64_t           getMisses() const;
+    void                             resetStats();
+};
+
+template <typename K, typename V, typename Hasher>
+LRUCache<K, V, Hasher>::LRUCache(std::size_t MaxSize) : maxSize(MaxSize)
+{
+}
+
+template <typename K, typename V, typename Hasher>
+void LRUCache<K, V, Hasher>::evictExcess()
+{
+    while (entries.size() > maxSize) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+template <typename K, typename V, typename Hasher>
+boost::optional<V> LRUCache<K, V, Hasher>::get(const K& key)
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    auto                            it = index.find(key);
+    if (it == index.end()) {
+        misses++;
+        return boost::none;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    return boost::make_optional(it->second->second);
+}
+
+template <typename K, typename V, typename Hasher>
+void LRUCache<K, V, Hasher>::insert(const K& key, const V& value)
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    if (maxSize == 0) {
+        return;
+    }
+    auto it = index.find(key);
+    if (it != index.end()) {
+        it->second->second = value;
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+    entries.emplace_front(key, value);
+    index.emplace(key, entries.begin());
+    evictExcess();
+}
+
+template <typename K, typename V, typename Hasher>
+std::size_t LRUCache<K, V, Hasher>::erase(const K& key)
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    auto                            it = index.find(key);
+    if (it == index.end()) {
+        return 0;
+    }
+    entries.erase(it->second);
+    index.erase(it);
+    return 1;
+}
+
+template <typename K, typename V, typename Hasher>
+void LRUCache<K, V, Hasher>::clear()
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    entries.clear();
+    index.clear();
+}
+
+template <typename K, typename V, typename Hasher>
+std::size_t LRUCache<K, V, Hasher>::size() const
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    return entries.size();
+}
+
+template <typename K, typename V, typename Hasher>
+std::size_t LRUCache<K, V, Hasher>::getMaxSize() const
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    return maxSize;
+}
+
+template <typename K, typename V, typename Hasher>
+void LRUCache<K, V, Hasher>::setMaxSize(std::size_t MaxSize)
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    maxSize = MaxSize;
+    evictExcess();
+}
+
+template <typename K, typename V, typename Hasher>
+uint64_t LRUCache<K, V, Hasher>::getHits() const
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    return hits;
+}
+
+template <typename K, typename V, typename Hasher>
+uint64_t LRUCache<K, V, Hasher>::getMisses() const
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    return misses;
+}
+
+template <typename K, typename V, typename Hasher>
+void LRUCache<K, V, Hasher>::resetStats()
+{
+    boost::lock_guard<boost::mutex> lock(mtx);
+    hits   = 0;
+    misses = 0;
+}
+
+#endif // LRUCACHE_H
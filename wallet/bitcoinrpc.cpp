@@ -328,6 +328,7 @@ static const CRPCCommand vRPCCommands[] =
     { "addmultisigaddress",        &addmultisigaddress,        false,  false },
     { "addredeemscript",           &addredeemscript,           false,  false },
     { "getrawmempool",             &getrawmempool,             true,   false },
+    { "getmempoolinfo",            &getmempoolinfo,            true,   false },
     { "calculateblockhash",        &calculateblockhash,        false,  false },
     { "gettxout",                  &gettxout,                  false,  false },
     { "getblock",                  &getblock,                  false,  false },
@@ -372,6 +373,8 @@ static const CRPCCommand vRPCCommands[] =
     { "exportblockchain",          &exportblockchain,          false,  false },
     { "getblockchaininfo",         &getblockchaininfo,         false,  false },
     { "getblockheader",            &getblockheader,            false,  false },
+    { "getsigcacheinfo",           &getsigcacheinfo,           true,   false },
+    { "getntp1cacheinfo",          &getntp1cacheinfo,          true,   false },
     { "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, true, false },
 };
 // clang-format on
@@ -1272,6 +1275,8 @@ Array RPCConvertValues(const std::string& strMethod, const std::vector<std::stri
         ConvertTo<int64_t>(params[1]);
     if (strMethod == "getntp1balances" && n > 0)
         ConvertTo<int64_t>(params[0]);
+    if (strMethod == "getrawmempool" && n > 0)
+        ConvertTo<bool>(params[0]);
     if (strMethod == "getblock" && n > 1)
         ConvertTo<bool>(params[1]);
     if (strMethod == "getblock" && n > 2)
@@ -278,6 +278,8 @@ extern json_spirit::Value getbestblockhash(const json_spirit::Array& params, boo
 extern json_spirit::Value syncwithvalidationinterfacequeue(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockchaininfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockheader(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getsigcacheinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getntp1cacheinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value generatepos(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value generate(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value generatetoaddress(const json_spirit::Array& params, bool fHelp);
@@ -286,6 +288,7 @@ extern json_spirit::Value getblockcount(const json_spirit::Array& params, bool f
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getmempoolinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value calculateblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
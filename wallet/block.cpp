@@ -3,11 +3,14 @@
 #include "NetworkForks.h"
 #include "blockindex.h"
 #include "blocklocator.h"
+#include "chain.h"
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "kernel.h"
 #include "main.h"
 #include "merkle.h"
 #include "ntp1/ntp1transaction.h"
+#include "stakemodifierindex.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -116,10 +119,52 @@ void CBlock::SetNull()
     nNonce         = 0;
     vtx.clear();
     vchBlockSig.clear();
+    vCheckedTxHashes.clear();
     nDoS = 0;
 }
 
-uint256 CBlock::GetPoWHash() const { return scrypt_blockhash(CVOIDBEGIN(nVersion)); }
+std::atomic<uint64_t> CBlock::nPoWHashComputations{0};
+
+uint256 CBlock::GetPoWHash() const
+{
+    static_assert(sizeof(vchPoWHashHeader) == sizeof(nVersion) + sizeof(hashPrevBlock) +
+                                                  sizeof(hashMerkleRoot) + sizeof(nTime) +
+                                                  sizeof(nBits) + sizeof(nNonce),
+                  "The header is hashed as the 80 bytes from nVersion to nNonce");
+    if (fPoWHashMemoSet && memcmp(vchPoWHashHeader, CVOIDBEGIN(nVersion), sizeof(vchPoWHashHeader)) == 0)
+        return hashPoWMemo;
+    nPoWHashComputations.fetch_add(1, std::memory_order_relaxed);
+    hashPoWMemo = scrypt_blockhash(CVOIDBEGIN(nVersion));
+    memcpy(vchPoWHashHeader, CVOIDBEGIN(nVersion), sizeof(vchPoWHashHeader));
+    fPoWHashMemoSet = true;
+    return hashPoWMemo;
+}
+
+void CBlock::PrecomputePoWHashes(const std::vector<CBlock>& vBlocks)
+{
+    std::vector<unsigned char> vchHeaders(vBlocks.size() * sizeof(vchPoWHashHeader));
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        memcpy(&vchHeaders[i * sizeof(vchPoWHashHeader)], CVOIDBEGIN(vBlocks[i].nVersion),
+               sizeof(vchPoWHashHeader));
+    }
+    std::vector<uint256> vHashes(vBlocks.size());
+    scrypt_blockhash_many(vchHeaders.data(), vBlocks.size(), vHashes.data());
+    nPoWHashComputations.fetch_add(vBlocks.size(), std::memory_order_relaxed);
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        const CBlock& block = vBlocks[i];
+        memcpy(block.vchPoWHashHeader, &vchHeaders[i * sizeof(vchPoWHashHeader)],
+               sizeof(vchPoWHashHeader));
+        block.hashPoWMemo     = vHashes[i];
+        block.fPoWHashMemoSet = true;
+    }
+}
+
+uint256 CBlock::GetTxHash(unsigned int nIndex) const
+{
+    if (vCheckedTxHashes.size() == vtx.size() && hashCheckedMerkleRoot == hashMerkleRoot)
+        return vCheckedTxHashes[nIndex];
+    return vtx[nIndex].GetHash();
+}
 
 int64_t CBlock::GetBlockTime() const { return (int64_t)nTime; }
 
@@ -139,6 +184,46 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndexSmartPtr& pindex)
         if (!vtx[i].DisconnectInputs(txdb))
             return false;
 
+    // Revert the UTXO set: the outputs of this block disappear, and the transactions that it spent from
+    // get back the outputs that their tx index entries, updated above, have left unspent
+    {
+        CCoinsViewDB      dbView(txdb);
+        CCoinsViewCache   view(dbView);
+        const std::size_t nUtxoCacheSize = GetUtxoCacheSize();
+        std::set<uint256> setBlockTxs;
+        for (unsigned int i = 0; i < vtx.size(); i++) {
+            setBlockTxs.insert(GetTxHash(i));
+            view.SetCoins(GetTxHash(i), CCoins());
+        }
+        std::set<uint256> setInputTxs;
+        for (const CTransaction& tx : vtx) {
+            if (tx.IsCoinBase())
+                continue;
+            for (const CTxIn& txin : tx.vin)
+                if (setBlockTxs.count(txin.prevout.hash) == 0)
+                    setInputTxs.insert(txin.prevout.hash);
+        }
+        for (const uint256& hashTx : setInputTxs) {
+            CTransaction txPrev;
+            CTxIndex     txindex;
+            if (!txdb.ReadDiskTx(hashTx, txPrev, txindex))
+                return error("DisconnectBlock() : failed to read input transaction %s",
+                             hashTx.ToString().c_str());
+            const CBlockIndexSmartPtr pindexTx =
+                mapBlockIndex.get(txindex.pos.nBlockPos).value_or(nullptr);
+            if (!pindexTx)
+                return error("DisconnectBlock() : block of input transaction %s not found",
+                             hashTx.ToString().c_str());
+            view.SetCoins(hashTx, CCoins(txPrev, pindexTx->nHeight, txindex));
+            if (view.DynamicMemoryUsage() > nUtxoCacheSize && !view.Flush())
+                return error("DisconnectBlock() : failed to write the UTXO set");
+        }
+        const CBlockIndexSmartPtr pindexPrev = boost::atomic_load(&pindex->pprev);
+        view.SetBestBlock(pindexPrev ? pindexPrev->GetBlockHash() : uint256(0));
+        if (!view.Flush())
+            return error("DisconnectBlock() : failed to write the UTXO set");
+    }
+
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
     if (pindex->pprev) {
@@ -408,16 +493,18 @@ bool CBlock::VerifyInputsUnspent(CTxDB& txdb) const
 
     std::unordered_map<uint256, CTxIndex>& queuedTxs = alternateChainTxs.modifiedOutputsTxs;
 
-    for (const CTransaction& tx : vtx) {
+    for (unsigned int nTxIndex = 0; nTxIndex < vtx.size(); nTxIndex++) {
+        const CTransaction& tx     = vtx[nTxIndex];
+        const uint256       hashTx = GetTxHash(nTxIndex);
         {
             // if an output in the transaction is spent in the same block, it should also be found in the
             // queued transactions list in order for the tests below to work because it's not in the
             // blockchain yet
-            auto it = queuedTxs.find(tx.GetHash());
+            auto it = queuedTxs.find(hashTx);
             if (it == queuedTxs.cend()) {
                 // unspent tx (all vSpent are null)
                 CTxIndex txindex(CDiskTxPos(this->GetHash(), 2), tx.vout.size());
-                queuedTxs[tx.GetHash()] = txindex;
+                queuedTxs[hashTx] = txindex;
             }
         }
 
@@ -439,7 +526,7 @@ bool CBlock::VerifyInputsUnspent(CTxDB& txdb) const
                     return error("Output number %u in tx %s which is an input to tx %s "
                                  "has an invalid input index in block %s (1)",
                                  outputNumInTx, outputTxHash.ToString().c_str(),
-                                 tx.GetHash().ToString().c_str(), this->GetHash().ToString().c_str());
+                                 hashTx.ToString().c_str(), this->GetHash().ToString().c_str());
                 }
 
                 if (it->second.vSpent[outputNumInTx].IsNull()) {
@@ -449,14 +536,14 @@ bool CBlock::VerifyInputsUnspent(CTxDB& txdb) const
                     return error("Output number %u in tx %s which is an input to tx %s is attempting to "
                                  "double-spend in the same block %s",
                                  outputNumInTx, outputTxHash.ToString().c_str(),
-                                 tx.GetHash().ToString().c_str(), this->GetHash().ToString().c_str());
+                                 hashTx.ToString().c_str(), this->GetHash().ToString().c_str());
                 }
             } else if (txdb.ReadTxIndex(outputTxHash, txindex)) {
                 if (outputNumInTx >= txindex.vSpent.size()) {
                     return error("Output number %u in tx %s which is an input to tx %s "
                                  "has an invalid input index in block %s (2)",
                                  outputNumInTx, outputTxHash.ToString().c_str(),
-                                 tx.GetHash().ToString().c_str(), this->GetHash().ToString().c_str());
+                                 hashTx.ToString().c_str(), this->GetHash().ToString().c_str());
                 }
 
                 queuedTxs[outputTxHash] = txindex;
@@ -468,14 +555,14 @@ bool CBlock::VerifyInputsUnspent(CTxDB& txdb) const
                                  "spent in block %s +++++ it was already spent in block %s, this is a "
                                  "double-spend attempt",
                                  outputNumInTx, outputTxHash.ToString().c_str(),
-                                 tx.GetHash().ToString().c_str(), this->GetHash().ToString().c_str(),
+                                 hashTx.ToString().c_str(), this->GetHash().ToString().c_str(),
                                  txindex.vSpent[outputNumInTx].nBlockPos.ToString().c_str());
                 }
             } else {
                 return error("Output number %u in tx %s which is an input to tx %s and is being "
                              "attempted to spend it in block %s. it's an invalid tx",
                              outputNumInTx, outputTxHash.ToString().c_str(),
-                             tx.GetHash().ToString().c_str(),
+                             hashTx.ToString().c_str(),
                              vin[inIdx].prevout.hash.ToString().c_str());
             }
         }
@@ -511,6 +598,9 @@ bool CBlock::ConnectBlock(CTxDB& txdb, const CBlockIndexSmartPtr& pindex, bool f
 {
     printf("Connecting block: %s\n", this->GetHash().ToString().c_str());
 
+    const uint64_t nPoWHashesBefore = nPoWHashComputations.load();
+    const uint64_t nTxHashesBefore  = CTransaction::nHashComputations.load();
+
     // Check it again in case a previous version let a bad block in, but skip BlockSig checking
     if (!CheckBlock(txdb, !fJustCheck, !fJustCheck, false))
         return false;
@@ -543,8 +633,20 @@ bool CBlock::ConnectBlock(CTxDB& txdb, const CBlockIndexSmartPtr& pindex, bool f
     // this is used to prevent duplicate token names
     std::unordered_map<std::string, uint256> issuedTokensSymbolsInThisBlock;
 
-    for (CTransaction& tx : vtx) {
-        uint256 hashTx = tx.GetHash();
+    // signature checks are collected while connecting the inputs, and run on the -par threads
+    std::vector<CScriptCheck>        vChecks;
+    CCheckQueueControl<CScriptCheck> control(scriptcheckqueue.HasThreads() ? &scriptcheckqueue
+                                                                           : nullptr);
+
+    // The UTXO set is updated from the inputs that validation fetches anyway; every SetCoins() writes
+    // the complete coins of a transaction, so the cache can be flushed to the block's batch at any point
+    CCoinsViewDB      dbView(txdb);
+    CCoinsViewCache   view(dbView);
+    const std::size_t nUtxoCacheSize = GetUtxoCacheSize();
+
+    for (unsigned int nTxIndex = 0; nTxIndex < vtx.size(); nTxIndex++) {
+        CTransaction& tx     = vtx[nTxIndex];
+        uint256       hashTx = GetTxHash(nTxIndex);
 
         std::vector<std::pair<CTransaction, NTP1Transaction>> inputsWithNTP1;
 
@@ -600,6 +702,10 @@ bool CBlock::ConnectBlock(CTxDB& txdb, const CBlockIndexSmartPtr& pindex, bool f
                         // write NTP1 transactions' data
                         NTP1Transaction ntp1tx;
                         ntp1tx.readNTP1DataFromTx(tx, inputsWithNTP1);
+
+                        // the transactions after this one in the block, and writing the block's NTP1
+                        // data to the database, use it from there
+                        NTP1Transaction::GetResolvedTxCache().insert(hashTx, ntp1tx);
                     }
                 } catch (std::exception& ex) {
                     return error("Error while verifying NTP1Transaction validity in ConnectBlock(): "
@@ -632,14 +738,36 @@ bool CBlock::ConnectBlock(CTxDB& txdb, const CBlockIndexSmartPtr& pindex, bool f
                 }
             }
 
-            if (tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, this)
+            if (tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, this,
+                                 &vChecks)
                     .isErr()) {
                 return false;
             }
+            control.Add(vChecks);
+
+            // ConnectInputs() marked the spent outputs in the queued tx index entries of the inputs
+            for (MapPrevTx::const_iterator mi = mapInputs.begin(); !fJustCheck && mi != mapInputs.end();
+                 ++mi) {
+                const CTxIndex&           txindexPrev = mapQueuedChanges.at(mi->first);
+                const CBlockIndexSmartPtr pindexPrev =
+                    txindexPrev.pos.nBlockPos == pindex->blockKeyInDB
+                        ? pindex
+                        : mapBlockIndex.get(txindexPrev.pos.nBlockPos).value_or(nullptr);
+                if (!pindexPrev)
+                    return error("ConnectBlock() : block of input transaction %s not found",
+                                 mi->first.ToString().c_str());
+                view.SetCoins(mi->first, CCoins(mi->second.second, pindexPrev->nHeight, txindexPrev));
+            }
         }
 
-        mapQueuedChanges[hashTx]          = CTxIndex(posThisTx, tx.vout.size());
-        mapQueuedNTP1Inputs[tx.GetHash()] = inputsWithNTP1;
+        mapQueuedChanges[hashTx]    = CTxIndex(posThisTx, tx.vout.size());
+        mapQueuedNTP1Inputs[hashTx] = inputsWithNTP1;
+
+        if (!fJustCheck) {
+            view.SetCoins(hashTx, CCoins(tx, pindex->nHeight));
+            if (view.DynamicMemoryUsage() > nUtxoCacheSize && !view.Flush())
+                return error("ConnectBlock() : failed to write the UTXO set");
+        }
     }
 
     if (IsProofOfWork()) {
@@ -668,6 +796,12 @@ bool CBlock::ConnectBlock(CTxDB& txdb, const CBlockIndexSmartPtr& pindex, bool f
                                   nStakeReward, nCalculatedStakeReward));
     }
 
+    if (!control.Wait()) {
+        reject = CBlockReject(REJECT_INVALID, "mandatory-script-verify-flag-failed", this->GetHash());
+        return DoS(100, error("ConnectBlock() : %s script verification failed",
+                              this->GetHash().ToString().c_str()));
+    }
+
     // ppcoin: track money supply and mint amount info
     pindex->nMint        = nValueOut - nValueIn + nFees;
     pindex->nMoneySupply = (pindex->pprev ? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
@@ -711,10 +845,22 @@ bool CBlock::ConnectBlock(CTxDB& txdb, const CBlockIndexSmartPtr& pindex, bool f
             return error("ConnectBlock() : WriteBlockIndex failed");
     }
 
+    // the UTXO set moves to this block in the same database batch
+    view.SetBestBlock(pindex->GetBlockHash());
+    if (!view.Flush())
+        return error("ConnectBlock() : failed to write the UTXO set");
+
     // we change the best hash. Remember this is within a transaction and will be reverted in case of
     // failure.
     txdb.WriteHashBestChain(pindex->GetBlockHash());
 
+    if (fDebug)
+        printf("ConnectBlock() : %" PRIu64 " scrypt and %" PRIu64 " transaction hashes computed for %u "
+               "transactions\n",
+               nPoWHashComputations.load() - nPoWHashesBefore,
+               CTransaction::nHashComputations.load() - nTxHashesBefore,
+               static_cast<unsigned>(vtx.size()));
+
     return true;
 }
 
@@ -737,10 +883,11 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, const CBlockIndexSmartPtr& pindexNew
 
     // Add to current best branch
     pindexNew->pprev->pnext = pindexNew;
+    chainActive.SetTip(pindexNew.get());
+    GetStakeModifierIndex().Push(pindexNew);
 
     // Delete redundant memory transactions
-    for (const CTransaction& tx : vtx)
-        mempool.remove(tx);
+    mempool.removeForBlock(vtx);
 
     return true;
 }
@@ -758,6 +905,8 @@ bool CBlock::SetBestChain(CTxDB& txdb, const CBlockIndexSmartPtr& pindexNew,
         if (createDbTransaction && !txdb.TxnCommit())
             return error("SetBestChain() : TxnCommit failed");
         pindexGenesisBlock = pindexNew;
+        chainActive.SetTip(pindexNew.get());
+        GetStakeModifierIndex().Reset(pindexNew);
     } else if (hashPrevBlock == txdb.GetBestBlockHash()) {
         if (!SetBestChainInner(txdb, pindexNew, createDbTransaction))
             return error("SetBestChain() : SetBestChainInner failed");
@@ -885,7 +1034,10 @@ bool CBlock::IsProofOfStake() const { return (vtx.size() > 1 && vtx[1].IsCoinSta
 
 CBlockIndexSmartPtr CBlock::FindBlockByHeight(int nHeight)
 {
-    CBlockIndexSmartPtr pblockindex;
+    CBlockIndexSmartPtr pblockindex = GetStakeModifierIndex().Get(nHeight);
+    if (pblockindex) {
+        return pblockindex;
+    }
     if (nHeight < CTxDB().GetBestChainHeight().value_or(0) / 2) {
         pblockindex = boost::atomic_load(&pindexGenesisBlock);
     } else {
@@ -1024,6 +1176,14 @@ bool CBlock::Reorganize(CTxDB& txdb, const CBlockIndexSmartPtr& pindexNew,
         if (pindex->pprev)
             pindex->pprev->pnext = pindex;
 
+    chainActive.SetTip(pindexNew.get());
+    GetStakeModifierIndex().Truncate(pfork->nHeight);
+    for (const CBlockIndexSmartPtr& pindex : vConnect)
+        GetStakeModifierIndex().Push(pindex);
+
+    // The stake modifiers of outputs come from the blocks after them, which changed
+    GetStakeKernelRecordCache().clear();
+
     // Resurrect memory transactions that were in the disconnected branch
     for (CTransaction& tx : vResurrect)
         AcceptToMemoryPool(mempool, tx, &txdb);
@@ -1227,12 +1387,17 @@ bool CBlock::CheckBlock(const ITxDB& txdb, bool fCheckPOW, bool fCheckMerkleRoot
                              GetBlockTime(), i, (int64_t)tx.nTime));
     }
 
-    // Check for duplicate txids. This is caught by ConnectInputs(),
-    // but catching it earlier avoids a potential DoS attack:
-    std::set<uint256> uniqueTx;
+    // the transaction hashes are needed for the duplicate and the merkle root checks, and
+    // ConnectBlock() reuses them once they match the merkle root
+    std::vector<uint256> vTxHashes;
+    vTxHashes.reserve(vtx.size());
     for (const CTransaction& tx : vtx) {
-        uniqueTx.insert(tx.GetHash());
+        vTxHashes.push_back(tx.GetHash());
     }
+
+    // Check for duplicate txids. This is caught by ConnectInputs(),
+    // but catching it earlier avoids a potential DoS attack:
+    std::set<uint256> uniqueTx(vTxHashes.begin(), vTxHashes.end());
     if (uniqueTx.size() != vtx.size()) {
         reject = CBlockReject(REJECT_INVALID, "bad-txns-duplicate", this->GetHash());
         return DoS(100, error("CheckBlock() : duplicate transaction"));
@@ -1248,8 +1413,8 @@ bool CBlock::CheckBlock(const ITxDB& txdb, bool fCheckPOW, bool fCheckMerkleRoot
     }
 
     // Check merkle root
-    bool merkleRootMutated;
-    if (fCheckMerkleRoot && hashMerkleRoot != GetMerkleRoot(&merkleRootMutated)) {
+    bool merkleRootMutated = false;
+    if (fCheckMerkleRoot && hashMerkleRoot != ComputeMerkleRoot(vTxHashes, &merkleRootMutated)) {
         reject = CBlockReject(REJECT_INVALID, "bad-txnmrklroot", this->GetHash());
         return DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"));
     }
@@ -1262,10 +1427,21 @@ bool CBlock::CheckBlock(const ITxDB& txdb, bool fCheckPOW, bool fCheckMerkleRoot
         return DoS(100, error("CheckBlock() : hashMerkleRoot duplicate: duplicate transaction"));
     }
 
+    if (fCheckMerkleRoot) {
+        vCheckedTxHashes      = std::move(vTxHashes);
+        hashCheckedMerkleRoot = hashMerkleRoot;
+    }
+
     return true;
 }
 
 bool CBlock::AcceptBlock()
+{
+    CTxDB txdb;
+    return AcceptBlock(txdb);
+}
+
+bool CBlock::AcceptBlock(CTxDB& txdb)
 {
     AssertLockHeld(cs_main);
 
@@ -1280,7 +1456,7 @@ bool CBlock::AcceptBlock()
     // protect against a possible attack where an attacker sends predecessors of very early blocks in the
     // blockchain, forcing a non-necessary scan of the whole blockchain
     int64_t maxCheckpointBlockHeight = Checkpoints::GetLastCheckpointBlockHeight();
-    if (CTxDB().GetBestChainHeight().value_or(0) > maxCheckpointBlockHeight + 1) {
+    if (txdb.GetBestChainHeight().value_or(0) > maxCheckpointBlockHeight + 1) {
         const uint256 prevBlockHash = this->hashPrevBlock;
         const auto    bi            = mapBlockIndex.get(prevBlockHash).value_or(nullptr);
         if (bi) {
@@ -1301,7 +1477,6 @@ bool CBlock::AcceptBlock()
     }
 
     try {
-        CTxDB txdb;
         if (!VerifyInputsUnspent(txdb)) {
             reject = CBlockReject(REJECT_INVALID, "bad-txns-inputs-missingorspent", this->GetHash());
             return DoS(100, error("VerifyInputsUnspent() failed for block %s\n",
@@ -1323,8 +1498,7 @@ bool CBlock::AcceptBlock()
         return DoS(100, error("AcceptBlock() : reject proof-of-work at height %d", nHeight));
 
     {
-        const CTxDB txdb;
-        const auto  hasColdStakingResult = HasColdStaking(txdb);
+        const auto hasColdStakingResult = HasColdStaking(txdb);
         if (hasColdStakingResult.isErr()) {
             return DoS(100, error("AcceptBlock() : reject cold-stake at height %d with error", nHeight));
         }
@@ -1363,7 +1537,7 @@ bool CBlock::AcceptBlock()
     // Verify hash target and signature of coinstake tx
     if (IsProofOfStake()) {
         uint256 targetProofOfStake;
-        if (!CheckProofOfStake(vtx[1], nBits, hashProof, targetProofOfStake)) {
+        if (!CheckProofOfStake(txdb, vtx[1], nBits, hashProof, targetProofOfStake)) {
             printf("WARNING: AcceptBlock(): check proof-of-stake failed for block %s\n",
                    hash.ToString().c_str());
             return false; // do not error here as we expect this during initial block download
@@ -1393,15 +1567,15 @@ bool CBlock::AcceptBlock()
     if (!CheckDiskSpace(::GetSerializeSize(*this, SER_DISK, CLIENT_VERSION)))
         return error("AcceptBlock() : out of disk space");
     uint256 nBlockPos = hash;
-    if (!WriteToDisk(nBlockPos, hashProof))
+    if (!WriteToDisk(txdb, nBlockPos, hashProof))
         return error("AcceptBlock() : WriteToDisk failed");
 
     // Relay inventory, but don't relay old inventory during initial block download
     int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
-    if (CTxDB().GetBestBlockHash() == hash) {
+    if (txdb.GetBestBlockHash() == hash) {
         LOCK(cs_vNodes);
         for (CNode* pnode : vNodes)
-            if (CTxDB().GetBestChainHeight().value_or(0) >
+            if (txdb.GetBestChainHeight().value_or(0) >
                 (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
                 pnode->PushInventory(CInv(MSG_BLOCK, hash));
     }
@@ -1745,14 +1919,15 @@ void UpdateWallets(const uint256& prevBestChain)
     }
 }
 
-bool CBlock::WriteToDisk(const uint256& nBlockPos, const uint256& hashProof)
+bool CBlock::WriteToDisk(CTxDB& txdb, const uint256& nBlockPos, const uint256& hashProof)
 {
     /**
      * @brief txdb
      * This function writes a whole block in an ACID transaction
      */
 
-    CTxDB txdb;
+    // in a batch, the caller commits it and syncs the wallets
+    const bool fNested = txdb.IsInTxn();
 
     // before adding the new block, we keep in mind what the current best block is
     const uint256 prevBestChain = txdb.GetBestBlockHash();
@@ -1804,7 +1979,8 @@ bool CBlock::WriteToDisk(const uint256& nBlockPos, const uint256& hashProof)
     txEnder.reset();
 
     // after having (potentially) updated the best block, we sync with wallets
-    UpdateWallets(prevBestChain);
+    if (!fNested)
+        UpdateWallets(prevBestChain);
 
     return true;
 }
@@ -6,6 +6,7 @@
 #include "transaction.h"
 #include "txindex.h"
 #include "uint256.h"
+#include <atomic>
 #include <unordered_map>
 #include <vector>
 
@@ -116,6 +117,17 @@ public:
 
     uint256 GetPoWHash() const;
 
+    /** The number of times GetPoWHash() ran scrypt, for measuring how often it's called */
+    static std::atomic<uint64_t> nPoWHashComputations;
+
+    /** Computes the PoW hashes of all the blocks together, which is faster than one by one, and keeps
+     * them for GetPoWHash() */
+    static void PrecomputePoWHashes(const std::vector<CBlock>& vBlocks);
+
+    /** The hash of vtx[nIndex]; taken from the hashes that CheckBlock() verified against the merkle
+     * root, if the merkle root hasn't changed since */
+    uint256 GetTxHash(unsigned int nIndex) const;
+
     int64_t GetBlockTime() const;
 
     void UpdateTime(const CBlockIndex* pindexPrev);
@@ -140,7 +152,9 @@ public:
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch,
                                      int nIndex);
 
-    bool WriteToDisk(const uint256& nBlockPos, const uint256& hashProof);
+    // writes the block in a batch of txdb, nested in the batch that txdb is in if any; wallets are only
+    // synced when it's not nested, otherwise the caller syncs them with UpdateWallets() after committing
+    bool WriteToDisk(CTxDB& txdb, const uint256& nBlockPos, const uint256& hashProof);
 
     bool WriteBlockPubKeys(CTxDB& txdb);
 
@@ -185,6 +199,9 @@ public:
     bool CheckBlock(const ITxDB& txdb, bool fCheckPOW = true, bool fCheckMerkleRoot = true,
                     bool fCheckSig = true);
     bool AcceptBlock();
+    // validates and writes the block through txdb, so it can build on blocks written in the batch that
+    // txdb is in
+    bool AcceptBlock(CTxDB& txdb);
     bool GetCoinAge(uint64_t& nCoinAge) const; // ppcoin: calculate total coin age spent in block
     bool
          SignBlock(const CTxDB& txdb, const CWallet& keystore, int64_t nFees,
@@ -206,6 +223,20 @@ public:
 private:
     bool SetBestChainInner(CTxDB& txdb, const CBlockIndexSmartPtr& pindexNew,
                            const bool createDbTransaction = true);
+
+    // GetPoWHash() memo: the header it was computed for (the 80 bytes from nVersion to nNonce), and
+    // its hash. Any change to the header fields makes it miss, so it needs no invalidation.
+    mutable unsigned char vchPoWHashHeader[80];
+    mutable uint256       hashPoWMemo;
+    mutable bool          fPoWHashMemoSet = false;
+
+    // the transaction hashes that CheckBlock() computed, and the merkle root they matched
+    std::vector<uint256> vCheckedTxHashes;
+    uint256              hashCheckedMerkleRoot;
 };
 
+// syncs the wallets with the blocks that were connected or disconnected since prevBestChain was the best
+// block
+void UpdateWallets(const uint256& prevBestChain);
+
 #endif // BLOCK_H
@@ -0,0 +1,300 @@
+#include "blockdownload.h"
+
+#include "blockindex.h"
+#include "chain.h"
+
+#include <algorithm>
+
+CBlockDownload blockDownload;
+
+int CBlockDownload::HeightUnsafe() const { return dHeaders.empty() ? -1 : dHeaders.back().nHeight; }
+
+void CBlockDownload::ReleaseInFlight(std::unordered_map<uint256, BlockInFlight>::iterator it)
+{
+    const auto peerIt = mapPeers.find(it->second.nodeId);
+    if (peerIt != mapPeers.end() && peerIt->second.nBlocksInFlight > 0)
+        peerIt->second.nBlocksInFlight--;
+    mapBlocksInFlight.erase(it);
+}
+
+void CBlockDownload::EraseFrom(std::size_t nIndex)
+{
+    for (std::size_t i = nIndex; i < dHeaders.size(); i++) {
+        const HeaderEntry& entry = dHeaders[i];
+        mapHeaderHeights.erase(entry.hash);
+        mapBlocksReceived.erase(entry.hashPrevBlock);
+        const auto it = mapBlocksInFlight.find(entry.hash);
+        if (it != mapBlocksInFlight.end())
+            ReleaseInFlight(it);
+    }
+    dHeaders.erase(dHeaders.begin() + nIndex, dHeaders.end());
+}
+
+void CBlockDownload::ErasePeerHeaders(int64_t nodeId)
+{
+    std::size_t nKeep = 0;
+    for (const auto& p : mapPeers) {
+        const auto it = mapHeaderHeights.find(p.second.hashLastHeader);
+        if (p.first != nodeId && it != mapHeaderHeights.end())
+            nKeep = std::max<std::size_t>(nKeep, it->second - dHeaders.front().nHeight + 1);
+    }
+    if (nKeep == dHeaders.size())
+        return;
+    EraseFrom(nKeep);
+    // the other peers may have a branch that wasn't taken while these headers were there
+    for (auto& p : mapPeers)
+        p.second.fHeadersRequested = false;
+}
+
+void CBlockDownload::PopConnected(const std::function<bool(const uint256&)>& fHaveBlock)
+{
+    while (!dHeaders.empty() && fHaveBlock(dHeaders.front().hash)) {
+        const HeaderEntry& entry = dHeaders.front();
+        mapHeaderHeights.erase(entry.hash);
+        mapBlocksReceived.erase(entry.hashPrevBlock);
+        const auto it = mapBlocksInFlight.find(entry.hash);
+        if (it != mapBlocksInFlight.end())
+            ReleaseInFlight(it);
+        dHeaders.pop_front();
+    }
+}
+
+void CBlockDownload::PeerConnected(int64_t nodeId, int nStartingHeight)
+{
+    LOCK(cs);
+    mapPeers[nodeId].nBestHeight = nStartingHeight;
+}
+
+void CBlockDownload::PeerDisconnected(int64_t nodeId)
+{
+    LOCK(cs);
+    for (auto it = mapBlocksInFlight.begin(); it != mapBlocksInFlight.end();) {
+        if (it->second.nodeId == nodeId)
+            it = mapBlocksInFlight.erase(it);
+        else
+            ++it;
+    }
+    ErasePeerHeaders(nodeId);
+    mapPeers.erase(nodeId);
+}
+
+int CBlockDownload::Height() const
+{
+    LOCK(cs);
+    return HeightUnsafe();
+}
+
+bool CBlockDownload::Contains(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapHeaderHeights.count(hash) > 0;
+}
+
+bool CBlockDownload::GetHeader(const uint256& hash, HeaderEntry& entry) const
+{
+    LOCK(cs);
+    const auto it = mapHeaderHeights.find(hash);
+    if (it == mapHeaderHeights.end())
+        return false;
+    entry = dHeaders[it->second - dHeaders.front().nHeight];
+    return true;
+}
+
+bool CBlockDownload::ShouldRequestHeaders(int64_t nodeId, int nBestHeight, int64_t nNow)
+{
+    LOCK(cs);
+    const auto it = mapPeers.find(nodeId);
+    if (it == mapPeers.end())
+        return false;
+    PeerState& peer = it->second;
+    if (peer.fHeadersRequested && nNow - peer.nHeadersRequestTime < HEADERS_RESPONSE_TIMEOUT)
+        return false;
+    // the first request is sent anyway, as it finds out where the chain of the peer forks from ours
+    if (peer.fHeadersSyncStarted) {
+        if (dHeaders.size() >= MAX_HEADERS_AHEAD)
+            return false;
+        if (peer.nBestHeight <= std::max(nBestHeight, HeightUnsafe()))
+            return false;
+    }
+    peer.fHeadersSyncStarted = true;
+    peer.fHeadersRequested   = true;
+    peer.nHeadersRequestTime = nNow;
+    return true;
+}
+
+std::vector<uint256> CBlockDownload::GetLocatorHashes(const CChain& chain) const
+{
+    LOCK(cs);
+    std::vector<uint256> vHave;
+    const int            nFirstHeight = dHeaders.empty() ? 0 : dHeaders.front().nHeight;
+    int                  nStep        = 1;
+    for (int nHeight = std::max(HeightUnsafe(), chain.Height()); nHeight > 0; nHeight -= nStep) {
+        if (!dHeaders.empty() && nHeight >= nFirstHeight && nHeight <= HeightUnsafe()) {
+            vHave.push_back(dHeaders[nHeight - nFirstHeight].hash);
+        } else if (const CBlockIndex* pindex = chain[nHeight]) {
+            vHave.push_back(pindex->GetBlockHash());
+        }
+        if (vHave.size() > 10)
+            nStep *= 2;
+    }
+    if (const CBlockIndex* pindexGenesis = chain.Genesis())
+        vHave.push_back(pindexGenesis->GetBlockHash());
+    return vHave;
+}
+
+bool CBlockDownload::AddHeaders(int64_t nodeId, const std::vector<HeaderEntry>& vEntries,
+                                bool fMoreAvailable, const uint256& hashBestChain)
+{
+    LOCK(cs);
+    PeerState& peer        = mapPeers[nodeId];
+    peer.fHeadersRequested = false;
+    if (vEntries.empty()) {
+        // the peer has nothing after the locator we sent
+        peer.nBestHeight = std::min(peer.nBestHeight, std::max(HeightUnsafe(), 0));
+        return true;
+    }
+    peer.nBestHeight = fMoreAvailable ? std::max(peer.nBestHeight, vEntries.back().nHeight + 1)
+                                      : vEntries.back().nHeight;
+
+    for (const HeaderEntry& entry : vEntries) {
+        if (setInvalidBlocks.count(entry.hash) || setInvalidBlocks.count(entry.hashPrevBlock))
+            return false;
+    }
+
+    // skip what we have already
+    std::size_t nFirstNew = 0;
+    while (nFirstNew < vEntries.size() && mapHeaderHeights.count(vEntries[nFirstNew].hash))
+        nFirstNew++;
+    if (nFirstNew == vEntries.size()) {
+        const auto lastIt = mapHeaderHeights.find(peer.hashLastHeader);
+        if (lastIt == mapHeaderHeights.end() || lastIt->second < vEntries.back().nHeight)
+            peer.hashLastHeader = vEntries.back().hash;
+        return true;
+    }
+
+    const uint256& hashPrev = vEntries[nFirstNew].hashPrevBlock;
+    if (dHeaders.empty() ? hashPrev != hashBestChain : hashPrev != dHeaders.back().hash) {
+        // Another branch, which may claim any trust, as the trust of proof-of-stake headers can't be
+        // checked; it doesn't replace the headers we have, but the peer is asked again once the request
+        // times out, by when they may be gone
+        peer.fHeadersRequested = true;
+        return true;
+    }
+
+    for (std::size_t i = nFirstNew; i < vEntries.size(); i++) {
+        mapHeaderHeights[vEntries[i].hash] = vEntries[i].nHeight;
+        dHeaders.push_back(vEntries[i]);
+    }
+    peer.hashLastHeader = vEntries.back().hash;
+    return true;
+}
+
+std::vector<uint256> CBlockDownload::RequestBlocks(int64_t nodeId, int64_t nNow,
+                                                   const std::function<bool(const uint256&)>& fHaveBlock)
+{
+    LOCK(cs);
+    std::vector<uint256> vRequest;
+    PopConnected(fHaveBlock);
+
+    const auto it = mapPeers.find(nodeId);
+    if (it == mapPeers.end())
+        return vRequest;
+    PeerState& peer = it->second;
+
+    const std::size_t nWindow = std::min<std::size_t>(dHeaders.size(), BLOCK_DOWNLOAD_WINDOW);
+    for (std::size_t i = 0; i < nWindow && peer.nBlocksInFlight < MAX_BLOCKS_IN_FLIGHT_PER_PEER; i++) {
+        const HeaderEntry& entry = dHeaders[i];
+        if (entry.nHeight > peer.nBestHeight)
+            break;
+        if (mapBlocksInFlight.count(entry.hash) || mapBlocksReceived.count(entry.hashPrevBlock) ||
+            fHaveBlock(entry.hash))
+            continue;
+        mapBlocksInFlight[entry.hash] = BlockInFlight{nodeId, nNow};
+        peer.nBlocksInFlight++;
+        vRequest.push_back(entry.hash);
+    }
+    return vRequest;
+}
+
+bool CBlockDownload::BlockReceived(const uint256& hash)
+{
+    LOCK(cs);
+    const auto it = mapBlocksInFlight.find(hash);
+    if (it == mapBlocksInFlight.end())
+        return false;
+    ReleaseInFlight(it);
+    return true;
+}
+
+bool CBlockDownload::AddReceivedBlock(const CBlock& block, int64_t nodeId)
+{
+    LOCK(cs);
+    const auto it = mapHeaderHeights.find(block.GetHash());
+    if (it == mapHeaderHeights.end() ||
+        it->second - dHeaders.front().nHeight >= static_cast<int>(BLOCK_DOWNLOAD_WINDOW))
+        return false;
+    mapBlocksReceived[block.hashPrevBlock] = ReceivedBlock{block, nodeId};
+    return true;
+}
+
+bool CBlockDownload::TakeReceivedChild(const uint256& hashPrev, CBlock& block, int64_t& nodeId)
+{
+    LOCK(cs);
+    const auto it = mapBlocksReceived.find(hashPrev);
+    if (it == mapBlocksReceived.end())
+        return false;
+    block  = std::move(it->second.block);
+    nodeId = it->second.nodeId;
+    mapBlocksReceived.erase(it);
+    return true;
+}
+
+void CBlockDownload::BlockRejected(const uint256& hash, bool fInvalid)
+{
+    LOCK(cs);
+    if (fInvalid)
+        setInvalidBlocks.insert(hash);
+    const auto it = mapHeaderHeights.find(hash);
+    if (it != mapHeaderHeights.end())
+        EraseFrom(it->second - dHeaders.front().nHeight);
+}
+
+bool CBlockDownload::IsStalling(int64_t nodeId, int64_t nNow) const
+{
+    LOCK(cs);
+    for (const auto& p : mapBlocksInFlight) {
+        if (p.second.nodeId == nodeId && nNow - p.second.nRequestTime > BLOCK_DOWNLOAD_TIMEOUT)
+            return true;
+    }
+
+    // with a single peer there's no one else to get the blocks from
+    if (mapPeers.size() < 2)
+        return false;
+
+    // the window can't move while every block in it is in flight or waiting for the first one
+    const HeaderEntry* pfirstMissing = nullptr;
+    const std::size_t  nWindow = std::min<std::size_t>(dHeaders.size(), BLOCK_DOWNLOAD_WINDOW);
+    for (std::size_t i = 0; i < nWindow; i++) {
+        const HeaderEntry& entry     = dHeaders[i];
+        const bool         fReceived = mapBlocksReceived.count(entry.hashPrevBlock) > 0;
+        if (!fReceived && !mapBlocksInFlight.count(entry.hash))
+            return false;
+        if (!fReceived && !pfirstMissing)
+            pfirstMissing = &entry;
+    }
+    if (!pfirstMissing)
+        return false;
+    const auto it = mapBlocksInFlight.find(pfirstMissing->hash);
+    return it->second.nodeId == nodeId && nNow - it->second.nRequestTime > BLOCK_STALLING_TIMEOUT;
+}
+
+void CBlockDownload::Clear()
+{
+    LOCK(cs);
+    dHeaders.clear();
+    mapHeaderHeights.clear();
+    mapBlocksInFlight.clear();
+    mapBlocksReceived.clear();
+    setInvalidBlocks.clear();
+    mapPeers.clear();
+}
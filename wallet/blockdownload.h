@@ -0,0 +1,155 @@
+#ifndef BLOCKDOWNLOAD_H
+#define BLOCKDOWNLOAD_H
+
+#include "block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+class CChain;
+
+/** The most headers sent in one "headers" message; a full message means that the peer has more */
+static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** The most headers kept above the block index; more are requested as the blocks get connected */
+static const unsigned int MAX_HEADERS_AHEAD = 50000;
+/** The blocks of the header chain, counted from the first one we don't have, that may be downloaded
+ * at the same time */
+static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+static const unsigned int MAX_BLOCKS_IN_FLIGHT_PER_PEER = 16;
+/** Seconds a peer may keep back the block that the whole download window waits for */
+static const int64_t BLOCK_STALLING_TIMEOUT = 10;
+/** Seconds a peer may take to send any block requested from it */
+static const int64_t BLOCK_DOWNLOAD_TIMEOUT = 120;
+/** Seconds after which a "getheaders" without an answer may be sent again */
+static const int64_t HEADERS_RESPONSE_TIMEOUT = 120;
+
+/** A checked header of the header chain */
+struct HeaderEntry
+{
+    uint256      hash;
+    uint256      hashPrevBlock;
+    int          nHeight = 0;
+    unsigned int nBits   = 0;
+    uint256      nChainTrust;
+};
+
+/**
+ * Headers-first synchronization: the best chain of headers that peers sent, starting above the block
+ * index, and the downloads of its blocks. The blocks are requested from all the peers that have them,
+ * a few at a time from each, within a window that moves up as blocks get connected. Blocks that
+ * arrive before their parent are kept here instead of in the orphan blocks, which are then only the
+ * blocks that peers send unasked.
+ *
+ * Only the headers are known to be linked, to pass the checkpoints and (for proof-of-stake) to have a
+ * plausible target; the blocks are fully checked when they arrive. A block that turns out to be
+ * invalid removes it and the headers after it.
+ *
+ * The trust that the headers claim can't be verified before their blocks arrive, so the headers only
+ * ever extend the tip of the active chain or the header chain; a competing branch isn't taken for the
+ * trust it claims, but comes in as blocks, through the orphan blocks. The headers that no other peer
+ * sent are removed when their peer disconnects or stalls the download.
+ */
+class CBlockDownload
+{
+    struct PeerState
+    {
+        // the height the peer has the chain up to, as far as we know
+        int          nBestHeight         = -1;
+        bool         fHeadersSyncStarted = false;
+        bool         fHeadersRequested   = false;
+        int64_t      nHeadersRequestTime = 0;
+        unsigned int nBlocksInFlight     = 0;
+        // the last header of the header chain that the peer sent
+        uint256 hashLastHeader;
+    };
+
+    struct BlockInFlight
+    {
+        int64_t nodeId;
+        int64_t nRequestTime;
+    };
+
+    struct ReceivedBlock
+    {
+        CBlock  block;
+        int64_t nodeId;
+    };
+
+    mutable CCriticalSection cs;
+
+    std::deque<HeaderEntry>                    dHeaders;
+    std::unordered_map<uint256, int>           mapHeaderHeights;
+    std::unordered_map<uint256, BlockInFlight> mapBlocksInFlight;
+    // blocks that arrived before their parent, by the hash of the parent
+    std::unordered_map<uint256, ReceivedBlock> mapBlocksReceived;
+    std::set<uint256>                          setInvalidBlocks;
+    std::map<int64_t, PeerState>               mapPeers;
+
+    int  HeightUnsafe() const;
+    void EraseFrom(std::size_t nIndex);
+    // removes the headers after the last one that another peer sent
+    void ErasePeerHeaders(int64_t nodeId);
+    void ReleaseInFlight(std::unordered_map<uint256, BlockInFlight>::iterator it);
+    void PopConnected(const std::function<bool(const uint256&)>& fHaveBlock);
+
+public:
+    void PeerConnected(int64_t nodeId, int nStartingHeight);
+    void PeerDisconnected(int64_t nodeId);
+
+    /** The height of the last header, or -1 if there are no headers */
+    int Height() const;
+
+    bool Contains(const uint256& hash) const;
+
+    bool GetHeader(const uint256& hash, HeaderEntry& entry) const;
+
+    /** Whether to send "getheaders" to the peer now; marks the request as sent if so */
+    bool ShouldRequestHeaders(int64_t nodeId, int nBestHeight, int64_t nNow);
+
+    /** A locator of the last header, followed by the blocks of the active chain */
+    std::vector<uint256> GetLocatorHashes(const CChain& chain) const;
+
+    /**
+     * Takes a "headers" answer of the peer, already linked and checked, whose new headers are added if
+     * they build on the last header, or, without headers, on hashBestChain, the tip of the active chain.
+     * Returns false if the headers contain a block found invalid before.
+     */
+    bool AddHeaders(int64_t nodeId, const std::vector<HeaderEntry>& vEntries, bool fMoreAvailable,
+                    const uint256& hashBestChain);
+
+    /** The blocks to request from the peer now. fHaveBlock tells whether a block is in the block
+     * index, in which case it's no longer needed here */
+    std::vector<uint256> RequestBlocks(int64_t nodeId, int64_t nNow,
+                                       const std::function<bool(const uint256&)>& fHaveBlock);
+
+    /** Marks the block as no longer in flight; returns whether it had been requested */
+    bool BlockReceived(const uint256& hash);
+
+    /** Keeps a block within the download window that arrived before its parent; returns false if the
+     * block isn't one of these */
+    bool AddReceivedBlock(const CBlock& block, int64_t nodeId);
+
+    /** Takes the kept block whose parent is hashPrev, if any */
+    bool TakeReceivedChild(const uint256& hashPrev, CBlock& block, int64_t& nodeId);
+
+    /** Removes the block and the headers after it, after it failed to be accepted; an invalid
+     * block is also never taken again */
+    void BlockRejected(const uint256& hash, bool fInvalid);
+
+    /** Whether the peer holds back the download, by not sending a block in time or by keeping back
+     * the block that the full window waits for */
+    bool IsStalling(int64_t nodeId, int64_t nNow) const;
+
+    void Clear();
+};
+
+extern CBlockDownload blockDownload;
+
+#endif // BLOCKDOWNLOAD_H
@@ -3,6 +3,7 @@
 #include "bignum.h"
 #include "block.h"
 #include "boost/shared_ptr.hpp"
+#include "chain.h"
 #include "util.h"
 
 CBlockIndex::CBlockIndex()
@@ -86,7 +87,9 @@ std::string CBlockIndex::ToString() const
                      hashMerkleRoot.ToString().c_str(), GetBlockHash().ToString().c_str());
 }
 
-uint256 CBlockIndex::GetBlockTrust() const
+uint256 CBlockIndex::GetBlockTrust() const { return GetBlockTrust(nBits); }
+
+uint256 CBlockIndex::GetBlockTrust(unsigned int nBits)
 {
     CBigNum bnTarget;
     bnTarget.SetCompact(nBits);
@@ -99,7 +102,8 @@ uint256 CBlockIndex::GetBlockTrust() const
 
 bool CBlockIndex::IsInMainChain(const ITxDB& txdb) const
 {
-    return (pnext || this == txdb.GetBestBlockIndex().get());
+    // the best block of txdb may be ahead of the active chain in the middle of connecting blocks
+    return (chainActive.Next(this) || this == txdb.GetBestBlockIndex().get());
 }
 
 bool CBlockIndex::IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned int nRequired,
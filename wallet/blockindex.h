@@ -63,6 +63,9 @@ public:
 
     uint256 GetBlockTrust() const;
 
+    /** The trust of a block with the target nBits, which is all that it depends on */
+    static uint256 GetBlockTrust(unsigned int nBits);
+
     bool IsInMainChain(const ITxDB& txdb) const;
 
     bool CheckIndex() const { return true; }
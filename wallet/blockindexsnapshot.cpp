@@ -0,0 +1,255 @@
+#include "blockindexsnapshot.h"
+
+#include "blockindex.h"
+#include "kernel.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+static BlockIndexSnapshotRecord RecordFromBlockIndex(const uint256& hash, const CBlockIndex& index)
+{
+    BlockIndexSnapshotRecord r{};
+    const CBlockIndexSmartPtr pprev = boost::atomic_load(&index.pprev);
+    const CBlockIndexSmartPtr pnext = boost::atomic_load(&index.pnext);
+
+    r.blockHash              = hash;
+    r.hashPrev               = (pprev ? pprev->GetBlockHash() : 0);
+    r.hashNext               = (pnext ? pnext->GetBlockHash() : 0);
+    r.blockKeyInDB           = index.blockKeyInDB;
+    r.nChainTrust            = index.nChainTrust;
+    r.hashProof              = index.hashProof;
+    r.hashMerkleRoot         = index.hashMerkleRoot;
+    r.prevoutStakeHash       = index.prevoutStake.hash;
+    r.prevoutStakeN          = index.prevoutStake.n;
+    r.nMint                  = index.nMint;
+    r.nMoneySupply           = index.nMoneySupply;
+    r.nStakeModifier         = index.nStakeModifier;
+    r.nHeight                = index.nHeight;
+    r.nFlags                 = index.nFlags;
+    r.nStakeModifierChecksum = index.nStakeModifierChecksum;
+    r.nStakeTime             = index.nStakeTime;
+    r.nVersion               = index.nVersion;
+    r.nTime                  = index.nTime;
+    r.nBits                  = index.nBits;
+    r.nNonce                 = index.nNonce;
+    return r;
+}
+
+static void BlockIndexFromRecord(const BlockIndexSnapshotRecord& r, CBlockIndex& index)
+{
+    index.phashBlock             = r.blockHash;
+    index.blockKeyInDB           = r.blockKeyInDB;
+    index.nChainTrust            = r.nChainTrust;
+    index.hashProof              = r.hashProof;
+    index.hashMerkleRoot         = r.hashMerkleRoot;
+    index.prevoutStake           = COutPoint(r.prevoutStakeHash, r.prevoutStakeN);
+    index.nMint                  = r.nMint;
+    index.nMoneySupply           = r.nMoneySupply;
+    index.nStakeModifier         = r.nStakeModifier;
+    index.nHeight                = r.nHeight;
+    index.nFlags                 = r.nFlags;
+    index.nStakeModifierChecksum = r.nStakeModifierChecksum;
+    index.nStakeTime             = r.nStakeTime;
+    index.nVersion               = r.nVersion;
+    index.nTime                  = r.nTime;
+    index.nBits                  = r.nBits;
+    index.nNonce                 = r.nNonce;
+}
+
+bool WriteBlockIndexSnapshot(const boost::filesystem::path&    path,
+                             const BlockIndexMapType::MapType& blockIndex,
+                             const BlockIndexSnapshotId&       id)
+{
+    const boost::filesystem::path tempPath = path.string() + ".temp";
+
+    BlockIndexSnapshotHeader header{};
+    memcpy(header.magic, BLOCKINDEX_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.nSnapshotVersion = BLOCKINDEX_SNAPSHOT_VERSION;
+    header.nRecordSize      = sizeof(BlockIndexSnapshotRecord);
+    header.nRecordCount     = blockIndex.size();
+    header.nDbTxnId         = id.nDbTxnId;
+    header.nDbVersion       = id.nDbVersion;
+    header.hashBestChain    = id.hashBestChain;
+
+    try {
+        boost::filesystem::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return error("WriteBlockIndexSnapshot(): failed to open %s for writing",
+                         tempPath.string().c_str());
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        // std::map is ordered by hash, which the loader relies on to build its map in linear time
+        for (const auto& entry : blockIndex) {
+            const BlockIndexSnapshotRecord r = RecordFromBlockIndex(entry.first, *entry.second);
+            file.write(reinterpret_cast<const char*>(&r), sizeof(r));
+        }
+        file.close();
+        if (file.fail()) {
+            boost::filesystem::remove(tempPath);
+            return error("WriteBlockIndexSnapshot(): failed to write %s", tempPath.string().c_str());
+        }
+        boost::filesystem::rename(tempPath, path);
+    } catch (std::exception& ex) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(tempPath, ec);
+        return error("WriteBlockIndexSnapshot(): %s", ex.what());
+    }
+
+    printf("Wrote block index snapshot with %" PRIu64 " entries to %s\n", header.nRecordCount,
+           path.string().c_str());
+    return true;
+}
+
+bool LoadBlockIndexSnapshot(const boost::filesystem::path& path, const BlockIndexSnapshotId& expectedId,
+                            BlockIndexMapType::MapType&                    blockIndex,
+                            CBlockIndexSmartPtr&                           pindexGenesis,
+                            std::set<std::pair<COutPoint, unsigned int>>& stakeSeen, unsigned nThreads)
+{
+    if (!boost::filesystem::exists(path)) {
+        printf("No block index snapshot found\n");
+        return false;
+    }
+
+    boost::iostreams::mapped_file_source file;
+    try {
+        file.open(path.string());
+    } catch (std::exception& ex) {
+        return error("LoadBlockIndexSnapshot(): failed to map %s: %s", path.string().c_str(),
+                     ex.what());
+    }
+
+    if (file.size() < sizeof(BlockIndexSnapshotHeader)) {
+        return error("LoadBlockIndexSnapshot(): snapshot file is truncated");
+    }
+
+    BlockIndexSnapshotHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, BLOCKINDEX_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.nSnapshotVersion != BLOCKINDEX_SNAPSHOT_VERSION ||
+        header.nRecordSize != sizeof(BlockIndexSnapshotRecord)) {
+        return error("LoadBlockIndexSnapshot(): unknown snapshot format");
+    }
+    if (header.nRecordCount != (file.size() - sizeof(header)) / sizeof(BlockIndexSnapshotRecord) ||
+        (file.size() - sizeof(header)) % sizeof(BlockIndexSnapshotRecord) != 0) {
+        return error("LoadBlockIndexSnapshot(): snapshot size doesn't match its record count");
+    }
+    if (header.nRecordCount == 0) {
+        return error("LoadBlockIndexSnapshot(): snapshot is empty");
+    }
+    if (header.nDbTxnId != expectedId.nDbTxnId || header.nDbVersion != expectedId.nDbVersion ||
+        header.hashBestChain != expectedId.hashBestChain) {
+        printf("Block index snapshot is stale (txn id %" PRIu64 " vs %" PRIu64
+               "; best chain %s vs %s)\n",
+               header.nDbTxnId, expectedId.nDbTxnId, header.hashBestChain.ToString().c_str(),
+               expectedId.hashBestChain.ToString().c_str());
+        return false;
+    }
+
+    const uint64_t    count   = header.nRecordCount;
+    const char* const records = file.data() + sizeof(header);
+    auto              recordAt = [records](uint64_t i) {
+        BlockIndexSnapshotRecord r;
+        memcpy(&r, records + i * sizeof(BlockIndexSnapshotRecord), sizeof(r));
+        return r;
+    };
+
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    nThreads = static_cast<unsigned>(
+        std::max<uint64_t>(1, std::min<uint64_t>(nThreads, count / BLOCKINDEX_SNAPSHOT_MIN_SHARD)));
+
+    // step 1 (parallel): create the index objects, and verify that the records are sorted by hash
+    std::vector<CBlockIndexSmartPtr> nodes(count);
+    std::atomic<bool>                unsorted{false};
+    std::atomic<bool>                failedCheck{false};
+    RunSharded(count, nThreads, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+            const BlockIndexSnapshotRecord r = recordAt(i);
+            if (i > 0 && !(recordAt(i - 1).blockHash < r.blockHash)) {
+                unsorted = true;
+                return;
+            }
+            nodes[i] = boost::make_shared<CBlockIndex>();
+            BlockIndexFromRecord(r, *nodes[i]);
+            // the same check as when the index is read from the database; the snapshot is only
+            // trusted as far as its link to the state of the database goes
+            if (!nodes[i]->CheckIndex()) {
+                failedCheck = true;
+                return;
+            }
+        }
+    });
+    if (unsorted) {
+        return error("LoadBlockIndexSnapshot(): snapshot records are not sorted");
+    }
+    if (failedCheck) {
+        return error("LoadBlockIndexSnapshot(): CheckIndex failed for a snapshot record");
+    }
+
+    // step 2 (serial): since the records are sorted, every insertion is amortized O(1) at the end
+    BlockIndexMapType::MapType loaded;
+    for (const CBlockIndexSmartPtr& node : nodes) {
+        loaded.emplace_hint(loaded.end(), node->phashBlock, node);
+    }
+
+    // step 3 (parallel): fix up pointers; the map isn't modified anymore, so concurrent lookups are safe
+    std::atomic<bool> danglingPointer{false};
+    RunSharded(count, nThreads, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+            const BlockIndexSnapshotRecord r = recordAt(i);
+            if (r.hashPrev != 0) {
+                const auto it = loaded.find(r.hashPrev);
+                if (it == loaded.cend()) {
+                    danglingPointer = true;
+                    return;
+                }
+                nodes[i]->pprev = it->second;
+            }
+            if (r.hashNext != 0) {
+                const auto it = loaded.find(r.hashNext);
+                if (it == loaded.cend()) {
+                    danglingPointer = true;
+                    return;
+                }
+                nodes[i]->pnext = it->second;
+            }
+        }
+    });
+    if (danglingPointer) {
+        return error("LoadBlockIndexSnapshot(): snapshot references a block that it doesn't contain");
+    }
+
+    // step 4 (serial): global state that LoadBlockIndex() would have built while walking the db
+    CBlockIndexSmartPtr                          genesis;
+    std::set<std::pair<COutPoint, unsigned int>> loadedStakeSeen;
+    const uint256                                genesisHash = Params().GenesisBlockHash();
+    for (const CBlockIndexSmartPtr& node : nodes) {
+        if (node->phashBlock == genesisHash) {
+            genesis = node;
+        }
+        if (node->IsProofOfStake()) {
+            loadedStakeSeen.insert(std::make_pair(node->prevoutStake, node->nStakeTime));
+        }
+        if (!CheckStakeModifierCheckpoints(node->nHeight, node->nStakeModifierChecksum)) {
+            return error("LoadBlockIndexSnapshot(): failed stake modifier checkpoint height=%d, "
+                         "modifier=0x%016" PRIx64,
+                         node->nHeight, node->nStakeModifier);
+        }
+    }
+
+    blockIndex = std::move(loaded);
+    if (genesis) {
+        pindexGenesis = genesis;
+    }
+    stakeSeen.insert(loadedStakeSeen.begin(), loadedStakeSeen.end());
+
+    printf("Loaded %" PRIu64 " block index entries from snapshot using %u threads\n", count, nThreads);
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef BLOCKINDEXSNAPSHOT_H
+#define BLOCKINDEXSNAPSHOT_H
+
+#include "globals.h"
+#include "outpoint.h"
+#include "uint256.h"
+
+#include <boost/filesystem/path.hpp>
+#include <set>
+#include <string>
+
+/**
+ * The block index snapshot is a flat, fixed-width copy of mapBlockIndex that is written on clean
+ * shutdown. On the next start, it's memory-mapped and loaded in parallel instead of walking and
+ * deserializing every entry of BlockIndexDb. It's tied to the exact state of the database it was
+ * written from (the LMDB transaction id and the best chain hash); any write to the database after
+ * the snapshot makes it stale, in which case the caller falls back to reading the database.
+ *
+ * The layout is the in-memory layout of the structs below, so a snapshot is only meant to be read
+ * by the same build on the same machine.
+ */
+
+static const char        BLOCKINDEX_SNAPSHOT_MAGIC[8]  = {'N', 'E', 'B', 'L', 'B', 'I', 'D', 'X'};
+static const uint32_t    BLOCKINDEX_SNAPSHOT_VERSION   = 1;
+const std::string        BLOCKINDEX_SNAPSHOT_FILENAME  = "blockindex.snapshot";
+// loading threads get at least this many records each, smaller snapshots use fewer threads
+static const uint64_t    BLOCKINDEX_SNAPSHOT_MIN_SHARD = 20000;
+
+struct BlockIndexSnapshotHeader
+{
+    char     magic[8];
+    uint32_t nSnapshotVersion;
+    uint32_t nRecordSize;
+    uint64_t nRecordCount;
+    uint64_t nDbTxnId;
+    int32_t  nDbVersion;
+    uint32_t nReserved;
+    uint256  hashBestChain;
+};
+
+struct BlockIndexSnapshotRecord
+{
+    uint256  blockHash;
+    uint256  hashPrev;
+    uint256  hashNext;
+    uint256  blockKeyInDB;
+    uint256  nChainTrust;
+    uint256  hashProof;
+    uint256  hashMerkleRoot;
+    uint256  prevoutStakeHash;
+    int64_t  nMint;
+    int64_t  nMoneySupply;
+    uint64_t nStakeModifier;
+    int32_t  nHeight;
+    uint32_t nFlags;
+    uint32_t nStakeModifierChecksum;
+    uint32_t prevoutStakeN;
+    uint32_t nStakeTime;
+    int32_t  nVersion;
+    uint32_t nTime;
+    uint32_t nBits;
+    uint32_t nNonce;
+    uint32_t nReserved;
+};
+
+static_assert(sizeof(BlockIndexSnapshotHeader) % 8 == 0, "Snapshot records must stay aligned");
+static_assert(sizeof(BlockIndexSnapshotRecord) % 8 == 0, "Snapshot records must stay aligned");
+
+/** The state of the database a snapshot belongs to */
+struct BlockIndexSnapshotId
+{
+    uint64_t nDbTxnId;
+    int32_t  nDbVersion;
+    uint256  hashBestChain;
+};
+
+/**
+ * Writes blockIndex to path (through a temporary file that is renamed when complete).
+ * Returns false and logs on error.
+ */
+bool WriteBlockIndexSnapshot(const boost::filesystem::path&    path,
+                             const BlockIndexMapType::MapType& blockIndex,
+                             const BlockIndexSnapshotId&       id);
+
+/**
+ * Loads a snapshot written by WriteBlockIndexSnapshot() into blockIndex, linking pprev/pnext.
+ * Returns false (with blockIndex, pindexGenesis and stakeSeen untouched) if the file doesn't exist,
+ * doesn't belong to expectedId or is malformed. nThreads == 0 picks the number of hardware threads.
+ */
+bool LoadBlockIndexSnapshot(const boost::filesystem::path& path, const BlockIndexSnapshotId& expectedId,
+                            BlockIndexMapType::MapType&                    blockIndex,
+                            CBlockIndexSmartPtr&                           pindexGenesis,
+                            std::set<std::pair<COutPoint, unsigned int>>& stakeSeen,
+                            unsigned                                       nThreads = 0);
+
+#endif // BLOCKINDEXSNAPSHOT_H
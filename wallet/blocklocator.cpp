@@ -1,6 +1,7 @@
 #include "blocklocator.h"
 
 #include "blockindex.h"
+#include "chain.h"
 #include "protocol.h"
 #include "txdb-lmdb.h"
 
@@ -26,9 +27,14 @@ void CBlockLocator::Set(const CBlockIndex* pindex)
     while (pindex) {
         vHave.push_back(pindex->GetBlockHash());
 
-        // Exponentially larger steps back
-        for (int i = 0; pindex && i < nStep; i++)
-            pindex = boost::atomic_load(&pindex->pprev).get();
+        // Exponentially larger steps back; in the main chain, by height
+        if (pindex->nHeight < nStep)
+            pindex = nullptr;
+        else if (chainActive.Contains(pindex))
+            pindex = chainActive[pindex->nHeight - nStep];
+        else
+            for (int i = 0; pindex && i < nStep; i++)
+                pindex = boost::atomic_load(&pindex->pprev).get();
         if (vHave.size() > 10)
             nStep *= 2;
     }
@@ -43,7 +49,7 @@ int CBlockLocator::GetDistanceBack()
     BOOST_FOREACH (const uint256& hash, vHave) {
         const auto bi = mapBlockIndex.get(hash).value_or(nullptr);
         if (bi) {
-            if (bi->IsInMainChain(CTxDB()))
+            if (chainActive.Contains(bi.get()))
                 return nDistance;
         }
         nDistance += nStep;
@@ -59,7 +65,7 @@ CBlockIndexSmartPtr CBlockLocator::GetBlockIndex()
     BOOST_FOREACH (const uint256& hash, vHave) {
         const auto bi = mapBlockIndex.get(hash).value_or(nullptr);
         if (bi) {
-            if (bi->IsInMainChain(CTxDB()))
+            if (chainActive.Contains(bi.get()))
                 return bi;
         }
     }
@@ -72,7 +78,7 @@ uint256 CBlockLocator::GetBlockHash()
     BOOST_FOREACH (const uint256& hash, vHave) {
         const auto bi = mapBlockIndex.get(hash).value_or(nullptr);
         if (bi) {
-            if (bi->IsInMainChain(CTxDB()))
+            if (chainActive.Contains(bi.get()))
                 return hash;
         }
     }
@@ -0,0 +1,61 @@
+#include "chain.h"
+
+#include "blockindex.h"
+
+CChain chainActive;
+
+CBlockIndex* CChain::Genesis() const
+{
+    LOCK(cs);
+    return vChain.empty() ? nullptr : vChain.front();
+}
+
+CBlockIndex* CChain::Tip() const
+{
+    LOCK(cs);
+    return vChain.empty() ? nullptr : vChain.back();
+}
+
+CBlockIndex* CChain::operator[](int nHeight) const
+{
+    LOCK(cs);
+    if (nHeight < 0 || nHeight >= static_cast<int>(vChain.size()))
+        return nullptr;
+    return vChain[nHeight];
+}
+
+bool CChain::Contains(const CBlockIndex* pindex) const
+{
+    if (!pindex)
+        return false;
+    return (*this)[pindex->nHeight] == pindex;
+}
+
+CBlockIndex* CChain::Next(const CBlockIndex* pindex) const
+{
+    LOCK(cs);
+    if (!pindex || pindex->nHeight < 0 || pindex->nHeight + 1 >= static_cast<int>(vChain.size()) ||
+        vChain[pindex->nHeight] != pindex)
+        return nullptr;
+    return vChain[pindex->nHeight + 1];
+}
+
+int CChain::Height() const
+{
+    LOCK(cs);
+    return static_cast<int>(vChain.size()) - 1;
+}
+
+void CChain::SetTip(CBlockIndex* pindex)
+{
+    LOCK(cs);
+    if (!pindex) {
+        vChain.clear();
+        return;
+    }
+    vChain.resize(pindex->nHeight + 1);
+    while (pindex && vChain[pindex->nHeight] != pindex) {
+        vChain[pindex->nHeight] = pindex;
+        pindex                  = pindex->pprev.get();
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#include "sync.h"
+
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * The blocks of the active (main) chain in a vector indexed by height, so that finding a block by
+ * height and checking whether a block is in the main chain don't follow pprev/pnext pointers or read
+ * the best block from the database. Blocks of the block index are never freed, so the raw pointers
+ * stay valid.
+ */
+class CChain
+{
+    mutable CCriticalSection  cs;
+    std::vector<CBlockIndex*> vChain;
+
+public:
+    /** The genesis block, or null if the chain is empty */
+    CBlockIndex* Genesis() const;
+
+    /** The best block, or null if the chain is empty */
+    CBlockIndex* Tip() const;
+
+    /** The block at nHeight, or null if the chain isn't that high */
+    CBlockIndex* operator[](int nHeight) const;
+
+    bool Contains(const CBlockIndex* pindex) const;
+
+    /** The block after pindex in the chain, or null if pindex isn't in it or is the tip */
+    CBlockIndex* Next(const CBlockIndex* pindex) const;
+
+    /** The height of the tip, or -1 if the chain is empty */
+    int Height() const;
+
+    /** Makes pindex the tip, replacing the blocks above the fork of its branch with the chain */
+    void SetTip(CBlockIndex* pindex);
+};
+
+/** The main chain, updated together with pnext */
+extern CChain chainActive;
+
+#endif // CHAIN_H
@@ -0,0 +1,221 @@
+#ifndef CHECKQUEUE_H
+#define CHECKQUEUE_H
+
+#include <algorithm>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <vector>
+
+/**
+ * Queue for verifications that have to be performed.
+ * The verifications are represented by a type T, which must provide an operator(), returning a bool.
+ *
+ * One thread (the master) is assumed to push batches of verifications onto the queue, where they are
+ * processed by N-1 worker threads. When the master is done adding work, it temporarily joins the
+ * worker pool as an N'th worker, until all jobs are done.
+ */
+template <typename T>
+class CCheckQueue
+{
+    // Mutex to protect the inner state
+    boost::mutex mtx;
+
+    // Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    // Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
+
+    // The queue of elements to be processed.
+    // As the order of booleans doesn't matter, it is used as a LIFO (stack)
+    std::vector<T> queue;
+
+    // The number of workers (including the master) that are idle
+    int nIdle = 0;
+
+    // The total number of workers (including the master)
+    int nTotal = 0;
+
+    // The temporary evaluation result
+    bool fAllOk = true;
+
+    // Number of verifications that haven't completed yet. This includes elements that are not anymore
+    // in queue, but are still in the worker's own batches.
+    unsigned int nTodo = 0;
+
+    // Whether the worker threads should exit
+    bool fQuit = false;
+
+    // The maximum number of elements to be processed in one batch
+    const unsigned int nBatchSize;
+
+    std::vector<boost::thread> workerThreads;
+
+    // Internal function that does bulk of the verification work
+    bool Loop(bool fMaster = false)
+    {
+        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        std::vector<T>             vChecks;
+        vChecks.reserve(nBatchSize);
+        unsigned int nNow = 0;
+        bool         fOk  = true;
+        do {
+            {
+                boost::unique_lock<boost::mutex> lock(mtx);
+                // first do the clean-up of the previous loop run (allowing us to do it in the same
+                // critsect)
+                if (nNow) {
+                    fAllOk &= fOk;
+                    nTodo -= nNow;
+                    if (nTodo == 0 && !fMaster)
+                        // We processed the last element; inform the master it can exit and return the
+                        // result
+                        condMaster.notify_one();
+                } else {
+                    // first iteration
+                    nTotal++;
+                }
+                // logically, the do loop starts here
+                while (queue.empty() && !fQuit) {
+                    if (fMaster && nTodo == 0) {
+                        nTotal--;
+                        bool fRet = fAllOk;
+                        // reset the status for new work later
+                        fAllOk = true;
+                        // return the current status
+                        return fRet;
+                    }
+                    nIdle++;
+                    cond.wait(lock); // wait
+                    nIdle--;
+                }
+                if (fQuit) {
+                    nTotal--;
+                    return false;
+                }
+                // Decide how many work units to process now.
+                // * Do not try to do everything at once, but aim for increasingly smaller batches so
+                //   all workers finish approximately simultaneously.
+                // * Try to account for idle jobs which will instantly start helping.
+                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+                nNow = std::max(1U, std::min(nBatchSize,
+                                             (unsigned int)queue.size() / (nTotal + nIdle + 1)));
+                vChecks.resize(nNow);
+                for (unsigned int i = 0; i < nNow; i++) {
+                    // We want the lock on the mutex to be as short as possible, so swap jobs from the
+                    // global queue to the local batch vector instead of copying.
+                    vChecks[i].swap(queue.back());
+                    queue.pop_back();
+                }
+                // Check whether we need to do work at all
+                fOk = fAllOk;
+            }
+            // execute work
+            for (T& check : vChecks)
+                if (fOk)
+                    fOk = check();
+            vChecks.clear();
+        } while (true);
+    }
+
+public:
+    // Create a new check queue
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nBatchSize(nBatchSizeIn) {}
+
+    ~CCheckQueue() { Stop(); }
+
+    // Start nThreads worker threads; the master thread that calls Wait() is an additional worker
+    void Start(int nThreads)
+    {
+        for (int i = 0; i < nThreads; i++)
+            workerThreads.emplace_back([this]() { Loop(); });
+    }
+
+    // Make the worker threads exit, and wait for them
+    void Stop()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mtx);
+            fQuit = true;
+        }
+        condWorker.notify_all();
+        for (boost::thread& t : workerThreads)
+            t.join();
+        workerThreads.clear();
+        boost::unique_lock<boost::mutex> lock(mtx);
+        fQuit = false;
+    }
+
+    // Wait until execution finishes, and return whether all evaluations were successful
+    bool Wait() { return Loop(true); }
+
+    // Add a batch of checks to the queue
+    void Add(std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        for (T& check : vChecks) {
+            queue.push_back(T());
+            check.swap(queue.back());
+        }
+        nTodo += vChecks.size();
+        if (vChecks.size() == 1)
+            condWorker.notify_one();
+        else if (vChecks.size() > 1)
+            condWorker.notify_all();
+    }
+
+    // Whether the queue has worker threads to run checks in parallel
+    bool HasThreads() const { return !workerThreads.empty(); }
+};
+
+/**
+ * RAII-style controller object for a CCheckQueue that guarantees the passed queue is finished before
+ * continuing. Without a queue, the checks are run by the master thread as they're added.
+ */
+template <typename T>
+class CCheckQueueControl
+{
+    CCheckQueue<T>* pqueue;
+    bool            fDone;
+    bool            fAllOk;
+
+public:
+    explicit CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false), fAllOk(true)
+    {
+    }
+
+    CCheckQueueControl(const CCheckQueueControl&) = delete;
+    CCheckQueueControl& operator=(const CCheckQueueControl&) = delete;
+
+    bool Wait()
+    {
+        if (fDone)
+            return fAllOk;
+        if (pqueue != nullptr)
+            fAllOk = pqueue->Wait() && fAllOk;
+        fDone = true;
+        return fAllOk;
+    }
+
+    void Add(std::vector<T>& vChecks)
+    {
+        if (pqueue != nullptr) {
+            pqueue->Add(vChecks);
+        } else {
+            for (T& check : vChecks)
+                if (fAllOk)
+                    fAllOk = check();
+        }
+        vChecks.clear();
+    }
+
+    ~CCheckQueueControl()
+    {
+        if (!fDone)
+            Wait();
+    }
+};
+
+#endif // CHECKQUEUE_H
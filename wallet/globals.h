@@ -46,6 +46,16 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 static const unsigned int MAX_INV_SZ = 50000;
 /** Default for -maxorphanblocks, maximum number of orphan blocks kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 750;
+/** Default for -maxorphanblocksmb, maximum megabytes of serialized orphan blocks kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS_SIZE = 100;
+/** Maximum bytes of orphan blocks that are connected in one database transaction */
+static const unsigned int MAX_ORPHAN_BLOCKS_BATCH_SIZE = OLD_MAX_BLOCK_SIZE;
+/** Default for -maxmempool, maximum megabytes of memory the memory pool takes */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -utxocache, maximum MiB of coins that a block being connected keeps in memory */
+static const unsigned int DEFAULT_UTXO_CACHE_SIZE = 16;
+/** Default for -mempoolexpiry, hours after which transactions are removed from the memory pool */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying) */
 static const int64_t MIN_RELAY_TX_FEE = MIN_TX_FEE;
 /** Threshold for nLockTime: below this value it is interpreted as block number, otherwise as UNIX
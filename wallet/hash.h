@@ -6,6 +6,7 @@
 #define BITCOIN_HASH_H
 
 #include "serialize.h"
+#include "sha256.h"
 #include "uint256.h"
 
 #include <boost/filesystem.hpp>
@@ -20,29 +21,31 @@ inline uint256 Hash(const T1 pbegin, const T1 pend)
 {
     static unsigned char pblank[1];
     uint256              hash1;
-    SHA256((pbegin == pend ? pblank : (unsigned char*)&pbegin[0]), (pend - pbegin) * sizeof(pbegin[0]),
-           (unsigned char*)&hash1);
+    CSHA256              sha;
+    sha.Write((pbegin == pend ? pblank : (unsigned char*)&pbegin[0]),
+              (pend - pbegin) * sizeof(pbegin[0]));
+    sha.Finalize((unsigned char*)&hash1);
     uint256 hash2;
-    SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+    CSHA256().Write((unsigned char*)&hash1, sizeof(hash1)).Finalize((unsigned char*)&hash2);
     return hash2;
 }
 
 class CHashWriter
 {
 private:
-    SHA256_CTX ctx;
+    CSHA256 ctx;
 
 public:
     int nType;
     int nVersion;
 
-    void Init() { SHA256_Init(&ctx); }
+    void Init() { ctx.Reset(); }
 
     CHashWriter(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) { Init(); }
 
     CHashWriter& write(const char* pch, size_t size)
     {
-        SHA256_Update(&ctx, pch, size);
+        ctx.Write((const unsigned char*)pch, size);
         return (*this);
     }
 
@@ -50,9 +53,9 @@ public:
     uint256 GetHash()
     {
         uint256 hash1;
-        SHA256_Final((unsigned char*)&hash1, &ctx);
+        ctx.Finalize((unsigned char*)&hash1);
         uint256 hash2;
-        SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+        CSHA256().Write((unsigned char*)&hash1, sizeof(hash1)).Finalize((unsigned char*)&hash2);
         return hash2;
     }
 
@@ -70,15 +73,14 @@ inline uint256 Hash(const T1 p1begin, const T1 p1end, const T2 p2begin, const T2
 {
     static unsigned char pblank[1];
     uint256              hash1;
-    SHA256_CTX           ctx;
-    SHA256_Init(&ctx);
-    SHA256_Update(&ctx, (p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]),
-                  (p1end - p1begin) * sizeof(p1begin[0]));
-    SHA256_Update(&ctx, (p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]),
-                  (p2end - p2begin) * sizeof(p2begin[0]));
-    SHA256_Final((unsigned char*)&hash1, &ctx);
+    CSHA256              sha;
+    sha.Write((p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]),
+              (p1end - p1begin) * sizeof(p1begin[0]));
+    sha.Write((p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]),
+              (p2end - p2begin) * sizeof(p2begin[0]));
+    sha.Finalize((unsigned char*)&hash1);
     uint256 hash2;
-    SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+    CSHA256().Write((unsigned char*)&hash1, sizeof(hash1)).Finalize((unsigned char*)&hash2);
     return hash2;
 }
 
@@ -88,17 +90,16 @@ inline uint256 Hash(const T1 p1begin, const T1 p1end, const T2 p2begin, const T2
 {
     static unsigned char pblank[1];
     uint256              hash1;
-    SHA256_CTX           ctx;
-    SHA256_Init(&ctx);
-    SHA256_Update(&ctx, (p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]),
-                  (p1end - p1begin) * sizeof(p1begin[0]));
-    SHA256_Update(&ctx, (p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]),
-                  (p2end - p2begin) * sizeof(p2begin[0]));
-    SHA256_Update(&ctx, (p3begin == p3end ? pblank : (unsigned char*)&p3begin[0]),
-                  (p3end - p3begin) * sizeof(p3begin[0]));
-    SHA256_Final((unsigned char*)&hash1, &ctx);
+    CSHA256              sha;
+    sha.Write((p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]),
+              (p1end - p1begin) * sizeof(p1begin[0]));
+    sha.Write((p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]),
+              (p2end - p2begin) * sizeof(p2begin[0]));
+    sha.Write((p3begin == p3end ? pblank : (unsigned char*)&p3begin[0]),
+              (p3end - p3begin) * sizeof(p3begin[0]));
+    sha.Finalize((unsigned char*)&hash1);
     uint256 hash2;
-    SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+    CSHA256().Write((unsigned char*)&hash1, sizeof(hash1)).Finalize((unsigned char*)&hash2);
     return hash2;
 }
 
@@ -113,7 +114,7 @@ uint256 SerializeHash(const T& obj, int nType = SER_GETHASH, int nVersion = PROT
 inline uint160 Hash160(const std::vector<unsigned char>& vch)
 {
     uint256 hash1;
-    SHA256(&vch[0], vch.size(), (unsigned char*)&hash1);
+    CSHA256().Write(vch.data(), vch.size()).Finalize((unsigned char*)&hash1);
     uint160 hash2;
     RIPEMD160((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
     return hash2;
@@ -9,10 +9,14 @@
 #include "nebliorest.h"
 #endif
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "globals.h"
 #include "init.h"
 #include "main.h"
 #include "net.h"
+#include "ntp1/ntp1transaction.h"
+#include "sha256.h"
+#include "sigcache.h"
 #include "ui_interface.h"
 #include "util.h"
 #include <boost/algorithm/string/predicate.hpp>
@@ -117,6 +121,11 @@ void Shutdown(void* /*parg*/)
         //        CTxDB().Close();
         FlushDBWalletTransient(false);
         StopNode();
+        scriptcheckqueue.Stop();
+        if (mapBlockIndex.size() > 0) {
+            LOCK(cs_main);
+            CTxDB().WriteBlockIndexSnapshot();
+        }
         FlushDBWalletTransient(true);
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
@@ -266,7 +275,10 @@ std::string HelpMessage()
         "  -wallet=<dir>          " + _("Specify wallet file (within data directory)") + "\n" +
         "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n" +
         "  -maxorphanblocks=<n>   " + _("Keep at most <n> unconnectable blocks in memory (default: 750)") + "\n" +
+        "  -maxorphanblocksmb=<n> " + _("Keep at most <n> megabytes of unconnectable blocks in memory (default: 100)") + "\n" +
         "  -maxorphantx=<n>       " + _("Keep at most <n> unconnectable transactions in memory (default: 100)") + "\n" +
+        "  -maxmempool=<n>        " + _("Keep the transaction memory pool below <n> megabytes (default: 300)") + "\n" +
+        "  -mempoolexpiry=<n>     " + _("Do not keep transactions in the mempool longer than <n> hours (default: 336)") + "\n" +
         "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n" +
         "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n" +
         "  -proxy=<ip:port>       " + _("Connect through socks proxy") + "\n" +
@@ -291,6 +303,7 @@ std::string HelpMessage()
         "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n" +
         "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n" +
         "  -maxsendbuffer=<n>     " + _("Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)") + "\n" +
+        "  -socketevents=<mode>   " + _("Wait for the sockets with epoll (Linux) or poll (default: epoll where available)") + "\n" +
         "  -noquicksync           " + _("Whether QuickSync should be used to quickly sync with the network") + "\n" +
         "  -coldstaking           " + _("Enable cold-staking for this node (default: true)") + "\n" +
 #ifdef USE_UPNP
@@ -338,6 +351,14 @@ std::string HelpMessage()
         "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
         "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n" +
         "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n" +
+        "  -txreadcache=<n>       " + _("Number of transactions read from disk to keep decoded in memory (default: 20000, 0 = disabled)") + "\n" +
+        "  -utxocache=<n>         " + strprintf(_("Maximum MiB of UTXO set changes that a block being connected keeps in memory before writing them (default: %u)"), DEFAULT_UTXO_CACHE_SIZE) + "\n" +
+        "  -servedblockcache=<n>  " + _("Number of blocks served to peers to keep in memory as raw messages (default: 16, 0 = disabled)") + "\n" +
+        "  -ntp1txcache=<n>       " + _("Number of resolved NTP1 transactions to keep in memory (default: 10000, 0 = disabled)") + "\n" +
+        "  -blockindexsnapshot    " + _("Save the block index on shutdown and load it on the next start (default: 1)") + "\n" +
+        "  -sigcachemb=<n>        " + strprintf(_("Limit the size of the signature cache to <n> MiB (default: %" PRId64 ", at most %" PRId64 ")"), DEFAULT_SIG_CACHE_MB, MAX_SIG_CACHE_MB) + "\n" +
+        "  -maxsigcachesize=<n>   " + _("Limit the signature cache to <n> signatures; ignored when -sigcachemb is given") + "\n" +
+        "  -par=<n>               " + strprintf(_("Set the number of script verification threads (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n" +
 
         "\n" + _("Block creation options:") + "\n" +
         "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n" +
@@ -353,6 +374,8 @@ std::string HelpMessage()
  */
 bool InitSanityCheck(void)
 {
+    printf("Using the '%s' SHA256 implementation\n", SHA256AutoDetect().c_str());
+
     if (!ECC_InitSanityCheck()) {
         InitError("OpenSSL appears to lack support for elliptic curve cryptography. For more "
                   "information, visit https://en.bitcoin.it/wiki/OpenSSL_and_EC_Libraries");
@@ -513,6 +536,22 @@ bool AppInit2()
                           "pay if you send a transaction."));
     }
 
+    InitSignatureCache();
+
+    // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
+    int nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    if (nScriptCheckThreads) {
+        printf("Using %i threads for script verification\n", nScriptCheckThreads);
+        // the thread that connects a block works through the queue too
+        scriptcheckqueue.Start(nScriptCheckThreads - 1);
+    }
+
     fConfChange       = GetBoolArg("-confchange", false);
     fEnforceCanonical = GetBoolArg("-enforcecanonical", true);
 
@@ -761,6 +800,15 @@ bool AppInit2()
         return InitError(msg);
     }
 
+    const int64_t txReadCacheSize = GetArg("-txreadcache", DEFAULT_TX_READ_CACHE_SIZE);
+    CTxDB::GetTxReadCache().setMaxSize(static_cast<std::size_t>(std::max<int64_t>(0, txReadCacheSize)));
+    const int64_t ntp1TxCacheSize = GetArg("-ntp1txcache", DEFAULT_NTP1_TX_CACHE_SIZE);
+    NTP1Transaction::GetResolvedTxCache().setMaxSize(
+        static_cast<std::size_t>(std::max<int64_t>(0, ntp1TxCacheSize)));
+    const int64_t servedBlockCacheSize = GetArg("-servedblockcache", DEFAULT_SERVED_BLOCK_CACHE_SIZE);
+    GetServedBlockCache().setMaxSize(
+        static_cast<std::size_t>(std::max<int64_t>(0, servedBlockCacheSize)));
+
     if (GetBoolArg("-loadblockindextest")) {
         CTxDB txdb("r");
         txdb.LoadBlockIndex();
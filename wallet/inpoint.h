@@ -7,11 +7,11 @@ class CTransaction;
 class CInPoint
 {
 public:
-    CTransaction* ptx;
-    unsigned int  n;
+    const CTransaction* ptx;
+    unsigned int        n;
 
     CInPoint() { SetNull(); }
-    CInPoint(CTransaction* ptxIn, unsigned int nIn)
+    CInPoint(const CTransaction* ptxIn, unsigned int nIn)
     {
         ptx = ptxIn;
         n   = nIn;
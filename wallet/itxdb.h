@@ -43,6 +43,7 @@ public:
     virtual bool ReadDiskTx(const COutPoint& outpoint, CTransaction& tx, CTxIndex& txindex) const   = 0;
     virtual bool ReadDiskTx(const COutPoint& outpoint, CTransaction& tx) const                      = 0;
     virtual bool ReadBlock(const uint256& hash, CBlock& blk, bool fReadTransactions = true) const   = 0;
+    virtual bool ReadBlockRaw(const uint256& hash, std::string& data) const                         = 0;
     virtual bool WriteBlock(const uint256& hash, const CBlock& blk)                                 = 0;
     virtual bool WriteBlockIndex(const CDiskBlockIndex& blockindex)                                 = 0;
     virtual bool ReadHashBestChain(uint256& hashBestChain) const                                    = 0;
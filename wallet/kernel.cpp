@@ -6,26 +6,38 @@
 #include "block.h"
 #include "chainparams.h"
 #include "main.h"
+#include "stakemodifierindex.h"
 #include "txdb.h"
 
 using namespace std;
 
-// Get time weight
-int64_t GetWeight(const ITxDB& txdb, int64_t nIntervalBeginning, int64_t nIntervalEnd)
+// Get time weight, given the stake min age
+static int64_t GetWeight(unsigned int nSMA, int64_t nIntervalBeginning, int64_t nIntervalEnd)
 {
     // Kernel hash weight starts from 0 at the min age
     // this change increases active coins participating the hash and helps
     // to secure the network when proof-of-stake difficulty is low
-    const unsigned int nSMA = Params().StakeMinAge(txdb);
     return min(nIntervalEnd - nIntervalBeginning - nSMA, Params().StakeMaxAge());
 }
 
+// Get time weight
+int64_t GetWeight(const ITxDB& txdb, int64_t nIntervalBeginning, int64_t nIntervalEnd)
+{
+    return GetWeight(Params().StakeMinAge(txdb), nIntervalBeginning, nIntervalEnd);
+}
+
 // Get the last stake modifier and its generation time from a given block
 static bool GetLastStakeModifier(const CBlockIndex* pindex, uint64_t& nStakeModifier,
                                  int64_t& nModifierTime)
 {
     if (!pindex)
         return error("GetLastStakeModifier: null pindex");
+    const auto lastGenerated = GetStakeModifierIndex().GetLastGenerated(pindex);
+    if (lastGenerated) {
+        nStakeModifier = lastGenerated->nStakeModifier;
+        nModifierTime  = lastGenerated->nTime;
+        return true;
+    }
     while (pindex && pindex->pprev && !pindex->GeneratedStakeModifier())
         pindex = pindex->pprev.get();
     if (!pindex->GeneratedStakeModifier())
@@ -53,44 +65,63 @@ static int64_t GetStakeModifierSelectionInterval()
     return nSelectionInterval;
 }
 
+// a candidate block of the stake modifier selection, with its selection hash computed once for all the
+// rounds; ordered by timestamp, then by hash
+struct StakeModifierCandidate
+{
+    int64_t            nTime;
+    uint256            hashBlock;
+    const CBlockIndex* pindex;
+    uint256            hashSelection;
+
+    bool operator<(const StakeModifierCandidate& other) const
+    {
+        return nTime < other.nTime || (nTime == other.nTime && hashBlock < other.hashBlock);
+    }
+};
+
+static StakeModifierCandidate MakeStakeModifierCandidate(const CBlockIndex* pindex,
+                                                         uint64_t           nStakeModifierPrev)
+{
+    StakeModifierCandidate candidate;
+    candidate.nTime     = pindex->GetBlockTime();
+    candidate.hashBlock = pindex->GetBlockHash();
+    candidate.pindex    = pindex;
+    // compute the selection hash by hashing its proof-hash and the
+    // previous proof-of-stake modifier
+    CDataStream ss(SER_GETHASH, 0);
+    ss << pindex->hashProof << nStakeModifierPrev;
+    candidate.hashSelection = Hash(ss.begin(), ss.end());
+    // the selection hash is divided by 2**32 so that proof-of-stake block
+    // is always favored over proof-of-work block. this is to preserve
+    // the energy efficiency property
+    if (pindex->IsProofOfStake())
+        candidate.hashSelection >>= 32;
+    return candidate;
+}
+
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
 // already selected blocks in vSelectedBlocks, and with timestamp up to
 // nSelectionIntervalStop.
-static bool SelectBlockFromCandidates(const vector<pair<int64_t, uint256>>&   vSortedByTimestamp,
+static bool SelectBlockFromCandidates(const vector<StakeModifierCandidate>&   vSortedByTimestamp,
                                       const map<uint256, const CBlockIndex*>& mapSelectedBlocks,
-                                      int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev,
-                                      const CBlockIndex** pindexSelected)
+                                      int64_t nSelectionIntervalStop, const CBlockIndex** pindexSelected)
 {
     bool    fSelected = false;
     uint256 hashBest  = 0;
     *pindexSelected   = (const CBlockIndex*)0;
-    BOOST_FOREACH (const PAIRTYPE(int64_t, uint256) & item, vSortedByTimestamp) {
-        const auto bi = mapBlockIndex.get(item.second).value_or(nullptr);
-        if (!bi)
-            return error("SelectBlockFromCandidates: failed to find block index for candidate block %s",
-                         item.second.ToString().c_str());
-        const CBlockIndex* pindex = bi.get();
-        if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
+    for (const StakeModifierCandidate& candidate : vSortedByTimestamp) {
+        if (fSelected && candidate.nTime > nSelectionIntervalStop)
             break;
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (mapSelectedBlocks.count(candidate.hashBlock) > 0)
             continue;
-        // compute the selection hash by hashing its proof-hash and the
-        // previous proof-of-stake modifier
-        CDataStream ss(SER_GETHASH, 0);
-        ss << pindex->hashProof << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
-        // the selection hash is divided by 2**32 so that proof-of-stake block
-        // is always favored over proof-of-work block. this is to preserve
-        // the energy efficiency property
-        if (pindex->IsProofOfStake())
-            hashSelection >>= 32;
-        if (fSelected && hashSelection < hashBest) {
-            hashBest        = hashSelection;
-            *pindexSelected = (const CBlockIndex*)pindex;
+        if (fSelected && candidate.hashSelection < hashBest) {
+            hashBest        = candidate.hashSelection;
+            *pindexSelected = candidate.pindex;
         } else if (!fSelected) {
             fSelected       = true;
-            hashBest        = hashSelection;
-            *pindexSelected = (const CBlockIndex*)pindex;
+            hashBest        = candidate.hashSelection;
+            *pindexSelected = candidate.pindex;
         }
     }
     if (fDebug && GetBoolArg("-printstakemodifier"))
@@ -134,7 +165,7 @@ bool ComputeNextStakeModifier(const ITxDB& txdb, const CBlockIndex* pindexPrev,
         return true;
 
     // Sort candidate blocks by timestamp
-    vector<pair<int64_t, uint256>> vSortedByTimestamp;
+    vector<StakeModifierCandidate> vSortedByTimestamp;
     unsigned int                   nTS = Params().TargetSpacing(txdb);
     vSortedByTimestamp.reserve(64 * Params().StakeModifierInterval() / nTS);
     int64_t nSelectionInterval      = GetStakeModifierSelectionInterval();
@@ -143,7 +174,7 @@ bool ComputeNextStakeModifier(const ITxDB& txdb, const CBlockIndex* pindexPrev,
                                       nSelectionInterval;
     const CBlockIndex* pindex = pindexPrev;
     while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart) {
-        vSortedByTimestamp.push_back(make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
+        vSortedByTimestamp.push_back(MakeStakeModifierCandidate(pindex, nStakeModifier));
         pindex = pindex->pprev.get();
     }
     int nHeightFirstCandidate = pindex ? (pindex->nHeight + 1) : 0;
@@ -159,7 +190,7 @@ bool ComputeNextStakeModifier(const ITxDB& txdb, const CBlockIndex* pindexPrev,
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
         // select a block from the candidates of current round
         if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop,
-                                       nStakeModifier, &pindex))
+                                       &pindex))
             return error("ComputeNextStakeModifier: unable to select block at round %d", nRound);
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
@@ -217,26 +248,22 @@ static bool GetKernelStakeModifier(const ITxDB& txdb, uint256 hashBlockFrom, uin
     nStakeModifierTime                                   = pindexFrom->GetBlockTime();
     static const int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
     unsigned int         nSMA                            = Params().StakeMinAge(txdb);
-    const CBlockIndex*   pindex                          = pindexFrom;
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
-        if (!pindex->pnext) { // reached best block; may happen if node is behind on block chain
-            if (fPrintProofOfStake ||
-                (pindex->GetBlockTime() + nSMA - nStakeModifierSelectionInterval > GetAdjustedTime()))
-                return error(
-                    "GetKernelStakeModifier() : reached best block %s at height %d from block %s",
-                    pindex->GetBlockHash().ToString().c_str(), pindex->nHeight,
-                    hashBlockFrom.ToString().c_str());
-            else
-                return false;
-        }
-        pindex = pindex->pnext.get();
-        if (pindex->GeneratedStakeModifier()) {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime   = pindex->GetBlockTime();
-        }
+    // find the stake modifier later by a selection interval
+    CBlockIndexSmartPtr pindex;
+    const auto          generated = GetStakeModifierIndex().FindGeneratedAfter(
+        bi, pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval, pindex);
+    if (!generated) { // reached best block; may happen if node is behind on block chain
+        if (fPrintProofOfStake ||
+            (pindex->GetBlockTime() + nSMA - nStakeModifierSelectionInterval > GetAdjustedTime()))
+            return error("GetKernelStakeModifier() : reached best block %s at height %d from block %s",
+                         pindex->GetBlockHash().ToString().c_str(), pindex->nHeight,
+                         hashBlockFrom.ToString().c_str());
+        else
+            return false;
     }
-    nStakeModifier = pindex->nStakeModifier;
+    nStakeModifierHeight = generated->nHeight;
+    nStakeModifierTime   = generated->nTime;
+    nStakeModifier       = generated->nStakeModifier;
     return true;
 }
 
@@ -335,9 +362,94 @@ bool CheckStakeKernelHash(const ITxDB& txdb, unsigned int nBits, const CBlock& b
     return true;
 }
 
+LRUCache<COutPoint, StakeKernelRecord>& GetStakeKernelRecordCache()
+{
+    static LRUCache<COutPoint, StakeKernelRecord> cache(DEFAULT_STAKE_KERNEL_CACHE_SIZE);
+    return cache;
+}
+
+bool MakeStakeKernelRecord(const ITxDB& txdb, const CBlock& blockFrom, unsigned int nTxPrevOffset,
+                           const CTransaction& txPrev, const COutPoint& prevout,
+                           StakeKernelRecord& record)
+{
+    record.hashBlockFrom  = blockFrom.GetHash();
+    record.nTimeBlockFrom = blockFrom.GetBlockTime();
+    record.nTxPrevOffset  = nTxPrevOffset;
+    record.nTimeTxPrev    = txPrev.nTime;
+    record.nPrevout       = prevout.n;
+    record.nValueIn       = txPrev.vout[prevout.n].nValue;
+
+    int     nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime   = 0;
+    return GetKernelStakeModifier(txdb, record.hashBlockFrom, record.nStakeModifier,
+                                  nStakeModifierHeight, nStakeModifierTime, false);
+}
+
+// the same serialization as in CheckStakeKernelHash(), with the time of the coinstake left out
+StakeKernelHasher::StakeKernelHasher(const StakeKernelRecord& record)
+{
+    unsigned char data[24];
+    memcpy(data, &record.nStakeModifier, 8);
+    memcpy(data + 8, &record.nTimeBlockFrom, 4);
+    memcpy(data + 12, &record.nTxPrevOffset, 4);
+    memcpy(data + 16, &record.nTimeTxPrev, 4);
+    memcpy(data + 20, &record.nPrevout, 4);
+    prefix.Write(data, sizeof(data));
+}
+
+uint256 StakeKernelHasher::operator()(unsigned int nTimeTx) const
+{
+    unsigned char time[4];
+    memcpy(time, &nTimeTx, 4);
+
+    uint256 hash;
+    CSHA256(prefix).Write(time, sizeof(time)).Finalize(hash.begin());
+    CSHA256().Write(hash.begin(), hash.size()).Finalize(hash.begin());
+    return hash;
+}
+
+boost::optional<unsigned int> SearchStakeKernelTime(const StakeKernelRecord& record, unsigned int nBits,
+                                                    unsigned int nSMA, int64_t nTimeTxFrom,
+                                                    unsigned int nCount)
+{
+    CBigNum bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    auto targetAt = [&](int64_t nTimeTx) {
+        const CBigNum bnCoinDayWeight = CBigNum(record.nValueIn) *
+                                        GetWeight(nSMA, (int64_t)record.nTimeTxPrev, nTimeTx) / COIN /
+                                        (24 * 60 * 60);
+        return bnCoinDayWeight * bnTargetPerCoinDay;
+    };
+
+    // the weight only grows with time, so no earlier time has a higher target; the exact target is
+    // only computed for the hashes that are below this
+    const CBigNum bnMaxTarget = targetAt(nTimeTxFrom);
+    if (bnMaxTarget < 0) {
+        return boost::none;
+    }
+    const CBigNum bnHashMax(~uint256(0));
+    const uint256 maxTarget = bnMaxTarget < bnHashMax ? bnMaxTarget.getuint256() : ~uint256(0);
+
+    const StakeKernelHasher hasher(record);
+    for (unsigned int n = 0; n < nCount; n++) {
+        const int64_t nTimeTx = nTimeTxFrom - n;
+        // earlier times violate these too
+        if (nTimeTx < record.nTimeTxPrev || record.nTimeBlockFrom + nSMA > nTimeTx) {
+            break;
+        }
+        const uint256 hashProofOfStake = hasher(static_cast<unsigned int>(nTimeTx));
+        if (hashProofOfStake > maxTarget || CBigNum(hashProofOfStake) > targetAt(nTimeTx)) {
+            continue;
+        }
+        return static_cast<unsigned int>(nTimeTx);
+    }
+    return boost::none;
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake,
-                       uint256& targetProofOfStake)
+bool CheckProofOfStake(const ITxDB& txdb, const CTransaction& tx, unsigned int nBits,
+                       uint256& hashProofOfStake, uint256& targetProofOfStake)
 {
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s",
@@ -347,7 +459,6 @@ bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hash
     const CTxIn& txin = tx.vin[0];
 
     // First try finding the previous transaction in database
-    CTxDB        txdb("r");
     CTransaction txPrev;
     CTxIndex     txindex;
     if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
@@ -364,7 +475,7 @@ bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hash
 
     // Read block header
     CBlock block;
-    if (!block.ReadFromDisk(txindex.pos.nBlockPos, false))
+    if (!block.ReadFromDisk(txindex.pos.nBlockPos, txdb, false))
         return fDebug ? error("CheckProofOfStake() : read block failed")
                       : false; // unable to read block of previous transaction
 
@@ -4,7 +4,10 @@
 #ifndef PPCOIN_KERNEL_H
 #define PPCOIN_KERNEL_H
 
+#include "LRUCache.h"
+#include "sha256.h"
 #include "transaction.h"
+#include <boost/optional.hpp>
 #include <cstdint>
 
 class CBlock;
@@ -25,10 +28,51 @@ bool CheckStakeKernelHash(const ITxDB& txdb, unsigned int nBits, const CBlock& b
                           const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake,
                           uint256& targetProofOfStake, bool fPrintProofOfStake = false);
 
+// What the kernel hash of an output needs besides the time of the coinstake, so that searching
+// through timestamps reads nothing from disk and doesn't walk the block index
+struct StakeKernelRecord
+{
+    uint256      hashBlockFrom;
+    unsigned int nTimeBlockFrom = 0;
+    unsigned int nTxPrevOffset  = 0;
+    unsigned int nTimeTxPrev    = 0;
+    unsigned int nPrevout       = 0;
+    uint64_t     nStakeModifier = 0;
+    int64_t      nValueIn       = 0;
+};
+
+static const std::size_t DEFAULT_STAKE_KERNEL_CACHE_SIZE = 100000;
+
+// The records of the outputs that were searched for kernels; must be cleared on reorganizations,
+// because the stake modifier of an output depends on the blocks after it
+LRUCache<COutPoint, StakeKernelRecord>& GetStakeKernelRecordCache();
+
+// Fills the record of an output, which fails if its stake modifier isn't known yet
+bool MakeStakeKernelRecord(const ITxDB& txdb, const CBlock& blockFrom, unsigned int nTxPrevOffset,
+                           const CTransaction& txPrev, const COutPoint& prevout,
+                           StakeKernelRecord& record);
+
+// Computes the kernel hashes of one output for many coinstake times; the 24 bytes that don't depend
+// on the time are written once
+class StakeKernelHasher
+{
+    CSHA256 prefix;
+
+public:
+    explicit StakeKernelHasher(const StakeKernelRecord& record);
+    uint256 operator()(unsigned int nTimeTx) const;
+};
+
+// Searches nCount coinstake times backwards from nTimeTxFrom for one at which the output of record is
+// a kernel that meets nBits, like CheckStakeKernelHash() would for each; nSMA is the stake min age
+boost::optional<unsigned int> SearchStakeKernelTime(const StakeKernelRecord& record, unsigned int nBits,
+                                                    unsigned int nSMA, int64_t nTimeTxFrom,
+                                                    unsigned int nCount);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake,
-                       uint256& targetProofOfStake);
+bool CheckProofOfStake(const ITxDB& txdb, const CTransaction& tx, unsigned int nBits,
+                       uint256& hashProofOfStake, uint256& targetProofOfStake);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
@@ -6,7 +6,10 @@
 #include "main.h"
 #include "alert.h"
 #include "block.h"
+#include "blockdownload.h"
+#include "chain.h"
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "db.h"
 #include "disktxpos.h"
 #include "init.h"
@@ -18,11 +21,13 @@
 #include "ntp1/ntp1script_issuance.h"
 #include "ntp1/ntp1script_transfer.h"
 #include "ntp1/ntp1transaction.h"
+#include "orphanblocks.h"
 #include "outpoint.h"
 #include "txdb.h"
 #include "txindex.h"
 #include "txmempool.h"
 #include "ui_interface.h"
+#include "validationqueue.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -51,13 +56,21 @@ boost::atomic<bool> fImporting{false};
 
 CMedianFilter<int> cPeerBlockCounts(5, 0);
 
-std::unordered_map<uint256, CBlock*> mapOrphanBlocks;
-multimap<uint256, CBlock*>           mapOrphanBlocksByPrev;
-set<pair<COutPoint, unsigned int>>   setStakeSeenOrphan;
+// requires LOCK(cs_main)
+static COrphanBlocks& GetOrphanBlocks()
+{
+    static COrphanBlocks orphanBlocks(
+        (std::size_t)std::max(INT64_C(0), GetArg("-maxorphanblocks", DEFAULT_MAX_ORPHAN_BLOCKS)),
+        (std::size_t)std::max(INT64_C(0), GetArg("-maxorphanblocksmb", DEFAULT_MAX_ORPHAN_BLOCKS_SIZE)) *
+            1000000);
+    return orphanBlocks;
+}
 
 map<uint256, CTransaction> mapOrphanTransactions;
 map<uint256, set<uint256>> mapOrphanTransactionsByPrev;
 
+CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
 // Constant stuff for coinbase transactions we create:
 CScript COINBASE_FLAGS;
 
@@ -391,6 +404,65 @@ void AssertNTP1TokenNameIsNotAlreadyInMainChain(const NTP1Transaction& ntp1tx, c
     }
 }
 
+std::size_t GetMaxMempoolSize()
+{
+    return static_cast<std::size_t>(
+        std::max(INT64_C(0), GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE)) * 1000000);
+}
+
+std::size_t GetUtxoCacheSize()
+{
+    return static_cast<std::size_t>(
+        std::max(INT64_C(0), GetArg("-utxocache", DEFAULT_UTXO_CACHE_SIZE)) * 1024 * 1024);
+}
+
+ServedBlockCacheType& GetServedBlockCache()
+{
+    static ServedBlockCacheType cache(DEFAULT_SERVED_BLOCK_CACHE_SIZE);
+    return cache;
+}
+
+// The "block" message of a block in the index, made from the bytes stored in the database, which
+// serialize the same way for the network, instead of deserializing and serializing the block again
+static std::shared_ptr<const CSerializeData> GetServedBlockMessage(const CBlockIndex* pindex)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    if (const boost::optional<std::shared_ptr<const CSerializeData>> cached =
+            GetServedBlockCache().get(hash)) {
+        return *cached;
+    }
+
+    std::string raw;
+    if (!CTxDB("r").ReadBlockRaw(pindex->blockKeyInDB, raw))
+        return nullptr;
+
+    // compare the header with the index instead of computing the block hash
+    CDataStream ssHeader(SER_NETWORK | SER_BLOCKHEADERONLY, PROTOCOL_VERSION);
+    ssHeader << pindex->GetBlockHeader();
+    if (raw.size() <= ssHeader.size() || memcmp(raw.data(), &ssHeader[0], ssHeader.size()) != 0) {
+        error("GetServedBlockMessage() : stored block doesn't match the index for %s",
+              hash.ToString().c_str());
+        return nullptr;
+    }
+
+    const std::shared_ptr<const CSerializeData> msg = std::make_shared<const CSerializeData>(
+        CNode::MakeRawMessage("block", raw.data(), raw.data() + raw.size()));
+    GetServedBlockCache().insert(hash, msg);
+    return msg;
+}
+
+static void LimitMempoolSize(CTxMemPool& pool, std::size_t limit, int64_t age)
+{
+    const int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        printf("Expired %i transactions from the memory pool\n", expired);
+
+    std::vector<uint256> vRemoved;
+    pool.TrimToSize(limit, &vRemoved);
+    if (!vRemoved.empty())
+        printf("Evicted %" PRIszu " transactions from the full memory pool\n", vRemoved.size());
+}
+
 Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTransaction& tx,
                                                    const ITxDB* txdbPtr)
 {
@@ -434,7 +506,7 @@ Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTran
         return Err(MakeInvalidTxState(TxValidationResult::TX_CONFLICT, "txn-already-in-mempool"));
 
     // Check for conflicts with in-memory transactions
-    CTransaction* ptxOld = NULL;
+    const CTransaction* ptxOld = NULL;
     {
         LOCK(pool.cs); // protect pool.mapNextTx
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
@@ -469,6 +541,7 @@ Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTran
         }
     }
 
+    boost::optional<CTxMemPoolEntry> entry;
     {
         // do we already have it?
         if (txdb->ContainsTx(hash))
@@ -511,6 +584,14 @@ Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTran
                                                     hash.ToString().c_str(), nFees, txMinFee)));
         }
 
+        // When the pool is full, the transaction has to pay more than what was evicted
+        const int64_t mempoolRejectFee = pool.GetMinFee(GetMaxMempoolSize()) * nSize / 1000;
+        if (mempoolRejectFee > 0 && nFees < mempoolRejectFee) {
+            return Err(MakeInvalidTxState(TxValidationResult::TX_MEMPOOL_POLICY,
+                                          "mempool min fee not met",
+                                          strprintf("%" PRId64 " < %" PRId64, nFees, mempoolRejectFee)));
+        }
+
         // Continuously rate-limit free transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
         // be annoying or make others' transactions take longer to confirm.
@@ -570,6 +651,28 @@ Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTran
                 return Err(MakeInvalidTxState(TxValidationResult::TX_NTP1_ERROR, "ntp1-error-unknown"));
             }
         }
+
+        // what block assembly needs to know about the inputs, so that it doesn't read them again
+        const int bestHeight        = txdb->GetBestChainHeight().value_or(0);
+        double    dPriority         = 0;
+        int64_t   inChainInputValue = 0;
+        for (const CTxIn& txin : tx.vin) {
+            const std::pair<CTxIndex, CTransaction>& input = mapInputs[txin.prevout.hash];
+            if (pool.exists(txin.prevout.hash)) {
+                continue;
+            }
+            const int64_t nValueIn = input.second.vout[txin.prevout.n].nValue;
+            const int     nConf    = input.first.GetDepthInMainChain(*txdb);
+            dPriority += (double)nValueIn * nConf;
+            if (nConf > 0) {
+                inChainInputValue += nValueIn;
+            }
+        }
+        dPriority /= nSize;
+
+        entry.emplace(tx, nFees, GetTime(), bestHeight, dPriority, inChainInputValue,
+                      tx.GetValueIn(mapInputs),
+                      tx.GetLegacySigOpCount() + tx.GetP2SHSigOpCount(mapInputs));
     }
 
     // Store transaction in memory
@@ -580,7 +683,7 @@ Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTran
                    ptxOld->GetHash().ToString().c_str());
             pool.remove(*ptxOld);
         }
-        pool.addUnchecked(hash, tx);
+        pool.addUnchecked(*entry);
     }
 
     ///// are we sure this is ok when loading transactions or restoring block txes
@@ -588,6 +691,11 @@ Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTran
     if (ptxOld)
         EraseFromWallets(ptxOld->GetHash());
 
+    LimitMempoolSize(pool, GetMaxMempoolSize(),
+                     GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    if (!pool.exists(hash))
+        return Err(MakeInvalidTxState(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full"));
+
     printf("AcceptToMemoryPool : accepted %s (poolsz %" PRIszu ")\n",
            hash.ToString().substr(0, 10).c_str(), pool.mapTx.size());
 
@@ -618,23 +726,6 @@ bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock)
 // CBlock and CBlockIndex
 //
 
-uint256 static GetOrphanRoot(const CBlock* pblock)
-{
-    // Work back to the first block in the orphan chain
-    while (mapOrphanBlocks.count(pblock->hashPrevBlock))
-        pblock = mapOrphanBlocks[pblock->hashPrevBlock];
-    return pblock->GetHash();
-}
-
-// ppcoin: find block wanted by given orphan block
-uint256 WantedByOrphan(const CBlock* pblockOrphan)
-{
-    // Work back to the first block in the orphan chain
-    while (mapOrphanBlocks.count(pblockOrphan->hashPrevBlock))
-        pblockOrphan = mapOrphanBlocks[pblockOrphan->hashPrevBlock];
-    return pblockOrphan->hashPrevBlock;
-}
-
 //
 // maximum nBits value could possible be required nTime after
 //
@@ -898,14 +989,12 @@ int GetNumBlocksOfPeers()
 // IsInitialBlockDownload_tolerant
 bool __IsInitialBlockDownload_internal()
 {
-    CTxDB txdb;
-    auto  pindex = txdb.GetBestBlockIndex();
-    if (pindex == nullptr || pindex == pindexGenesisBlock ||
-        txdb.GetBestChainHeight().value_or(0) < Checkpoints::GetTotalBlocksEstimate())
+    const CBlockIndex* pindexBestPtr = chainActive.Tip();
+    if (pindexBestPtr == nullptr || pindexBestPtr == pindexGenesisBlock.get() ||
+        pindexBestPtr->nHeight < Checkpoints::GetTotalBlocksEstimate())
         return true;
-    static int64_t             nLastUpdate;
-    static CBlockIndexSmartPtr pindexLastBest;
-    CBlockIndexSmartPtr        pindexBestPtr = pindex;
+    static int64_t            nLastUpdate;
+    static const CBlockIndex* pindexLastBest;
     if (pindexBestPtr != pindexLastBest) {
         pindexLastBest = pindexBestPtr;
         nLastUpdate    = GetTime();
@@ -964,6 +1053,7 @@ void FetchNTP1TxFromDisk(std::pair<CTransaction, NTP1Transaction>& txPair, const
         return;
     }
     txPair.second.updateDebugStrHash();
+    NTP1Transaction::GetResolvedTxCache().insert(txPair.first.GetHash(), txPair.second);
 }
 
 void WriteNTP1TxToDbAndDisk(const NTP1Transaction& ntp1tx, CTxDB& txdb)
@@ -999,8 +1089,14 @@ void WriteNTP1TxToDiskFromRawTx(const CTransaction& tx, CTxDB& txdb)
     if (Params().PassedFirstValidNTP1Tx(&txdb)) {
         // read previous transactions (inputs) which are necessary to validate an NTP1
         // transaction
-        std::string opReturnArg;
-        if (!NTP1Transaction::IsTxNTP1(&tx, &opReturnArg)) {
+        if (!NTP1Transaction::IsTxNTP1(&tx)) {
+            return;
+        }
+
+        // ConnectBlock() has just resolved the transactions of the block it writes
+        NTP1TxCacheType& resolvedTxCache = NTP1Transaction::GetResolvedTxCache();
+        if (boost::optional<NTP1Transaction> cached = resolvedTxCache.get(tx.GetHash())) {
+            WriteNTP1TxToDbAndDisk(*cached, txdb);
             return;
         }
 
@@ -1010,6 +1106,7 @@ void WriteNTP1TxToDiskFromRawTx(const CTransaction& tx, CTxDB& txdb)
         // write NTP1 transactions' data
         NTP1Transaction ntp1tx;
         ntp1tx.readNTP1DataFromTx(tx, inputsWithNTP1);
+        resolvedTxCache.insert(tx.GetHash(), ntp1tx);
 
         WriteNTP1TxToDbAndDisk(ntp1tx, txdb);
     }
@@ -1021,16 +1118,19 @@ void AssertIssuanceUniquenessInBlock(
     const map<uint256, std::vector<std::pair<CTransaction, NTP1Transaction>>>& mapQueuedNTP1Inputs,
     const map<uint256, CTxIndex>&                                              queuedAcceptedTxs)
 {
-    std::string opRet;
-    if (NTP1Transaction::IsTxNTP1(&tx, &opRet)) {
-        auto script = NTP1Script::ParseScript(opRet);
+    if (NTP1Transaction::IsTxNTP1(&tx)) {
+        auto script = NTP1Transaction::ParseTxNTP1Script(tx);
         if (script->getTxType() == NTP1Script::TxType_Issuance) {
-            std::vector<std::pair<CTransaction, NTP1Transaction>> inputsTxs =
-                NTP1Transaction::GetAllNTP1InputsOfTx(tx, txdb, false, mapQueuedNTP1Inputs,
-                                                      queuedAcceptedTxs);
-
             NTP1Transaction ntp1tx;
-            ntp1tx.readNTP1DataFromTx(tx, inputsTxs);
+            if (boost::optional<NTP1Transaction> cached =
+                    NTP1Transaction::GetResolvedTxCache().get(tx.GetHash())) {
+                ntp1tx = std::move(*cached);
+            } else {
+                std::vector<std::pair<CTransaction, NTP1Transaction>> inputsTxs =
+                    NTP1Transaction::GetAllNTP1InputsOfTx(tx, txdb, false, mapQueuedNTP1Inputs,
+                                                          queuedAcceptedTxs);
+                ntp1tx.readNTP1DataFromTx(tx, inputsTxs);
+            }
             AssertNTP1TokenNameIsNotAlreadyInMainChain(ntp1tx, txdb);
             if (ntp1tx.getTxType() == NTP1TxType_ISSUANCE) {
                 std::string currSymbol = ntp1tx.getTokenSymbolIfIssuance();
@@ -1048,36 +1148,6 @@ void AssertIssuanceUniquenessInBlock(
     }
 }
 
-void static PruneOrphanBlocks()
-{
-    static const size_t MAX_SIZE =
-        (size_t)std::max(INT64_C(0), GetArg("-maxorphanblocks", DEFAULT_MAX_ORPHAN_BLOCKS));
-    if (mapOrphanBlocksByPrev.size() <= MAX_SIZE)
-        return;
-
-    // Pick a random orphan block.
-    int                                       pos = insecure_rand() % mapOrphanBlocksByPrev.size();
-    std::multimap<uint256, CBlock*>::iterator it  = mapOrphanBlocksByPrev.begin();
-    std::advance(it, pos);
-
-    // As long as this block has other orphans depending on it, move to one of those successors.
-    do {
-        std::multimap<uint256, CBlock*>::iterator it2 =
-            mapOrphanBlocksByPrev.find(it->second->GetHash());
-        if (it2 == mapOrphanBlocksByPrev.end())
-            break;
-        it = it2;
-    } while (true);
-
-    printf("Removing block %s from orphans map as the size of the orphans has exceeded the maximum %zu; "
-           "current size: %zu\n",
-           it->second->GetHash().ToString().c_str(), MAX_SIZE, mapOrphanBlocksByPrev.size());
-    uint256 hash = it->second->GetHash();
-    delete it->second;
-    mapOrphanBlocksByPrev.erase(it);
-    mapOrphanBlocks.erase(hash);
-}
-
 void WriteNTP1BlockTransactionsToDisk(const std::vector<CTransaction>& vtx, CTxDB& txdb)
 {
     if (Params().PassedFirstValidNTP1Tx(&txdb)) {
@@ -1095,14 +1165,15 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     uint256 hash = pblock->GetHash();
     if (auto v = mapBlockIndex.get(hash).value_or(nullptr))
         return error("ProcessBlock() : already have block %d %s", v->nHeight, hash.ToString().c_str());
-    if (mapOrphanBlocks.count(hash))
+    COrphanBlocks& orphanBlocks = GetOrphanBlocks();
+    if (orphanBlocks.Contains(hash))
         return error("ProcessBlock() : already have block (orphan) %s", hash.ToString().c_str());
 
     // ppcoin: check proof-of-stake
     // Limited duplicity on stake: prevents block flood attack
     // Duplicate stake allowed only when there is orphan child block
     if (pblock->IsProofOfStake() && setStakeSeen.count(pblock->GetProofOfStake()) &&
-        !mapOrphanBlocksByPrev.count(hash))
+        !orphanBlocks.HasChildren(hash))
         return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for block %s",
                      pblock->GetProofOfStake().first.ToString().c_str(),
                      pblock->GetProofOfStake().second, hash.ToString().c_str());
@@ -1140,29 +1211,28 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     if (!mapBlockIndex.exists(pblock->hashPrevBlock)) {
         printf("ProcessBlock: ORPHAN BLOCK, prev=%s\n", pblock->hashPrevBlock.ToString().c_str());
         // ppcoin: check proof-of-stake
-        if (pblock->IsProofOfStake()) {
-            // Limited duplicity on stake: prevents block flood attack
-            // Duplicate stake allowed only when there is orphan child block
-            if (setStakeSeenOrphan.count(pblock->GetProofOfStake()) &&
-                !mapOrphanBlocksByPrev.count(hash))
-                return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for orphan block %s",
-                             pblock->GetProofOfStake().first.ToString().c_str(),
-                             pblock->GetProofOfStake().second, hash.ToString().c_str());
-            else
-                setStakeSeenOrphan.insert(pblock->GetProofOfStake());
-        }
-        PruneOrphanBlocks();
-        CBlock* pblock2 = new CBlock(*pblock);
-        mapOrphanBlocks.insert(make_pair(hash, pblock2));
-        mapOrphanBlocksByPrev.insert(make_pair(pblock2->hashPrevBlock, pblock2));
-
-        // Ask this guy to fill in what we're missing
-        if (pfrom) {
-            pfrom->PushGetBlocks(txdb.GetBestBlockIndex().get(), GetOrphanRoot(pblock2));
+        // Limited duplicity on stake: prevents block flood attack
+        // Duplicate stake allowed only when there is orphan child block
+        if (pblock->IsProofOfStake() && orphanBlocks.HasStake(pblock->GetProofOfStake()) &&
+            !orphanBlocks.HasChildren(hash))
+            return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for orphan block %s",
+                         pblock->GetProofOfStake().first.ToString().c_str(),
+                         pblock->GetProofOfStake().second, hash.ToString().c_str());
+        if (!orphanBlocks.Add(std::unique_ptr<CBlock>(new CBlock(*pblock)), hash,
+                              pfrom ? pfrom->nodeid : -1)) {
+            printf("ProcessBlock: orphan block %s evicted, the orphan blocks are full\n",
+                   hash.ToString().c_str());
+            return true;
+        }
+
+        // Ask this guy to fill in what we're missing, unless the parent is downloaded already as part
+        // of the header chain
+        if (pfrom && !blockDownload.Contains(pblock->hashPrevBlock)) {
+            pfrom->PushGetBlocks(txdb.GetBestBlockIndex().get(), orphanBlocks.GetRoot(hash));
             // ppcoin: getblocks may not obtain the ancestor block rejected
             // earlier by duplicate-stake check so we ask for it again directly
             if (!IsInitialBlockDownload())
-                pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(pblock2)));
+                pfrom->AskFor(CInv(MSG_BLOCK, orphanBlocks.GetMissingParent(hash)));
         }
         return true;
     }
@@ -1171,28 +1241,176 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     if (!pblock->AcceptBlock())
         return error("ProcessBlock() : AcceptBlock FAILED");
 
-    // Recursively process any orphan blocks that depended on this one
-    vector<uint256> vWorkQueue;
-    vWorkQueue.push_back(hash);
-    for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
-        uint256 hashPrev = vWorkQueue[i];
-        for (multimap<uint256, CBlock*>::iterator mi = mapOrphanBlocksByPrev.lower_bound(hashPrev);
-             mi != mapOrphanBlocksByPrev.upper_bound(hashPrev); ++mi) {
-            CBlock* pblockOrphan = (*mi).second;
-            if (pblockOrphan->AcceptBlock())
-                vWorkQueue.push_back(pblockOrphan->GetHash());
-            mapOrphanBlocks.erase(pblockOrphan->GetHash());
-            setStakeSeenOrphan.erase(pblockOrphan->GetProofOfStake());
-            delete pblockOrphan;
+    // Process any orphan blocks that depended on this one, each after its parent. Each orphan is written
+    // in a nested transaction of one batch, so that a chain of them is committed at once instead of
+    // block by block; an orphan that fails only rolls back its own writes.
+    CTxDB       txdbBatch;
+    uint256     prevBestChain;
+    std::size_t nBatchBytes = 0;
+    std::size_t nBatchRoom  = 0;
+
+    auto commitBatch = [&]() {
+        if (!txdbBatch.IsInTxn())
+            return;
+        txdbBatch.TxnCommit();
+        UpdateWallets(prevBestChain);
+    };
+
+    try {
+        vector<uint256> vWorkQueue(1, hash);
+        for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
+            std::vector<std::unique_ptr<CBlock>> vChildren = orphanBlocks.TakeChildren(vWorkQueue[i]);
+            for (const std::unique_ptr<CBlock>& pblockOrphan : vChildren) {
+                const std::size_t nBytes = ::GetSerializeSize(*pblockOrphan, SER_DISK, CLIENT_VERSION);
+                if (nBatchBytes + nBytes > nBatchRoom)
+                    commitBatch();
+                if (!txdbBatch.IsInTxn()) {
+                    // the map can't be resized while the batch is open, so room is made for what's left
+                    // in the pool, the way WriteToDisk() does it for a single block
+                    nBatchRoom    = std::min<std::size_t>(nBytes + orphanBlocks.Bytes(),
+                                                          MAX_ORPHAN_BLOCKS_BATCH_SIZE);
+                    nBatchRoom    = std::max(nBatchRoom, nBytes);
+                    nBatchBytes   = 0;
+                    prevBestChain = txdbBatch.GetBestBlockHash();
+                    if (!txdbBatch.TxnBegin(1000 * nBatchRoom))
+                        return error("ProcessBlock() : TxnBegin failed for the orphan blocks");
+                }
+                nBatchBytes += nBytes;
+                if (pblockOrphan->AcceptBlock(txdbBatch))
+                    vWorkQueue.push_back(pblockOrphan->GetHash());
+            }
         }
-        mapOrphanBlocksByPrev.erase(hashPrev);
+    } catch (...) {
+        // the orphans that were accepted are in the block index already, so they're kept
+        commitBatch();
+        throw;
     }
+    commitBatch();
 
     printf("ProcessBlock: ACCEPTED\n");
 
     return true;
 }
 
+// Checks the headers that a peer sent and adds them to the header chain that blocks are downloaded for
+static bool ProcessHeaders(CNode* pfrom, std::vector<CBlock>& vHeaders)
+{
+    AssertLockHeld(cs_main);
+
+    // the block hashes are scrypt hashes, which are faster to compute for all the headers together
+    CBlock::PrecomputePoWHashes(vHeaders);
+
+    const uint256      hashBestChain = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : 0;
+    const CBlockIndex* pcheckpoint   = Checkpoints::GetLastCheckpoint(mapBlockIndex);
+
+    std::vector<HeaderEntry> vEntries;
+    vEntries.reserve(vHeaders.size());
+    // the height, trust and hash of the parent of the next header
+    int     nHeight = -1;
+    uint256 nChainTrust;
+    uint256 hashPrev;
+    for (const CBlock& header : vHeaders) {
+        const uint256 hash = header.GetHash();
+        if (nHeight < 0) {
+            // the first header follows a block we have or a header of the header chain
+            HeaderEntry parent;
+            if (const CBlockIndexSmartPtr pindexPrev =
+                    mapBlockIndex.get(header.hashPrevBlock).value_or(nullptr)) {
+                nHeight     = pindexPrev->nHeight;
+                nChainTrust = pindexPrev->nChainTrust;
+            } else if (blockDownload.GetHeader(header.hashPrevBlock, parent)) {
+                nHeight     = parent.nHeight;
+                nChainTrust = parent.nChainTrust;
+            } else {
+                // an answer to an older locator, or a chain we know nothing of
+                printf("ProcessHeaders() : headers from %s don't connect to our chain\n",
+                       pfrom->addr.ToString().c_str());
+                blockDownload.AddHeaders(pfrom->nodeid, vEntries, false, hashBestChain);
+                return true;
+            }
+        } else if (header.hashPrevBlock != hashPrev) {
+            pfrom->Misbehaving(20);
+            return error("ProcessHeaders() : non-continuous headers sequence");
+        }
+        nHeight++;
+        hashPrev = hash;
+
+        if (vEntries.empty()) {
+            if (const CBlockIndexSmartPtr pindex = mapBlockIndex.get(hash).value_or(nullptr)) {
+                nChainTrust = pindex->nChainTrust;
+                continue;
+            }
+        }
+
+        if (!Checkpoints::CheckHardened(nHeight, hash)) {
+            pfrom->Misbehaving(100);
+            return error("ProcessHeaders() : header %s rejected by hardened checkpoint lock-in at %d",
+                         hash.ToString().c_str(), nHeight);
+        }
+
+        if (header.GetBlockTime() > FutureDrift(GetAdjustedTime()))
+            return error("ProcessHeaders() : header %s has a timestamp too far in the future",
+                         hash.ToString().c_str());
+
+        // The same check against bogus blocks as in ProcessBlock(). Before the last proof-of-work block,
+        // the header doesn't tell whether the block is proof-of-work or proof-of-stake; these heights
+        // are covered by the checkpoints.
+        if (pcheckpoint && nHeight > Params().LastPoWBlock()) {
+            CBigNum bnNewBlock;
+            bnNewBlock.SetCompact(header.nBits);
+            CBigNum bnRequired;
+            bnRequired.SetCompact(ComputeMinStake(GetLastBlockIndex(pcheckpoint, true)->nBits,
+                                                  header.GetBlockTime() - pcheckpoint->nTime,
+                                                  header.nTime));
+            if (bnNewBlock > bnRequired) {
+                pfrom->Misbehaving(100);
+                return error("ProcessHeaders() : header %s with too little proof-of-stake",
+                             hash.ToString().c_str());
+            }
+        }
+
+        nChainTrust = nChainTrust + CBlockIndex::GetBlockTrust(header.nBits);
+
+        HeaderEntry entry;
+        entry.hash          = hash;
+        entry.hashPrevBlock = header.hashPrevBlock;
+        entry.nHeight       = nHeight;
+        entry.nBits         = header.nBits;
+        entry.nChainTrust   = nChainTrust;
+        vEntries.push_back(entry);
+    }
+
+    if (!blockDownload.AddHeaders(pfrom->nodeid, vEntries, vHeaders.size() == MAX_HEADERS_RESULTS,
+                                  hashBestChain)) {
+        pfrom->Misbehaving(20);
+        return error("ProcessHeaders() : headers from %s build on an invalid block",
+                     pfrom->addr.ToString().c_str());
+    }
+    return true;
+}
+
+// Processes the downloaded blocks that were waiting for the block hashPrev
+static void ProcessDownloadedChildren(uint256 hashPrev)
+{
+    while (true) {
+        CBlock  block;
+        int64_t nodeId = 0;
+        if (!blockDownload.TakeReceivedChild(hashPrev, block, nodeId))
+            break;
+        const uint256 hash = block.GetHash();
+        if (!ProcessBlock(nullptr, &block)) {
+            if (!mapBlockIndex.exists(hash))
+                blockDownload.BlockRejected(hash, block.nDoS > 0);
+            if (block.nDoS > 0) {
+                if (CNode* pnode = FindNode(nodeId))
+                    pnode->Misbehaving(block.nDoS);
+            }
+            break;
+        }
+        hashPrev = hash;
+    }
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
 {
     header = block.GetBlockHeader();
@@ -1374,6 +1592,9 @@ bool LoadBlockIndex(bool fAllowNew)
     if (!txdb.LoadBlockIndex())
         return false;
 
+    if (!txdb.BuildUtxoSetIfNeeded())
+        return false;
+
     //
     // Init with genesis block
     //
@@ -1396,7 +1617,7 @@ bool LoadBlockIndex(bool fAllowNew)
         assert(genesisBlock.CheckBlock(txdb));
 
         // Start new block file
-        if (!genesisBlock.WriteToDisk(genesisBlock.GetHash(), genesisBlock.GetHash()))
+        if (!genesisBlock.WriteToDisk(txdb, genesisBlock.GetHash(), genesisBlock.GetHash()))
             return error("LoadBlockIndex() : writing genesis block to disk failed");
     }
 
@@ -1470,6 +1691,9 @@ void PrintBlockTree()
     }
 }
 
+/** The number of consecutive blocks that LoadExternalBlockFile() reads before hashing their headers */
+static const unsigned int LOAD_BLOCK_FILE_HASH_BATCH = 16;
+
 bool LoadExternalBlockFile(FILE* fileIn)
 {
     int64_t nStart = GetTimeMillis();
@@ -1519,15 +1743,47 @@ bool LoadExternalBlockFile(FILE* fileIn)
                 // }
 
                 if (nSize > 0 && nSize <= nSizeLimit) {
-                    CBlock block;
-                    blkdat >> block;
-                    printf("Reading block at file pos: %u\n", nPos);
+                    // Read ahead the blocks that directly follow this one, so that their headers are
+                    // hashed together, which is several times faster than one by one
+                    std::vector<CBlock>       vBlocks(1);
+                    std::vector<unsigned int> vBlockPos(1, nPos);
+                    std::vector<unsigned int> vBlockSize(1, nSize);
+                    blkdat >> vBlocks.back();
+                    try {
+                        while (vBlocks.size() < LOAD_BLOCK_FILE_HASH_BATCH) {
+                            const unsigned int nNextPos = vBlockPos.back() + 4 + vBlockSize.back();
+                            unsigned char      pchMessageStart[CMessageHeader::MESSAGE_START_SIZE];
+                            fseek(blkdat, nNextPos, SEEK_SET);
+                            blkdat.read((char*)pchMessageStart, sizeof(pchMessageStart));
+                            if (memcmp(pchMessageStart, Params().MessageStart(),
+                                       sizeof(pchMessageStart)) != 0)
+                                break;
+                            unsigned int nNextSize;
+                            blkdat >> nNextSize;
+                            if (nNextSize == 0 || nNextSize > nSizeLimit)
+                                break;
+                            CBlock block;
+                            blkdat >> block;
+                            vBlocks.push_back(std::move(block));
+                            vBlockPos.push_back(nNextPos + CMessageHeader::MESSAGE_START_SIZE);
+                            vBlockSize.push_back(nNextSize);
+                        }
+                    } catch (std::exception& e) {
+                        // the end of the file, or a broken block that the scan below will skip
+                        blkdat.clear();
+                    }
+                    CBlock::PrecomputePoWHashes(vBlocks);
+
+                    // on a failure, scan for the next block from the failed one, as before
+                    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+                        printf("Reading block at file pos: %u\n", vBlockPos[i]);
 
-                    LOCK(cs_main);
+                        LOCK(cs_main);
 
-                    if (ProcessBlock(NULL, &block)) {
+                        if (!ProcessBlock(NULL, &vBlocks[i]))
+                            break;
                         nLoaded++;
-                        nPos += 4 + nSize;
+                        nPos = vBlockPos[i] + 4 + vBlockSize[i];
                     }
                 }
             }
@@ -1650,642 +1906,822 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv, const BlockIndexMapType& b
     }
 
     case MSG_BLOCK:
-        return blockIndexMap.exists_unsafe(inv.hash) || mapOrphanBlocks.count(inv.hash);
+        // blocks of the header chain are downloaded by blockDownload
+        return blockIndexMap.exists_unsafe(inv.hash) || GetOrphanBlocks().Contains(inv.hash) ||
+               blockDownload.Contains(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
 }
 
-bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
+static bool ProcessVersionMessage(CNode* pfrom, CDataStream& vRecv)
 {
-    static map<CService, CPubKey> mapReuseKey;
-    RandAddSeedPerfmon();
-    if (fDebug)
-        printf("received: %s (%" PRIszu " bytes)\n", strCommand.c_str(), vRecv.size());
-    const boost::optional<std::string> dropMessageTest = mapArgs.get("-dropmessagestest");
-    if (dropMessageTest && GetRand(atoi(*dropMessageTest)) == 0) {
-        printf("dropmessagestest DROPPING RECV MESSAGE\n");
-        return true;
+    // Each connection can only send one version message
+    if (pfrom->nVersion != 0) {
+        pfrom->Misbehaving(1);
+        return false;
     }
 
-    if (strCommand == "version") {
-        // Each connection can only send one version message
-        if (pfrom->nVersion != 0) {
-            pfrom->Misbehaving(1);
-            return false;
-        }
-
-        int64_t  nTime;
-        CAddress addrMe;
-        CAddress addrFrom;
-        uint64_t nNonce = 1;
-        vRecv >> pfrom->nVersion >> pfrom->nServices >> nTime >> addrMe;
-        int minPeerVer = MinPeerVersion(CTxDB());
-        if (pfrom->nVersion < minPeerVer) {
-            // disconnect from peers older than this proto version
-            printf("partner %s using obsolete version %i; disconnecting\n",
-                   pfrom->addr.ToString().c_str(), pfrom->nVersion);
-            pfrom->fDisconnect = true;
-            return false;
-        }
-
-        if (pfrom->nVersion == 10300)
-            pfrom->nVersion = 300;
-        if (!vRecv.empty())
-            vRecv >> addrFrom >> nNonce;
-        if (!vRecv.empty())
-            vRecv >> pfrom->strSubVer;
-        if (!vRecv.empty())
-            vRecv >> pfrom->nStartingHeight;
-        if (!vRecv.empty())
-            vRecv >> pfrom->fRelayTxes; // set to true after we get the first filter* message
-        else
-            pfrom->fRelayTxes = true;
+    int64_t  nTime;
+    CAddress addrMe;
+    CAddress addrFrom;
+    uint64_t nNonce = 1;
+    vRecv >> pfrom->nVersion >> pfrom->nServices >> nTime >> addrMe;
+    int minPeerVer = MinPeerVersion(CTxDB());
+    if (pfrom->nVersion < minPeerVer) {
+        // disconnect from peers older than this proto version
+        printf("partner %s using obsolete version %i; disconnecting\n",
+               pfrom->addr.ToString().c_str(), pfrom->nVersion);
+        pfrom->fDisconnect = true;
+        return false;
+    }
 
-        if (pfrom->fInbound && addrMe.IsRoutable()) {
-            pfrom->addrLocal = addrMe;
-            SeenLocal(addrMe);
-        }
+    if (pfrom->nVersion == 10300)
+        pfrom->nVersion = 300;
+    if (!vRecv.empty())
+        vRecv >> addrFrom >> nNonce;
+    if (!vRecv.empty())
+        vRecv >> pfrom->strSubVer;
+    if (!vRecv.empty())
+        vRecv >> pfrom->nStartingHeight;
+    if (!vRecv.empty())
+        vRecv >> pfrom->fRelayTxes; // set to true after we get the first filter* message
+    else
+        pfrom->fRelayTxes = true;
 
-        // Disconnect if we connected to ourself
-        if (nNonce == nLocalHostNonce && nNonce > 1) {
-            printf("connected to self at %s, disconnecting\n", pfrom->addr.ToString().c_str());
-            pfrom->fDisconnect = true;
-            return true;
-        }
+    if (pfrom->fInbound && addrMe.IsRoutable()) {
+        pfrom->addrLocal = addrMe;
+        SeenLocal(addrMe);
+    }
 
-        // record my external IP reported by peer
-        if (addrFrom.IsRoutable() && addrMe.IsRoutable())
-            addrSeenByPeer.get() = addrMe;
+    // Disconnect if we connected to ourself
+    if (nNonce == nLocalHostNonce && nNonce > 1) {
+        printf("connected to self at %s, disconnecting\n", pfrom->addr.ToString().c_str());
+        pfrom->fDisconnect = true;
+        return true;
+    }
 
-        // Be shy and don't send version until we hear
-        if (pfrom->fInbound)
-            pfrom->PushVersion();
+    // record my external IP reported by peer
+    if (addrFrom.IsRoutable() && addrMe.IsRoutable())
+        addrSeenByPeer.get() = addrMe;
 
-        pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
+    // Be shy and don't send version until we hear
+    if (pfrom->fInbound)
+        pfrom->PushVersion();
 
-        if (GetBoolArg("-synctime", true))
-            AddTimeData(pfrom->addr, nTime);
+    pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
 
-        // Change version
-        pfrom->PushMessage("verack");
-        pfrom->ssSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+    if (GetBoolArg("-synctime", true))
+        AddTimeData(pfrom->addr, nTime);
 
-        if (!pfrom->fInbound) {
-            // Advertise our address
-            if (!fNoListen && !IsInitialBlockDownload()) {
-                CAddress addr = GetLocalAddress(&pfrom->addr);
-                if (addr.IsRoutable())
-                    pfrom->PushAddress(addr);
-            }
+    // Change version
+    pfrom->PushMessage("verack");
+    pfrom->ssSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
 
-            // Get recent addresses
-            if (pfrom->fOneShot || pfrom->nVersion >= CADDR_TIME_VERSION ||
-                addrman.get().size() < 1000) {
-                pfrom->PushMessage("getaddr");
-                pfrom->fGetAddr = true;
-            }
-            addrman.get().Good(pfrom->addr);
-        } else {
-            if (((CNetAddr)pfrom->addr) == (CNetAddr)addrFrom) {
-                auto lock = addrman.get_lock();
-                addrman.get_unsafe().Add(addrFrom, addrFrom);
-                addrman.get_unsafe().Good(addrFrom);
-            }
+    if (!pfrom->fInbound) {
+        // Advertise our address
+        if (!fNoListen && !IsInitialBlockDownload()) {
+            CAddress addr = GetLocalAddress(&pfrom->addr);
+            if (addr.IsRoutable())
+                pfrom->PushAddress(addr);
         }
 
-        // Ask the first connected node for block updates
-        // For regtest, we need to sync immediately after connection; this is important for tests that
-        // split and reconnect the network
-        CTxDB      txdb;
-        static int nAskedForBlocks = 0;
-        if ((!pfrom->fClient && !pfrom->fOneShot && !fImporting) &&
-            (((pfrom->nStartingHeight > (txdb.GetBestChainHeight().value_or(0) - 144)) &&
-              (pfrom->nVersion < NOBLKS_VERSION_START || pfrom->nVersion >= NOBLKS_VERSION_END) &&
-              (nAskedForBlocks < 1 || vNodes.size() <= 1)) ||
-             Params().NetType() == NetworkType::Regtest)) {
-            nAskedForBlocks++;
-            pfrom->PushGetBlocks(txdb.GetBestBlockIndex().get(), uint256(0));
+        // Get recent addresses
+        if (pfrom->fOneShot || pfrom->nVersion >= CADDR_TIME_VERSION || addrman.get().size() < 1000) {
+            pfrom->PushMessage("getaddr");
+            pfrom->fGetAddr = true;
         }
-
-        // Relay alerts
-        {
-            LOCK(cs_mapAlerts);
-            for (PAIRTYPE(const uint256, CAlert) & item : mapAlerts)
-                item.second.RelayTo(pfrom);
+        addrman.get().Good(pfrom->addr);
+    } else {
+        if (((CNetAddr)pfrom->addr) == (CNetAddr)addrFrom) {
+            auto lock = addrman.get_lock();
+            addrman.get_unsafe().Add(addrFrom, addrFrom);
+            addrman.get_unsafe().Good(addrFrom);
         }
-
-        pfrom->fSuccessfullyConnected = true;
-
-        printf("receive version message: version %d, blocks=%d, us=%s, them=%s, peer=%s\n",
-               pfrom->nVersion, pfrom->nStartingHeight, addrMe.ToString().c_str(),
-               addrFrom.ToString().c_str(), pfrom->addr.ToString().c_str());
-
-        cPeerBlockCounts.input(pfrom->nStartingHeight);
     }
 
-    else if (pfrom->nVersion == 0) {
-        // Must have a version message before anything else
-        pfrom->Misbehaving(1);
-        return false;
+    // Sync the chain from every node that serves blocks; SendMessages() asks it for headers first,
+    // which also finds where our chains fork, and then for blocks
+    if (!pfrom->fClient && !pfrom->fOneShot &&
+        (pfrom->nVersion < NOBLKS_VERSION_START || pfrom->nVersion >= NOBLKS_VERSION_END)) {
+        blockDownload.PeerConnected(pfrom->nodeid, pfrom->nStartingHeight);
     }
 
-    else if (strCommand == "verack") {
-        pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+    // Relay alerts
+    {
+        LOCK(cs_mapAlerts);
+        for (PAIRTYPE(const uint256, CAlert) & item : mapAlerts)
+            item.second.RelayTo(pfrom);
     }
 
-    else if (strCommand == "addr") {
-        vector<CAddress> vAddr;
-        vRecv >> vAddr;
+    pfrom->fSuccessfullyConnected = true;
 
-        // Don't want addr from older versions unless seeding
-        if (pfrom->nVersion < CADDR_TIME_VERSION && addrman.get().size() > 1000)
-            return true;
-        if (vAddr.size() > 1000) {
-            pfrom->Misbehaving(20);
-            return error("message addr size() = %" PRIszu "", vAddr.size());
-        }
+    printf("receive version message: version %d, blocks=%d, us=%s, them=%s, peer=%s\n",
+           pfrom->nVersion, pfrom->nStartingHeight, addrMe.ToString().c_str(),
+           addrFrom.ToString().c_str(), pfrom->addr.ToString().c_str());
 
-        // Store the new addresses
-        vector<CAddress> vAddrOk;
-        int64_t          nNow   = GetAdjustedTime();
-        int64_t          nSince = nNow - 10 * 60;
-        for (CAddress& addr : vAddr) {
-            if (fShutdown)
-                return true;
-            if (addr.nTime <= 100000000 || addr.nTime > nNow + 10 * 60)
-                addr.nTime = nNow - 5 * 24 * 60 * 60;
-            pfrom->AddAddressKnown(addr);
-            bool fReachable = IsReachable(addr);
-            if (addr.nTime > nSince && !pfrom->fGetAddr && vAddr.size() <= 10 && addr.IsRoutable()) {
-                // Relay to a limited number of other nodes
-                {
-                    LOCK(cs_vNodes);
-                    // Use deterministic randomness to send to the same nodes for 24 hours
-                    // at a time so the setAddrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint64_t hashAddr = addr.GetHash();
-                    uint256  hashRand =
-                        hashSalt ^ (hashAddr << 32) ^ ((GetTime() + hashAddr) / (24 * 60 * 60));
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    multimap<uint256, CNode*> mapMix;
-                    for (CNode* pnode : vNodes) {
-                        if (pnode->nVersion < CADDR_TIME_VERSION)
-                            continue;
-                        unsigned int nPointer;
-                        memcpy(&nPointer, &pnode, sizeof(nPointer));
-                        uint256 hashKey = hashRand ^ nPointer;
-                        hashKey         = Hash(BEGIN(hashKey), END(hashKey));
-                        mapMix.insert(make_pair(hashKey, pnode));
-                    }
-                    int nRelayNodes =
-                        fReachable ? 2 : 1; // limited relaying of addresses outside our network(s)
-                    for (multimap<uint256, CNode*>::iterator mi = mapMix.begin();
-                         mi != mapMix.end() && nRelayNodes-- > 0; ++mi)
-                        ((*mi).second)->PushAddress(addr);
+    cPeerBlockCounts.input(pfrom->nStartingHeight);
+    return true;
+}
+
+static bool ProcessVerackMessage(CNode* pfrom, CDataStream& /*vRecv*/)
+{
+    pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+    return true;
+}
+
+static bool ProcessAddrMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    vector<CAddress> vAddr;
+    vRecv >> vAddr;
+
+    // Don't want addr from older versions unless seeding
+    if (pfrom->nVersion < CADDR_TIME_VERSION && addrman.get().size() > 1000)
+        return true;
+    if (vAddr.size() > 1000) {
+        pfrom->Misbehaving(20);
+        return error("message addr size() = %" PRIszu "", vAddr.size());
+    }
+
+    // Store the new addresses
+    vector<CAddress> vAddrOk;
+    int64_t          nNow   = GetAdjustedTime();
+    int64_t          nSince = nNow - 10 * 60;
+    for (CAddress& addr : vAddr) {
+        if (fShutdown)
+            return true;
+        if (addr.nTime <= 100000000 || addr.nTime > nNow + 10 * 60)
+            addr.nTime = nNow - 5 * 24 * 60 * 60;
+        pfrom->AddAddressKnown(addr);
+        bool fReachable = IsReachable(addr);
+        if (addr.nTime > nSince && !pfrom->fGetAddr && vAddr.size() <= 10 && addr.IsRoutable()) {
+            // Relay to a limited number of other nodes
+            {
+                LOCK(cs_vNodes);
+                // Use deterministic randomness to send to the same nodes for 24 hours
+                // at a time so the setAddrKnowns of the chosen nodes prevent repeats
+                static uint256 hashSalt;
+                if (hashSalt == 0)
+                    hashSalt = GetRandHash();
+                uint64_t hashAddr = addr.GetHash();
+                uint256  hashRand =
+                    hashSalt ^ (hashAddr << 32) ^ ((GetTime() + hashAddr) / (24 * 60 * 60));
+                hashRand = Hash(BEGIN(hashRand), END(hashRand));
+                multimap<uint256, CNode*> mapMix;
+                for (CNode* pnode : vNodes) {
+                    if (pnode->nVersion < CADDR_TIME_VERSION)
+                        continue;
+                    unsigned int nPointer;
+                    memcpy(&nPointer, &pnode, sizeof(nPointer));
+                    uint256 hashKey = hashRand ^ nPointer;
+                    hashKey         = Hash(BEGIN(hashKey), END(hashKey));
+                    mapMix.insert(make_pair(hashKey, pnode));
                 }
+                int nRelayNodes =
+                    fReachable ? 2 : 1; // limited relaying of addresses outside our network(s)
+                for (multimap<uint256, CNode*>::iterator mi = mapMix.begin();
+                     mi != mapMix.end() && nRelayNodes-- > 0; ++mi)
+                    ((*mi).second)->PushAddress(addr);
             }
-            // Do not store addresses outside our network
-            if (fReachable)
-                vAddrOk.push_back(addr);
         }
-        addrman.get().Add(vAddrOk, pfrom->addr, 2 * 60 * 60);
-        if (vAddr.size() < 1000)
-            pfrom->fGetAddr = false;
-        if (pfrom->fOneShot)
-            pfrom->fDisconnect = true;
+        // Do not store addresses outside our network
+        if (fReachable)
+            vAddrOk.push_back(addr);
     }
+    addrman.get().Add(vAddrOk, pfrom->addr, 2 * 60 * 60);
+    if (vAddr.size() < 1000)
+        pfrom->fGetAddr = false;
+    if (pfrom->fOneShot)
+        pfrom->fDisconnect = true;
+    return true;
+}
 
-    else if (strCommand == "inv") {
-        vector<CInv> vInv;
-        vRecv >> vInv;
-        if (vInv.size() > MAX_INV_SZ) {
-            pfrom->Misbehaving(20);
-            return error("message inv size() = %" PRIszu "", vInv.size());
-        }
+static bool ProcessInvMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    vector<CInv> vInv;
+    vRecv >> vInv;
+    if (vInv.size() > MAX_INV_SZ) {
+        pfrom->Misbehaving(20);
+        return error("message inv size() = %" PRIszu "", vInv.size());
+    }
 
-        // find last block in inv vector
-        unsigned int nLastBlock = (unsigned int)(-1);
-        for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
-            if (vInv[vInv.size() - 1 - nInv].type == MSG_BLOCK) {
-                nLastBlock = vInv.size() - 1 - nInv;
-                break;
-            }
+    // find last block in inv vector
+    unsigned int nLastBlock = (unsigned int)(-1);
+    for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
+        if (vInv[vInv.size() - 1 - nInv].type == MSG_BLOCK) {
+            nLastBlock = vInv.size() - 1 - nInv;
+            break;
         }
-        CTxDB txdb("r");
-        for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
-            const CInv& inv = vInv[nInv];
-
-            if (fShutdown)
-                return true;
-            pfrom->AddInventoryKnown(inv);
+    }
+    CTxDB txdb("r");
+    for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
+        const CInv& inv = vInv[nInv];
 
-            {
-                auto lock = mapBlockIndex.get_shared_lock();
+        if (fShutdown)
+            return true;
+        pfrom->AddInventoryKnown(inv);
 
-                bool fAlreadyHave = AlreadyHave(txdb, inv, mapBlockIndex);
+        {
+            auto lock = mapBlockIndex.get_shared_lock();
+
+            bool fAlreadyHave = AlreadyHave(txdb, inv, mapBlockIndex);
+            if (fDebug)
+                printf("  got inventory: %s  %s\n", inv.ToString().c_str(),
+                       fAlreadyHave ? "have" : "new");
+
+            if (!fAlreadyHave) {
+                if (!fImporting)
+                    pfrom->AskFor(inv);
+            } else if (inv.type == MSG_BLOCK && GetOrphanBlocks().Contains(inv.hash)) {
+                pfrom->PushGetBlocks(txdb.GetBestBlockIndex().get(),
+                                     GetOrphanBlocks().GetRoot(inv.hash));
+            } else if (nInv == nLastBlock && mapBlockIndex.exists_unsafe(inv.hash)) {
+                // In case we are on a very long side-chain, it is possible that we already have
+                // the last block in an inv bundle sent in response to getblocks. Try to detect
+                // this situation and push another getblocks to continue.
+                pfrom->PushGetBlocks(mapBlockIndex.get_unsafe(inv.hash).value_or(nullptr).get(),
+                                     uint256(0));
                 if (fDebug)
-                    printf("  got inventory: %s  %s\n", inv.ToString().c_str(),
-                           fAlreadyHave ? "have" : "new");
-
-                if (!fAlreadyHave) {
-                    if (!fImporting)
-                        pfrom->AskFor(inv);
-                } else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
-                    pfrom->PushGetBlocks(txdb.GetBestBlockIndex().get(),
-                                         GetOrphanRoot(mapOrphanBlocks[inv.hash]));
-                } else if (nInv == nLastBlock) {
-                    // In case we are on a very long side-chain, it is possible that we already have
-                    // the last block in an inv bundle sent in response to getblocks. Try to detect
-                    // this situation and push another getblocks to continue.
-                    pfrom->PushGetBlocks(mapBlockIndex.get_unsafe(inv.hash).value_or(nullptr).get(),
-                                         uint256(0));
-                    if (fDebug)
-                        printf("force request: %s\n", inv.ToString().c_str());
-                }
+                    printf("force request: %s\n", inv.ToString().c_str());
             }
-
-            // Track requests for our stuff
-            Inventory(inv.hash);
         }
-    }
 
-    else if (strCommand == "getdata") {
-        vector<CInv> vInv;
-        vRecv >> vInv;
-        if (vInv.size() > MAX_INV_SZ) {
-            pfrom->Misbehaving(20);
-            return error("message getdata size() = %" PRIszu "", vInv.size());
-        }
+        // Track requests for our stuff
+        Inventory(inv.hash);
+    }
+    return true;
+}
 
-        if (fDebugNet || (vInv.size() != 1))
-            printf("received getdata (%" PRIszu " invsz)\n", vInv.size());
+static bool ProcessGetDataMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    vector<CInv> vInv;
+    vRecv >> vInv;
+    if (vInv.size() > MAX_INV_SZ) {
+        pfrom->Misbehaving(20);
+        return error("message getdata size() = %" PRIszu "", vInv.size());
+    }
 
-        for (const CInv& inv : vInv) {
-            if (fShutdown)
-                return true;
-            if (fDebugNet || (vInv.size() == 1))
-                printf("received getdata for: %s\n", inv.ToString().c_str());
+    if (fDebugNet || (vInv.size() != 1))
+        printf("received getdata (%" PRIszu " invsz)\n", vInv.size());
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
-                // Send block from disk
-                auto mi = mapBlockIndex.get(inv.hash).value_or(nullptr);
-                if (mi) {
+    for (const CInv& inv : vInv) {
+        if (fShutdown)
+            return true;
+        if (fDebugNet || (vInv.size() == 1))
+            printf("received getdata for: %s\n", inv.ToString().c_str());
+
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+            // Send block from disk
+            auto mi = mapBlockIndex.get(inv.hash).value_or(nullptr);
+            if (mi) {
+                if (inv.type == MSG_BLOCK) {
+                    const std::shared_ptr<const CSerializeData> msg = GetServedBlockMessage(mi.get());
+                    if (msg)
+                        pfrom->PushRawMessage(*msg);
+                } else // MSG_FILTERED_BLOCK)
+                {
                     CBlock block;
                     block.ReadFromDisk(mi.get());
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
-                    {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter) {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the
-                            // block the client did not see This avoids hurting performance by
-                            // pointlessly requiring a round-trip Note that there is currently no way for
-                            // a node to request any single transactions we didnt send here - they must
-                            // either disconnect and retry or request the full block. Thus, the protocol
-                            // spec specified allows for us to provide duplicate txn here, however we
-                            // MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            for (PairType& pair : merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
-                            pfrom->PushMessage("merkleblock", merkleBlock);
+                    LOCK(pfrom->cs_filter);
+                    if (pfrom->pfilter) {
+                        CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                        // CMerkleBlock just contains hashes, so also push any transactions in the
+                        // block the client did not see This avoids hurting performance by
+                        // pointlessly requiring a round-trip Note that there is currently no way for
+                        // a node to request any single transactions we didnt send here - they must
+                        // either disconnect and retry or request the full block. Thus, the protocol
+                        // spec specified allows for us to provide duplicate txn here, however we
+                        // MUST always provide at least what the remote peer needs
+                        typedef std::pair<unsigned int, uint256> PairType;
+                        for (PairType& pair : merkleBlock.vMatchedTxn) {
+                            bool fKnown;
+                            {
+                                LOCK(pfrom->cs_inventory);
+                                fKnown = pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)) > 0;
+                            }
+                            if (!fKnown)
+                                pfrom->PushMessage("tx", block.vtx[pair.first]);
                         }
-                        // else
-                        // no response
+                        pfrom->PushMessage("merkleblock", merkleBlock);
                     }
+                    // else
+                    // no response
+                }
 
-                    // Trigger them to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue) {
-                        // ppcoin: send latest proof-of-work block to allow the
-                        // download node to accept as orphan (proof-of-stake
-                        // block might be rejected by stake connection check)
-                        vector<CInv> vInv;
-                        vInv.push_back(
-                            CInv(MSG_BLOCK, GetLastBlockIndex(CTxDB().GetBestBlockIndex().get(), false)
-                                                ->GetBlockHash()));
-                        pfrom->PushMessage("inv", vInv);
-                        pfrom->hashContinue = 0;
-                    }
+                // Trigger them to send a getblocks request for the next batch of inventory
+                if (inv.hash == pfrom->hashContinue) {
+                    // ppcoin: send latest proof-of-work block to allow the
+                    // download node to accept as orphan (proof-of-stake
+                    // block might be rejected by stake connection check)
+                    vector<CInv> vInv;
+                    vInv.push_back(
+                        CInv(MSG_BLOCK, GetLastBlockIndex(CTxDB().GetBestBlockIndex().get(), false)
+                                            ->GetBlockHash()));
+                    pfrom->PushMessage("inv", vInv);
+                    pfrom->hashContinue = 0;
                 }
-            } else if (inv.IsKnownType()) {
-                // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
-                    }
+            }
+        } else if (inv.IsKnownType()) {
+            // Send stream from relay memory
+            bool pushed = false;
+            {
+                LOCK(cs_mapRelay);
+                map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                if (mi != mapRelay.end()) {
+                    pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                    pushed = true;
                 }
-                if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
-                    }
+            }
+            if (!pushed && inv.type == MSG_TX) {
+                CTransaction tx;
+                if (mempool.lookup(inv.hash, tx)) {
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    ss.reserve(1000);
+                    ss << tx;
+                    pfrom->PushMessage("tx", ss);
                 }
             }
+        }
+
+        // Track requests for our stuff
+        Inventory(inv.hash);
+    }
+    return true;
+}
+
+static bool ProcessGetBlocksMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    CBlockLocator locator;
+    uint256       hashStop;
+    vRecv >> locator >> hashStop;
 
-            // Track requests for our stuff
-            Inventory(inv.hash);
+    // Find the last block the caller has in the main chain
+    const CBlockIndexSmartPtr pindexLocator = locator.GetBlockIndex();
+
+    // Send the rest of the chain
+    const CBlockIndex* pindex = chainActive.Next(pindexLocator.get());
+    int                nLimit = 500;
+    printf("getblocks %d to %s limit %d\n", (pindex ? pindex->nHeight : -1),
+           hashStop.ToString().c_str(), nLimit);
+    CTxDB txdb;
+    for (; pindex; pindex = chainActive.Next(pindex)) {
+        if (pindex->GetBlockHash() == hashStop) {
+            printf("  getblocks stopping at %d %s\n", pindex->nHeight,
+                   pindex->GetBlockHash().ToString().c_str());
+            unsigned int nSMA = Params().StakeMinAge(txdb);
+            // ppcoin: tell downloading node about the latest block if it's
+            // without risk being rejected due to stake connection check
+            uint256 bestBlockHash = txdb.GetBestBlockHash();
+            if (hashStop != bestBlockHash &&
+                pindex->GetBlockTime() + nSMA > txdb.GetBestBlockIndex()->GetBlockTime())
+                pfrom->PushInventory(CInv(MSG_BLOCK, bestBlockHash));
+            break;
+        }
+        pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+        if (--nLimit <= 0) {
+            // When this block is requested, we'll send an inv that'll make them
+            // getblocks the next batch of inventory.
+            printf("  getblocks stopping at limit %d %s\n", pindex->nHeight,
+                   pindex->GetBlockHash().ToString().c_str());
+            pfrom->hashContinue = pindex->GetBlockHash();
+            break;
         }
     }
+    return true;
+}
 
-    else if (strCommand == "getblocks") {
-        CBlockLocator locator;
-        uint256       hashStop;
-        vRecv >> locator >> hashStop;
+static bool ProcessGetHeadersMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    CBlockLocator locator;
+    uint256       hashStop;
+    vRecv >> locator >> hashStop;
 
+    CBlockIndexSmartPtr pindexStart = NULL;
+    const CBlockIndex*  pindex      = NULL;
+    if (locator.IsNull()) {
+        // If locator is null, return the hashStop block
+        pindexStart = mapBlockIndex.get(hashStop).value_or(nullptr);
+        if (!pindexStart)
+            return true;
+        pindex = pindexStart.get();
+    } else {
         // Find the last block the caller has in the main chain
-        CBlockIndexSmartPtr pindex = locator.GetBlockIndex();
-
-        // Send the rest of the chain
-        if (pindex)
-            pindex = boost::atomic_load(&pindex->pnext);
-        int nLimit = 500;
-        printf("getblocks %d to %s limit %d\n", (pindex ? pindex->nHeight : -1),
-               hashStop.ToString().c_str(), nLimit);
-        CTxDB txdb;
-        for (; pindex; pindex = pindex->pnext) {
-            if (pindex->GetBlockHash() == hashStop) {
-                printf("  getblocks stopping at %d %s\n", pindex->nHeight,
-                       pindex->GetBlockHash().ToString().c_str());
-                unsigned int nSMA = Params().StakeMinAge(txdb);
-                // ppcoin: tell downloading node about the latest block if it's
-                // without risk being rejected due to stake connection check
-                uint256 bestBlockHash = txdb.GetBestBlockHash();
-                if (hashStop != bestBlockHash &&
-                    pindex->GetBlockTime() + nSMA > txdb.GetBestBlockIndex()->GetBlockTime())
-                    pfrom->PushInventory(CInv(MSG_BLOCK, bestBlockHash));
-                break;
-            }
-            pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
-            if (--nLimit <= 0) {
-                // When this block is requested, we'll send an inv that'll make them
-                // getblocks the next batch of inventory.
-                printf("  getblocks stopping at limit %d %s\n", pindex->nHeight,
-                       pindex->GetBlockHash().ToString().c_str());
-                pfrom->hashContinue = pindex->GetBlockHash();
-                break;
-            }
-        }
+        pindexStart = locator.GetBlockIndex();
+        pindex      = chainActive.Next(pindexStart.get());
     }
 
-    else if (strCommand == "getheaders") {
-        CBlockLocator locator;
-        uint256       hashStop;
-        vRecv >> locator >> hashStop;
+    vector<CBlock> vHeaders;
+    int            nLimit = MAX_HEADERS_RESULTS;
+    printf("getheaders %d to %s\n", (pindex ? pindex->nHeight : -1), hashStop.ToString().c_str());
+    for (; pindex; pindex = chainActive.Next(pindex)) {
+        vHeaders.push_back(pindex->GetBlockHeader());
+        if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+            break;
+    }
+    pfrom->PushMessage("headers", vHeaders);
+    return true;
+}
 
-        CBlockIndexSmartPtr pindex = NULL;
-        if (locator.IsNull()) {
-            // If locator is null, return the hashStop block
-            const auto mi = mapBlockIndex.get(hashStop).value_or(nullptr);
-            if (!mi)
-                return true;
-            pindex = mi;
-        } else {
-            // Find the last block the caller has in the main chain
-            pindex = locator.GetBlockIndex();
-            if (pindex)
-                pindex = boost::atomic_load(&pindex->pnext);
-        }
-
-        vector<CBlock> vHeaders;
-        int            nLimit = 2000;
-        printf("getheaders %d to %s\n", (pindex ? pindex->nHeight : -1), hashStop.ToString().c_str());
-        for (; pindex; pindex = pindex->pnext) {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
-        }
-        pfrom->PushMessage("headers", vHeaders);
+static bool ProcessHeadersMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    vector<CBlock> vHeaders;
+    vRecv >> vHeaders;
+    if (vHeaders.size() > MAX_HEADERS_RESULTS) {
+        pfrom->Misbehaving(20);
+        return error("message headers size() = %" PRIszu "", vHeaders.size());
     }
+    ProcessHeaders(pfrom, vHeaders);
+    return true;
+}
 
-    else if (strCommand == "tx") {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
-        CTransaction    tx;
-        vRecv >> tx;
+static bool ProcessTxMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    vector<uint256> vWorkQueue;
+    vector<uint256> vEraseQueue;
+    CTransaction    tx;
+    vRecv >> tx;
 
-        CInv inv(MSG_TX, tx.GetHash());
-        pfrom->AddInventoryKnown(inv);
+    CInv inv(MSG_TX, tx.GetHash());
+    pfrom->AddInventoryKnown(inv);
 
-        const CTxDB txdb;
-
-        const Result<void, TxValidationState> mempoolRes = AcceptToMemoryPool(mempool, tx);
-        if (mempoolRes.isOk()) {
-            SyncWithWallets(txdb, tx, nullptr);
-            RelayTransaction(tx);
-            mapAlreadyAskedFor.erase(inv);
-            vWorkQueue.push_back(inv.hash);
-            vEraseQueue.push_back(inv.hash);
-
-            // Recursively process any orphan transactions that depended on this one
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
-                uint256 hashPrev = vWorkQueue[i];
-                for (set<uint256>::iterator mi = mapOrphanTransactionsByPrev[hashPrev].begin();
-                     mi != mapOrphanTransactionsByPrev[hashPrev].end(); ++mi) {
-                    const uint256& orphanTxHash = *mi;
-                    CTransaction&  orphanTx     = mapOrphanTransactions[orphanTxHash];
-
-                    const Result<void, TxValidationState> mempoolOrphanRes =
-                        AcceptToMemoryPool(mempool, orphanTx);
-                    if (mempoolOrphanRes.isOk()) {
-                        printf("   accepted orphan tx %s\n", orphanTxHash.ToString().c_str());
-                        SyncWithWallets(txdb, tx, nullptr);
-                        RelayTransaction(orphanTx);
-                        mapAlreadyAskedFor.erase(CInv(MSG_TX, orphanTxHash));
-                        vWorkQueue.push_back(orphanTxHash);
-                        vEraseQueue.push_back(orphanTxHash);
-                    } else if (mempoolRes.unwrapErr().GetResult() !=
-                               TxValidationResult::TX_MISSING_INPUTS) {
-                        // invalid orphan
-                        vEraseQueue.push_back(orphanTxHash);
-                        printf("   removed invalid orphan tx %s\n", orphanTxHash.ToString().c_str());
-                    }
+    const CTxDB txdb;
+
+    const Result<void, TxValidationState> mempoolRes = AcceptToMemoryPool(mempool, tx);
+    if (mempoolRes.isOk()) {
+        SyncWithWallets(txdb, tx, nullptr);
+        RelayTransaction(tx);
+        mapAlreadyAskedFor.erase(inv);
+        vWorkQueue.push_back(inv.hash);
+        vEraseQueue.push_back(inv.hash);
+
+        // Recursively process any orphan transactions that depended on this one
+        for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
+            uint256 hashPrev = vWorkQueue[i];
+            for (set<uint256>::iterator mi = mapOrphanTransactionsByPrev[hashPrev].begin();
+                 mi != mapOrphanTransactionsByPrev[hashPrev].end(); ++mi) {
+                const uint256& orphanTxHash = *mi;
+                CTransaction&  orphanTx     = mapOrphanTransactions[orphanTxHash];
+
+                const Result<void, TxValidationState> mempoolOrphanRes =
+                    AcceptToMemoryPool(mempool, orphanTx);
+                if (mempoolOrphanRes.isOk()) {
+                    printf("   accepted orphan tx %s\n", orphanTxHash.ToString().c_str());
+                    SyncWithWallets(txdb, tx, nullptr);
+                    RelayTransaction(orphanTx);
+                    mapAlreadyAskedFor.erase(CInv(MSG_TX, orphanTxHash));
+                    vWorkQueue.push_back(orphanTxHash);
+                    vEraseQueue.push_back(orphanTxHash);
+                } else if (mempoolRes.unwrapErr().GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
+                    // invalid orphan
+                    vEraseQueue.push_back(orphanTxHash);
+                    printf("   removed invalid orphan tx %s\n", orphanTxHash.ToString().c_str());
                 }
             }
+        }
 
-            for (uint256 hash : vEraseQueue)
-                EraseOrphanTx(hash);
-        } else if (mempoolRes.unwrapErr().GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
-            AddOrphanTx(tx);
+        for (uint256 hash : vEraseQueue)
+            EraseOrphanTx(hash);
+    } else if (mempoolRes.unwrapErr().GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
+        AddOrphanTx(tx);
 
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max(
-                INT64_C(0), GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                printf("mapOrphan overflow, removed %u tx\n", nEvicted);
-        }
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        unsigned int nMaxOrphanTx = (unsigned int)std::max(
+            INT64_C(0), GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+        unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+        if (nEvicted > 0)
+            printf("mapOrphan overflow, removed %u tx\n", nEvicted);
+    }
 
-        if (tx.reject) {
-            pfrom->PushMessage("reject", std::string("tx"), tx.reject->chRejectCode,
-                               tx.reject->strRejectReason.substr(0, MAX_REJECT_MESSAGE_LENGTH),
-                               tx.reject->hashTx);
-        }
-        if (tx.nDoS) {
-            pfrom->Misbehaving(tx.nDoS);
-        }
+    if (tx.reject) {
+        pfrom->PushMessage("reject", std::string("tx"), tx.reject->chRejectCode,
+                           tx.reject->strRejectReason.substr(0, MAX_REJECT_MESSAGE_LENGTH),
+                           tx.reject->hashTx);
     }
+    if (tx.nDoS) {
+        pfrom->Misbehaving(tx.nDoS);
+    }
+    return true;
+}
 
-    else if (strCommand == "block") {
-        CBlock block;
-        vRecv >> block;
-        uint256 hashBlock = block.GetHash();
+static bool ProcessBlockMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    CBlock block;
+    vRecv >> block;
+    uint256 hashBlock = block.GetHash();
 
-        printf("received block %s\n", hashBlock.ToString().c_str());
+    printf("received block %s\n", hashBlock.ToString().c_str());
 
-        CInv inv(MSG_BLOCK, hashBlock);
-        pfrom->AddInventoryKnown(inv);
+    CInv inv(MSG_BLOCK, hashBlock);
+    pfrom->AddInventoryKnown(inv);
 
-        if (ProcessBlock(pfrom, &block)) {
-            mapAlreadyAskedFor.erase(inv);
-        } else if (block.reject) {
+    blockDownload.BlockReceived(hashBlock);
+    if (!mapBlockIndex.exists(block.hashPrevBlock) &&
+        blockDownload.AddReceivedBlock(block, pfrom->nodeid)) {
+        // a downloaded block that came before its parent waits for it outside of the orphan blocks
+        mapAlreadyAskedFor.erase(inv);
+    } else if (ProcessBlock(pfrom, &block)) {
+        mapAlreadyAskedFor.erase(inv);
+        ProcessDownloadedChildren(hashBlock);
+    } else {
+        if (!mapBlockIndex.exists(hashBlock) && !GetOrphanBlocks().Contains(hashBlock))
+            blockDownload.BlockRejected(hashBlock, block.nDoS > 0);
+        if (block.reject)
             pfrom->PushMessage("reject", std::string("block"), block.reject->chRejectCode,
                                block.reject->strRejectReason, block.reject->hashBlock);
-        }
+    }
 
-        if (block.nDoS) {
-            pfrom->Misbehaving(block.nDoS);
-        }
+    if (block.nDoS) {
+        pfrom->Misbehaving(block.nDoS);
     }
+    return true;
+}
 
-    else if (strCommand == "getaddr") {
-        // Don't return addresses older than nCutOff timestamp
-        int64_t nCutOff = GetTime() - (nNodeLifespan * 24 * 60 * 60);
-        pfrom->vAddrToSend.clear();
-        vector<CAddress> vAddr = addrman.get().GetAddr();
-        for (const CAddress& addr : vAddr)
-            if (addr.nTime > nCutOff)
-                pfrom->PushAddress(addr);
+static bool ProcessGetAddrMessage(CNode* pfrom, CDataStream& /*vRecv*/)
+{
+    // Don't return addresses older than nCutOff timestamp
+    int64_t nCutOff = GetTime() - (nNodeLifespan * 24 * 60 * 60);
+    pfrom->vAddrToSend.clear();
+    vector<CAddress> vAddr = addrman.get().GetAddr();
+    for (const CAddress& addr : vAddr)
+        if (addr.nTime > nCutOff)
+            pfrom->PushAddress(addr);
+    return true;
+}
+
+static bool ProcessMempoolMessage(CNode* pfrom, CDataStream& /*vRecv*/)
+{
+    std::vector<uint256> vtxid;
+    LOCK2(mempool.cs, pfrom->cs_filter);
+    mempool.queryHashes(vtxid);
+    vector<CInv> vInv;
+    for (uint256& hash : vtxid) {
+        CInv                inv(MSG_TX, hash);
+        const CTransaction* txFromMempool = mempool.lookup_unsafe(hash);
+        // this tx should exist because we locked then used mempool.queryHashes()
+        assert(txFromMempool);
+        if ((pfrom->pfilter && pfrom->pfilter->IsRelevantAndUpdate(*txFromMempool)) || (!pfrom->pfilter))
+            vInv.push_back(inv);
+        if (vInv.size() == MAX_INV_SZ)
+            break;
     }
+    if (vInv.size() > 0)
+        pfrom->PushMessage("inv", vInv);
+    return true;
+}
 
-    else if (strCommand == "mempool") {
-        std::vector<uint256> vtxid;
-        LOCK2(mempool.cs, pfrom->cs_filter);
-        mempool.queryHashes(vtxid);
-        vector<CInv> vInv;
-        for (uint256& hash : vtxid) {
-            CInv                inv(MSG_TX, hash);
-            const CTransaction* txFromMempool = mempool.lookup_unsafe(hash);
-            // this tx should exist because we locked then used mempool.queryHashes()
-            assert(txFromMempool);
-            if ((pfrom->pfilter && pfrom->pfilter->IsRelevantAndUpdate(*txFromMempool)) ||
-                (!pfrom->pfilter))
-                vInv.push_back(inv);
-            if (vInv.size() == MAX_INV_SZ)
-                break;
-        }
-        if (vInv.size() > 0)
-            pfrom->PushMessage("inv", vInv);
-    }
-
-    else if (strCommand == "ping") {
-        if (pfrom->nVersion > BIP0031_VERSION) {
-            uint64_t nonce = 0;
-            vRecv >> nonce;
-            // Echo the message back with the nonce. This allows for two useful features:
-            //
-            // 1) A remote node can quickly check if the connection is operational
-            // 2) Remote nodes can measure the latency of the network thread. If this node
-            //    is overloaded it won't respond to pings quickly and the remote node can
-            //    avoid sending us more work, like chain download requests.
-            //
-            // The nonce stops the remote getting confused between different pings: without
-            // it, if the remote node sends a ping once per second and this node takes 5
-            // seconds to respond to each, the 5th ping the remote sends would appear to
-            // return very quickly.
-            pfrom->PushMessage("pong", nonce);
-        }
-    }
-
-    else if (strCommand == "alert") {
-        CAlert alert;
-        vRecv >> alert;
-
-        uint256 alertHash = alert.GetHash();
-        if (pfrom->setKnown.count(alertHash) == 0) {
-            if (alert.ProcessAlert()) {
-                // Relay
-                pfrom->setKnown.insert(alertHash);
-                {
-                    LOCK(cs_vNodes);
-                    for (CNode* pnode : vNodes)
-                        alert.RelayTo(pnode);
-                }
-            } else {
-                // Small DoS penalty so peers that send us lots of
-                // duplicate/expired/invalid-signature/whatever alerts
-                // eventually get banned.
-                // This isn't a Misbehaving(100) (immediate ban) because the
-                // peer might be an older or different implementation with
-                // a different signature key, etc.
-                pfrom->Misbehaving(10);
+static bool ProcessPingMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    if (pfrom->nVersion > BIP0031_VERSION) {
+        uint64_t nonce = 0;
+        vRecv >> nonce;
+        // Echo the message back with the nonce. This allows for two useful features:
+        //
+        // 1) A remote node can quickly check if the connection is operational
+        // 2) Remote nodes can measure the latency of the network thread. If this node
+        //    is overloaded it won't respond to pings quickly and the remote node can
+        //    avoid sending us more work, like chain download requests.
+        //
+        // The nonce stops the remote getting confused between different pings: without
+        // it, if the remote node sends a ping once per second and this node takes 5
+        // seconds to respond to each, the 5th ping the remote sends would appear to
+        // return very quickly.
+        pfrom->PushMessage("pong", nonce);
+    }
+    return true;
+}
+
+static bool ProcessAlertMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    CAlert alert;
+    vRecv >> alert;
+
+    uint256 alertHash = alert.GetHash();
+    if (pfrom->setKnown.count(alertHash) == 0) {
+        if (alert.ProcessAlert()) {
+            // Relay
+            pfrom->setKnown.insert(alertHash);
+            {
+                LOCK(cs_vNodes);
+                for (CNode* pnode : vNodes)
+                    alert.RelayTo(pnode);
             }
+        } else {
+            // Small DoS penalty so peers that send us lots of
+            // duplicate/expired/invalid-signature/whatever alerts
+            // eventually get banned.
+            // This isn't a Misbehaving(100) (immediate ban) because the
+            // peer might be an older or different implementation with
+            // a different signature key, etc.
+            pfrom->Misbehaving(10);
         }
     }
+    return true;
+}
 
-    else if (strCommand == "filterload") {
-        CBloomFilter filter;
-        vRecv >> filter;
+static bool ProcessFilterLoadMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    CBloomFilter filter;
+    vRecv >> filter;
 
-        if (!filter.IsWithinSizeConstraints())
-            // There is no excuse for sending a too-large filter
-            pfrom->Misbehaving(100);
-        else {
-            LOCK(pfrom->cs_filter);
-            delete pfrom->pfilter;
-            pfrom->pfilter = new CBloomFilter(filter);
-        }
-        pfrom->fRelayTxes = true;
+    if (!filter.IsWithinSizeConstraints())
+        // There is no excuse for sending a too-large filter
+        pfrom->Misbehaving(100);
+    else {
+        LOCK(pfrom->cs_filter);
+        delete pfrom->pfilter;
+        pfrom->pfilter = new CBloomFilter(filter);
     }
+    pfrom->fRelayTxes = true;
+    return true;
+}
 
-    else if (strCommand == "filteradd") {
-        vector<unsigned char> vData;
-        vRecv >> vData;
+static bool ProcessFilterAddMessage(CNode* pfrom, CDataStream& vRecv)
+{
+    vector<unsigned char> vData;
+    vRecv >> vData;
 
-        // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
-        // and thus, the maximum size any matched object can have) in a filteradd message
-        if (vData.size() > 520) {
+    // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
+    // and thus, the maximum size any matched object can have) in a filteradd message
+    if (vData.size() > 520) {
+        pfrom->Misbehaving(100);
+    } else {
+        LOCK(pfrom->cs_filter);
+        if (pfrom->pfilter)
+            pfrom->pfilter->insert(vData);
+        else
             pfrom->Misbehaving(100);
-        } else {
-            LOCK(pfrom->cs_filter);
-            if (pfrom->pfilter)
-                pfrom->pfilter->insert(vData);
-            else
-                pfrom->Misbehaving(100);
-        }
     }
+    return true;
+}
 
-    else if (strCommand == "filterclear") {
-        LOCK(pfrom->cs_filter);
-        delete pfrom->pfilter;
-        pfrom->pfilter    = NULL;
-        pfrom->fRelayTxes = true;
+static bool ProcessFilterClearMessage(CNode* pfrom, CDataStream& /*vRecv*/)
+{
+    LOCK(pfrom->cs_filter);
+    delete pfrom->pfilter;
+    pfrom->pfilter    = NULL;
+    pfrom->fRelayTxes = true;
+    return true;
+}
+
+/** What a message handler needs before it runs */
+enum class MessageLock
+{
+    // only the locks that the handler takes itself
+    None,
+    // cs_main, taken by the message handler thread
+    Main,
+    // cs_main, taken by ThreadMessageValidation, so that the other peers are served meanwhile
+    Validation,
+};
+
+typedef bool (*MessageHandlerFn)(CNode* pfrom, CDataStream& vRecv);
+
+struct MessageHandler
+{
+    const char*      pszCommand;
+    MessageHandlerFn fn;
+    MessageLock      lock;
+    bool             fUpdatesLastSeen; // of the address of the peer
+};
+
+static const MessageHandler messageHandlers[] = {
+    {"version", ProcessVersionMessage, MessageLock::Main, true},
+    {"verack", ProcessVerackMessage, MessageLock::None, false},
+    {"addr", ProcessAddrMessage, MessageLock::None, true},
+    {"inv", ProcessInvMessage, MessageLock::Main, true},
+    {"getdata", ProcessGetDataMessage, MessageLock::None, true},
+    {"getblocks", ProcessGetBlocksMessage, MessageLock::Main, false},
+    {"getheaders", ProcessGetHeadersMessage, MessageLock::Main, false},
+    {"headers", ProcessHeadersMessage, MessageLock::Main, false},
+    {"tx", ProcessTxMessage, MessageLock::Validation, false},
+    {"block", ProcessBlockMessage, MessageLock::Validation, false},
+    {"getaddr", ProcessGetAddrMessage, MessageLock::None, false},
+    {"mempool", ProcessMempoolMessage, MessageLock::None, false},
+    {"ping", ProcessPingMessage, MessageLock::None, true},
+    {"alert", ProcessAlertMessage, MessageLock::Main, false},
+    {"filterload", ProcessFilterLoadMessage, MessageLock::None, false},
+    {"filteradd", ProcessFilterAddMessage, MessageLock::None, false},
+    {"filterclear", ProcessFilterClearMessage, MessageLock::None, false},
+};
+
+// The handler of the command, or nullptr for unknown commands
+static const MessageHandler* FindMessageHandler(const string& strCommand)
+{
+    static const std::unordered_map<string, const MessageHandler*> mapHandlers = []() {
+        std::unordered_map<string, const MessageHandler*> mapHandlers;
+        for (const MessageHandler& handler : messageHandlers)
+            mapHandlers[handler.pszCommand] = &handler;
+        return mapHandlers;
+    }();
+    const auto it = mapHandlers.find(strCommand);
+    return it == mapHandlers.end() ? nullptr : it->second;
+}
+
+bool static ProcessMessage(CNode* pfrom, const MessageHandler* phandler, const string& strCommand,
+                           CDataStream& vRecv)
+{
+    if (fDebug)
+        printf("received: %s (%" PRIszu " bytes)\n", strCommand.c_str(), vRecv.size());
+    const boost::optional<std::string> dropMessageTest = mapArgs.get("-dropmessagestest");
+    if (dropMessageTest && GetRand(atoi(*dropMessageTest)) == 0) {
+        printf("dropmessagestest DROPPING RECV MESSAGE\n");
+        return true;
     }
 
-    else {
-        // Ignore unknown commands for extensibility
+    if (pfrom->nVersion == 0 && (!phandler || phandler->fn != ProcessVersionMessage)) {
+        // Must have a version message before anything else
+        pfrom->Misbehaving(1);
+        return false;
     }
 
+    // Ignore unknown commands for extensibility
+    if (!phandler)
+        return true;
+
+    if (!phandler->fn(pfrom, vRecv))
+        return false;
+
     // Update the last seen time for this node's address
-    if (pfrom->fNetworkNode)
-        if (strCommand == "version" || strCommand == "addr" || strCommand == "inv" ||
-            strCommand == "getdata" || strCommand == "ping")
-            AddressCurrentlyConnected(pfrom->addr);
+    if (pfrom->fNetworkNode && phandler->fUpdatesLastSeen)
+        AddressCurrentlyConnected(pfrom->addr);
 
     return true;
 }
 
+// Processes the message, and tells the peer if it couldn't be parsed
+void static RunMessageHandler(CNode* pfrom, const MessageHandler* phandler, const string& strCommand,
+                              CDataStream& vRecv, unsigned int nMessageSize)
+{
+    const int64_t nTimeStart = GetTimeMicros();
+    bool          fRet       = false;
+    try {
+        fRet = ProcessMessage(pfrom, phandler, strCommand, vRecv);
+    } catch (std::ios_base::failure& e) {
+        pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, std::string("error parsing message"));
+        if (strstr(e.what(), "end of data")) {
+            // Allow exceptions from under-length message on vRecv
+            printf("ProcessMessages(%s, %u bytes) : Exception '%s' caught, normally caused by a "
+                   "message being shorter than its stated length\n",
+                   strCommand.c_str(), nMessageSize, e.what());
+        } else if (strstr(e.what(), "size too large")) {
+            // Allow exceptions from over-long size
+            printf("ProcessMessages(%s, %u bytes) : Exception '%s' caught\n", strCommand.c_str(),
+                   nMessageSize, e.what());
+        } else {
+            PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMessages()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMessages()");
+    }
+
+    if (!fRet)
+        printf("ProcessMessage(%s, %u bytes) FAILED\n", strCommand.c_str(), nMessageSize);
+
+    pfrom->RecordRecvMessage(phandler ? strCommand : "*other*",
+                             CMessageHeader::HEADER_SIZE + nMessageSize, GetTimeMicros() - nTimeStart);
+}
+
+static CValidationQueue messageValidationQueue;
+
+// Hands the message over to ThreadMessageValidation, which keeps the node until it's done
+void static QueueMessageValidation(CNode* pfrom, const MessageHandler* phandler,
+                                   const string& strCommand, CDataStream& vRecv,
+                                   unsigned int nMessageSize)
+{
+    {
+        LOCK(cs_vNodes);
+        pfrom->AddRef();
+    }
+    // the message still counts toward the receive flood limit of the peer while it waits
+    const unsigned int nQueuedSize = CMessageHeader::HEADER_SIZE + vRecv.size();
+    pfrom->nValidationQueueSize += nQueuedSize;
+    const std::shared_ptr<CDataStream> pvRecv = std::make_shared<CDataStream>(std::move(vRecv));
+    messageValidationQueue.Push(pfrom->nodeid, [=]() {
+        if (!fShutdown && !pfrom->fDisconnect) {
+            LOCK(cs_main);
+            RunMessageHandler(pfrom, phandler, strCommand, *pvRecv, nMessageSize);
+        }
+        pfrom->nValidationQueueSize -= nQueuedSize;
+        LOCK(cs_vNodes);
+        pfrom->Release();
+    });
+}
+
+void ThreadMessageValidation(void* /*parg*/)
+{
+    // Make this thread recognisable as the block and transaction validation thread
+    RenameThread("neblio-validate");
+
+    vnThreadsRunning[THREAD_MESSAGEVALIDATION]++;
+    printf("ThreadMessageValidation started\n");
+    while (!fShutdown)
+        messageValidationQueue.RunNext(100);
+    vnThreadsRunning[THREAD_MESSAGEVALIDATION]--;
+    printf("ThreadMessageValidation exited\n");
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -2320,6 +2756,16 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // messages that use the chain wait until the blocks and transactions that the peer sent before
+        // them have been validated, and, like in SendMessages, for the chain to be free, so that the
+        // other peers aren't held up; the message is left for the next round
+        const string                         strCommand = msg.hdr.GetCommand();
+        const MessageHandler*                phandler   = FindMessageHandler(strCommand);
+        boost::unique_lock<CCriticalSection> lockMain(cs_main, boost::defer_lock);
+        if (phandler && phandler->lock == MessageLock::Main &&
+            (messageValidationQueue.Pending(pfrom->nodeid) > 0 || !lockMain.try_lock()))
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -2337,54 +2783,27 @@ bool ProcessMessages(CNode* pfrom)
             printf("\n\nPROCESSMESSAGE: ERRORS IN HEADER %s\n\n\n", hdr.GetCommand().c_str());
             continue;
         }
-        string strCommand = hdr.GetCommand();
 
         // Message size
         unsigned int nMessageSize = hdr.nMessageSize;
 
-        // Checksum
-        CDataStream& vRecv     = msg.vRecv;
-        uint256      hash      = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
-        unsigned int nChecksum = 0;
-        memcpy(&nChecksum, &hash, sizeof(nChecksum));
-        if (nChecksum != hdr.nChecksum) {
+        // Checksum, which the socket thread computed while receiving the message
+        CDataStream& vRecv = msg.vRecv;
+        if (msg.nChecksum != hdr.nChecksum) {
             printf("ProcessMessages(%s, %u bytes) : CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n",
-                   strCommand.c_str(), nMessageSize, nChecksum, hdr.nChecksum);
+                   strCommand.c_str(), nMessageSize, msg.nChecksum, hdr.nChecksum);
             continue;
         }
 
         // Process message
-        bool fRet = false;
-        try {
-            {
-                LOCK(cs_main);
-                fRet = ProcessMessage(pfrom, strCommand, vRecv);
-            }
-            if (fShutdown)
-                break;
-        } catch (std::ios_base::failure& e) {
-            pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED,
-                               std::string("error parsing message"));
-            if (strstr(e.what(), "end of data")) {
-                // Allow exceptions from under-length message on vRecv
-                printf("ProcessMessages(%s, %u bytes) : Exception '%s' caught, normally caused by a "
-                       "message being shorter than its stated length\n",
-                       strCommand.c_str(), nMessageSize, e.what());
-            } else if (strstr(e.what(), "size too large")) {
-                // Allow exceptions from over-long size
-                printf("ProcessMessages(%s, %u bytes) : Exception '%s' caught\n", strCommand.c_str(),
-                       nMessageSize, e.what());
-            } else {
-                PrintExceptionContinue(&e, "ProcessMessages()");
-            }
-        } catch (std::exception& e) {
-            PrintExceptionContinue(&e, "ProcessMessages()");
-        } catch (...) {
-            PrintExceptionContinue(NULL, "ProcessMessages()");
+        RandAddSeedPerfmon();
+        if (phandler && phandler->lock == MessageLock::Validation && pfrom->nVersion != 0) {
+            QueueMessageValidation(pfrom, phandler, strCommand, vRecv, nMessageSize);
+        } else {
+            RunMessageHandler(pfrom, phandler, strCommand, vRecv, nMessageSize);
         }
-
-        if (!fRet)
-            printf("ProcessMessage(%s, %u bytes) FAILED\n", strCommand.c_str(), nMessageSize);
+        if (fShutdown)
+            break;
     }
 
     // In case the connection got shut down, its receive buffer was wiped
@@ -2396,22 +2815,46 @@ bool ProcessMessages(CNode* pfrom)
 
 bool SendMessages(CNode* pto, bool fSendTrickle)
 {
-    TRY_LOCK(cs_main, lockMain);
-    if (lockMain) {
-        // Don't send anything until we get their version message
-        if (pto->nVersion == 0)
-            return true;
+    // Don't send anything until we get their version message
+    if (pto->nVersion == 0)
+        return true;
+
+    // Keep-alive ping. We send a nonce of zero because we don't use it anywhere
+    // right now.
+    if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSendMsg.empty()) {
+        uint64_t nonce = 0;
+        if (pto->nVersion > BIP0031_VERSION)
+            pto->PushMessage("ping", nonce);
+        else
+            pto->PushMessage("ping");
+    }
 
-        // Keep-alive ping. We send a nonce of zero because we don't use it anywhere
-        // right now.
-        if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSendMsg.empty()) {
-            uint64_t nonce = 0;
-            if (pto->nVersion > BIP0031_VERSION)
-                pto->PushMessage("ping", nonce);
-            else
-                pto->PushMessage("ping");
+    //
+    // Message: addr
+    //
+    if (fSendTrickle) {
+        vector<CAddress> vAddr;
+        vAddr.reserve(pto->vAddrToSend.size());
+        for (const CAddress& addr : pto->vAddrToSend) {
+            // returns true if wasn't already contained in the set
+            if (pto->setAddrKnown.insert(addr).second) {
+                vAddr.push_back(addr);
+                // receiver rejects addr messages larger than 1000
+                if (vAddr.size() >= 1000) {
+                    pto->PushMessage("addr", vAddr);
+                    vAddr.clear();
+                }
+            }
         }
+        pto->vAddrToSend.clear();
+        if (!vAddr.empty())
+            pto->PushMessage("addr", vAddr);
+    }
 
+    // what follows uses the chain or the wallets, and waits for a later round while a block is being
+    // validated
+    TRY_LOCK(cs_main, lockMain);
+    if (lockMain) {
         // Resend wallet transactions that haven't gotten in a block yet
         ResendWalletTransactions();
 
@@ -2436,28 +2879,6 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             nLastRebroadcast = GetTime();
         }
 
-        //
-        // Message: addr
-        //
-        if (fSendTrickle) {
-            vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            for (const CAddress& addr : pto->vAddrToSend) {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second) {
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000) {
-                        pto->PushMessage("addr", vAddr);
-                        vAddr.clear();
-                    }
-                }
-            }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                pto->PushMessage("addr", vAddr);
-        }
-
         //
         // Message: inventory
         //
@@ -2509,6 +2930,33 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!vInv.empty())
             pto->PushMessage("inv", vInv);
 
+        //
+        // Message: getheaders, and getdata for the blocks of the header chain
+        //
+        if (!fImporting) {
+            const int64_t nTime = GetTime();
+            // the blocks of the peer that wait for validation have arrived
+            if (messageValidationQueue.Pending(pto->nodeid) == 0 &&
+                blockDownload.IsStalling(pto->nodeid, nTime)) {
+                printf("peer %s is stalling the block download, disconnecting\n",
+                       pto->addr.ToString().c_str());
+                blockDownload.PeerDisconnected(pto->nodeid);
+                pto->fDisconnect = true;
+                return true;
+            }
+            if (blockDownload.ShouldRequestHeaders(pto->nodeid, chainActive.Height(), nTime)) {
+                const CBlockLocator locator(blockDownload.GetLocatorHashes(chainActive));
+                pto->PushMessage("getheaders", locator, uint256(0));
+            }
+            vector<CInv> vGetBlocks;
+            for (const uint256& hash : blockDownload.RequestBlocks(
+                     pto->nodeid, nTime, [](const uint256& h) { return mapBlockIndex.exists(h); })) {
+                vGetBlocks.push_back(CInv(MSG_BLOCK, hash));
+            }
+            if (!vGetBlocks.empty())
+                pto->PushMessage("getdata", vGetBlocks);
+        }
+
         //
         // Message: getdata
         //
@@ -2621,6 +3069,191 @@ uint64_t CTxOutCompressor::DecompressAmount(uint64_t x)
     return n;
 }
 
+bool CCoinsView::GetCoins(uint256 /*txid*/, CCoins& /*coins*/) { return false; }
+
+bool CCoinsView::SetCoins(uint256 /*txid*/, const CCoins& /*coins*/) { return false; }
+
+bool CCoinsView::HaveCoins(uint256 /*txid*/) { return false; }
+
+uint256 CCoinsView::GetBestBlock() { return 0; }
+
+bool CCoinsView::SetBestBlock(const uint256& /*hashBlock*/) { return false; }
+
+bool CCoinsView::BatchWrite(const std::map<uint256, CCoins>& /*mapCoins*/,
+                            const uint256& /*hashBlock*/)
+{
+    return false;
+}
+
+bool CCoinsView::GetStats(CCoinsStats& /*stats*/) { return false; }
+
+CCoinsViewBacked::CCoinsViewBacked(CCoinsView& viewIn) : base(&viewIn) {}
+
+bool CCoinsViewBacked::GetCoins(uint256 txid, CCoins& coins) { return base->GetCoins(txid, coins); }
+
+bool CCoinsViewBacked::SetCoins(uint256 txid, const CCoins& coins)
+{
+    return base->SetCoins(txid, coins);
+}
+
+bool CCoinsViewBacked::HaveCoins(uint256 txid) { return base->HaveCoins(txid); }
+
+uint256 CCoinsViewBacked::GetBestBlock() { return base->GetBestBlock(); }
+
+bool CCoinsViewBacked::SetBestBlock(const uint256& hashBlock) { return base->SetBestBlock(hashBlock); }
+
+void CCoinsViewBacked::SetBackend(CCoinsView& viewIn) { base = &viewIn; }
+
+bool CCoinsViewBacked::BatchWrite(const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlock)
+{
+    return base->BatchWrite(mapCoins, hashBlock);
+}
+
+bool CCoinsViewBacked::GetStats(CCoinsStats& stats) { return base->GetStats(stats); }
+
+// a node of cacheCoins has three pointers and a color besides its value
+static const std::size_t CACHECOINS_ENTRY_OVERHEAD =
+    sizeof(std::map<uint256, CCoins>::value_type) + 4 * sizeof(void*);
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView& baseIn, bool /*fDummy*/)
+    : CCoinsViewBacked(baseIn), hashBlock(0), cachedCoinsUsage(0), fCachedCoinsUsageStale(false)
+{
+}
+
+bool CCoinsViewCache::GetCoins(uint256 txid, CCoins& coins)
+{
+    std::map<uint256, CCoins>::iterator it = FetchCoins(txid);
+    if (it == cacheCoins.end())
+        return false;
+    coins = it->second;
+    return true;
+}
+
+std::map<uint256, CCoins>::iterator CCoinsViewCache::FetchCoins(uint256 txid)
+{
+    std::map<uint256, CCoins>::iterator it = cacheCoins.lower_bound(txid);
+    if (it != cacheCoins.end() && it->first == txid)
+        return it;
+    CCoins tmp;
+    if (!base->GetCoins(txid, tmp))
+        return cacheCoins.end();
+    cachedCoinsUsage += tmp.DynamicMemoryUsage();
+    return cacheCoins.insert(it, std::make_pair(txid, tmp));
+}
+
+CCoins& CCoinsViewCache::GetCoins(uint256 txid)
+{
+    std::map<uint256, CCoins>::iterator it = FetchCoins(txid);
+    assert(it != cacheCoins.end());
+    // the caller may change the outputs through the reference
+    fCachedCoinsUsageStale = true;
+    return it->second;
+}
+
+bool CCoinsViewCache::SetCoins(uint256 txid, const CCoins& coins)
+{
+    CCoins& cached = cacheCoins[txid];
+    cachedCoinsUsage -= std::min(cachedCoinsUsage, cached.DynamicMemoryUsage());
+    cached = coins;
+    cachedCoinsUsage += cached.DynamicMemoryUsage();
+    return true;
+}
+
+bool CCoinsViewCache::HaveCoins(uint256 txid) { return FetchCoins(txid) != cacheCoins.end(); }
+
+uint256 CCoinsViewCache::GetBestBlock()
+{
+    if (hashBlock == 0)
+        hashBlock = base->GetBestBlock();
+    return hashBlock;
+}
+
+bool CCoinsViewCache::SetBestBlock(const uint256& hashBlockIn)
+{
+    hashBlock = hashBlockIn;
+    return true;
+}
+
+bool CCoinsViewCache::BatchWrite(const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlockIn)
+{
+    for (const auto& p : mapCoins)
+        SetCoins(p.first, p.second);
+    hashBlock = hashBlockIn;
+    return true;
+}
+
+bool CCoinsViewCache::Flush()
+{
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    if (fOk) {
+        cacheCoins.clear();
+        cachedCoinsUsage       = 0;
+        fCachedCoinsUsageStale = false;
+    }
+    return fOk;
+}
+
+unsigned int CCoinsViewCache::GetCacheSize() { return cacheCoins.size(); }
+
+std::size_t CCoinsViewCache::DynamicMemoryUsage()
+{
+    if (fCachedCoinsUsageStale) {
+        cachedCoinsUsage = 0;
+        for (const auto& p : cacheCoins)
+            cachedCoinsUsage += p.second.DynamicMemoryUsage();
+        fCachedCoinsUsageStale = false;
+    }
+    return cacheCoins.size() * CACHECOINS_ENTRY_OVERHEAD + cachedCoinsUsage;
+}
+
+CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView& baseIn, CTxMemPool& mempoolIn)
+    : CCoinsViewBacked(baseIn), mempool(mempoolIn)
+{
+}
+
+bool CCoinsViewMemPool::GetCoins(uint256 txid, CCoins& coins)
+{
+    if (base->GetCoins(txid, coins))
+        return true;
+    CTransaction tx;
+    if (mempool.lookup(txid, tx)) {
+        coins = CCoins(tx, MEMPOOL_HEIGHT);
+        return true;
+    }
+    return false;
+}
+
+bool CCoinsViewMemPool::HaveCoins(uint256 txid) { return mempool.exists(txid) || base->HaveCoins(txid); }
+
+CCoinsViewDB::CCoinsViewDB(CTxDB& txdbIn) : txdb(txdbIn) {}
+
+bool CCoinsViewDB::GetCoins(uint256 txid, CCoins& coins) { return txdb.ReadCoins(txid, coins); }
+
+bool CCoinsViewDB::SetCoins(uint256 txid, const CCoins& coins) { return txdb.WriteCoins(txid, coins); }
+
+bool CCoinsViewDB::HaveCoins(uint256 txid) { return txdb.HaveCoins(txid); }
+
+uint256 CCoinsViewDB::GetBestBlock()
+{
+    uint256 hashBlock = 0;
+    txdb.ReadCoinsBestBlock(hashBlock);
+    return hashBlock;
+}
+
+bool CCoinsViewDB::SetBestBlock(const uint256& hashBlock) { return txdb.WriteCoinsBestBlock(hashBlock); }
+
+bool CCoinsViewDB::BatchWrite(const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlock)
+{
+    for (const auto& p : mapCoins) {
+        if (!txdb.WriteCoins(p.first, p.second))
+            return error("CCoinsViewDB::BatchWrite() : failed to write coins of %s",
+                         p.first.ToString().c_str());
+    }
+    if (hashBlock != 0 && !txdb.WriteCoinsBestBlock(hashBlock))
+        return error("CCoinsViewDB::BatchWrite() : failed to write the best block");
+    return true;
+}
+
 bool IsTxInMainChain(const ITxDB& txdb, const uint256& txHash)
 {
     CTransaction tx;
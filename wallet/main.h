@@ -6,6 +6,7 @@
 #define BITCOIN_MAIN_H
 
 #include "bignum.h"
+#include "LRUCache.h"
 #include "block.h"
 #include "blockindex.h"
 #include "blockindexcatalog.h"
@@ -75,7 +76,6 @@ extern const std::string                            strMessageMagic;
 extern boost::atomic_int64_t                        nTimeBestReceived;
 extern CCriticalSection                             cs_setpwalletRegistered;
 extern std::set<std::shared_ptr<CWallet>>           setpwalletRegistered;
-extern std::unordered_map<uint256, CBlock*>         mapOrphanBlocks;
 extern boost::atomic<bool>                          fImporting;
 
 // Amount of blocks that other nodes claim to have
@@ -89,6 +89,18 @@ extern unsigned int nDerivationMethodIndex;
 
 extern bool fEnforceCanonical;
 
+/** Maximum number of script-checking threads allowed */
+static const int MAX_SCRIPTCHECK_THREADS = 16;
+/** -par default (number of script-checking threads, 0 = auto) */
+static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+
+template <typename T>
+class CCheckQueue;
+class CScriptCheck;
+
+/** Queue that ConnectBlock() defers the signature checks of a block to, run on -par threads */
+extern CCheckQueue<CScriptCheck> scriptcheckqueue;
+
 class NTP1Transaction;
 
 // Minimum disk space required - used in CheckDiskSpace()
@@ -108,6 +120,7 @@ void         PrintBlockTree();
 bool         ProcessMessages(CNode* pfrom);
 bool         SendMessages(CNode* pto, bool fSendTrickle);
 void         ThreadImport(void* parg);
+void         ThreadMessageValidation(void* parg);
 bool         CheckProofOfWork(const uint256& hash, unsigned int nBits, bool silent = false);
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake);
 unsigned int ComputeMinWork(unsigned int nBase, int64_t nTime);
@@ -118,7 +131,6 @@ bool         IsInitialBlockDownload_tolerant();
 bool         __IsInitialBlockDownload_internal();
 std::string  GetWarnings(std::string strFor);
 bool         GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock);
-uint256      WantedByOrphan(const CBlock* pblockOrphan);
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 void               StakeMiner(CWallet* pwallet);
 void               ResendWalletTransactions(bool fForce = false);
@@ -160,6 +172,20 @@ CTransaction PopLeafTransaction(std::vector<CTransaction>& vtx);
 /** True if the transaction is in the main chain (can throw) */
 bool IsTxInMainChain(const ITxDB& txdb, const uint256& txHash);
 
+/** the -maxmempool limit, in bytes */
+std::size_t GetMaxMempoolSize();
+
+/** the -utxocache limit, in bytes, past which ConnectBlock() and DisconnectBlock() flush their UTXO
+ * cache to the block's database batch */
+std::size_t GetUtxoCacheSize();
+
+static const std::size_t DEFAULT_SERVED_BLOCK_CACHE_SIZE = 16;
+
+/** Blocks recently sent to peers, as complete "block" messages, so that peers syncing the same range
+ * share one database read and one checksum */
+using ServedBlockCacheType = LRUCache<uint256, std::shared_ptr<const CSerializeData>>;
+ServedBlockCacheType& GetServedBlockCache();
+
 /** (try to) add transaction to memory pool **/
 Result<void, TxValidationState> AcceptToMemoryPool(CTxMemPool& pool, const CTransaction& tx,
                                                    const ITxDB* txdbPtr = nullptr);
@@ -277,7 +303,8 @@ public:
  * - VARINT(nCode)
  * - unspentness bitvector, for vout[2] and further; least significant byte first
  * - the non-spent CTxOuts (via CTxOutCompressor)
- * - VARINT(nHeight)
+ * - VARINT(nHeight * 2 + fCoinStake)
+ * - VARINT(nTime), the ppcoin transaction timestamp
  *
  * The nCode value consists of:
  * - bit 1: IsCoinBase()
@@ -330,6 +357,9 @@ public:
     // whether transaction is a coinbase
     bool fCoinBase;
 
+    // whether transaction is a coinstake
+    bool fCoinStake;
+
     // unspent transaction outputs; spent outputs are .IsNull(); spent outputs at the end of the array
     // are dropped
     std::vector<CTxOut> vout;
@@ -341,14 +371,28 @@ public:
     // as new tx version will probably only be introduced at certain heights
     int nVersion;
 
+    // timestamp of the CTransaction
+    unsigned int nTime;
+
     // construct a CCoins from a CTransaction, at a given height
     CCoins(const CTransaction& tx, int nHeightIn)
-        : fCoinBase(tx.IsCoinBase()), vout(tx.vout), nHeight(nHeightIn), nVersion(tx.nVersion)
+        : fCoinBase(tx.IsCoinBase()), fCoinStake(tx.IsCoinStake()), vout(tx.vout), nHeight(nHeightIn),
+          nVersion(tx.nVersion), nTime(tx.nTime)
+    {
+    }
+
+    // construct a CCoins from a CTransaction, at a given height, without the outputs that its tx index
+    // entry marks as spent
+    CCoins(const CTransaction& tx, int nHeightIn, const CTxIndex& txindex) : CCoins(tx, nHeightIn)
     {
+        for (unsigned int i = 0; i < vout.size() && i < txindex.vSpent.size(); i++)
+            if (!txindex.vSpent[i].IsNull())
+                vout[i].SetNull();
+        Cleanup();
     }
 
     // empty constructor
-    CCoins() : fCoinBase(false), vout(0), nHeight(0), nVersion(0) {}
+    CCoins() : fCoinBase(false), fCoinStake(false), vout(0), nHeight(0), nVersion(0), nTime(0) {}
 
     // remove spent outputs at the end of vout
     void Cleanup()
@@ -360,8 +404,8 @@ public:
     // equality test
     friend bool operator==(const CCoins& a, const CCoins& b)
     {
-        return a.fCoinBase == b.fCoinBase && a.nHeight == b.nHeight && a.nVersion == b.nVersion &&
-               a.vout == b.vout;
+        return a.fCoinBase == b.fCoinBase && a.fCoinStake == b.fCoinStake && a.nHeight == b.nHeight &&
+               a.nVersion == b.nVersion && a.nTime == b.nTime && a.vout == b.vout;
     }
     friend bool operator!=(const CCoins& a, const CCoins& b) { return !(a == b); }
 
@@ -389,6 +433,8 @@ public:
 
     bool IsCoinBase() const { return fCoinBase; }
 
+    bool IsCoinStake() const { return fCoinStake; }
+
     unsigned int GetSerializeSize(int nType, int nVersion) const
     {
         unsigned int nSize     = 0;
@@ -409,8 +455,10 @@ public:
         for (unsigned int i = 0; i < vout.size(); i++)
             if (!vout[i].IsNull())
                 nSize += ::GetSerializeSize(CTxOutCompressor(REF(vout[i])), nType, nVersion);
-        // height
-        nSize += ::GetSerializeSize(VARINT(nHeight), nType, nVersion);
+        // height and coinstake flag
+        nSize += ::GetSerializeSize(VARINT(nHeight * 2 + (fCoinStake ? 1 : 0)), nType, nVersion);
+        // timestamp
+        nSize += ::GetSerializeSize(VARINT(nTime), nType, nVersion);
         return nSize;
     }
 
@@ -441,8 +489,10 @@ public:
             if (!vout[i].IsNull())
                 ::Serialize(s, CTxOutCompressor(REF(vout[i])), nType, nVersion);
         }
-        // coinbase height
-        ::Serialize(s, VARINT(nHeight), nType, nVersion);
+        // height and coinstake flag
+        ::Serialize(s, VARINT(nHeight * 2 + (fCoinStake ? 1 : 0)), nType, nVersion);
+        // timestamp
+        ::Serialize(s, VARINT(nTime), nType, nVersion);
     }
 
     template <typename Stream>
@@ -475,8 +525,13 @@ public:
             if (vAvail[i])
                 ::Unserialize(s, REF(CTxOutCompressor(vout[i])), nType, nVersion);
         }
-        // coinbase height
-        ::Unserialize(s, VARINT(nHeight), nType, nVersion);
+        // height and coinstake flag
+        unsigned int nHeightCode = 0;
+        ::Unserialize(s, VARINT(nHeightCode), nType, nVersion);
+        nHeight    = nHeightCode / 2;
+        fCoinStake = nHeightCode & 1;
+        // timestamp
+        ::Unserialize(s, VARINT(nTime), nType, nVersion);
         Cleanup();
     }
 
@@ -518,6 +573,15 @@ public:
                 return false;
         return true;
     }
+
+    // the heap memory of the outputs, beyond sizeof(CCoins)
+    std::size_t DynamicMemoryUsage() const
+    {
+        std::size_t result = vout.capacity() * sizeof(CTxOut);
+        for (const CTxOut& out : vout)
+            result += out.scriptPubKey.capacity();
+        return result;
+    }
 };
 
 /** Data structure that represents a partial merkle tree.
@@ -636,14 +700,14 @@ public:
     // This may (but cannot always) return true for fully spent transactions
     virtual bool HaveCoins(uint256 txid);
 
-    // Retrieve the block index whose state this CCoinsView currently represents
-    virtual CBlockIndex* GetBestBlock();
+    // Retrieve the hash of the block whose state this CCoinsView currently represents
+    virtual uint256 GetBestBlock();
 
-    // Modify the currently active block index
-    virtual bool SetBestBlock(CBlockIndex* pindex);
+    // Modify the currently active block
+    virtual bool SetBestBlock(const uint256& hashBlock);
 
     // Do a bulk modification (multiple SetCoins + one SetBestBlock)
-    virtual bool BatchWrite(const std::map<uint256, CCoins>& mapCoins, CBlockIndex* pindex);
+    virtual bool BatchWrite(const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlock);
 
     // Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats);
@@ -660,33 +724,35 @@ protected:
 
 public:
     CCoinsViewBacked(CCoinsView& viewIn);
-    bool         GetCoins(uint256 txid, CCoins& coins);
-    bool         SetCoins(uint256 txid, const CCoins& coins);
-    bool         HaveCoins(uint256 txid);
-    CBlockIndex* GetBestBlock();
-    bool         SetBestBlock(CBlockIndex* pindex);
-    void         SetBackend(CCoinsView& viewIn);
-    bool         BatchWrite(const std::map<uint256, CCoins>& mapCoins, CBlockIndex* pindex);
-    bool         GetStats(CCoinsStats& stats);
+    bool    GetCoins(uint256 txid, CCoins& coins);
+    bool    SetCoins(uint256 txid, const CCoins& coins);
+    bool    HaveCoins(uint256 txid);
+    uint256 GetBestBlock();
+    bool    SetBestBlock(const uint256& hashBlock);
+    void    SetBackend(CCoinsView& viewIn);
+    bool    BatchWrite(const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlock);
+    bool    GetStats(CCoinsStats& stats);
 };
 
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
 protected:
-    CBlockIndex*              pindexTip;
+    uint256                   hashBlock;
     std::map<uint256, CCoins> cacheCoins;
+    std::size_t               cachedCoinsUsage; // the sum of the usage of the cached coins
+    bool                      fCachedCoinsUsageStale;
 
 public:
     CCoinsViewCache(CCoinsView& baseIn, bool fDummy = false);
 
     // Standard CCoinsView methods
-    bool         GetCoins(uint256 txid, CCoins& coins);
-    bool         SetCoins(uint256 txid, const CCoins& coins);
-    bool         HaveCoins(uint256 txid);
-    CBlockIndex* GetBestBlock();
-    bool         SetBestBlock(CBlockIndex* pindex);
-    bool         BatchWrite(const std::map<uint256, CCoins>& mapCoins, CBlockIndex* pindex);
+    bool    GetCoins(uint256 txid, CCoins& coins);
+    bool    SetCoins(uint256 txid, const CCoins& coins);
+    bool    HaveCoins(uint256 txid);
+    uint256 GetBestBlock();
+    bool    SetBestBlock(const uint256& hashBlockIn);
+    bool    BatchWrite(const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlockIn);
 
     // Return a modifiable reference to a CCoins. Check HaveCoins first.
     // Many methods explicitly require a CCoinsViewCache because of this method, to reduce
@@ -700,6 +766,9 @@ public:
     // Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize();
 
+    // Estimate the memory that the cache takes, in bytes
+    std::size_t DynamicMemoryUsage();
+
 private:
     std::map<uint256, CCoins>::iterator FetchCoins(uint256 txid);
 };
@@ -717,6 +786,23 @@ public:
     bool HaveCoins(uint256 txid);
 };
 
+/** CCoinsView backed by the UTXO set in the blockchain database. Writes go to the database's active
+ * batch, if any, so that they're committed together with the block that caused them. */
+class CCoinsViewDB : public CCoinsView
+{
+protected:
+    CTxDB& txdb;
+
+public:
+    CCoinsViewDB(CTxDB& txdbIn);
+    bool    GetCoins(uint256 txid, CCoins& coins);
+    bool    SetCoins(uint256 txid, const CCoins& coins);
+    bool    HaveCoins(uint256 txid);
+    uint256 GetBestBlock();
+    bool    SetBestBlock(const uint256& hashBlock);
+    bool    BatchWrite(const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlock);
+};
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 // extern CCoinsViewCache* pcoinsTip;
 
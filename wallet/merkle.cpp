@@ -6,6 +6,7 @@
 
 #include "block.h"
 #include "hash.h"
+#include "sha256.h"
 
 /*     WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
@@ -43,6 +44,8 @@
        root.
 */
 
+static_assert(sizeof(uint256) == 32, "Merkle tree levels are hashed as arrays of 64-byte pairs");
+
 uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated)
 {
     bool mutation = false;
@@ -56,10 +59,8 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated)
         if (hashes.size() & 1) {
             hashes.push_back(hashes.back());
         }
-        for (unsigned i = 0; i < hashes.size() / 2; i++) {
-            hashes[i] = Hash(BEGIN(hashes[2 * i]), END(hashes[2 * i]), BEGIN(hashes[2 * i + 1]),
-                             END(hashes[2 * i + 1]));
-        }
+        // the pairs are adjacent 64-byte inputs, hashed in place as one batch
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
         hashes.resize(hashes.size() / 2);
     }
     if (mutated)
@@ -97,14 +98,18 @@ std::vector<uint256> ConstructMerkleTree(std::vector<uint256> leaves, bool* fMut
     int  j       = 0;
     bool mutated = false;
     for (int nSize = leaves.size(); nSize > 1; nSize = (nSize + 1) / 2) {
-        for (int i = 0; i < nSize; i += 2) {
-            int i2 = std::min(i + 1, nSize - 1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j + i] == vMerkleTree[j + i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(vMerkleTree[j + i].begin(), vMerkleTree[j + i].end(),
-                                       vMerkleTree[j + i2].begin(), vMerkleTree[j + i2].end()));
+        if (nSize % 2 == 0 && vMerkleTree[j + nSize - 2] == vMerkleTree[j + nSize - 1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        const int nPairs = nSize / 2;
+        vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+        // the full pairs of this level are adjacent 64-byte inputs, hashed as one batch
+        SHA256D64(vMerkleTree[j + nSize].begin(), vMerkleTree[j].begin(), nPairs);
+        if (nSize % 2 == 1) {
+            // an odd hash out is paired with itself
+            const uint256& last = vMerkleTree[j + nSize - 1];
+            vMerkleTree[j + nSize + nPairs] = Hash(last.begin(), last.end(), last.begin(), last.end());
         }
         j += nSize;
     }
@@ -107,6 +107,280 @@ public:
     }
 };
 
+/**
+ * The transactions that CreateNewBlock selected from the memory pool on top of a block, with the state
+ * of validating them. While the tip stays the same, the next call reuses them as they are if the memory
+ * pool didn't change, and only validates the transactions that entered it since otherwise.
+ */
+struct BlockTxSelection
+{
+    uint256      hashPrevBlock;
+    unsigned int nTransactionsUpdated = 0; // of the memory pool, when the selection was last updated
+    int64_t      nTimeStart           = 0; // when the selection was started from scratch
+
+    std::vector<CTransaction> vtx;
+    // the memory pool transactions that were included, or can't be on top of this block; the others,
+    // which were skipped for reasons that may go away, like the size limits, a timestamp or a missing
+    // parent, are looked at again
+    std::set<uint256>         setConsidered;
+    uint64_t                  nBlockSize   = 1000;
+    uint64_t                  nBlockTx     = 0;
+    int                       nBlockSigOps = 100;
+    int64_t                   nFees        = 0;
+
+    map<uint256, CTxIndex>                                              mapTestPool;
+    map<uint256, std::vector<std::pair<CTransaction, NTP1Transaction>>> mapQueuedNTP1Inputs;
+
+    // map of issued token names in the selection vs token hashes
+    // this is used to prevent duplicate token names
+    std::unordered_map<std::string, uint256> issuedTokensSymbols;
+};
+
+// a selection is started from scratch at least this often, in seconds, so that the transactions that
+// came later get their place by priority and fee
+static const int64_t BLOCK_TX_SELECTION_MAX_AGE = 60;
+
+struct BlockSizePolicy
+{
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    int64_t      nMinTxFee;
+};
+
+// adds to the selection the transactions of the memory pool that it didn't look at yet
+static void AddMempoolTransactions(BlockTxSelection& sel, const CTxMemPool& mempool_, CTxDB& txdb,
+                                   const ConstCBlockIndexSmartPtr& pindexPrev,
+                                   const BlockSizePolicy& policy, int64_t nMaxTxTime)
+{
+    AssertLockHeld(mempool_.cs);
+
+    // Priority order to process transactions
+    list<COrphan>                  vOrphan; // list memory doesn't move
+    map<uint256, vector<COrphan*>> mapDependers;
+
+    // This vector will be sorted into a priority queue:
+    vector<TxPriority> vecPriority;
+    vecPriority.reserve(mempool_.mapTx.size());
+    for (const CTxMemPoolEntry& entry : mempool_.mapTx) {
+        if (sel.setConsidered.count(entry.GetHash()))
+            continue;
+
+        const CTransaction& tx = entry.GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake()) {
+            sel.setConsidered.insert(entry.GetHash());
+            continue;
+        }
+        // a lock time may still pass
+        if (!IsFinalTx(tx, pindexPrev->nHeight + 1))
+            continue;
+
+        // the values and confirmations of the inputs are in the entry; only the inputs that are
+        // still in the memory pool have to be looked at, because they have to be included first
+        COrphan* porphan = nullptr;
+        for (const CTxIn& txin : tx.vin) {
+            if (mempool_.mapTx.find(txin.prevout.hash) == mempool_.mapTx.end() ||
+                sel.mapTestPool.count(txin.prevout.hash)) {
+                continue;
+            }
+
+            // Has to wait for dependencies
+            if (!porphan) {
+                // Use list for automatic deletion
+                vOrphan.push_back(COrphan(&tx));
+                porphan = &vOrphan.back();
+            }
+            mapDependers[txin.prevout.hash].push_back(porphan);
+            porphan->setDependsOn.insert(txin.prevout.hash);
+        }
+
+        // Priority is sum(valuein * age) / txsize
+        const double dPriority = entry.GetPriority(pindexPrev->nHeight);
+
+        // This is a more accurate fee-per-kilobyte than is used by the client code, because the
+        // client code rounds up the size to the nearest 1K. That's good, because it gives an
+        // incentive to create smaller transactions.
+        const double dFeePerKb = entry.GetFeeRate();
+
+        if (porphan) {
+            porphan->dPriority = dPriority;
+            porphan->dFeePerKb = dFeePerKb;
+        } else
+            vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &tx));
+    }
+
+    // Collect transactions into block
+    bool fSortedByFee = (policy.nBlockPrioritySize <= 0);
+
+    TxPriorityCompare comparer(fSortedByFee);
+    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+    while (!vecPriority.empty()) {
+        // Take highest priority transaction off the priority queue:
+        double              dPriority = vecPriority.front().get<0>();
+        double              dFeePerKb = vecPriority.front().get<1>();
+        const CTransaction& tx        = *(vecPriority.front().get<2>());
+
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        vecPriority.pop_back();
+
+        // Size limits
+        unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (sel.nBlockSize + nTxSize >= policy.nBlockMaxSize)
+            continue;
+
+        // Legacy limits on sigOps:
+        unsigned int nTxSigOps = tx.GetLegacySigOpCount();
+        if (sel.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            continue;
+
+        // Timestamp limit
+        if (tx.nTime > GetAdjustedTime() || tx.nTime > nMaxTxTime)
+            continue;
+
+        // Transaction fee
+        int64_t nMinFee = tx.GetMinFee(txdb, sel.nBlockSize, GMF_BLOCK);
+
+        // Skip free transactions if we're past the minimum block size:
+        if (fSortedByFee && (dFeePerKb < policy.nMinTxFee) &&
+            (sel.nBlockSize + nTxSize >= policy.nBlockMinSize))
+            continue;
+
+        // Prioritize by fee once past the priority size or we run out of high-priority
+        // transactions:
+        if (!fSortedByFee && ((sel.nBlockSize + nTxSize >= policy.nBlockPrioritySize) ||
+                              (dPriority < COIN * 144 / 250))) {
+            fSortedByFee = true;
+            comparer     = TxPriorityCompare(fSortedByFee);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        }
+
+        // Connecting shouldn't fail due to dependency on other memory pool transactions
+        // because we're already processing them in order of dependency
+        map<uint256, CTxIndex> mapTestPoolTmp(sel.mapTestPool);
+
+        std::vector<std::pair<CTransaction, NTP1Transaction>>               inputsTxs;
+        map<uint256, std::vector<std::pair<CTransaction, NTP1Transaction>>> mapQueuedNTP1InputsTmp(
+            sel.mapQueuedNTP1Inputs);
+
+        MapPrevTx mapInputs;
+        bool      fInvalid;
+        if (!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid)) {
+            // a missing input may still come, as a memory pool transaction that's added later
+            if (fInvalid)
+                sel.setConsidered.insert(tx.GetHash());
+            continue;
+        }
+
+        int64_t nTxFees = tx.GetValueIn(mapInputs) - tx.GetValueOut();
+        if (nTxFees < nMinFee)
+            continue;
+
+        nTxSigOps += tx.GetP2SHSigOpCount(mapInputs);
+        if (sel.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            continue;
+
+        try {
+            if (NTP1Transaction::IsTxNTP1(&tx)) {
+                auto script = NTP1Transaction::ParseTxNTP1Script(tx);
+                if (script->getTxType() == NTP1Script::TxType_Issuance) {
+
+                    inputsTxs = NTP1Transaction::StdFetchedInputTxsToNTP1(
+                        tx, mapInputs, txdb, false, mapQueuedNTP1InputsTmp, mapTestPoolTmp);
+
+                    NTP1Transaction ntp1tx;
+                    ntp1tx.readNTP1DataFromTx(tx, inputsTxs);
+                    AssertNTP1TokenNameIsNotAlreadyInMainChain(ntp1tx, txdb);
+                    if (ntp1tx.getTxType() == NTP1TxType_ISSUANCE) {
+                        std::string currSymbol = ntp1tx.getTokenSymbolIfIssuance();
+                        // make sure that case doesn't matter by converting to upper case
+                        std::transform(currSymbol.begin(), currSymbol.end(), currSymbol.begin(),
+                                       ::toupper);
+                        if (sel.issuedTokensSymbols.find(currSymbol) != sel.issuedTokensSymbols.end()) {
+                            throw std::runtime_error("The token name " + currSymbol +
+                                                     " already exists in this block (while mining). "
+                                                     "Skipping this transaction.");
+                        }
+                        sel.issuedTokensSymbols.insert(std::make_pair(currSymbol, ntp1tx.getTxHash()));
+                    }
+                }
+            }
+        } catch (std::exception& ex) {
+            printf("Error while mining and verifying the uniqueness of issued token symbol in "
+                   "CreateNewBlock(): "
+                   "%s\n",
+                   ex.what());
+            sel.setConsidered.insert(tx.GetHash());
+            continue;
+        } catch (...) {
+            printf("Error while mining and verifying the uniqueness of issued token symbol in "
+                   "CreateNewBlock(). "
+                   "Unknown exception thrown\n");
+            sel.setConsidered.insert(tx.GetHash());
+            continue;
+        }
+
+        if (tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1, 1), pindexPrev, false, true)
+                .isErr()) {
+            sel.setConsidered.insert(tx.GetHash());
+            continue;
+        }
+
+        mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1, 1), tx.vout.size());
+        swap(sel.mapTestPool, mapTestPoolTmp);
+        mapQueuedNTP1InputsTmp[tx.GetHash()] = inputsTxs;
+        swap(sel.mapQueuedNTP1Inputs, mapQueuedNTP1InputsTmp);
+
+        // Added
+        sel.vtx.push_back(tx);
+        sel.setConsidered.insert(tx.GetHash());
+        sel.nBlockSize += nTxSize;
+        ++sel.nBlockTx;
+        sel.nBlockSigOps += nTxSigOps;
+        sel.nFees += nTxFees;
+
+        if (fDebug) {
+            printf("priority %.1f feeperkb %.1f txid %s\n", dPriority, dFeePerKb,
+                   tx.GetHash().ToString().c_str());
+        }
+
+        // Add transactions that depend on this one to the priority queue
+        uint256 hash = tx.GetHash();
+        if (mapDependers.count(hash)) {
+            for (COrphan* porphan : mapDependers[hash]) {
+                if (!porphan->setDependsOn.empty()) {
+                    porphan->setDependsOn.erase(hash);
+                    if (porphan->setDependsOn.empty()) {
+                        vecPriority.push_back(
+                            TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
+                        std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// whether the selection can be built upon for a new block on top of pindexPrev
+static bool IsSelectionReusable(const BlockTxSelection& sel, const CTxMemPool& mempool_,
+                                const ConstCBlockIndexSmartPtr& pindexPrev)
+{
+    if (sel.hashPrevBlock != pindexPrev->GetBlockHash() ||
+        GetTime() - sel.nTimeStart > BLOCK_TX_SELECTION_MAX_AGE) {
+        return false;
+    }
+    if (sel.nTransactionsUpdated == nTransactionsUpdated) {
+        return true;
+    }
+    // transactions that left the memory pool may have been replaced or conflicted
+    for (const CTransaction& tx : sel.vtx) {
+        if (mempool_.mapTx.find(tx.GetHash()) == mempool_.mapTx.end()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // CreateNewBlock: create new block (without proof-of-work/proof-of-stake)
 std::unique_ptr<CBlock> CreateNewBlock(CWallet* pwallet, bool fProofOfStake, int64_t* pFees,
                                        const boost::optional<CBitcoinAddress>& PoWDestination)
@@ -186,244 +460,41 @@ std::unique_ptr<CBlock> CreateNewBlock(CWallet* pwallet, bool fProofOfStake, int
 
     pblock->nBits = GetNextTargetRequired(pindexPrev.get(), fProofOfStake);
 
-    // map of issued token names in this block vs token hashes
-    // this is used to prevent duplicate token names
-    std::unordered_map<std::string, uint256> issuedTokensSymbolsInThisBlock;
-
     // Collect memory pool transactions into the block
     int64_t nFees = 0;
     {
         const CTxMemPool& mempool_ = ::mempool;
         LOCK2(cs_main, mempool_.cs);
 
-        // Priority order to process transactions
-        list<COrphan>                  vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*>> mapDependers;
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool_.mapTx.size());
-        for (map<uint256, CTransaction>::const_iterator mi = mempool_.mapTx.cbegin();
-             mi != mempool_.mapTx.cend(); ++mi) {
-            const CTransaction& tx = (*mi).second;
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, pindexPrev->nHeight + 1))
-                continue;
-
-            COrphan* porphan        = nullptr;
-            double   dPriority      = 0;
-            int64_t  nTotalIn       = 0;
-            bool     fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                CTransaction txPrev;
-                CTxIndex     txindex;
-                if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    const auto txIt = mempool_.mapTx.find(txin.prevout.hash);
-                    if (txIt == mempool_.mapTx.cend()) {
-                        printf("ERROR: mempool transaction missing input\n");
-                        if (fDebug)
-                            assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += txIt->second.vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = txindex.GetDepthInMainChain(txdb);
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs)
-                continue;
-
-            // Priority is sum(valuein * age) / txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority /= nTxSize;
-
-            // This is a more accurate fee-per-kilobyte than is used by the client code, because the
-            // client code rounds up the size to the nearest 1K. That's good, because it gives an
-            // incentive to create smaller transactions.
-            double dFeePerKb = double(nTotalIn - tx.GetValueOut()) / (double(nTxSize) / 1000.0);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->dFeePerKb = dFeePerKb;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
+        // one for proof-of-work and one for proof-of-stake blocks, guarded by cs_main
+        static BlockTxSelection selections[2];
+        BlockTxSelection&       sel    = selections[fProofOfStake ? 1 : 0];
+        const bool              fReuse = IsSelectionReusable(sel, mempool_, pindexPrev);
+        if (!fReuse) {
+            sel               = BlockTxSelection();
+            sel.hashPrevBlock = pindexPrev->GetBlockHash();
+            sel.nTimeStart    = GetTime();
+        } else if (fDebug) {
+            printf("CreateNewBlock(): reusing the %" PRIu64 " transactions selected before\n",
+                   sel.nBlockTx);
         }
+        if (!fReuse || sel.nTransactionsUpdated != nTransactionsUpdated) {
+            sel.nTransactionsUpdated = nTransactionsUpdated;
 
-        // Collect transactions into block
-        map<uint256, CTxIndex> mapTestPool;
-        uint64_t               nBlockSize   = 1000;
-        uint64_t               nBlockTx     = 0;
-        int                    nBlockSigOps = 100;
-        bool                   fSortedByFee = (nBlockPrioritySize <= 0);
-
-        map<uint256, std::vector<std::pair<CTransaction, NTP1Transaction>>> mapQueuedNTP1Inputs;
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double              dPriority = vecPriority.front().get<0>();
-            double              dFeePerKb = vecPriority.front().get<1>();
-            const CTransaction& tx        = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = tx.GetLegacySigOpCount();
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Timestamp limit
-            if (tx.nTime > GetAdjustedTime() || (fProofOfStake && tx.nTime > pblock->vtx[0].nTime))
-                continue;
-
-            // Transaction fee
-            int64_t nMinFee = tx.GetMinFee(txdb, nBlockSize, GMF_BLOCK);
-
-            // Skip free transactions if we're past the minimum block size:
-            if (fSortedByFee && (dFeePerKb < nMinTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritize by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || (dPriority < COIN * 144 / 250))) {
-                fSortedByFee = true;
-                comparer     = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            // Connecting shouldn't fail due to dependency on other memory pool transactions
-            // because we're already processing them in order of dependency
-            map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
-
-            std::vector<std::pair<CTransaction, NTP1Transaction>>               inputsTxs;
-            map<uint256, std::vector<std::pair<CTransaction, NTP1Transaction>>> mapQueuedNTP1InputsTmp(
-                mapQueuedNTP1Inputs);
-
-            MapPrevTx mapInputs;
-            bool      fInvalid;
-            if (!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
-                continue;
-
-            int64_t nTxFees = tx.GetValueIn(mapInputs) - tx.GetValueOut();
-            if (nTxFees < nMinFee)
-                continue;
-
-            nTxSigOps += tx.GetP2SHSigOpCount(mapInputs);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            try {
-                std::string opRet;
-                if (NTP1Transaction::IsTxNTP1(&tx, &opRet)) {
-                    auto script = NTP1Script::ParseScript(opRet);
-                    if (script->getTxType() == NTP1Script::TxType_Issuance) {
-
-                        inputsTxs = NTP1Transaction::StdFetchedInputTxsToNTP1(
-                            tx, mapInputs, txdb, false, mapQueuedNTP1InputsTmp, mapTestPoolTmp);
-
-                        NTP1Transaction ntp1tx;
-                        ntp1tx.readNTP1DataFromTx(tx, inputsTxs);
-                        AssertNTP1TokenNameIsNotAlreadyInMainChain(ntp1tx, txdb);
-                        if (ntp1tx.getTxType() == NTP1TxType_ISSUANCE) {
-                            std::string currSymbol = ntp1tx.getTokenSymbolIfIssuance();
-                            // make sure that case doesn't matter by converting to upper case
-                            std::transform(currSymbol.begin(), currSymbol.end(), currSymbol.begin(),
-                                           ::toupper);
-                            if (issuedTokensSymbolsInThisBlock.find(currSymbol) !=
-                                issuedTokensSymbolsInThisBlock.end()) {
-                                throw std::runtime_error("The token name " + currSymbol +
-                                                         " already exists in this block (while mining). "
-                                                         "Skipping this transaction.");
-                            }
-                            issuedTokensSymbolsInThisBlock.insert(
-                                std::make_pair(currSymbol, ntp1tx.getTxHash()));
-                        }
-                    }
-                }
-            } catch (std::exception& ex) {
-                printf("Error while mining and verifying the uniqueness of issued token symbol in "
-                       "CreateNewBlock(): "
-                       "%s\n",
-                       ex.what());
-                continue;
-            } catch (...) {
-                printf("Error while mining and verifying the uniqueness of issued token symbol in "
-                       "CreateNewBlock(). "
-                       "Unknown exception thrown\n");
-                continue;
-            }
-
-            if (tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1, 1), pindexPrev, false,
-                                 true)
-                    .isErr())
-                continue;
-
-            mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1, 1), tx.vout.size());
-            swap(mapTestPool, mapTestPoolTmp);
-            mapQueuedNTP1InputsTmp[tx.GetHash()] = inputsTxs;
-            swap(mapQueuedNTP1Inputs, mapQueuedNTP1InputsTmp);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fDebug) {
-                printf("priority %.1f feeperkb %.1f txid %s\n", dPriority, dFeePerKb,
-                       tx.GetHash().ToString().c_str());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            uint256 hash = tx.GetHash();
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(
-                                TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
+            const BlockSizePolicy policy{nBlockMaxSize, nBlockPrioritySize, nBlockMinSize, nMinTxFee};
+            const int64_t         nMaxTxTime =
+                fProofOfStake ? pblock->vtx[0].nTime : std::numeric_limits<int64_t>::max();
+            AddMempoolTransactions(sel, mempool_, txdb, pindexPrev, policy, nMaxTxTime);
         }
 
-        nLastBlockTx   = nBlockTx;
-        nLastBlockSize = nBlockSize;
+        pblock->vtx.insert(pblock->vtx.end(), sel.vtx.cbegin(), sel.vtx.cend());
+        nFees = sel.nFees;
+
+        nLastBlockTx   = sel.nBlockTx;
+        nLastBlockSize = sel.nBlockSize;
 
         if (fDebug)
-            printf("CreateNewBlock(): total size %" PRIu64 "\n", nBlockSize);
+            printf("CreateNewBlock(): total size %" PRIu64 "\n", sel.nBlockSize);
 
         if (!fProofOfStake)
             pblock->vtx[0].vout[0].nValue = GetProofOfWorkReward(nFees);
@@ -553,7 +624,7 @@ bool CheckStake(CBlock* pblock, CWallet& wallet)
         return error("CheckStake() : %s is not a proof-of-stake block", hashBlock.GetHex().c_str());
 
     // verify hash target and signature of coinstake tx
-    if (!CheckProofOfStake(pblock->vtx[1], pblock->nBits, proofHash, hashTarget))
+    if (!CheckProofOfStake(CTxDB(), pblock->vtx[1], pblock->nBits, proofHash, hashTarget))
         return error("CheckStake() : proof-of-stake checking failed");
 
     //// debug print
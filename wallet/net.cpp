@@ -5,10 +5,12 @@
 
 #include "net.h"
 #include "addrman.h"
+#include "blockdownload.h"
 #include "db.h"
 #include "globals.h"
 #include "init.h"
 #include "main.h"
+#include "socketevents.h"
 #include "ui_interface.h"
 
 #include <chrono>
@@ -75,6 +77,13 @@ CCriticalSection     cs_vOneShots;
 
 static CSemaphore* semOutbound = nullptr;
 
+CSocketEvents& GetSocketEvents()
+{
+    static CSocketEvents events(GetArg("-socketevents", "") == "poll" ? CSocketEvents::BACKEND_POLL
+                                                                      : CSocketEvents::DefaultBackend());
+    return events;
+}
+
 void AddOneShot(string strDest)
 {
     LOCK(cs_vOneShots);
@@ -474,6 +483,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest)
         CNode* pnode = new CNode(NodeIDCounter++, hSocket, addrConnect, pszDest ? pszDest : "", false);
         pnode->AddRef();
 
+        GetSocketEvents().Add(hSocket, pnode);
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
@@ -491,6 +501,7 @@ void CNode::CloseSocketDisconnect()
     fDisconnect = true;
     if (hSocket != INVALID_SOCKET) {
         printf("disconnecting node %s\n", addrName.get().c_str());
+        GetSocketEvents().Remove(hSocket);
         closesocket(hSocket);
         hSocket = INVALID_SOCKET;
 
@@ -501,6 +512,22 @@ void CNode::CloseSocketDisconnect()
     }
 }
 
+CSerializeData CNode::MakeRawMessage(const char* pszCommand, const char* pbegin, const char* pend)
+{
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, static_cast<unsigned int>(pend - pbegin));
+    const uint256  hash = Hash(pbegin, pend);
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(CMessageHeader::HEADER_SIZE + (pend - pbegin));
+    ss << hdr;
+    ss.write(pbegin, pend - pbegin);
+
+    CSerializeData msg;
+    ss.GetAndClear(msg);
+    return msg;
+}
+
 void CNode::PushVersion()
 {
     /// when NTP implemented, change to just nTime = GetAdjustedTime()
@@ -576,9 +603,22 @@ void CNode::copyStats(CNodeStats& stats)
     X(fInbound);
     X(nStartingHeight);
     X(nMisbehavior);
+    {
+        LOCK(cs_mapRecvPerCommand);
+        X(mapRecvPerCommand);
+    }
 }
 #undef X
 
+void CNode::RecordRecvMessage(const std::string& strCommand, unsigned int nBytes, int64_t nTimeMicros)
+{
+    LOCK(cs_mapRecvPerCommand);
+    CMessageCommandStats& stats = mapRecvPerCommand[strCommand];
+    stats.nMessages++;
+    stats.nBytes += nBytes;
+    stats.nTimeMicros += nTimeMicros;
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 {
@@ -633,6 +673,8 @@ int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
 
     // switch state to reading message data
     in_data = true;
+    if (hdr.nMessageSize == 0)
+        finishChecksum();
 
     return nCopy;
 }
@@ -648,11 +690,22 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
     }
 
     memcpy(&vRecv[nDataPos], pch, nCopy);
+    hasher.Write((const unsigned char*)pch, nCopy);
     nDataPos += nCopy;
+    if (complete())
+        finishChecksum();
 
     return nCopy;
 }
 
+void CNetMessage::finishChecksum()
+{
+    uint256 hash;
+    hasher.Finalize((unsigned char*)&hash);
+    CSHA256().Write((const unsigned char*)&hash, sizeof(hash)).Finalize((unsigned char*)&hash);
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+}
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
@@ -694,6 +747,10 @@ void SocketSendData(CNode* pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+    // what's left is sent when the socket has room, which wakes the socket handler
+    if (pnode->hSocket != INVALID_SOCKET)
+        GetSocketEvents().SetWantSend(pnode->hSocket, !pnode->vSendMsg.empty());
 }
 
 void ThreadSocketHandler(void* parg)
@@ -715,265 +772,284 @@ void ThreadSocketHandler(void* parg)
     printf("ThreadSocketHandler exited\n");
 }
 
+// Accepts the pending connections of the listening socket
+static void AcceptConnections(SOCKET hListenSocket)
+{
+    int nInbound = 0;
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    // the listening socket is non-blocking, and every connection has to be taken for the next one to
+    // be reported with epoll
+    while (true) {
+        struct sockaddr_storage sockaddr;
+        socklen_t               len     = sizeof(sockaddr);
+        SOCKET                  hSocket = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
+        CAddress                addr;
+
+        if (hSocket == INVALID_SOCKET) {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEWOULDBLOCK)
+                printf("socket error accept failed: %d\n", nErr);
+            break;
+        }
+        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+            printf("Warning: Unknown socket family\n");
+
+        if (nInbound >= GetArg("-maxconnections", 125) - MAX_OUTBOUND_CONNECTIONS) {
+            closesocket(hSocket);
+        } else if (CNode::IsBanned(addr)) {
+            printf("connection from %s dropped (banned)\n", addr.ToString().c_str());
+            closesocket(hSocket);
+        } else {
+            printf("accepted connection %s\n", addr.ToString().c_str());
+            CNode* pnode = new CNode(NodeIDCounter++, hSocket, addr, "", true);
+            pnode->AddRef();
+            GetSocketEvents().Add(hSocket, pnode);
+            {
+                LOCK(cs_vNodes);
+                vNodes.push_back(pnode);
+            }
+            nInbound++;
+        }
+    }
+}
+
+// Reads what arrived on the socket of the node, up to nMaxReads buffers. Returns false if there may be
+// more to read, because the node was busy or the limit was reached.
+static bool SocketRecvData(CNode* pnode, int nMaxReads)
+{
+    {
+        // do not read, if draining write queue
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (!lockSend || !pnode->vSendMsg.empty())
+            return false;
+    }
+
+    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+    if (!lockRecv)
+        return false;
+
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    for (int i = 0; i < nMaxReads; i++) {
+        if (pnode->hSocket == INVALID_SOCKET)
+            return true;
+        if (pnode->GetTotalRecvSize() > ReceiveFloodSize()) {
+            if (!pnode->fDisconnect)
+                printf("socket recv flood control disconnect (%u bytes)\n", pnode->GetTotalRecvSize());
+            pnode->CloseSocketDisconnect();
+            return true;
+        }
+
+        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        if (nBytes > 0) {
+            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes)) {
+                pnode->CloseSocketDisconnect();
+                return true;
+            }
+            pnode->nLastRecv = GetTime();
+            // a short read emptied the socket
+            if (nBytes < static_cast<int>(sizeof(pchBuf)))
+                return true;
+        } else if (nBytes == 0) {
+            // socket closed gracefully
+            if (!pnode->fDisconnect)
+                printf("socket closed\n");
+            pnode->CloseSocketDisconnect();
+            return true;
+        } else {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR &&
+                nErr != WSAEINPROGRESS) {
+                if (!pnode->fDisconnect)
+                    printf("socket recv error %d\n", nErr);
+                pnode->CloseSocketDisconnect();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
 void ThreadSocketHandler2(void* /*parg*/)
 {
     printf("ThreadSocketHandler started\n");
     list<CNode*> vNodesDisconnected;
     unsigned int nPrevNodeCount = 0;
 
+    CSocketEvents& events = GetSocketEvents();
+    printf("ThreadSocketHandler waits for sockets with %s\n", events.GetBackendName());
+    for (SOCKET hListenSocket : vhListenSocket)
+        if (hListenSocket != INVALID_SOCKET)
+            events.Add(hListenSocket, nullptr);
+
+    // With epoll, a socket is only reported again when more data or room to send arrives, so the nodes
+    // that couldn't be served in full are served again after the next wait
+    const bool  fEdgeTriggered = events.GetBackend() == CSocketEvents::BACKEND_EPOLL;
+    const int   nMaxReads      = fEdgeTriggered ? 4 : 1;
+    set<CNode*> setPendingRecv;
+    set<CNode*> setPendingSend;
+    int64_t     nLastNodeCheck = 0;
+
+    vector<CSocketEvents::Event> vEvents;
+
     while (true) {
-        //
-        // Disconnect nodes
-        //
-        {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-                if (pnode->fDisconnect || (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() &&
-                                           pnode->nSendSize == 0 && pnode->ssSend.empty())) {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
-
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
-
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+        // the nodes are checked at the rate at which the sockets used to be polled
+        if (GetTimeMillis() - nLastNodeCheck >= 100) {
+            nLastNodeCheck = GetTimeMillis();
+
+            //
+            // Disconnect nodes
+            //
+            {
+                LOCK(cs_vNodes);
+                // Disconnect unused nodes
+                vector<CNode*> vNodesCopy = vNodes;
+                BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+                    if (pnode->fDisconnect ||
+                        (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 &&
+                         pnode->ssSend.empty())) {
+                        // remove from vNodes
+                        vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                        setPendingRecv.erase(pnode);
+                        setPendingSend.erase(pnode);
+
+                        // release the blocks it was to send
+                        blockDownload.PeerDisconnected(pnode->nodeid);
+
+                        // release outbound grant (if any)
+                        pnode->grantOutbound.Release();
+
+                        // close socket and cleanup
+                        pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
+                        // hold in disconnected pool until all refs are released
+                        if (pnode->fNetworkNode || pnode->fInbound)
+                            pnode->Release();
+                        vNodesDisconnected.push_back(pnode);
+                    }
                 }
-            }
 
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH (CNode* pnode, vNodesDisconnectedCopy) {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0) {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK4(pnode->cs_vSend, pnode->cs_vRecvMsg, pnode->cs_mapRequests, pnode->cs_inventory, lock);
-                        if (lock) {
-                            fDelete = true;
+                // Delete disconnected nodes
+                list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+                BOOST_FOREACH (CNode* pnode, vNodesDisconnectedCopy) {
+                    // wait until threads are done using it
+                    if (pnode->GetRefCount() <= 0) {
+                        bool fDelete = false;
+                        {
+                            TRY_LOCK4(pnode->cs_vSend, pnode->cs_vRecvMsg, pnode->cs_mapRequests, pnode->cs_inventory, lock);
+                            if (lock) {
+                                fDelete = true;
+                            }
+                        }
+                        if (fDelete) {
+                            vNodesDisconnected.remove(pnode);
+                            delete pnode;
                         }
-                    }
-                    if (fDelete) {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
                     }
                 }
             }
-        }
-        std::size_t vNodesSize = 0;
-        {
-            LOCK(cs_vNodes);
-            vNodesSize = vNodes.size();
-        }
-        if (vNodesSize != nPrevNodeCount) {
-            nPrevNodeCount = vNodesSize;
-            uiInterface.NotifyNumConnectionsChanged(vNodesSize);
-        }
+            std::size_t vNodesSize = 0;
+            {
+                LOCK(cs_vNodes);
+                vNodesSize = vNodes.size();
+            }
+            if (vNodesSize != nPrevNodeCount) {
+                nPrevNodeCount = vNodesSize;
+                uiInterface.NotifyNumConnectionsChanged(vNodesSize);
+            }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool   have_fds   = false;
-
-        BOOST_FOREACH (SOCKET hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket);
-            have_fds   = true;
-        }
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend) {
-                        // do not read, if draining write queue
-                        if (!pnode->vSendMsg.empty())
-                            FD_SET(pnode->hSocket, &fdsetSend);
-                        else
-                            FD_SET(pnode->hSocket, &fdsetRecv);
-                        FD_SET(pnode->hSocket, &fdsetError);
-                        hSocketMax = max(hSocketMax, pnode->hSocket);
-                        have_fds   = true;
+            //
+            // Inactivity checking
+            //
+            {
+                LOCK(cs_vNodes);
+                for (CNode* pnode : vNodes) {
+                    if (pnode->hSocket == INVALID_SOCKET)
+                        continue;
+                    {
+                        TRY_LOCK(pnode->cs_vSend, lockSend);
+                        if (lockSend && pnode->vSendMsg.empty())
+                            pnode->nLastSendEmpty = GetTime();
+                    }
+                    if (GetTime() - pnode->nTimeConnected > 60) {
+                        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+                            printf("socket no message in first 60 seconds, %d %d\n",
+                                   pnode->nLastRecv != 0, pnode->nLastSend != 0);
+                            pnode->fDisconnect = true;
+                        } else if (GetTime() - pnode->nLastSend > 90 * 60 &&
+                                   GetTime() - pnode->nLastSendEmpty > 90 * 60) {
+                            printf("socket not sending\n");
+                            pnode->fDisconnect = true;
+                        } else if (GetTime() - pnode->nLastRecv > 90 * 60) {
+                            printf("socket inactivity timeout\n");
+                            pnode->fDisconnect = true;
+                        }
                     }
                 }
             }
         }
 
+        //
+        // Wait for the sockets; messages queued for sending wake the wait
+        //
+        const bool fPending = !setPendingRecv.empty() || !setPendingSend.empty();
         vnThreadsRunning[THREAD_SOCKETHANDLER]--;
-        int nSelect =
-            select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        const bool fWaited = events.Wait(vEvents, fPending ? 10 : 100);
         vnThreadsRunning[THREAD_SOCKETHANDLER]++;
         if (fShutdown)
             return;
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                printf("socket select error %d\n", nErr);
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+        if (!fWaited)
+            MilliSleep(50);
+
+        // the nodes are only deleted by this thread, after their socket was removed from the events
+        for (const CSocketEvents::Event& event : vEvents) {
+            if (!event.pdata) {
+                if (event.fRecv)
+                    AcceptConnections(event.hSocket);
+                continue;
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
+            CNode* pnode = static_cast<CNode*>(event.pdata);
+            if (event.fRecv)
+                setPendingRecv.insert(pnode);
+            if (event.fSend)
+                setPendingSend.insert(pnode);
         }
 
         //
-        // Accept new connections
+        // Service the sockets
         //
-        for (SOCKET hListenSocket : vhListenSocket)
-            if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv)) {
-                struct sockaddr_storage sockaddr;
-                socklen_t               len = sizeof(sockaddr);
-                SOCKET   hSocket            = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
-                CAddress addr;
-                int      nInbound = 0;
-
-                if (hSocket != INVALID_SOCKET)
-                    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                        printf("Warning: Unknown socket family\n");
+        vector<CNode*> vRecvNodes(setPendingRecv.begin(), setPendingRecv.end());
+        vector<CNode*> vSendNodes(setPendingSend.begin(), setPendingSend.end());
+        setPendingRecv.clear();
+        setPendingSend.clear();
 
-                {
-                    LOCK(cs_vNodes);
-                    BOOST_FOREACH (CNode* pnode, vNodes)
-                        if (pnode->fInbound)
-                            nInbound++;
-                }
-
-                if (hSocket == INVALID_SOCKET) {
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK)
-                        printf("socket error accept failed: %d\n", nErr);
-                } else if (nInbound >= GetArg("-maxconnections", 125) - MAX_OUTBOUND_CONNECTIONS) {
-                    closesocket(hSocket);
-                } else if (CNode::IsBanned(addr)) {
-                    printf("connection from %s dropped (banned)\n", addr.ToString().c_str());
-                    closesocket(hSocket);
-                } else {
-                    printf("accepted connection %s\n", addr.ToString().c_str());
-                    CNode* pnode = new CNode(NodeIDCounter++, hSocket, addr, "", true);
-                    pnode->AddRef();
-                    {
-                        LOCK(cs_vNodes);
-                        vNodes.push_back(pnode);
-                    }
-                }
-            }
-
-        //
-        // Service each socket
-        //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->AddRef();
-        }
-        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+        for (CNode* pnode : vSendNodes) {
             if (fShutdown)
                 return;
-
-            //
-            // Receive
-            //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    if (pnode->GetTotalRecvSize() > ReceiveFloodSize()) {
-                        if (!pnode->fDisconnect)
-                            printf("socket recv flood control disconnect (%u bytes)\n",
-                                   pnode->GetTotalRecvSize());
-                        pnode->CloseSocketDisconnect();
-                    } else {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int  nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                printf("socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR &&
-                                nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    printf("socket recv error %d\n", nErr);
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
-            }
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend)
+                SocketSendData(pnode);
+            else if (fEdgeTriggered)
+                setPendingSend.insert(pnode);
+        }
 
-            //
-            // Send
-            //
+        for (CNode* pnode : vRecvNodes) {
+            if (fShutdown)
+                return;
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
-                TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    SocketSendData(pnode);
-            }
-
-            //
-            // Inactivity checking
-            //
-            {
-                LOCK(pnode->cs_vSend);
-                if (pnode->vSendMsg.empty())
-                    pnode->nLastSendEmpty = GetTime();
-            }
-            if (GetTime() - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    printf("socket no message in first 60 seconds, %d %d\n", pnode->nLastRecv != 0,
-                           pnode->nLastSend != 0);
-                    pnode->fDisconnect = true;
-                } else if (GetTime() - pnode->nLastSend > 90 * 60 &&
-                           GetTime() - pnode->nLastSendEmpty > 90 * 60) {
-                    printf("socket not sending\n");
-                    pnode->fDisconnect = true;
-                } else if (GetTime() - pnode->nLastRecv > 90 * 60) {
-                    printf("socket inactivity timeout\n");
-                    pnode->fDisconnect = true;
-                }
-            }
+            if (!SocketRecvData(pnode, nMaxReads) && fEdgeTriggered)
+                setPendingRecv.insert(pnode);
         }
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->Release();
-        }
-
-        MilliSleep(10);
     }
 }
 
@@ -1848,6 +1924,10 @@ void StartNode(void* /*parg*/)
     if (!NewThread(ThreadMessageHandler, nullptr))
         printf("Error: NewThread(ThreadMessageHandler) failed\n");
 
+    // Validate the blocks and transactions that peers send
+    if (!NewThread(ThreadMessageValidation, nullptr))
+        printf("Error: NewThread(ThreadMessageValidation) failed\n");
+
     // Dump network addresses
     if (!NewThread(ThreadDumpAddress, nullptr))
         printf("Error; NewThread(ThreadDumpAddress) failed\n");
@@ -1900,7 +1980,10 @@ bool StopNode()
         printf("ThreadDumpAddresses still running\n");
     if (vnThreadsRunning[THREAD_STAKE_MINER] > 0)
         printf("ThreadStakeMiner still running\n");
-    while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0)
+    if (vnThreadsRunning[THREAD_MESSAGEVALIDATION] > 0)
+        printf("ThreadMessageValidation still running\n");
+    while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0 ||
+           vnThreadsRunning[THREAD_MESSAGEVALIDATION] > 0)
         MilliSleep(20);
 
     MilliSleep(50);
@@ -26,6 +26,7 @@
 
 class CRequestTracker;
 class CNode;
+class CSocketEvents;
 class CBlockIndex;
 
 inline unsigned int ReceiveFloodSize() { return 1000 * GetArg("-maxreceivebuffer", 5 * 1000); }
@@ -47,6 +48,9 @@ void           StartNode(void* parg);
 bool           StopNode();
 void           SocketSendData(CNode* pnode);
 
+/** The sockets of the nodes and the listening sockets, as watched by ThreadSocketHandler */
+CSocketEvents& GetSocketEvents();
+
 enum
 {
     LOCAL_NONE,   // unknown
@@ -114,6 +118,7 @@ enum threadId
     THREAD_RPCHANDLER,
     THREAD_STAKE_MINER,
     THREAD_IMPORT,
+    THREAD_MESSAGEVALIDATION,
 
     THREAD_MAX
 };
@@ -134,6 +139,14 @@ extern std::deque<std::pair<int64_t, CInv>> vRelayExpiration;
 extern CCriticalSection                     cs_mapRelay;
 extern ThreadSafeHashMap<CInv, int64_t>     mapAlreadyAskedFor;
 
+/** The messages of a command that were received from a peer */
+struct CMessageCommandStats
+{
+    uint64_t nMessages   = 0;
+    uint64_t nBytes      = 0; // with their headers
+    int64_t  nTimeMicros = 0; // spent handling them
+};
+
 class CNodeStats
 {
 public:
@@ -148,6 +161,8 @@ public:
     bool        fInbound;
     int         nStartingHeight;
     int         nMisbehavior;
+
+    std::map<std::string, CMessageCommandStats> mapRecvPerCommand;
 };
 
 class CNetMessage
@@ -162,13 +177,18 @@ public:
     CDataStream  vRecv; // received message data
     unsigned int nDataPos;
 
+    // the data is hashed as it arrives, so that the checksum is known when the message is complete
+    CSHA256      hasher;
+    unsigned int nChecksum;
+
     CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn)
         : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
-        in_data  = false;
-        nHdrPos  = 0;
-        nDataPos = 0;
+        in_data   = false;
+        nHdrPos   = 0;
+        nDataPos  = 0;
+        nChecksum = 0;
     }
 
     bool complete() const
@@ -186,6 +206,9 @@ public:
 
     int readHeader(const char* pch, unsigned int nBytes);
     int readData(const char* pch, unsigned int nBytes);
+
+private:
+    void finishChecksum();
 };
 
 /** Information about a peer */
@@ -205,6 +228,8 @@ public:
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection        cs_vRecvMsg;
     int                     nRecvVersion;
+    // the bytes of the messages that wait in the validation queue
+    boost::atomic<unsigned int> nValidationQueueSize;
 
     boost::atomic<int64_t> nLastSend;
     boost::atomic<int64_t> nLastRecv;
@@ -259,6 +284,10 @@ public:
     CCriticalSection             cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
 
+    // by command; unknown commands are counted as "*other*"
+    std::map<std::string, CMessageCommandStats> mapRecvPerCommand;
+    CCriticalSection                            cs_mapRecvPerCommand;
+
     CNode(int64_t nodeId, SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "",
           bool fInboundIn = false)
         : nodeid(nodeId), ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000)
@@ -266,6 +295,7 @@ public:
         nServices                = 0;
         hSocket                  = hSocketIn;
         nRecvVersion             = INIT_PROTO_VERSION;
+        nValidationQueueSize     = 0;
         nLastSend                = 0;
         nLastRecv                = 0;
         nLastSendEmpty           = GetTime();
@@ -322,10 +352,10 @@ public:
         return nRefCount;
     }
 
-    // requires LOCK(cs_vRecvMsg)
+    // requires LOCK(cs_vRecvMsg); includes the messages that were handed over for validation
     unsigned int GetTotalRecvSize()
     {
-        unsigned int total = 0;
+        unsigned int total = nValidationQueueSize;
         BOOST_FOREACH (const CNetMessage& msg, vRecvMsg)
             total += msg.vRecv.size() + 24;
         return total;
@@ -458,6 +488,25 @@ public:
         LEAVE_CRITICAL_SECTION(cs_vSend);
     }
 
+    /** Serializes a whole message, header and checksum included, around a payload that was serialized
+     * elsewhere, like a block read raw from the database */
+    static CSerializeData MakeRawMessage(const char* pszCommand, const char* pbegin, const char* pend);
+
+    /** Queues a message made by MakeRawMessage(), which can be sent to many nodes */
+    void PushRawMessage(const CSerializeData& msg)
+    {
+        LOCK(cs_vSend);
+        if (fDebug)
+            printf("sending: raw message (%" PRIszu " bytes)\n", msg.size());
+
+        std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), msg);
+        nSendSize += (*it).size();
+
+        // If write queue empty, attempt "optimistic write"
+        if (it == vSendMsg.begin())
+            SocketSendData(this);
+    }
+
     void PushVersion();
 
     void PushMessage(const char* pszCommand)
@@ -661,6 +710,8 @@ public:
     static bool IsBanned(CNetAddr ip);
     bool        Misbehaving(int howmuch); // 1 == a little, 100 == a lot
     void        copyStats(CNodeStats& stats);
+    void        RecordRecvMessage(const std::string& strCommand, unsigned int nBytes,
+                                  int64_t nTimeMicros);
 };
 
 inline void RelayInventory(const CInv& inv)
@@ -26,18 +26,21 @@ std::string NTP1Script::getOpCodeBin() const { return opCodeBin; }
 
 NTP1Script::TxType NTP1Script::getTxType() const { return txType; }
 
-std::string NTP1Script::getParsedScriptHex() const { return parsedScriptHex; }
+std::string NTP1Script::getParsedScriptHex() const
+{
+    return HexStr(parsedScriptBin.cbegin(), parsedScriptBin.cend());
+}
 
 int NTP1Script::getProtocolVersion() const { return protocolVersion; }
 
 void NTP1Script::setCommonParams(std::string Header, int ProtocolVersion, std::string OpCodeBin,
-                                 std::string scriptHex)
+                                 std::string scriptBin)
 {
     headerBin       = Header;
     protocolVersion = ProtocolVersion;
     opCodeBin       = OpCodeBin;
     txType          = CalculateTxType(opCodeBin);
-    parsedScriptHex = scriptHex;
+    parsedScriptBin = scriptBin;
 }
 
 void NTP1Script::setEnableOpReturnSizeCheck(bool value) { enableOpReturnSizeCheck = value; }
@@ -350,17 +353,29 @@ NTP1Script::ParseNTP1v3TransferInstructionsFromLongEnoughString(
 }
 
 std::shared_ptr<NTP1Script> NTP1Script::ParseScript(const std::string& scriptHex)
+{
+    std::string scriptBin;
+    try {
+        scriptBin = boost::algorithm::unhex(scriptHex);
+    } catch (std::exception& ex) {
+        throw std::runtime_error("Unable to parse hex script: " + scriptHex + "; reason: " + ex.what());
+    }
+    const unsigned char* scriptBegin = reinterpret_cast<const unsigned char*>(scriptBin.data());
+    return ParseScript(scriptBegin, scriptBegin + scriptBin.size());
+}
+
+std::shared_ptr<NTP1Script> NTP1Script::ParseScript(const unsigned char* scriptBegin,
+                                                    const unsigned char* scriptEnd)
 {
     try {
-        std::string scriptBin = boost::algorithm::unhex(scriptHex);
+        std::string scriptBin(scriptBegin, scriptEnd);
 
         if (scriptBin.size() < 3) {
             throw std::runtime_error("Too short script");
         }
-        std::string              header        = scriptBin.substr(0, 3);
-        static const std::string NTP1HexPrefix = "4e54";
-        if (header.substr(0, 2) != boost::algorithm::unhex(NTP1HexPrefix)) {
-            throw std::runtime_error("NTP1 script prefix is invalid for " + scriptHex);
+        std::string header = scriptBin.substr(0, 3);
+        if (header[0] != 0x4e || header[1] != 0x54) {
+            throw std::runtime_error("NTP1 script prefix is invalid");
         }
         int protocolVersion = static_cast<decltype(protocolVersion)>(static_cast<uint8_t>(header[2]));
 
@@ -374,8 +389,7 @@ std::shared_ptr<NTP1Script> NTP1Script::ParseScript(const std::string& scriptHex
         } else if (protocolVersion == 3) {
             txType = CalculateTxTypeNTP1v3(opCodeBin);
         } else {
-            throw std::runtime_error("Unknown protocol version " + ToString(protocolVersion) +
-                                     " in script: " + scriptHex);
+            throw std::runtime_error("Unknown protocol version " + ToString(protocolVersion));
         }
         // drop the OP_CODE parsed part
         scriptBin.erase(scriptBin.begin(), scriptBin.begin() + opCodeBin.size());
@@ -385,39 +399,32 @@ std::shared_ptr<NTP1Script> NTP1Script::ParseScript(const std::string& scriptHex
         if (txType == TxType::TxType_Issuance) {
             if (protocolVersion == 1) {
                 result_ = NTP1Script_Issuance::ParseNTP1v1IssuancePostHeaderData(scriptBin, opCodeBin);
-            } else if (protocolVersion == 3) {
-                result_ = NTP1Script_Issuance::ParseNTP1v3IssuancePostHeaderData(scriptBin);
             } else {
-                throw std::runtime_error("Unknown protocol version " + ToString(protocolVersion) +
-                                         " in script: " + scriptHex);
+                result_ = NTP1Script_Issuance::ParseNTP1v3IssuancePostHeaderData(scriptBin);
             }
         } else if (txType == TxType::TxType_Transfer) {
             if (protocolVersion == 1) {
                 result_ = NTP1Script_Transfer::ParseNTP1v1TransferPostHeaderData(scriptBin, opCodeBin);
-            } else if (protocolVersion == 3) {
-                result_ = NTP1Script_Transfer::ParseNTP1v3TransferPostHeaderData(scriptBin);
             } else {
-                throw std::runtime_error("Unknown protocol version " + ToString(protocolVersion) +
-                                         " in script: " + scriptHex);
+                result_ = NTP1Script_Transfer::ParseNTP1v3TransferPostHeaderData(scriptBin);
             }
         } else if (txType == TxType::TxType_Burn) {
             if (protocolVersion == 1) {
                 result_ = NTP1Script_Burn::ParseNTP1v1BurnPostHeaderData(scriptBin, opCodeBin);
-            } else if (protocolVersion == 3) {
-                result_ = NTP1Script_Burn::ParseNTP1v3BurnPostHeaderData(scriptBin);
             } else {
-                throw std::runtime_error("Unknown protocol version " + ToString(protocolVersion) +
-                                         " in script: " + scriptHex);
+                result_ = NTP1Script_Burn::ParseNTP1v3BurnPostHeaderData(scriptBin);
             }
         } else {
-            throw std::runtime_error("Unknown transaction type to parse in script: " + scriptHex);
+            throw std::runtime_error("Unknown transaction type to parse");
         }
-        result_->setCommonParams(header, protocolVersion, opCodeBin, scriptHex);
+        result_->setCommonParams(header, protocolVersion, opCodeBin,
+                                 std::string(scriptBegin, scriptEnd));
 
         return result_;
 
     } catch (std::exception& ex) {
-        throw std::runtime_error("Unable to parse hex script: " + scriptHex + "; reason: " + ex.what());
+        throw std::runtime_error("Unable to parse hex script: " + HexStr(scriptBegin, scriptEnd) +
+                                 "; reason: " + ex.what());
     }
 }
 
@@ -65,7 +65,7 @@ struct RawNTP1MetadataBeforeSend
 
 class NTP1Script
 {
-    std::string parsedScriptHex;
+    std::string parsedScriptBin;
 
 public:
     enum TxType
@@ -85,7 +85,7 @@ protected:
     bool   enableOpReturnSizeCheck = true;
 
     void setCommonParams(std::string Header, int ProtocolVersion, std::string OpCodeBin,
-                         std::string scriptHex);
+                         std::string scriptBin);
 
 public:
     void setEnableOpReturnSizeCheck(bool value = true);
@@ -198,6 +198,9 @@ public:
     TxType      getTxType() const;
 
     static std::shared_ptr<NTP1Script> ParseScript(const std::string& scriptHex);
+    /** Parses the binary script in [scriptBegin, scriptEnd), like the data of an NTP1 OP_RETURN */
+    static std::shared_ptr<NTP1Script> ParseScript(const unsigned char* scriptBegin,
+                                                   const unsigned char* scriptEnd);
     std::string                        getParsedScriptHex() const;
     int                                getProtocolVersion() const;
 
@@ -20,6 +20,58 @@ const boost::regex NTP1OpReturnRegex(NTP1OpReturnRegexStr);
 const std::string  OpReturnRegexStr = R"(^OP_RETURN\s+(.*)$)";
 const boost::regex OpReturnRegex(OpReturnRegexStr);
 
+namespace {
+
+/** Where the data of an NTP1 OP_RETURN output starts in its script, or end() if the script isn't one.
+ * This matches the same scripts as NTP1OpReturnRegex does on CScript::ToString(): OP_RETURN followed
+ * by a single push of more than 4 bytes (ToString() shows smaller pushes as numbers), which starts
+ * with the NTP1 header 4e5401 or 4e5403. */
+CScript::const_iterator FindNTP1OpReturnData(const CScript& script)
+{
+    CScript::const_iterator    pc = script.begin();
+    opcodetype                 opcode;
+    std::vector<unsigned char> data;
+    if (!script.GetOp(pc, opcode) || opcode != OP_RETURN) {
+        return script.end();
+    }
+    if (!script.GetOp(pc, opcode, data) || opcode > OP_PUSHDATA4 || pc != script.end()) {
+        return script.end();
+    }
+    if (data.size() <= 4 || data[0] != 0x4e || data[1] != 0x54 || (data[2] != 0x01 && data[2] != 0x03)) {
+        return script.end();
+    }
+    return script.end() - data.size();
+}
+
+/** Whether the script matches OpReturnRegex when shown with CScript::ToString(): OP_RETURN followed by
+ * anything. The argument is what follows OP_RETURN, as ToString() shows it. */
+bool IsOpReturnScript(const CScript& script, std::string* opReturnArg)
+{
+    CScript::const_iterator pc = script.begin();
+    opcodetype              opcode;
+    if (!script.GetOp(pc, opcode) || opcode != OP_RETURN || pc == script.end()) {
+        return false;
+    }
+    if (opReturnArg != nullptr) {
+        *opReturnArg = CScript(pc, script.end()).ToString();
+    }
+    return true;
+}
+
+bool IsNTP1OpReturnScript(const CScript& script, std::string* opReturnArg)
+{
+    const CScript::const_iterator dataBegin = FindNTP1OpReturnData(script);
+    if (dataBegin == script.end()) {
+        return false;
+    }
+    if (opReturnArg != nullptr) {
+        *opReturnArg = HexStr(dataBegin, script.end());
+    }
+    return true;
+}
+
+} // namespace
+
 NTP1Transaction::NTP1Transaction() { setNull(); }
 
 void NTP1Transaction::setNull()
@@ -565,8 +617,7 @@ void NTP1Transaction::readNTP1DataFromTx(
 
     readNTP1DataFromTx_minimal(tx);
 
-    std::string opReturnArg;
-    if (!IsTxNTP1(&tx, &opReturnArg)) {
+    if (!IsTxNTP1(&tx)) {
         ntp1TransactionType = NTP1TxType_NOT_NTP1;
         return;
     }
@@ -589,8 +640,6 @@ void NTP1Transaction::readNTP1DataFromTx(
         // find inputs in the list of inputs and parse their OP_RETURN
         auto it = GetPrevInputIt(tx, vin[i].getPrevout().getHash(), inputsTxs);
 
-        std::string opReturnArgInput;
-
         // The transaction that has an input that matches currInputHash
         const CTransaction&    currStdInput  = it->first;
         const NTP1Transaction& currNTP1Input = it->second;
@@ -598,7 +647,7 @@ void NTP1Transaction::readNTP1DataFromTx(
         totalInput += currStdInput.vout.at(currInputIndex).nValue;
 
         // if the transaction is not NTP1, continue
-        if (!IsTxNTP1(&currStdInput, &opReturnArgInput)) {
+        if (!IsTxNTP1(&currStdInput)) {
             continue;
         }
 
@@ -620,7 +669,7 @@ void NTP1Transaction::readNTP1DataFromTx(
     this->nTime     = tx.nTime;
     this->nLockTime = tx.nLockTime;
 
-    std::shared_ptr<NTP1Script> scriptPtr = NTP1Script::ParseScript(opReturnArg);
+    std::shared_ptr<NTP1Script> scriptPtr = ParseTxNTP1Script(tx);
     if (scriptPtr->getTxType() == NTP1Script::TxType::TxType_Issuance) {
         ntp1TransactionType = NTP1TxType_ISSUANCE;
 
@@ -630,7 +679,7 @@ void NTP1Transaction::readNTP1DataFromTx(
         if (!scriptPtrD) {
             throw std::runtime_error(
                 "While parsing NTP1Transaction, casting script pointer to transfer type failed: " +
-                opReturnArg);
+                scriptPtr->getParsedScriptHex());
         }
 
         int64_t feeProvided = static_cast<int64_t>(totalInput) - static_cast<int64_t>(totalOutput);
@@ -648,11 +697,11 @@ void NTP1Transaction::readNTP1DataFromTx(
             NTP1TokenTxData ntp1tokenTxData;
             const auto&     instruction = scriptPtrD->getTransferInstruction(i);
             if (instruction.outputIndex >= tx.vout.size()) {
-                throw std::runtime_error("An output of issuance is outside the available range of "
-                                         "outputs in NTP1 OP_RETURN argument: " +
-                                         opReturnArg + ", where the number of available outputs is " +
-                                         ::ToString(tx.vout.size()) + " in transaction " +
-                                         tx.GetHash().ToString());
+                throw std::runtime_error(
+                    "An output of issuance is outside the available range of outputs in NTP1 OP_RETURN "
+                    "argument: " +
+                    scriptPtr->getParsedScriptHex() + ", where the number of available outputs is " +
+                    ::ToString(tx.vout.size()) + " in transaction " + tx.GetHash().ToString());
             }
             NTP1Int currentAmount = instruction.amount;
 
@@ -660,7 +709,7 @@ void NTP1Transaction::readNTP1DataFromTx(
             if (totalAmountLeft < currentAmount) {
                 throw std::runtime_error("The amount targeted to outputs in bigger than the amount "
                                          "issued in NTP1 OP_RETURN argument: " +
-                                         opReturnArg);
+                                         scriptPtr->getParsedScriptHex());
             }
 
             totalAmountLeft -= currentAmount;
@@ -723,7 +772,7 @@ void NTP1Transaction::readNTP1DataFromTx(
         if (!scriptPtrD) {
             throw std::runtime_error(
                 "While parsing NTP1Transaction, casting script pointer to transfer type failed: " +
-                opReturnArg);
+                scriptPtr->getParsedScriptHex());
         }
 
         __TransferTokens<NTP1Script_Transfer>(scriptPtrD, tx, inputsTxs, false);
@@ -736,7 +785,7 @@ void NTP1Transaction::readNTP1DataFromTx(
         if (!scriptPtrD) {
             throw std::runtime_error(
                 "While parsing NTP1Transaction, casting script pointer to burn type failed: " +
-                opReturnArg);
+                scriptPtr->getParsedScriptHex());
         }
 
         __TransferTokens<NTP1Script_Burn>(scriptPtrD, tx, inputsTxs, true);
@@ -752,13 +801,12 @@ json_spirit::Value NTP1Transaction::GetNTP1IssuanceMetadata(const uint256& issua
     CTransaction    tx = CTransaction::FetchTxFromDisk(issuanceTxid);
     NTP1Transaction ntp1tx;
     ntp1tx.readNTP1DataFromTx_minimal(tx);
-    std::string opRet;
-    bool        isNTP1 = IsTxNTP1(&tx, &opRet);
+    bool isNTP1 = IsTxNTP1(&tx);
     if (!isNTP1) {
         return json_spirit::Value();
     }
 
-    std::shared_ptr<NTP1Script>          s  = NTP1Script::ParseScript(opRet);
+    std::shared_ptr<NTP1Script>          s  = ParseTxNTP1Script(tx);
     std::shared_ptr<NTP1Script_Issuance> sd = std::dynamic_pointer_cast<NTP1Script_Issuance>(s);
     if (!sd || s->getTxType() != NTP1Script::TxType_Issuance) {
         return json_spirit::Value();
@@ -788,15 +836,14 @@ NTP1TokenMetaData NTP1Transaction::GetFullNTP1IssuanceMetadata(const CTransactio
         throw std::runtime_error("For GetFullNTP1IssuanceMetadata(), the NTP1 transaction doesn't match "
                                  "the standard transaction");
     }
-    uint256     issuanceTxid = issuanceTx.GetHash();
-    std::string opRet;
-    bool        isNTP1 = IsTxNTP1(&issuanceTx, &opRet);
+    uint256 issuanceTxid = issuanceTx.GetHash();
+    bool    isNTP1       = IsTxNTP1(&issuanceTx);
     if (!isNTP1) {
         throw std::runtime_error("A non-NTP1 transaction was proided (txid: " + issuanceTxid.ToString() +
                                  ") to get NTP1 issuance metadata");
     }
 
-    std::shared_ptr<NTP1Script>          s  = NTP1Script::ParseScript(opRet);
+    std::shared_ptr<NTP1Script>          s  = ParseTxNTP1Script(issuanceTx);
     std::shared_ptr<NTP1Script_Issuance> sd = std::dynamic_pointer_cast<NTP1Script_Issuance>(s);
     if (!sd || s->getTxType() != NTP1Script::TxType_Issuance) {
         throw std::runtime_error("A non-issuance NTP1 transaction was provided (txid: " +
@@ -850,17 +897,9 @@ bool NTP1Transaction::TxContainsOpReturn(const CTransaction* tx, std::string* op
         return false;
     }
 
-    boost::smatch opReturnArgMatch;
-
     for (unsigned long j = 0; j < tx->vout.size(); j++) {
-        // if the string OP_RET_STR is found in scriptPubKey
-        std::string scriptPubKeyStr = tx->vout[j].scriptPubKey.ToString();
-        if (boost::regex_match(scriptPubKeyStr, opReturnArgMatch, OpReturnRegex)) {
-            if (opReturnArg != nullptr && opReturnArgMatch[1].matched) {
-                *opReturnArg = std::string(opReturnArgMatch[1]);
-                return true;
-            }
-            return true; // could not retrieve OP_RETURN argument
+        if (IsOpReturnScript(tx->vout[j].scriptPubKey, opReturnArg)) {
+            return true;
         }
     }
     return false;
@@ -954,20 +993,30 @@ std::vector<std::pair<CTransaction, NTP1Transaction>> NTP1Transaction::StdFetche
     // NTP1 transaction data is either in the test pool OR in the database; no third option here
     auto it = mapQueuedNTP1Inputs.find(tx.GetHash());
     if (it == mapQueuedNTP1Inputs.end()) {
+        NTP1TxCacheType& resolvedTxCache = GetResolvedTxCache();
         for (auto&& inTx : inputsWithNTP1) {
             if (IsTxNTP1(&inTx.first)) {
-                if (txdb.ContainsNTP1Tx(inTx.first.GetHash())) {
+                const uint256 inHash = inTx.first.GetHash();
+                if (txdb.ContainsNTP1Tx(inHash)) {
                     // if the transaction is in the database, get it
-                    FetchNTP1TxFromDisk(inTx, txdb, recoverProtection);
-                } else if (queuedAcceptedTxs.find(inTx.first.GetHash()) != queuedAcceptedTxs.end()) {
+                    if (boost::optional<NTP1Transaction> cached = resolvedTxCache.get(inHash)) {
+                        inTx.second = std::move(*cached);
+                    } else {
+                        FetchNTP1TxFromDisk(inTx, txdb, recoverProtection);
+                    }
+                } else if (queuedAcceptedTxs.find(inHash) != queuedAcceptedTxs.end()) {
                     // otherwise, if the transaction is already in the test pool, use it to read it
+                    if (boost::optional<NTP1Transaction> cached = resolvedTxCache.get(inHash)) {
+                        inTx.second = std::move(*cached);
+                        continue;
+                    }
 
                     std::vector<std::pair<CTransaction, NTP1Transaction>> inputsOfInput =
                         GetAllNTP1InputsOfTx(inTx.first, txdb, recoverProtection, mapQueuedNTP1Inputs,
                                              queuedAcceptedTxs, recursionCount + 1);
 
-                    NTP1Transaction ntp1tx;
                     inTx.second.readNTP1DataFromTx(inTx.first, inputsOfInput);
+                    resolvedTxCache.insert(inHash, inTx.second);
                 } else {
                     // read NTP1 transaction inputs. If they fail, that's OK, because they will
                     // fail later if they're necessary
@@ -981,6 +1030,12 @@ std::vector<std::pair<CTransaction, NTP1Transaction>> NTP1Transaction::StdFetche
     return inputsWithNTP1;
 }
 
+NTP1TxCacheType& NTP1Transaction::GetResolvedTxCache()
+{
+    static NTP1TxCacheType resolvedTxCache(DEFAULT_NTP1_TX_CACHE_SIZE);
+    return resolvedTxCache;
+}
+
 int NTP1Transaction::GetCurrentBlockHeight(CTxDB* txdb)
 {
     if (txdb) {
@@ -996,25 +1051,29 @@ bool NTP1Transaction::IsTxNTP1(const CTransaction* tx, std::string* opReturnArg)
         return false;
     }
 
-    if (Params().IsNTP1TxExcluded(tx->GetHash())) {
-        return false;
-    }
-
-    boost::smatch opReturnArgMatch;
-
     for (unsigned long j = 0; j < tx->vout.size(); j++) {
-        std::string scriptPubKeyStr = tx->vout[j].scriptPubKey.ToString();
-        if (boost::regex_match(scriptPubKeyStr, opReturnArgMatch, NTP1OpReturnRegex)) {
-            if (opReturnArg != nullptr && opReturnArgMatch[1].matched) {
-                *opReturnArg = std::string(opReturnArgMatch[1]);
-                return true;
-            }
-            return true; // could not retrieve OP_RETURN argument
+        if (IsNTP1OpReturnScript(tx->vout[j].scriptPubKey, opReturnArg)) {
+            // checked last, because it hashes the transaction
+            return !Params().IsNTP1TxExcluded(tx->GetHash());
         }
     }
     return false;
 }
 
+std::shared_ptr<NTP1Script> NTP1Transaction::ParseTxNTP1Script(const CTransaction& tx)
+{
+    for (const CTxOut& output : tx.vout) {
+        const CScript&                script    = output.scriptPubKey;
+        const CScript::const_iterator dataBegin = FindNTP1OpReturnData(script);
+        if (dataBegin != script.end()) {
+            const unsigned char* data = script.data() + (dataBegin - script.begin());
+            return NTP1Script::ParseScript(data, script.data() + script.size());
+        }
+    }
+    throw std::runtime_error("Could not find an NTP1 OP_RETURN output in transaction " +
+                             tx.GetHash().ToString());
+}
+
 bool NTP1Transaction::IsTxOutputNTP1OpRet(const CTransaction* tx, unsigned int index,
                                           std::string* opReturnArg)
 {
@@ -1022,26 +1081,15 @@ bool NTP1Transaction::IsTxOutputNTP1OpRet(const CTransaction* tx, unsigned int i
         return false;
     }
 
-    if (Params().IsNTP1TxExcluded(tx->GetHash())) {
-        return false;
-    }
-
-    boost::smatch opReturnArgMatch;
-
     // out of range index
     if (index + 1 >= tx->vout.size()) {
         return false;
     }
 
-    std::string scriptPubKeyStr = tx->vout[index].scriptPubKey.ToString();
-    if (boost::regex_match(scriptPubKeyStr, opReturnArgMatch, NTP1OpReturnRegex)) {
-        if (opReturnArg != nullptr && opReturnArgMatch[1].matched) {
-            *opReturnArg = std::string(opReturnArgMatch[1]);
-            return true;
-        }
-        return true; // could not retrieve OP_RETURN argument
+    if (!IsNTP1OpReturnScript(tx->vout[index].scriptPubKey, opReturnArg)) {
+        return false;
     }
-    return false;
+    return !Params().IsNTP1TxExcluded(tx->GetHash());
 }
 
 bool NTP1Transaction::IsTxOutputOpRet(const CTransaction* tx, unsigned int index,
@@ -1051,22 +1099,12 @@ bool NTP1Transaction::IsTxOutputOpRet(const CTransaction* tx, unsigned int index
         return false;
     }
 
-    boost::smatch opReturnArgMatch;
-
     // out of range index
     if (index + 1 >= tx->vout.size()) {
         return false;
     }
 
-    std::string scriptPubKeyStr = tx->vout[index].scriptPubKey.ToString();
-    if (boost::regex_match(scriptPubKeyStr, opReturnArgMatch, OpReturnRegex)) {
-        if (opReturnArg != nullptr && opReturnArgMatch[1].matched) {
-            *opReturnArg = std::string(opReturnArgMatch[1]);
-            return true;
-        }
-        return true; // could not retrieve OP_RETURN argument
-    }
-    return false;
+    return IsOpReturnScript(tx->vout[index].scriptPubKey, opReturnArg);
 }
 
 bool NTP1Transaction::IsTxOutputOpRet(const CTxOut* output, std::string* opReturnArg)
@@ -1075,17 +1113,7 @@ bool NTP1Transaction::IsTxOutputOpRet(const CTxOut* output, std::string* opRetur
         return false;
     }
 
-    boost::smatch opReturnArgMatch;
-
-    std::string scriptPubKeyStr = output->scriptPubKey.ToString();
-    if (boost::regex_match(scriptPubKeyStr, opReturnArgMatch, OpReturnRegex)) {
-        if (opReturnArg != nullptr && opReturnArgMatch[1].matched) {
-            *opReturnArg = std::string(opReturnArgMatch[1]);
-            return true;
-        }
-        return true; // could not retrieve OP_RETURN argument
-    }
-    return false;
+    return IsOpReturnScript(output->scriptPubKey, opReturnArg);
 }
 
 bool AreTokenSymbolsEquivalent(std::string lhs, std::string rhs)
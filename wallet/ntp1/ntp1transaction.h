@@ -1,6 +1,7 @@
 #ifndef NTP1TRANSACTION_H
 #define NTP1TRANSACTION_H
 
+#include "LRUCache.h"
 #include "ntp1/ntp1script.h"
 #include "ntp1/ntp1script_burn.h"
 #include "ntp1/ntp1script_issuance.h"
@@ -21,6 +22,8 @@
 
 extern const std::string  NTP1OpReturnRegexStr;
 extern const boost::regex NTP1OpReturnRegex;
+extern const std::string  OpReturnRegexStr;
+extern const boost::regex OpReturnRegex;
 
 struct TokenMinimalData
 {
@@ -33,6 +36,13 @@ struct TokenMinimalData
 
 bool AreTokenSymbolsEquivalent(std::string lhs, std::string rhs);
 
+class NTP1Transaction;
+
+// number of resolved NTP1 transactions kept by NTP1Transaction::GetResolvedTxCache()
+constexpr static std::size_t DEFAULT_NTP1_TX_CACHE_SIZE = 10000;
+
+using NTP1TxCacheType = LRUCache<uint256, NTP1Transaction>;
+
 /**
  * @brief The NTP1Transaction class
  * A single NTP1 transaction
@@ -171,6 +181,10 @@ public:
                                 std::string* opReturnArg = nullptr);
     static bool IsTxOutputOpRet(const CTxOut* output, std::string* opReturnArg = nullptr);
 
+    /** Parses the NTP1 script straight from the NTP1 OP_RETURN output of tx, which IsTxNTP1() finds;
+     * throws if there's none */
+    static std::shared_ptr<NTP1Script> ParseTxNTP1Script(const CTransaction& tx);
+
     /** for a certain transaction, retrieve all NTP1 data from the database */
     static std::vector<std::pair<CTransaction, NTP1Transaction>>
     GetAllNTP1InputsOfTx(CTransaction tx, bool recoverProtection, int recursionCount = 0);
@@ -199,6 +213,13 @@ public:
         int                                recursionCount    = 0);
 
     static int GetCurrentBlockHeight(CTxDB* txdb = nullptr);
+
+    /** Resolved NTP1 transactions by txid, so that the inputs shared by the transactions of a block
+     * (and of the blocks after it) are read and resolved once. The NTP1 data of a transaction only
+     * depends on the transaction and its ancestors, so an entry doesn't go stale on reorgs. It's only
+     * used for inputs that are in the database or queued in the same block, never for the transaction
+     * being checked, which is still resolved (and checked against the blacklist) by itself. */
+    static NTP1TxCacheType& GetResolvedTxCache();
 };
 
 bool operator==(const NTP1Transaction& lhs, const NTP1Transaction& rhs)
@@ -9,6 +9,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/thread.hpp>
+#include <unordered_set>
 
 const std::string NTP1Wallet::ICON_ERROR_CONTENT = "<DownloadError>";
 
@@ -16,15 +17,12 @@ NTP1Wallet::NTP1Wallet()
 {
     lastTxCount                  = 0;
     lastOutputsCount             = 0;
-    updateBalance                = false;
     everSucceededInLoadingTokens = false;
 }
 
 void NTP1Wallet::update()
 {
-    __getOutputs();
-    if (updateBalance) {
-        __RecalculateTokensBalances();
+    if (__getOutputs()) {
         everSucceededInLoadingTokens = true;
     }
 }
@@ -40,7 +38,7 @@ const std::unordered_map<std::string, NTP1TokenMetaData>& NTP1Wallet::getTokenMe
     return tokenInformation;
 }
 
-void NTP1Wallet::__getOutputs()
+bool NTP1Wallet::__getOutputs()
 {
     // this helps in persisting to get the wallet data when the application is launched for the first
     // time and nebl wallet is null still the 100 number is just a protection against infinite waiting
@@ -48,7 +46,7 @@ void NTP1Wallet::__getOutputs()
     std::shared_ptr<CWallet> localWallet = std::atomic_load(&pwalletMain);
 
     if (!appInitiated) {
-        return;
+        return false;
     }
 
 #ifdef QT_GUI
@@ -60,50 +58,135 @@ void NTP1Wallet::__getOutputs()
 #endif
 
     if (std::atomic_load(&localWallet) == nullptr) {
-        return;
+        return false;
     }
 
-    std::vector<COutput> vecOutputs;
-    std::atomic_load(&localWallet)->AvailableCoins(vecOutputs);
-
-    // remove outputs that are outside confirmation bounds
-    auto outputToRemoveIt =
-        std::remove_if(vecOutputs.begin(), vecOutputs.end(), [this](const COutput& output) {
-            if (maxConfirmations >= 0 && output.tx->GetDepthInMainChain() > maxConfirmations) {
-                return true;
+    std::vector<COutput>      vecOutputs;
+    std::vector<NTP1OutPoint> unavailableOutputs;
+    int64_t                   currTxCount = 0;
+    std::shared_ptr<CWallet>  wallet      = std::atomic_load(&localWallet);
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        const uint64_t currTxChange = wallet->GetLastTxChange();
+
+        // the depths of all outputs change with every block, so they're all checked against the
+        // confirmation bounds
+        bool fullScan = scannedWallet != wallet.get() || minConfirmations >= 0 || maxConfirmations >= 0;
+
+        std::vector<uint256> txsToScan;
+        if (!fullScan) {
+            txsToScan = wallet->GetTxsChangedSince(lastWalletTxChange);
+            // a transaction that spends an output, or stops spending it, changes its availability
+            const std::size_t changedCount = txsToScan.size();
+            for (std::size_t i = 0; i < changedCount; i++) {
+                const auto it = wallet->mapWallet.find(txsToScan[i]);
+                if (it == wallet->mapWallet.end()) {
+                    // removed from the wallet
+                    fullScan = true;
+                    break;
+                }
+                for (const CTxIn& in : it->second.vin) {
+                    txsToScan.push_back(in.prevout.hash);
+                }
             }
-            if (minConfirmations >= 0 && output.tx->GetDepthInMainChain() < minConfirmations) {
-                return true;
+            txsToScan.insert(txsToScan.end(), watchedTxs.begin(), watchedTxs.end());
+        }
+        if (fullScan) {
+            txsToScan.clear();
+            txsToScan.reserve(wallet->mapWallet.size());
+            for (const auto& p : wallet->mapWallet) {
+                txsToScan.push_back(p.first);
             }
-            return false;
-        });
-    vecOutputs.erase(outputToRemoveIt, vecOutputs.end());
+        }
 
-    int64_t currTxCount      = 0;
-    int64_t currOutputsCount = 0;
-    {
-        LOCK2(cs_main, std::atomic_load(&localWallet)->cs_wallet);
+        std::unordered_set<uint256> scannedTxs;
+        watchedTxs.clear();
+        for (const uint256& txHash : txsToScan) {
+            const auto it = wallet->mapWallet.find(txHash);
+            if (it == wallet->mapWallet.end() || !scannedTxs.insert(txHash).second) {
+                continue;
+            }
+            const CWalletTx& wtx = it->second;
+            if (wtx.GetDepthInMainChain() == 0 || wtx.GetBlocksToMaturity() > 0 || !IsFinalTx(wtx)) {
+                watchedTxs.insert(txHash);
+            }
+            const std::size_t firstOutput = vecOutputs.size();
+            wallet->AvailableCoinsOfTx(wtx, vecOutputs);
+
+            // remove outputs that are outside confirmation bounds
+            auto outputToRemoveIt = std::remove_if(
+                vecOutputs.begin() + firstOutput, vecOutputs.end(), [this](const COutput& output) {
+                    if (maxConfirmations >= 0 && output.nDepth > maxConfirmations) {
+                        return true;
+                    }
+                    if (minConfirmations >= 0 && output.nDepth < minConfirmations) {
+                        return true;
+                    }
+                    return false;
+                });
+            vecOutputs.erase(outputToRemoveIt, vecOutputs.end());
 
-        currTxCount      = static_cast<int64_t>(std::atomic_load(&localWallet)->mapWallet.size());
-        currOutputsCount = static_cast<int64_t>(vecOutputs.size());
+            if (fullScan) {
+                continue;
+            }
+            // the outputs of the scanned transaction that were known but aren't available anymore
+            std::vector<bool> available(wtx.vout.size(), false);
+            for (std::size_t i = firstOutput; i < vecOutputs.size(); i++) {
+                available[vecOutputs[i].i] = true;
+            }
+            for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+                const NTP1OutPoint output(txHash, i);
+                if (!available[i] && (walletOutputsWithTokens.count(output) ||
+                                      outputsWithoutTokens.count(output))) {
+                    unavailableOutputs.push_back(output);
+                }
+            }
+        }
 
-        // if no new outputs are available
-        if (lastTxCount == currTxCount && lastOutputsCount == currOutputsCount) {
-            return;
+        // the outputs that were spent, or left the main chain or the confirmations range since the
+        // last update are dropped; only the new ones are resolved below
+        if (fullScan) {
+            std::unordered_set<NTP1OutPoint> availableOutputs;
+            availableOutputs.reserve(vecOutputs.size());
+            for (const COutput& output : vecOutputs) {
+                availableOutputs.insert(ConvertNeblOutputToNTP1(output));
+            }
+            for (const NTP1OutPoint& output : outputsWithoutTokens) {
+                if (!availableOutputs.count(output)) {
+                    unavailableOutputs.push_back(output);
+                }
+            }
+            for (const auto& p : walletOutputsWithTokens) {
+                if (!availableOutputs.count(p.first)) {
+                    unavailableOutputs.push_back(p.first);
+                }
+            }
         }
-    }
 
-    updateBalance = true;
+        scannedWallet      = wallet.get();
+        lastWalletTxChange = currTxChange;
+        currTxCount        = static_cast<int64_t>(wallet->mapWallet.size());
+    }
+    removeOutputs(unavailableOutputs);
 
     int failedRetrievals = 0;
 
+    // the metadata of every token is retrieved once per update, no matter how many new outputs have it
+    std::unordered_set<std::string> tokensWithUpdatedMetadata;
+
+    CTxDB txdb;
     for (unsigned long i = 0; i < vecOutputs.size(); i++) {
         NTP1OutPoint output = ConvertNeblOutputToNTP1(vecOutputs[i]);
         uint256      txHash = output.getHash();
 
+        if (walletOutputsWithTokens.find(output) != walletOutputsWithTokens.end() ||
+            outputsWithoutTokens.find(output) != outputsWithoutTokens.end()) {
+            continue;
+        }
+
         // get the transaction from the wallet
         CWalletTx neblTx;
-        if (!std::atomic_load(&localWallet)->GetTransaction(txHash, neblTx)) {
+        if (!wallet->GetTransaction(txHash, neblTx)) {
             printf("Error: Although the output number %i of transaction %s belongs to you, it couldn't "
                    "be found in your wallet.\n",
                    vecOutputs[i].i, txHash.ToString().c_str());
@@ -111,20 +194,14 @@ void NTP1Wallet::__getOutputs()
         }
 
         // NTP1 transactions strictly contain OP_RETURN in one of their vouts
-        std::string opReturnArg;
-        if (!NTP1Transaction::IsTxNTP1(&neblTx, &opReturnArg)) {
+        if (!NTP1Transaction::IsTxNTP1(&neblTx)) {
+            outputsWithoutTokens.insert(output);
             continue;
         }
 
-        // if output already exists, check if it's spent, if it's remove it
-        if (removeOutputIfSpent(output, neblTx))
-            continue;
-
         NTP1Transaction ntp1tx;
         try {
-            std::vector<std::pair<CTransaction, NTP1Transaction>> prevTxs =
-                NTP1Transaction::GetAllNTP1InputsOfTx(neblTx, true);
-            ntp1tx.readNTP1DataFromTx(neblTx, prevTxs);
+            ntp1tx = ResolveNTP1Tx(neblTx, txdb);
         } catch (std::exception& ex) {
             printf("Unable to download transaction information. Error says: %s\n", ex.what());
             failedRetrievals++;
@@ -132,99 +209,106 @@ void NTP1Wallet::__getOutputs()
         }
 
         // include only NTP1 transactions
-        if (ntp1tx.getTxOut(output.getIndex()).tokenCount() > 0) {
-            try {
-                // transaction with output index
-                walletOutputsWithTokens[output] = ntp1tx;
-                for (long j = 0; j < static_cast<long>(ntp1tx.getTxOut(output.getIndex()).tokenCount());
-                     j++) {
-
-                    NTP1TokenTxData tokenTx = ntp1tx.getTxOut(output.getIndex()).getToken(j);
-
-                    // find issue transaction to get meta data from
-                    uint256      issueTxid = tokenTx.getIssueTxId();
-                    CTransaction issueTx;
-                    try {
-                        issueTx = CTransaction::FetchTxFromDisk(issueTxid);
-                    } catch (const std::exception& ex) {
-                        if (!mempool.lookup(issueTxid, issueTx)) {
-                            throw std::runtime_error(
-                                "Transaction not found on disk or mempool. Disk search error: " +
-                                std::string(ex.what()));
-                        }
-                    }
-
-                    std::vector<std::pair<CTransaction, NTP1Transaction>> issueTxInputs =
-                        NTP1Transaction::GetAllNTP1InputsOfTx(issueTx, true);
-                    NTP1Transaction issueNTP1Tx;
-                    issueNTP1Tx.readNTP1DataFromTx(issueTx, issueTxInputs);
-
-                    // find the correct output in the issuance transaction that has the token in question
-                    // issued
-                    int  relevantIssueOutputIndex = -1;
-                    bool stop                     = false;
-                    for (int k = 0; k < (int)issueNTP1Tx.getTxOutCount(); k++) {
-                        for (int l = 0; l < (int)issueNTP1Tx.getTxOut(k).tokenCount(); l++) {
-                            if (issueNTP1Tx.getTxOut(k).getToken(l).getTokenId() ==
-                                tokenTx.getTokenId()) {
-                                relevantIssueOutputIndex = k;
-                                stop                     = true;
-                                break;
-                            }
-                        }
-                        if (stop) {
-                            break;
-                        }
-                    }
-
-                    if (relevantIssueOutputIndex < 0) {
-                        throw std::runtime_error("Could not find the correct output index for token: " +
-                                                 tokenTx.getTokenId());
-                    }
+        if (ntp1tx.getTxOut(output.getIndex()).tokenCount() == 0) {
+            outputsWithoutTokens.insert(output);
+            continue;
+        }
 
-                    if (retrieveFullMetadata) {
-                        try {
-                            tokenInformation[tokenTx.getTokenId()] =
-                                NTP1Transaction::GetFullNTP1IssuanceMetadata(issueTxid);
-                        } catch (std::exception& ex) {
-                            printf("Failed to retrieve NTP1 token metadata. Error: %s\n", ex.what());
-                            tokenInformation[tokenTx.getTokenId()] =
-                                GetMinimalMetadataInfoFromTxData(tokenTx);
-                        } catch (...) {
-                            printf("Failed to retrieve NTP1 token metadata. Unknown exception.\n");
-                            tokenInformation[tokenTx.getTokenId()] =
-                                GetMinimalMetadataInfoFromTxData(tokenTx);
-                        }
-                    } else {
-                        // no metadata available, set the name manually
-                        tokenInformation[tokenTx.getTokenId()] =
-                            GetMinimalMetadataInfoFromTxData(tokenTx);
-                    }
+        // transaction with output index
+        walletOutputsWithTokens[output] = ntp1tx;
+        AddOutputToWalletBalance(ntp1tx, output.getIndex(), balances);
+        try {
+            for (long j = 0; j < static_cast<long>(ntp1tx.getTxOut(output.getIndex()).tokenCount());
+                 j++) {
+                NTP1TokenTxData tokenTx = ntp1tx.getTxOut(output.getIndex()).getToken(j);
+                if (tokensWithUpdatedMetadata.insert(tokenTx.getTokenId()).second) {
+                    __retrieveTokenMetadata(tokenTx);
                 }
-            } catch (std::exception& ex) {
-                printf("Unable to download token metadata. Error says: %s\n", ex.what());
-                continue;
             }
+        } catch (std::exception& ex) {
+            printf("Unable to download token metadata. Error says: %s\n", ex.what());
+            continue;
         }
     }
 
-    scanSpentTransactions();
-
     lastTxCount      = currTxCount - failedRetrievals;
-    lastOutputsCount = currOutputsCount - failedRetrievals;
+    lastOutputsCount =
+        static_cast<int64_t>(walletOutputsWithTokens.size() + outputsWithoutTokens.size());
+
+    return true;
 }
 
-void NTP1Wallet::__RecalculateTokensBalances()
+NTP1Transaction NTP1Wallet::ResolveNTP1Tx(const CTransaction& neblTx, CTxDB& txdb)
 {
-    balances.clear();
-    for (std::unordered_map<NTP1OutPoint, NTP1Transaction>::iterator it =
-             walletOutputsWithTokens.begin();
-         it != walletOutputsWithTokens.end(); it++) {
-        const NTP1Transaction& tx          = it->second;
-        int                    outputIndex = it->first.getIndex();
-        AddOutputToWalletBalance(tx, outputIndex, this->balances);
+    // confirmed transactions were resolved when their block was connected
+    NTP1Transaction ntp1tx;
+    if (txdb.ReadNTP1Tx(neblTx.GetHash(), ntp1tx)) {
+        ntp1tx.updateDebugStrHash();
+        return ntp1tx;
+    }
+
+    std::vector<std::pair<CTransaction, NTP1Transaction>> prevTxs =
+        NTP1Transaction::GetAllNTP1InputsOfTx(neblTx, txdb, true);
+    ntp1tx.readNTP1DataFromTx(neblTx, prevTxs);
+    return ntp1tx;
+}
+
+void NTP1Wallet::__retrieveTokenMetadata(const NTP1TokenTxData& tokenTx)
+{
+    // find issue transaction to get meta data from
+    uint256      issueTxid = tokenTx.getIssueTxId();
+    CTransaction issueTx;
+    try {
+        issueTx = CTransaction::FetchTxFromDisk(issueTxid);
+    } catch (const std::exception& ex) {
+        if (!mempool.lookup(issueTxid, issueTx)) {
+            throw std::runtime_error("Transaction not found on disk or mempool. Disk search error: " +
+                                     std::string(ex.what()));
+        }
+    }
+
+    std::vector<std::pair<CTransaction, NTP1Transaction>> issueTxInputs =
+        NTP1Transaction::GetAllNTP1InputsOfTx(issueTx, true);
+    NTP1Transaction issueNTP1Tx;
+    issueNTP1Tx.readNTP1DataFromTx(issueTx, issueTxInputs);
+
+    // find the correct output in the issuance transaction that has the token in question
+    // issued
+    int  relevantIssueOutputIndex = -1;
+    bool stop                     = false;
+    for (int k = 0; k < (int)issueNTP1Tx.getTxOutCount(); k++) {
+        for (int l = 0; l < (int)issueNTP1Tx.getTxOut(k).tokenCount(); l++) {
+            if (issueNTP1Tx.getTxOut(k).getToken(l).getTokenId() == tokenTx.getTokenId()) {
+                relevantIssueOutputIndex = k;
+                stop                     = true;
+                break;
+            }
+        }
+        if (stop) {
+            break;
+        }
+    }
+
+    if (relevantIssueOutputIndex < 0) {
+        throw std::runtime_error("Could not find the correct output index for token: " +
+                                 tokenTx.getTokenId());
+    }
+
+    if (retrieveFullMetadata) {
+        try {
+            tokenInformation[tokenTx.getTokenId()] =
+                NTP1Transaction::GetFullNTP1IssuanceMetadata(issueTxid);
+        } catch (std::exception& ex) {
+            printf("Failed to retrieve NTP1 token metadata. Error: %s\n", ex.what());
+            tokenInformation[tokenTx.getTokenId()] = GetMinimalMetadataInfoFromTxData(tokenTx);
+        } catch (...) {
+            printf("Failed to retrieve NTP1 token metadata. Unknown exception.\n");
+            tokenInformation[tokenTx.getTokenId()] = GetMinimalMetadataInfoFromTxData(tokenTx);
+        }
+    } else {
+        // no metadata available, set the name manually
+        tokenInformation[tokenTx.getTokenId()] = GetMinimalMetadataInfoFromTxData(tokenTx);
     }
-    updateBalance = false;
 }
 
 void NTP1Wallet::AddOutputToWalletBalance(const NTP1Transaction& tx, int outputIndex,
@@ -241,50 +325,49 @@ void NTP1Wallet::AddOutputToWalletBalance(const NTP1Transaction& tx, int outputI
     }
 }
 
-bool NTP1Wallet::removeOutputIfSpent(const NTP1OutPoint& output, const CWalletTx& neblTx)
+void NTP1Wallet::SubtractOutputFromWalletBalance(const NTP1Transaction& tx, int outputIndex,
+                                                 std::map<std::string, NTP1Int>& balancesTable)
 {
-    std::unordered_map<NTP1OutPoint, NTP1Transaction>::iterator outputIt =
-        walletOutputsWithTokens.find(output);
-    if (outputIt != walletOutputsWithTokens.end()) {
-        if (pwalletMain->IsSpent(neblTx.GetHash(), output.getIndex())) {
-            walletOutputsWithTokens.erase(outputIt);
-        }
-        return true;
+    for (long j = 0; j < static_cast<long>(tx.getTxOut(outputIndex).tokenCount()); j++) {
+        NTP1TokenTxData tokenTx = tx.getTxOut(outputIndex).getToken(j);
+        balancesTable[tokenTx.getTokenId()] -= tokenTx.getAmount();
     }
-    return false;
 }
 
-void NTP1Wallet::scanSpentTransactions()
+void NTP1Wallet::removeOutputs(const std::vector<NTP1OutPoint>& unavailableOutputs)
 {
-    std::shared_ptr<CWallet> localWallet = std::atomic_load(&pwalletMain);
-    if (localWallet == nullptr)
-        return;
-    std::deque<NTP1OutPoint> toRemove;
-    for (std::unordered_map<NTP1OutPoint, NTP1Transaction>::iterator it =
-             walletOutputsWithTokens.begin();
-         it != walletOutputsWithTokens.end(); it++) {
-        CWalletTx      neblTx;
-        int            outputIndex = it->first.getIndex();
-        const uint256& txHash      = it->first.getHash();
-        if (!localWallet->GetTransaction(txHash, neblTx))
+    std::unordered_set<std::string> zeroBalanceTokens;
+    for (const NTP1OutPoint& output : unavailableOutputs) {
+        outputsWithoutTokens.erase(output);
+
+        const auto it = walletOutputsWithTokens.find(output);
+        if (it == walletOutputsWithTokens.end()) {
             continue;
-        if (pwalletMain->IsSpent(neblTx.GetHash(), outputIndex)) {
-            // this, although the right way to do things, causes a crash. A safer plan is chosen
-            // it = walletOutputsWithTokens.erase(it);
-            toRemove.push_back(it->first);
         }
+        SubtractOutputFromWalletBalance(it->second, it->first.getIndex(), balances);
+        const NTP1TxOut& out = it->second.getTxOut(it->first.getIndex());
+        for (long j = 0; j < static_cast<long>(out.tokenCount()); j++) {
+            const std::string& tokenId = out.getToken(j).getTokenId();
+            if (balances[tokenId] == 0) {
+                zeroBalanceTokens.insert(tokenId);
+            }
+        }
+        walletOutputsWithTokens.erase(it);
     }
-    for (unsigned long i = 0; i < toRemove.size(); i++) {
-        if (walletOutputsWithTokens.find(toRemove[i]) != walletOutputsWithTokens.end()) {
-            walletOutputsWithTokens.erase(toRemove[i]);
-        } else {
-            printf("Unable to find output %s:%s, although it was found before and marked for "
-                   "removal.\n",
-                   toRemove[i].getHash().ToString().c_str(), ToString(toRemove[i].getIndex()).c_str());
-            //            std::cerr<<"Unable to find output " << toRemove[i].getHash().ToString() <<
-            //            ":"
-            //            << ToString(toRemove[i].getIndex()) << ", although it was found before and
-            //            marked for removal." << std::endl;
+    if (zeroBalanceTokens.empty()) {
+        return;
+    }
+
+    // a token stays listed as long as an output has it, even with a zero amount
+    for (const auto& p : walletOutputsWithTokens) {
+        const NTP1TxOut& out = p.second.getTxOut(p.first.getIndex());
+        for (long j = 0; j < static_cast<long>(out.tokenCount()); j++) {
+            zeroBalanceTokens.erase(out.getToken(j).getTokenId());
+        }
+    }
+    for (const std::string& tokenId : zeroBalanceTokens) {
+        if (balances[tokenId] == 0) {
+            balances.erase(tokenId);
         }
     }
 }
@@ -458,10 +541,14 @@ void NTP1Wallet::clear()
 {
     tokenInformation.clear();
     walletOutputsWithTokens.clear();
+    outputsWithoutTokens.clear();
     tokenIcons.clear();
     balances.clear();
-    lastTxCount      = 0;
-    lastOutputsCount = 0;
+    lastTxCount        = 0;
+    lastOutputsCount   = 0;
+    scannedWallet      = nullptr;
+    lastWalletTxChange = 0;
+    watchedTxs.clear();
 }
 
 void NTP1Wallet::setMinMaxConfirmations(int minConfs, int maxConfs)
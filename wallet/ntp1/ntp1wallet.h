@@ -8,8 +8,10 @@
 #include "json/json_spirit.h"
 
 #include <unordered_map>
+#include <unordered_set>
 
 class COutput;
+class CWallet;
 class CWalletTx;
 
 class NTP1Wallet : public INTP1Wallet
@@ -23,18 +25,28 @@ class NTP1Wallet : public INTP1Wallet
     std::unordered_map<std::string, NTP1TokenMetaData> tokenInformation;
     // transaction with output index
     std::unordered_map<NTP1OutPoint, NTP1Transaction> walletOutputsWithTokens;
+    // available outputs that were found to have no tokens, so that they're not resolved again
+    std::unordered_set<NTP1OutPoint> outputsWithoutTokens;
     // wallet balances
     std::map<std::string, NTP1Int> balances;
     // map from token id vs icon image data
     ThreadSafeHashMap<std::string, std::string> tokenIcons;
 
-    bool updateBalance;
-
     // remains false until a successful attempt to retrieve tokens is over (for display purposes)
     bool everSucceededInLoadingTokens;
 
-    void __getOutputs();
-    void __RecalculateTokensBalances();
+    // the wallet whose transactions were all scanned, and its last transaction change that was applied;
+    // after that, only the transactions that changed since are scanned again
+    const CWallet* scannedWallet      = nullptr;
+    uint64_t       lastWalletTxChange = 0;
+    // the transactions whose outputs may become available or unavailable without the wallet telling,
+    // by maturing, becoming final or leaving the memory pool; they're scanned on every update
+    std::unordered_set<uint256> watchedTxs;
+
+    // applies the changes of the wallet's available outputs since the last call; returns false if the
+    // wallet isn't loaded yet
+    bool __getOutputs();
+    void __retrieveTokenMetadata(const NTP1TokenTxData& tokenTx);
 
     // it's very important to use shared_from_this() here to guarantee thread-safety
     // if the shared_ptr's content gets deleted before the thread gets executed, it will lead to a
@@ -45,10 +57,13 @@ class NTP1Wallet : public INTP1Wallet
     static std::string __downloadIcon(const std::string& IconURL);
     static void        AddOutputToWalletBalance(const NTP1Transaction& tx, int outputIndex,
                                                 std::map<std::string, NTP1Int>& balancesTable);
-    // returns true if removed
-    bool                removeOutputIfSpent(const NTP1OutPoint& output, const CWalletTx& neblTx);
-    void                scanSpentTransactions();
-    static NTP1OutPoint ConvertNeblOutputToNTP1(const COutput& output);
+    static void        SubtractOutputFromWalletBalance(const NTP1Transaction& tx, int outputIndex,
+                                                       std::map<std::string, NTP1Int>& balancesTable);
+    // drops the known outputs that aren't available anymore, and their tokens from the balances
+    void removeOutputs(const std::vector<NTP1OutPoint>& unavailableOutputs);
+
+    static NTP1OutPoint    ConvertNeblOutputToNTP1(const COutput& output);
+    static NTP1Transaction ResolveNTP1Tx(const CTransaction& neblTx, CTxDB& txdb);
 
     // when scanning the neblio wallet, this is the number of relevant transactions found
     int64_t lastTxCount;
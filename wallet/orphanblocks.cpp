@@ -0,0 +1,165 @@
+#include "orphanblocks.h"
+
+#include "version.h"
+
+COrphanBlocks::COrphanBlocks(std::size_t nMaxBlocksIn, std::size_t nMaxBytesIn)
+    : nMaxBlocks(nMaxBlocksIn), nMaxBytes(nMaxBytesIn)
+{
+}
+
+void COrphanBlocks::AddLeaf(const uint256& hash, const Entry& entry)
+{
+    setLeaves.insert(AgedHash(entry.nSequence, hash));
+    mapPeers[entry.nodeId].setLeaves.insert(AgedHash(entry.nSequence, hash));
+}
+
+void COrphanBlocks::RemoveLeaf(const uint256& hash, const Entry& entry)
+{
+    setLeaves.erase(AgedHash(entry.nSequence, hash));
+    const auto it = mapPeers.find(entry.nodeId);
+    if (it != mapPeers.end())
+        it->second.setLeaves.erase(AgedHash(entry.nSequence, hash));
+}
+
+void COrphanBlocks::SetPeerBytes(int64_t nodeId, std::size_t nPeerBytes)
+{
+    PeerOrphans& peer = mapPeers[nodeId];
+    setPeersByBytes.erase(std::make_pair(peer.nBytes, nodeId));
+    peer.nBytes = nPeerBytes;
+    if (nPeerBytes > 0)
+        setPeersByBytes.insert(std::make_pair(nPeerBytes, nodeId));
+    else
+        mapPeers.erase(nodeId);
+}
+
+std::unique_ptr<CBlock> COrphanBlocks::Erase(std::unordered_map<uint256, Entry>::iterator it)
+{
+    const uint256 hash     = it->first;
+    Entry&        entry    = it->second;
+    const uint256 hashPrev = entry.pblock->hashPrevBlock;
+
+    RemoveLeaf(hash, entry);
+    const auto range = mapByPrev.equal_range(hashPrev);
+    for (auto prevIt = range.first; prevIt != range.second; ++prevIt) {
+        if (prevIt->second == hash) {
+            mapByPrev.erase(prevIt);
+            break;
+        }
+    }
+    const auto parentIt = mapBlocks.find(hashPrev);
+    if (parentIt != mapBlocks.end() && !HasChildren(hashPrev))
+        AddLeaf(parentIt->first, parentIt->second);
+
+    if (entry.pblock->IsProofOfStake()) {
+        const auto stakeIt = setStakes.find(entry.pblock->GetProofOfStake());
+        if (stakeIt != setStakes.end())
+            setStakes.erase(stakeIt);
+    }
+
+    nBytes -= entry.nBytes;
+    SetPeerBytes(entry.nodeId, PeerBytes(entry.nodeId) - entry.nBytes);
+
+    std::unique_ptr<CBlock> pblock = std::move(entry.pblock);
+    mapBlocks.erase(it);
+    return pblock;
+}
+
+void COrphanBlocks::LimitSize()
+{
+    // the orphans form trees, so there are leaves as long as there are orphans
+    while (mapBlocks.size() > nMaxBlocks || nBytes > nMaxBytes) {
+        const std::set<AgedHash>& setPeerLeaves = mapPeers[setPeersByBytes.rbegin()->second].setLeaves;
+        const uint256             hash =
+            (setPeerLeaves.empty() ? setLeaves.begin() : setPeerLeaves.begin())->second;
+        Erase(mapBlocks.find(hash));
+    }
+}
+
+bool COrphanBlocks::Add(std::unique_ptr<CBlock> pblock, const uint256& hash, int64_t nodeId)
+{
+    if (mapBlocks.count(hash))
+        return false;
+
+    Entry entry;
+    entry.nodeId    = nodeId;
+    entry.nBytes    = ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    entry.nSequence = nNextSequence++;
+    entry.pblock    = std::move(pblock);
+
+    const uint256 hashPrev = entry.pblock->hashPrevBlock;
+    if (entry.pblock->IsProofOfStake())
+        setStakes.insert(entry.pblock->GetProofOfStake());
+
+    const auto parentIt = mapBlocks.find(hashPrev);
+    if (parentIt != mapBlocks.end())
+        RemoveLeaf(parentIt->first, parentIt->second);
+    mapByPrev.insert(std::make_pair(hashPrev, hash));
+
+    nBytes += entry.nBytes;
+    SetPeerBytes(nodeId, PeerBytes(nodeId) + entry.nBytes);
+
+    // the orphans that build on it may have come first
+    const bool fLeaf = !HasChildren(hash);
+    const auto it    = mapBlocks.emplace(hash, std::move(entry)).first;
+    if (fLeaf)
+        AddLeaf(it->first, it->second);
+
+    LimitSize();
+    return mapBlocks.count(hash) > 0;
+}
+
+bool COrphanBlocks::Contains(const uint256& hash) const { return mapBlocks.count(hash) > 0; }
+
+bool COrphanBlocks::HasChildren(const uint256& hash) const { return mapByPrev.count(hash) > 0; }
+
+bool COrphanBlocks::HasStake(const std::pair<COutPoint, unsigned int>& stake) const
+{
+    return setStakes.count(stake) > 0;
+}
+
+uint256 COrphanBlocks::GetRoot(const uint256& hash) const
+{
+    uint256 hashRoot = hash;
+    for (auto it = mapBlocks.find(hash); it != mapBlocks.end();
+         it      = mapBlocks.find(it->second.pblock->hashPrevBlock))
+        hashRoot = it->first;
+    return hashRoot;
+}
+
+uint256 COrphanBlocks::GetMissingParent(const uint256& hash) const
+{
+    uint256 hashMissing = hash;
+    for (auto it = mapBlocks.find(hash); it != mapBlocks.end(); it = mapBlocks.find(hashMissing))
+        hashMissing = it->second.pblock->hashPrevBlock;
+    return hashMissing;
+}
+
+std::vector<std::unique_ptr<CBlock>> COrphanBlocks::TakeChildren(const uint256& hashPrev)
+{
+    std::vector<uint256> vChildren;
+    const auto           range = mapByPrev.equal_range(hashPrev);
+    for (auto it = range.first; it != range.second; ++it)
+        vChildren.push_back(it->second);
+
+    std::vector<std::unique_ptr<CBlock>> vBlocks;
+    for (const uint256& hash : vChildren)
+        vBlocks.push_back(Erase(mapBlocks.find(hash)));
+    return vBlocks;
+}
+
+std::size_t COrphanBlocks::PeerBytes(int64_t nodeId) const
+{
+    const auto it = mapPeers.find(nodeId);
+    return it == mapPeers.end() ? 0 : it->second.nBytes;
+}
+
+void COrphanBlocks::Clear()
+{
+    mapBlocks.clear();
+    mapByPrev.clear();
+    setLeaves.clear();
+    mapPeers.clear();
+    setPeersByBytes.clear();
+    setStakes.clear();
+    nBytes = 0;
+}
@@ -0,0 +1,92 @@
+#ifndef ORPHANBLOCKS_H
+#define ORPHANBLOCKS_H
+
+#include "block.h"
+#include "outpoint.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The blocks that peers sent before their parent, until the parent is connected. They're limited in
+ * number and in bytes; when a limit is passed, the peer that takes the most bytes loses its oldest
+ * orphan that no other orphan builds on, so that a peer flooding orphans only evicts its own, and
+ * chains aren't cut in the middle.
+ *
+ * Like the rest of the chain state, it's guarded by cs_main.
+ */
+class COrphanBlocks
+{
+    typedef std::pair<uint64_t, uint256> AgedHash; // by the order of arrival
+
+    struct Entry
+    {
+        std::unique_ptr<CBlock> pblock;
+        int64_t                 nodeId;
+        std::size_t             nBytes;
+        uint64_t                nSequence;
+    };
+
+    struct PeerOrphans
+    {
+        std::size_t        nBytes = 0;
+        std::set<AgedHash> setLeaves;
+    };
+
+    std::size_t nMaxBlocks;
+    std::size_t nMaxBytes;
+    std::size_t nBytes        = 0;
+    uint64_t    nNextSequence = 0;
+
+    std::unordered_map<uint256, Entry> mapBlocks;
+    // the hashes of the orphans, by the hash of their parent
+    std::multimap<uint256, uint256> mapByPrev;
+    // the orphans that no other orphan builds on
+    std::set<AgedHash>                                setLeaves;
+    std::map<int64_t, PeerOrphans>                    mapPeers;
+    std::set<std::pair<std::size_t, int64_t>>         setPeersByBytes;
+    std::multiset<std::pair<COutPoint, unsigned int>> setStakes;
+
+    void                    AddLeaf(const uint256& hash, const Entry& entry);
+    void                    RemoveLeaf(const uint256& hash, const Entry& entry);
+    void                    SetPeerBytes(int64_t nodeId, std::size_t nPeerBytes);
+    std::unique_ptr<CBlock> Erase(std::unordered_map<uint256, Entry>::iterator it);
+    void                    LimitSize();
+
+public:
+    COrphanBlocks(std::size_t nMaxBlocksIn, std::size_t nMaxBytesIn);
+
+    /** Keeps the block, whose hash is given, for the peer that sent it; returns false if the block was
+     * there already or had to be evicted right away */
+    bool Add(std::unique_ptr<CBlock> pblock, const uint256& hash, int64_t nodeId);
+
+    bool Contains(const uint256& hash) const;
+
+    /** Whether some orphan builds on the block */
+    bool HasChildren(const uint256& hash) const;
+
+    /** Whether an orphan has this proof-of-stake */
+    bool HasStake(const std::pair<COutPoint, unsigned int>& stake) const;
+
+    /** The first block of the orphan chain that the orphan is in */
+    uint256 GetRoot(const uint256& hash) const;
+
+    /** The block that the orphan chain of the orphan waits for */
+    uint256 GetMissingParent(const uint256& hash) const;
+
+    /** Removes the orphans that build on the block, to be connected after it */
+    std::vector<std::unique_ptr<CBlock>> TakeChildren(const uint256& hashPrev);
+
+    std::size_t Size() const { return mapBlocks.size(); }
+    std::size_t Bytes() const { return nBytes; }
+    std::size_t PeerBytes(int64_t nodeId) const;
+
+    void Clear();
+};
+
+#endif // ORPHANBLOCKS_H
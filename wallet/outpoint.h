@@ -39,4 +39,12 @@ public:
     void print() const { printf("%s\n", ToString().c_str()); }
 };
 
+namespace std {
+template <>
+struct hash<COutPoint>
+{
+    std::size_t operator()(const COutPoint& k) const { return std::hash<uint256>()(k.hash) ^ k.n; }
+};
+} // namespace std
+
 #endif // OUTPOINT_H
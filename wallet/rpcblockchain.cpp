@@ -5,8 +5,11 @@
 
 #include "amount.h"
 #include "bitcoinrpc.h"
+#include "chain.h"
 #include "main.h"
 #include "merkletx.h"
+#include "ntp1/ntp1transaction.h"
+#include "sigcache.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include <algorithm>
@@ -107,8 +110,8 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPri
     result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (blockindex->IsInMainChain(CTxDB()))
-        confirmations = CTxDB().GetBestChainHeight().value_or(0) - blockindex->nHeight + 1;
+    if (chainActive.Contains(blockindex))
+        confirmations = chainActive.Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
     result.push_back(Pair("height", blockindex->nHeight));
@@ -169,7 +172,7 @@ Value getblockcount(const Array& params, bool fHelp)
         throw runtime_error("getblockcount\n"
                             "Returns the number of blocks in the longest block chain.");
 
-    return CTxDB().GetBestChainHeight().value_or(0);
+    return std::max(chainActive.Height(), 0);
 }
 
 Value getdifficulty(const Array& params, bool fHelp)
@@ -200,18 +203,109 @@ Value settxfee(const Array& params, bool fHelp)
 
 Value getrawmempool(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
-        throw runtime_error("getrawmempool\n"
-                            "Returns all transaction ids in memory pool.");
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrawmempool ( verbose )\n"
+            "Returns all transaction ids in memory pool.\n"
+            "\nArguments:\n"
+            "1. verbose           (boolean, optional, default=false) true for a json object, false for "
+            "array of transaction ids\n"
+            "\nResult: (for verbose = true):\n"
+            "{                           (json object)\n"
+            "  \"transactionid\" : {       (json object)\n"
+            "    \"size\" : n,             (numeric) transaction size in bytes\n"
+            "    \"fee\" : n,              (numeric) transaction fee\n"
+            "    \"time\" : n,             (numeric) local time the transaction entered the pool\n"
+            "    \"height\" : n,           (numeric) block height when the transaction entered the "
+            "pool\n"
+            "    \"startingpriority\" : n, (numeric) priority when the transaction entered the pool\n"
+            "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"sigops\" : n,           (numeric) signature operations, including P2SH ones\n"
+            "    \"ancestorcount\" : n,    (numeric) in-mempool ancestors, with this one\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors, with this one\n"
+            "    \"ancestorfees\" : n,     (numeric) fees of in-mempool ancestors, with this one\n"
+            "    \"descendantcount\" : n,  (numeric) in-mempool descendants, with this one\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants, with this one\n"
+            "    \"descendantfees\" : n,   (numeric) fees of in-mempool descendants, with this one\n"
+            "    \"depends\" : [           (array) unconfirmed transactions used as inputs\n"
+            "        \"transactionid\",    (string) parent transaction id\n"
+            "       ... ]\n"
+            "  }, ...\n"
+            "}\n");
+
+    const bool fVerbose = (params.size() > 0 && params[0].get_bool());
 
-    vector<uint256> vtxid;
-    mempool.queryHashes(vtxid);
+    if (!fVerbose) {
+        vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
 
-    Array a;
-    BOOST_FOREACH (const uint256& hash, vtxid)
-        a.push_back(hash.ToString());
+        Array a;
+        BOOST_FOREACH (const uint256& hash, vtxid)
+            a.push_back(hash.ToString());
 
-    return a;
+        return a;
+    }
+
+    const unsigned int currentHeight = CTxDB().GetBestChainHeight().value_or(0);
+
+    LOCK(mempool.cs);
+    Object o;
+    for (const CTxMemPoolEntry& e : mempool.mapTx) {
+        Object info;
+        info.push_back(Pair("size", static_cast<uint64_t>(e.GetTxSize())));
+        info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+        info.push_back(Pair("time", e.GetTime()));
+        info.push_back(Pair("height", static_cast<uint64_t>(e.GetHeight())));
+        info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+        info.push_back(Pair("currentpriority", e.GetPriority(currentHeight)));
+        info.push_back(Pair("sigops", static_cast<uint64_t>(e.GetSigOps())));
+        info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+        info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+        info.push_back(Pair("ancestorfees", ValueFromAmount(e.GetFeesWithAncestors())));
+        info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+        info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+        info.push_back(Pair("descendantfees", ValueFromAmount(e.GetFeesWithDescendants())));
+
+        std::set<uint256> setDepends;
+        for (const CTxIn& txin : e.GetTx().vin) {
+            if (mempool.mapTx.find(txin.prevout.hash) != mempool.mapTx.end())
+                setDepends.insert(txin.prevout.hash);
+        }
+        Array depends;
+        for (const uint256& dep : setDepends)
+            depends.push_back(dep.ToString());
+        info.push_back(Pair("depends", depends));
+
+        o.push_back(Pair(e.GetHash().ToString(), info));
+    }
+    return o;
+}
+
+Value getmempoolinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmempoolinfo\n"
+            "Returns details on the active state of the transaction memory pool.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\" : n,          (numeric) current transaction count\n"
+            "  \"bytes\" : n,         (numeric) sum of the sizes of the transactions\n"
+            "  \"usage\" : n,         (numeric) estimated memory usage of the pool, in bytes\n"
+            "  \"maxmempool\" : n,    (numeric) maximum memory usage of the pool, in bytes\n"
+            "  \"mempoolminfee\" : n, (numeric) minimum fee per 1000 bytes for entering the pool\n"
+            "}\n");
+
+    const std::size_t maxMempoolSize = GetMaxMempoolSize();
+
+    Object ret;
+    ret.push_back(Pair("size", static_cast<uint64_t>(mempool.size())));
+    ret.push_back(Pair("bytes", mempool.GetTotalTxSize()));
+    ret.push_back(Pair("usage", static_cast<uint64_t>(mempool.DynamicMemoryUsage())));
+    ret.push_back(Pair("maxmempool", static_cast<uint64_t>(maxMempoolSize)));
+    ret.push_back(Pair("mempoolminfee",
+                       ValueFromAmount(std::max(mempool.GetMinFee(maxMempoolSize), MIN_RELAY_TX_FEE))));
+    return ret;
 }
 
 Value getblockhash(const Array& params, bool fHelp)
@@ -220,11 +314,11 @@ Value getblockhash(const Array& params, bool fHelp)
         throw runtime_error("getblockhash <index>\n"
                             "Returns hash of block in best-block-chain at <index>.");
 
-    int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > CTxDB().GetBestChainHeight().value_or(0))
+    int                nHeight     = params[0].get_int();
+    const CBlockIndex* pblockindex = chainActive[nHeight];
+    if (!pblockindex)
         throw runtime_error("Block number out of range.");
 
-    CBlockIndexSmartPtr pblockindex = CBlock::FindBlockByHeight(nHeight);
     return pblockindex->phashBlock.GetHex();
 }
 
@@ -320,28 +414,19 @@ Value getblockbynumber(const Array& params, bool fHelp)
                             "try to retireve NTP1 data from the database. This won't work if the "
                             "transaction is not in the blockchain.");
 
-    int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > CTxDB().GetBestChainHeight().value_or(0))
+    int                nHeight     = params[0].get_int();
+    const CBlockIndex* pblockindex = chainActive[nHeight];
+    if (!pblockindex)
         throw runtime_error("Block number out of range.");
 
-    CBlock              block;
-    CBlockIndexSmartPtr pblockindex = CTxDB().GetBestBlockIndex();
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-
-    const uint256 hash = pblockindex->phashBlock;
-
-    pblockindex = mapBlockIndex.get(hash).value_or(nullptr);
-    if (!pblockindex) {
-        throw runtime_error("Failed to get block after finding its hash.");
-    }
-    block.ReadFromDisk(pblockindex.get(), true);
+    CBlock block;
+    block.ReadFromDisk(pblockindex, true);
 
     bool fIgnoreNTP1 = false;
     if (params.size() > 2)
         fIgnoreNTP1 = params[2].get_bool();
 
-    return blockToJSON(block, pblockindex.get(), params.size() > 1 ? params[1].get_bool() : false,
+    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false,
                        fIgnoreNTP1);
 }
 
@@ -474,6 +559,67 @@ Value syncwithvalidationinterfacequeue(const Array& params, bool fHelp)
     return Value();
 }
 
+Value getsigcacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getsigcacheinfo\n"
+            "Returns details about the cache of verified signatures.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"bytes\": xxxxx,      (numeric) memory allocated for the cache (see -sigcachemb)\n"
+            "  \"capacity\": xxxxx,   (numeric) number of signatures the cache can hold\n"
+            "  \"entries\": xxxxx,    (numeric) number of cached signatures\n"
+            "  \"hits\": xxxxx,       (numeric) lookups that found the signature\n"
+            "  \"misses\": xxxxx,     (numeric) lookups that required verifying the signature\n"
+            "  \"evictions\": xxxxx   (numeric) signatures dropped to make room for new ones\n"
+            "}\n"
+            "\nExamples:\n"
+            "getsigcacheinfo");
+
+    const CSignatureCache& cache = GetSignatureCache();
+
+    Object ret;
+    ret.push_back(Pair("bytes", cache.GetMemoryUsage()));
+    ret.push_back(Pair("capacity", static_cast<uint64_t>(cache.GetSlotCount())));
+    ret.push_back(Pair("entries", cache.GetEntryCount()));
+    ret.push_back(Pair("hits", cache.GetHits()));
+    ret.push_back(Pair("misses", cache.GetMisses()));
+    ret.push_back(Pair("evictions", cache.GetEvictions()));
+    return ret;
+}
+
+Value getntp1cacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getntp1cacheinfo\n"
+            "Returns details about the cache of resolved NTP1 transactions.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx,    (numeric) number of cached NTP1 transactions\n"
+            "  \"maxsize\": xxxxx,    (numeric) number of NTP1 transactions the cache can hold (see "
+            "-ntp1txcache)\n"
+            "  \"hits\": xxxxx,       (numeric) lookups that found the resolved transaction\n"
+            "  \"misses\": xxxxx,     (numeric) lookups that required reading or resolving it again\n"
+            "  \"hitrate\": x.xxx     (numeric) hits / (hits + misses)\n"
+            "}\n"
+            "\nExamples:\n"
+            "getntp1cacheinfo");
+
+    const NTP1TxCacheType& cache  = NTP1Transaction::GetResolvedTxCache();
+    const uint64_t         hits   = cache.getHits();
+    const uint64_t         misses = cache.getMisses();
+
+    Object ret;
+    ret.push_back(Pair("entries", static_cast<uint64_t>(cache.size())));
+    ret.push_back(Pair("maxsize", static_cast<uint64_t>(cache.getMaxSize())));
+    ret.push_back(Pair("hits", hits));
+    ret.push_back(Pair("misses", misses));
+    ret.push_back(Pair("hitrate", hits + misses > 0 ? double(hits) / double(hits + misses) : 0.));
+    return ret;
+}
+
 Value getblockchaininfo(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -541,8 +687,8 @@ Value blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (blockindex->IsInMainChain(CTxDB()))
-        confirmations = CTxDB().GetBestChainHeight().value_or(0) - blockindex->nHeight + 1;
+    if (chainActive.Contains(blockindex))
+        confirmations = chainActive.Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", blockindex->nVersion));
@@ -681,9 +827,10 @@ Value gettxout(const Array& params, bool fHelp)
     if (params.size() > 2 && params[2].type() != Value_type::null_type)
         fMempool = params[2].get_bool();
 
-    boost::optional<CTransaction> tx;
-    uint32_t                      nHeight = 0;
-    CTxIndex                      txindex;
+    boost::optional<CTxOut> txout;
+    uint32_t                nHeight    = 0;
+    bool                    fCoinBase  = false;
+    bool                    fCoinStake = false;
     if (fMempool) {
         LOCK(mempool.cs);
         if (mempool.isSpent(out)) {
@@ -691,48 +838,30 @@ Value gettxout(const Array& params, bool fHelp)
         }
         const CTransaction* txPtr = mempool.lookup_unsafe(out.hash);
         if (txPtr) {
-            nHeight = MEMPOOL_HEIGHT;
-            tx      = *txPtr;
+            if (n >= txPtr->vout.size()) {
+                throw std::runtime_error("Transaction " + out.hash.ToString() + " has only " +
+                                         std::to_string(txPtr->vout.size()) + " outputs. Output index " +
+                                         std::to_string(n) + " is invalid");
+            }
+            nHeight    = MEMPOOL_HEIGHT;
+            txout      = txPtr->vout[n];
+            fCoinBase  = txPtr->IsCoinBase();
+            fCoinStake = txPtr->IsCoinStake();
         }
     }
 
-    // if tx was not found in the mempool
+    // if tx was not found in the mempool, look it up in the UTXO set
     CTxDB txdb;
-    if (!tx) {
-        if (!txdb.ReadTxIndex(out.hash, txindex)) {
-            return Value();
-        }
-
-        if (n >= txindex.vSpent.size()) {
-            throw std::runtime_error("Transaction " + out.hash.ToString() + " has only " +
-                                     std::to_string(txindex.vSpent.size()) + " outputs. Output index " +
-                                     std::to_string(n) + " is invalid");
-        }
-
-        if (!txindex.vSpent.at(n).IsNull()) {
-            // it's already spent
+    if (!txout) {
+        CCoins coins;
+        if (!txdb.ReadCoins(out.hash, coins) || !coins.IsAvailable(n)) {
+            // unknown, or already spent
             return Value();
         }
-        auto bi = mapBlockIndex.get(txindex.pos.nBlockPos).value_or(nullptr);
-        if (bi) {
-            nHeight = bi->nHeight;
-            tx      = CTransaction();
-            if (!txdb.ReadTx(txindex.pos, *tx)) {
-                return Value();
-            }
-        } else {
-            return Value();
-        }
-    }
-
-    if (!tx) {
-        throw std::runtime_error("Failed to find tx " + out.hash.ToString());
-    }
-
-    if (n >= tx->vout.size()) {
-        throw std::runtime_error("Transaction " + out.hash.ToString() + " has only " +
-                                 std::to_string(tx->vout.size()) + " outputs. Output index " +
-                                 std::to_string(n) + " is invalid");
+        nHeight    = coins.nHeight;
+        txout      = coins.vout[n];
+        fCoinBase  = coins.IsCoinBase();
+        fCoinStake = coins.IsCoinStake();
     }
 
     const CBlockIndex* pindex = txdb.GetBestBlockIndex().get();
@@ -742,12 +871,12 @@ Value gettxout(const Array& params, bool fHelp)
     } else {
         ret.push_back(Pair("confirmations", (int64_t)(pindex->nHeight - nHeight)));
     }
-    ret.push_back(Pair("value", ValueFromAmount(tx->vout.at(n).nValue)));
+    ret.push_back(Pair("value", ValueFromAmount(txout->nValue)));
     Object o;
-    ScriptPubKeyToJSON(tx->vout.at(n).scriptPubKey, o, true);
+    ScriptPubKeyToJSON(txout->scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("coinbase", tx->IsCoinBase()));
-    ret.push_back(Pair("coinstake", tx->IsCoinStake()));
+    ret.push_back(Pair("coinbase", fCoinBase));
+    ret.push_back(Pair("coinstake", fCoinStake));
 
     return ret;
 }
@@ -136,6 +136,16 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         obj.push_back(Pair("banscore", stats.nMisbehavior));
 
+        Object recvPerCommand;
+        for (const auto& p : stats.mapRecvPerCommand) {
+            Object command;
+            command.push_back(Pair("messages", p.second.nMessages));
+            command.push_back(Pair("bytes", p.second.nBytes));
+            command.push_back(Pair("timeus", p.second.nTimeMicros));
+            recvPerCommand.push_back(Pair(p.first, command));
+        }
+        obj.push_back(Pair("recvpercommand", recvPerCommand));
+
         ret.push_back(obj);
     }
 
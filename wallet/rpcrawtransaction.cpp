@@ -29,10 +29,9 @@ json_spirit::Value GetNTP1TxMetadata(const CTransaction& tx) noexcept
                       std::is_same<T, NTP1Script_Burn>::value,
                   "Unexpected type. Type should be one of the ones in the assert statement.");
 
-    std::string opRet;
-    bool        isNTP1 = NTP1Transaction::IsTxNTP1(&tx, &opRet);
+    bool isNTP1 = NTP1Transaction::IsTxNTP1(&tx);
     if (isNTP1) {
-        std::shared_ptr<NTP1Script> s  = NTP1Script::ParseScript(opRet);
+        std::shared_ptr<NTP1Script> s  = NTP1Transaction::ParseTxNTP1Script(tx);
         std::shared_ptr<T>          sd = std::dynamic_pointer_cast<T>(s);
         if (sd) {
             return NTP1Script::GetMetadataAsJson(sd.get(), tx);
@@ -46,8 +45,7 @@ json_spirit::Value GetNTP1TxMetadata(const CTransaction& tx) noexcept
 void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry, bool ignoreNTP1 = false)
 {
     std::pair<CTransaction, NTP1Transaction> pair;
-    std::string                              opRet;
-    bool                                     isNTP1 = NTP1Transaction::IsTxNTP1(&tx, &opRet);
+    bool                                     isNTP1 = NTP1Transaction::IsTxNTP1(&tx);
 
     CTxDB txdb("r");
     if (isNTP1 && !ignoreNTP1) {
@@ -119,7 +117,7 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry, bo
 
     {
         if (isNTP1 && !ignoreNTP1) {
-            std::shared_ptr<NTP1Script> s = NTP1Script::ParseScript(opRet);
+            std::shared_ptr<NTP1Script> s = NTP1Transaction::ParseTxNTP1Script(tx);
             if (s && s->getProtocolVersion() >= 3) {
                 if (s->getTxType() == NTP1Script::TxType_Issuance) {
                     entry.push_back(json_spirit::Pair("metadataOfUtxos",
@@ -274,10 +272,16 @@ Value listunspent(const Array& params, bool fHelp)
     Array           results;
     vector<COutput> vecOutputs;
     pwalletMain->AvailableCoins(vecOutputs, false);
+    CTxDB txdb;
     for (const COutput& out : vecOutputs) {
         if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
             continue;
 
+        // the wallet's spent flags can lag behind the chain; confirmed outputs must be in the UTXO set
+        CCoins coins;
+        if (out.nDepth > 0 && (!txdb.ReadCoins(out.tx->GetHash(), coins) || !coins.IsAvailable(out.i)))
+            continue;
+
         std::vector<std::pair<CTransaction, NTP1Transaction>> ntp1inputs =
             NTP1Transaction::GetAllNTP1InputsOfTx(static_cast<CTransaction>(*out.tx), false);
         NTP1Transaction ntp1tx;
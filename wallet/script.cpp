@@ -4,8 +4,6 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/foreach.hpp>
-#include <boost/tuple/tuple.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
 
 using namespace std;
 using namespace boost;
@@ -15,6 +13,7 @@ using namespace boost;
 #include "keystore.h"
 #include "main.h"
 #include "script.h"
+#include "sigcache.h"
 #include "sync.h"
 #include "util.h"
 
@@ -1264,67 +1263,10 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int
     return ss.GetHash();
 }
 
-// Valid signature cache, to avoid doing expensive ECDSA signature checking
-// twice for every transaction (once when accepted into memory pool, and
-// again when accepted into the block chain)
-
-class CSignatureCache
-{
-private:
-    // sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, std::vector<unsigned char>> sigdata_type;
-    std::set<sigdata_type>                                                                setValid;
-    CCriticalSection                                                                      cs_sigcache;
-
-public:
-    bool Get(uint256 hash, const std::vector<unsigned char>& vchSig,
-             const std::vector<unsigned char>& pubKey)
-    {
-        LOCK(cs_sigcache);
-
-        sigdata_type                     k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
-    }
-
-    void Set(uint256 hash, const std::vector<unsigned char>& vchSig,
-             const std::vector<unsigned char>& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0)
-            return;
-
-        LOCK(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize) {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256                          randomHash = GetRandHash();
-            std::vector<unsigned char>       unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
-    }
-};
-
 bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode,
               const CTransaction& txTo, unsigned int nIn, int nHashType)
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
     // Hash type is one byte tacked on to the end of the signature
     if (vchSig.empty())
@@ -1337,7 +1279,8 @@ bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CSc
 
     uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
 
-    if (signatureCache.Get(sighash, vchSig, vchPubKey))
+    const uint256 cacheEntry = signatureCache.ComputeEntry(sighash, vchSig, vchPubKey);
+    if (signatureCache.Get(cacheEntry))
         return true;
 
     CKey key;
@@ -1347,7 +1290,7 @@ bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CSc
     if (!key.Verify(sighash, vchSig))
         return false;
 
-    signatureCache.Set(sighash, vchSig, vchPubKey);
+    signatureCache.Set(cacheEntry);
     return true;
 }
 
@@ -1914,6 +1857,36 @@ Result<void, ScriptError> VerifySignature(const CTransaction& txFrom, const CTra
     return Ok();
 }
 
+CScriptCheck::CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn,
+                           bool fValidatePayToScriptHashIn, bool fStrictEncodingsIn, int nHashTypeIn)
+    : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), ptxTo(&txToIn), nIn(nInIn),
+      fValidatePayToScriptHash(fValidatePayToScriptHashIn), fStrictEncodings(fStrictEncodingsIn),
+      nHashType(nHashTypeIn)
+{
+}
+
+bool CScriptCheck::operator()() const
+{
+    const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
+    const auto     res = VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, fValidatePayToScriptHash,
+                                      fStrictEncodings, nHashType);
+    if (res.isErr()) {
+        return error("CScriptCheck() : %s:%u VerifySignature failed: %s",
+                     ptxTo->GetHash().ToString().c_str(), nIn, ScriptErrorString(res.unwrapErr()));
+    }
+    return true;
+}
+
+void CScriptCheck::swap(CScriptCheck& check)
+{
+    scriptPubKey.swap(check.scriptPubKey);
+    std::swap(ptxTo, check.ptxTo);
+    std::swap(nIn, check.nIn);
+    std::swap(fValidatePayToScriptHash, check.fValidatePayToScriptHash);
+    std::swap(fStrictEncodings, check.fStrictEncodings);
+    std::swap(nHashType, check.nHashType);
+}
+
 static CScript PushAll(const vector<valtype>& values)
 {
     CScript result;
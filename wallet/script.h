@@ -709,6 +709,32 @@ Result<void, ScriptError> VerifySignature(const CTransaction& txFrom, const CTra
                                           unsigned int nIn, bool fValidatePayToScriptHash,
                                           bool fStrictEncodings, int nHashType);
 
+/** Closure representing one script verification, so that it can be deferred to a CCheckQueue.
+ * Note that this stores a pointer to the spending transaction, which must outlive the check. */
+class CScriptCheck
+{
+private:
+    CScript             scriptPubKey;
+    const CTransaction* ptxTo;
+    unsigned int        nIn;
+    bool                fValidatePayToScriptHash;
+    bool                fStrictEncodings;
+    int                 nHashType;
+
+public:
+    CScriptCheck() : ptxTo(nullptr), nIn(0), fValidatePayToScriptHash(false), fStrictEncodings(false),
+                     nHashType(0)
+    {
+    }
+
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn,
+                 bool fValidatePayToScriptHashIn, bool fStrictEncodingsIn, int nHashTypeIn);
+
+    bool operator()() const;
+
+    void swap(CScriptCheck& check);
+};
+
 // Given two sets of signatures for scriptPubKey, possibly with OP_0 placeholders,
 // combine them intelligently and return the result.
 CScript CombineSignatures(CScript scriptPubKey, const CTransaction& txTo, unsigned int nIn,
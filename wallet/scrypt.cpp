@@ -30,6 +30,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "scrypt.h"
 #include "pbkdf2.h"
 
@@ -196,3 +200,179 @@ uint256 scrypt_blockhash(const void* input)
     return scrypt_nosalt(input, 80, scratchpad);
 }
 
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCRYPT_MULTILANE 1
+#include <immintrin.h>
+#endif
+
+#ifdef SCRYPT_MULTILANE
+
+namespace {
+
+/** xor_salsa8() for vectors of 32-bit words, with an independent scrypt computation in each lane */
+template <typename V>
+__attribute__((always_inline)) inline void xor_salsa8_lanes(V B[16], const V Bx[16])
+{
+    V x[16];
+    for (int i = 0; i < 16; i++)
+        x[i] = (B[i] ^= Bx[i]);
+    for (int i = 0; i < 8; i += 2) {
+#define R(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
+        /* Operate on columns. */
+        x[4] ^= R(x[0] + x[12], 7);   x[9] ^= R(x[5] + x[1], 7);
+        x[14] ^= R(x[10] + x[6], 7);  x[3] ^= R(x[15] + x[11], 7);
+
+        x[8] ^= R(x[4] + x[0], 9);    x[13] ^= R(x[9] + x[5], 9);
+        x[2] ^= R(x[14] + x[10], 9);  x[7] ^= R(x[3] + x[15], 9);
+
+        x[12] ^= R(x[8] + x[4], 13);  x[1] ^= R(x[13] + x[9], 13);
+        x[6] ^= R(x[2] + x[14], 13);  x[11] ^= R(x[7] + x[3], 13);
+
+        x[0] ^= R(x[12] + x[8], 18);  x[5] ^= R(x[1] + x[13], 18);
+        x[10] ^= R(x[6] + x[2], 18);  x[15] ^= R(x[11] + x[7], 18);
+
+        /* Operate on rows. */
+        x[1] ^= R(x[0] + x[3], 7);    x[6] ^= R(x[5] + x[4], 7);
+        x[11] ^= R(x[10] + x[9], 7);  x[12] ^= R(x[15] + x[14], 7);
+
+        x[2] ^= R(x[1] + x[0], 9);    x[7] ^= R(x[6] + x[5], 9);
+        x[8] ^= R(x[11] + x[10], 9);  x[13] ^= R(x[12] + x[15], 9);
+
+        x[3] ^= R(x[2] + x[1], 13);   x[4] ^= R(x[7] + x[6], 13);
+        x[9] ^= R(x[8] + x[11], 13);  x[14] ^= R(x[13] + x[12], 13);
+
+        x[0] ^= R(x[3] + x[2], 18);   x[5] ^= R(x[4] + x[7], 18);
+        x[10] ^= R(x[9] + x[8], 18);  x[15] ^= R(x[14] + x[13], 18);
+#undef R
+    }
+    for (int i = 0; i < 16; i++)
+        B[i] += x[i];
+}
+
+typedef uint32_t Lanes4 __attribute__((vector_size(16)));
+typedef uint32_t Lanes8 __attribute__((vector_size(32)));
+
+/** The second loop of scrypt_core() xors every lane with its own pseudo-random entry of the
+ * scratchpad, which takes a lane by lane gather */
+template <typename V, int LANES>
+__attribute__((always_inline)) inline void xor_scratchpad_entries(V (&B)[32], const V* V_)
+{
+    uint32_t(&words)[32][LANES] = reinterpret_cast<uint32_t(&)[32][LANES]>(B);
+    for (int l = 0; l < LANES; l++) {
+        const uint32_t* p = reinterpret_cast<const uint32_t*>(&V_[32 * (words[16][l] & 1023)]) + l;
+        for (int k = 0; k < 32; k++)
+            words[k][l] ^= p[LANES * k];
+    }
+}
+
+/** AVX2 has a gather instruction for it */
+template <>
+__attribute__((target("avx2"))) inline void xor_scratchpad_entries<Lanes8, 8>(Lanes8 (&B)[32],
+                                                                              const Lanes8* V_)
+{
+    const Lanes8 lane  = {0, 1, 2, 3, 4, 5, 6, 7};
+    const Lanes8 first = (B[16] & 1023) * (32 * 8) + lane;
+    for (int k = 0; k < 32; k++) {
+        const __m256i index = reinterpret_cast<__m256i>(first + 8 * k);
+        B[k] ^= reinterpret_cast<Lanes8>(
+            _mm256_i32gather_epi32(reinterpret_cast<const int*>(V_), index, 4));
+    }
+}
+
+/** scrypt_core() for LANES independent inputs, one per lane of V. X holds the 32 words of each
+ * input, lane after lane, and V must have room for 1024 * 32 vectors. */
+template <typename V, int LANES>
+__attribute__((always_inline)) inline void scrypt_core_lanes(uint32_t* X, V* V_)
+{
+    V B[32];
+    for (int k = 0; k < 32; k++)
+        for (int l = 0; l < LANES; l++)
+            B[k][l] = X[32 * l + k];
+
+    for (int i = 0; i < 1024; i++) {
+        memcpy(&V_[i * 32], B, sizeof(B));
+        xor_salsa8_lanes(&B[0], &B[16]);
+        xor_salsa8_lanes(&B[16], &B[0]);
+    }
+    for (int i = 0; i < 1024; i++) {
+        xor_scratchpad_entries<V, LANES>(B, V_);
+        xor_salsa8_lanes(&B[0], &B[16]);
+        xor_salsa8_lanes(&B[16], &B[0]);
+    }
+
+    for (int k = 0; k < 32; k++)
+        for (int l = 0; l < LANES; l++)
+            X[32 * l + k] = B[k][l];
+}
+
+__attribute__((target("sse2"))) void scrypt_core_sse2(uint32_t* X, void* scratchpad)
+{
+    scrypt_core_lanes<Lanes4, 4>(X, static_cast<Lanes4*>(scratchpad));
+}
+
+__attribute__((target("avx2"))) void scrypt_core_avx2(uint32_t* X, void* scratchpad)
+{
+    scrypt_core_lanes<Lanes8, 8>(X, static_cast<Lanes8*>(scratchpad));
+}
+
+typedef void (*ScryptCoreLanesFn)(uint32_t* X, void* scratchpad);
+
+struct ScryptKernel
+{
+    ScryptCoreLanesFn fn    = scrypt_core_sse2;
+    int               lanes = 4;
+
+    ScryptKernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            fn    = scrypt_core_avx2;
+            lanes = 8;
+        }
+    }
+};
+
+const ScryptKernel& GetScryptKernel()
+{
+    static const ScryptKernel kernel;
+    return kernel;
+}
+
+} // namespace
+
+#endif // SCRYPT_MULTILANE
+
+void scrypt_blockhash_many(const void* headers, size_t n, uint256* hashes)
+{
+    const uint8_t* input = static_cast<const uint8_t*>(headers);
+    size_t         done  = 0;
+#ifdef SCRYPT_MULTILANE
+    const ScryptKernel& kernel = GetScryptKernel();
+    const size_t        lanes  = kernel.lanes;
+    // a group takes about as long as hashing half as many headers one by one, so a group that is at
+    // least half full is still faster; its empty lanes hash the last header again
+    if (n * 2 >= lanes) {
+        std::unique_ptr<unsigned char[]> scratchpad(new unsigned char[lanes * 131072 + 63]);
+        void* V = reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(scratchpad.get()) + 63) &
+                                          ~uintptr_t(63));
+        std::vector<uint32_t> X(32 * lanes);
+        while ((n - done) * 2 >= lanes) {
+            const size_t count = std::min(lanes, n - done);
+            for (size_t l = 0; l < lanes; l++) {
+                const uint8_t* header = input + 80 * (done + std::min(l, count - 1));
+                PBKDF2_SHA256(header, 80, header, 80, 1, reinterpret_cast<uint8_t*>(&X[32 * l]), 128);
+            }
+            kernel.fn(X.data(), V);
+            for (size_t l = 0; l < count; l++) {
+                const uint8_t* header = input + 80 * (done + l);
+                PBKDF2_SHA256(header, 80, reinterpret_cast<uint8_t*>(&X[32 * l]), 128, 1,
+                              reinterpret_cast<uint8_t*>(&hashes[done + l]), 32);
+            }
+            done += count;
+        }
+    }
+#endif
+    for (; done < n; done++)
+        hashes[done] = scrypt_blockhash(input + 80 * done);
+}
@@ -12,4 +12,8 @@ uint256 scrypt_salted_hash(const void* input, size_t inputlen, const void* salt,
 uint256 scrypt_hash(const void* input, size_t inputlen);
 uint256 scrypt_blockhash(const void* input);
 
+/** Computes the scrypt_blockhash() of n consecutive 80-byte block headers into hashes[0..n-1],
+ * several headers at a time where the CPU has the vector units for it */
+void scrypt_blockhash_many(const void* headers, size_t n, uint256* hashes);
+
 #endif // SCRYPT_MINE_H
@@ -1145,6 +1145,114 @@ public:
 
 
 
+/** Read-only stream over a contiguous range of bytes that it doesn't own.
+ *
+ * Unlike CDataStream, nothing is copied on construction; data is deserialized directly
+ * from the given memory. The caller must keep that memory alive and unchanged while the
+ * stream is in use (e.g., an LMDB value is only valid until its transaction ends).
+ */
+class CSpanReadStream
+{
+protected:
+    const char* pbegin;
+    const char* pend;
+    const char* pread;
+    short state;
+    short exceptmask;
+public:
+    int nType;
+    int nVersion;
+
+    typedef std::size_t size_type;
+
+    CSpanReadStream(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn)
+        : pbegin(pbeginIn), pend(pendIn), pread(pbeginIn)
+    {
+        assert(pendIn >= pbeginIn);
+        nType = nTypeIn;
+        nVersion = nVersionIn;
+        state = 0;
+        exceptmask = std::ios::badbit | std::ios::failbit;
+    }
+
+    const char* begin() const    { return pread; }
+    const char* end() const      { return pend; }
+    size_type size() const       { return static_cast<size_type>(pend - pread); }
+    bool empty() const           { return pread == pend; }
+    size_type tell() const       { return static_cast<size_type>(pread - pbegin); }
+
+    //
+    // Stream subset
+    //
+    void setstate(short bits, const char* psz)
+    {
+        state |= bits;
+        if (state & exceptmask)
+            throw std::ios_base::failure(psz);
+    }
+
+    bool eof() const             { return size() == 0; }
+    bool fail() const            { return state & (std::ios::badbit | std::ios::failbit); }
+    bool good() const            { return !eof() && (state == 0); }
+    void clear(short n)          { state = n; }
+    short exceptions()           { return exceptmask; }
+    short exceptions(short mask) { short prev = exceptmask; exceptmask = mask; setstate(0, "CSpanReadStream"); return prev; }
+    int in_avail()               { return size(); }
+
+    void SetType(int n)          { nType = n; }
+    int GetType()                { return nType; }
+    void SetVersion(int n)       { nVersion = n; }
+    int GetVersion()             { return nVersion; }
+    void ReadVersion()           { *this >> nVersion; }
+
+    CSpanReadStream& read(char* pch, int nSize)
+    {
+        assert(nSize >= 0);
+        if (static_cast<size_type>(nSize) > size())
+        {
+            const size_type available = size();
+            memset(pch, 0, nSize);
+            memcpy(pch, pread, available);
+            pread = pend;
+            setstate(std::ios::failbit, "CSpanReadStream::read() : end of data");
+            return (*this);
+        }
+        memcpy(pch, pread, nSize);
+        pread += nSize;
+        return (*this);
+    }
+
+    CSpanReadStream& ignore(int nSize)
+    {
+        assert(nSize >= 0);
+        if (static_cast<size_type>(nSize) > size())
+        {
+            pread = pend;
+            setstate(std::ios::failbit, "CSpanReadStream::ignore() : end of data");
+            return (*this);
+        }
+        pread += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    unsigned int GetSerializeSize(const T& obj)
+    {
+        // Tells the size of the object if serialized to this stream
+        return ::GetSerializeSize(obj, nType, nVersion);
+    }
+
+    template<typename T>
+    CSpanReadStream& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+
+
 
 
 
@@ -0,0 +1,377 @@
+#include "sha256.h"
+
+#include <cstring>
+#include <openssl/sha.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t IV[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// the second block of the SHA256 of a 64-byte message: the padding, and the length in bits
+const unsigned char PAD64[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, //
+                                 0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, //
+                                 0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, //
+                                 0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+
+inline uint32_t ReadBE32(const unsigned char* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void WriteBE32(unsigned char* p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+// These work on vectors of 32-bit lanes as well as on scalars
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA256_CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define SHA256_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA256_SIGMA0(x) (SHA256_ROTR(x, 2) ^ SHA256_ROTR(x, 13) ^ SHA256_ROTR(x, 22))
+#define SHA256_SIGMA1(x) (SHA256_ROTR(x, 6) ^ SHA256_ROTR(x, 11) ^ SHA256_ROTR(x, 25))
+#define SHA256_sigma0(x) (SHA256_ROTR(x, 7) ^ SHA256_ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_sigma1(x) (SHA256_ROTR(x, 17) ^ SHA256_ROTR(x, 19) ^ ((x) >> 10))
+
+/** One compression of the message words w[0..15] into the state s, for vectors of 32-bit words with
+ * an independent message in each lane. w[16..63] are overwritten with the message schedule. */
+template <typename V>
+__attribute__((always_inline)) inline void Compress(V (&s)[8], V (&w)[64])
+{
+    for (int i = 16; i < 64; i++)
+        w[i] = SHA256_sigma1(w[i - 2]) + w[i - 7] + SHA256_sigma0(w[i - 15]) + w[i - 16];
+
+    V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        const V t1 = h + SHA256_SIGMA1(e) + SHA256_CH(e, f, g) + K[i] + w[i];
+        const V t2 = SHA256_SIGMA0(a) + SHA256_MAJ(a, b, c);
+        h          = g;
+        g          = f;
+        f          = e;
+        e          = d + t1;
+        d          = c;
+        c          = b;
+        b          = a;
+        a          = t1 + t2;
+    }
+    s[0] += a;
+    s[1] += b;
+    s[2] += c;
+    s[3] += d;
+    s[4] += e;
+    s[5] += f;
+    s[6] += g;
+    s[7] += h;
+}
+
+typedef void (*TransformFn)(uint32_t* s, const unsigned char* chunk, size_t blocks);
+typedef void (*TransformD64Fn)(unsigned char* out, const unsigned char* in);
+
+/** OpenSSL's block function, which picks its own assembly for the CPU */
+void TransformOpenSSL(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    SHA256_CTX ctx;
+    memcpy(ctx.h, s, sizeof(ctx.h));
+    while (blocks--) {
+        SHA256_Transform(&ctx, chunk);
+        chunk += 64;
+    }
+    memcpy(s, ctx.h, sizeof(ctx.h));
+}
+
+TransformFn Transform = TransformOpenSSL;
+
+/** Double-SHA256 of one 64-byte input, with the selected Transform */
+void TransformD64Single(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    memcpy(s, IV, sizeof(s));
+    Transform(s, in, 1);
+    Transform(s, PAD64, 1);
+
+    // the 32-byte first hash, its padding and its length in bits
+    unsigned char buf[64] = {0};
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i]);
+    buf[32] = 0x80;
+    buf[62] = 1;
+    memcpy(s, IV, sizeof(s));
+    Transform(s, buf, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+TransformD64Fn TransformD64_4way = nullptr;
+TransformD64Fn TransformD64_8way = nullptr;
+
+#ifdef SHA256_X86
+
+/** Double-SHA256 of LANES 64-byte inputs at once, one per lane of V. All the input is read before
+ * any output is written. */
+template <typename V, int LANES>
+__attribute__((always_inline)) inline void TransformD64Wide(unsigned char* out, const unsigned char* in)
+{
+    V s[8], w[64];
+    for (int i = 0; i < 16; i++)
+        for (int l = 0; l < LANES; l++)
+            w[i][l] = ReadBE32(in + 64 * l + 4 * i);
+    const V zero = {};
+    for (int i = 0; i < 8; i++)
+        s[i] = zero + IV[i];
+    Compress(s, w);
+
+    w[0] = zero + 0x80000000u;
+    for (int i = 1; i < 15; i++)
+        w[i] = zero;
+    w[15] = zero + 512u;
+    Compress(s, w);
+
+    for (int i = 0; i < 8; i++) {
+        w[i] = s[i];
+        s[i] = zero + IV[i];
+    }
+    w[8] = zero + 0x80000000u;
+    for (int i = 9; i < 15; i++)
+        w[i] = zero;
+    w[15] = zero + 256u;
+    Compress(s, w);
+
+    for (int i = 0; i < 8; i++)
+        for (int l = 0; l < LANES; l++)
+            WriteBE32(out + 32 * l + 4 * i, s[i][l]);
+}
+
+typedef uint32_t Lanes4 __attribute__((vector_size(16)));
+typedef uint32_t Lanes8 __attribute__((vector_size(32)));
+
+__attribute__((target("sse4.1"))) void TransformD64_SSE41(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Wide<Lanes4, 4>(out, in);
+}
+
+__attribute__((target("avx2"))) void TransformD64_AVX2(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Wide<Lanes8, 8>(out, in);
+}
+
+// The SHA extensions keep the state as ABEF and CDGH, with A and C in the highest lane
+#define SHANI_TARGET __attribute__((target("sha,sse4.1")))
+
+SHANI_TARGET inline void QuadRound(__m128i& state0, __m128i& state1, const __m128i& msg, int i)
+{
+    const __m128i wk = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i*)&K[i]));
+    state1           = _mm_sha256rnds2_epu32(state1, state0, wk);
+    state0           = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0e));
+}
+
+/** Replaces the four message words in m0 by the four that follow m3 in the schedule */
+SHANI_TARGET inline void NextMessage(__m128i& m0, const __m128i& m1, const __m128i& m2, const __m128i& m3)
+{
+    m0 = _mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4));
+    m0 = _mm_sha256msg2_epu32(m0, m3);
+}
+
+SHANI_TARGET void TransformSHANI(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    // reverses the bytes of each 32-bit word, as the message words are big endian
+    const __m128i byteSwap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    // (A, B, C, D), (E, F, G, H) -> (F, E, B, A), (H, G, D, C)
+    const __m128i abcd   = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)s), 0xB1);
+    const __m128i efgh   = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(s + 4)), 0x1B);
+    __m128i       state0 = _mm_alignr_epi8(abcd, efgh, 8);
+    __m128i       state1 = _mm_blend_epi16(efgh, abcd, 0xF0);
+
+    while (blocks--) {
+        const __m128i save0 = state0;
+        const __m128i save1 = state1;
+
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)chunk), byteSwap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16)), byteSwap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 32)), byteSwap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 48)), byteSwap);
+        QuadRound(state0, state1, m0, 0);
+        QuadRound(state0, state1, m1, 4);
+        QuadRound(state0, state1, m2, 8);
+        QuadRound(state0, state1, m3, 12);
+        for (int i = 16; i < 64; i += 16) {
+            NextMessage(m0, m1, m2, m3);
+            QuadRound(state0, state1, m0, i);
+            NextMessage(m1, m2, m3, m0);
+            QuadRound(state0, state1, m1, i + 4);
+            NextMessage(m2, m3, m0, m1);
+            QuadRound(state0, state1, m2, i + 8);
+            NextMessage(m3, m0, m1, m2);
+            QuadRound(state0, state1, m3, i + 12);
+        }
+
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
+        chunk += 64;
+    }
+
+    // back to (A, B, C, D), (E, F, G, H)
+    const __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+    const __m128i hgdc = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*)s, _mm_blend_epi16(feba, hgdc, 0xF0));
+    _mm_storeu_si128((__m128i*)(s + 4), _mm_alignr_epi8(hgdc, feba, 8));
+}
+
+#undef SHANI_TARGET
+
+struct CPUFeatures
+{
+    bool fSSE41 = false;
+    bool fAVX2  = false;
+    bool fSHANI = false;
+
+    CPUFeatures()
+    {
+        uint32_t eax, ebx, ecx, edx;
+        if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+            return;
+        const uint32_t nMaxLeaf = eax;
+        __cpuid(1, eax, ebx, ecx, edx);
+        fSSE41 = (ecx >> 19) & 1;
+        // AVX registers are only usable if the OS saves them, which it announces with OSXSAVE
+        bool fAVX = false;
+        if (((ecx >> 27) & 1) && ((ecx >> 28) & 1)) {
+            uint32_t xcr0Low, xcr0High;
+            __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+            fAVX = (xcr0Low & 6) == 6;
+        }
+        if (nMaxLeaf >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            fAVX2  = fAVX && ((ebx >> 5) & 1);
+            fSHANI = fSSE41 && ((ebx >> 29) & 1);
+        }
+    }
+};
+
+#endif // SHA256_X86
+
+} // namespace
+
+std::string SHA256AutoDetect(unsigned int nAllowed)
+{
+    std::string ret   = "openssl";
+    Transform         = TransformOpenSSL;
+    TransformD64_4way = nullptr;
+    TransformD64_8way = nullptr;
+
+#ifdef SHA256_X86
+    static const CPUFeatures features;
+    if (features.fSHANI && (nAllowed & SHA256_USE_SHANI)) {
+        // one lane of the SHA extensions is as fast as eight lanes of AVX2
+        Transform = TransformSHANI;
+        return "shani";
+    }
+    // without the SHA extensions, OpenSSL's assembly is still the fastest for a single message, but
+    // several 64-byte messages are hashed faster side by side
+    if (features.fSSE41 && (nAllowed & SHA256_USE_SSE41)) {
+        TransformD64_4way = TransformD64_SSE41;
+        ret += ",sse41(4way)";
+    }
+    if (features.fAVX2 && (nAllowed & SHA256_USE_AVX2)) {
+        TransformD64_8way = TransformD64_AVX2;
+        ret += ",avx2(8way)";
+    }
+#else
+    (void)nAllowed;
+#endif
+
+    return ret;
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks--) {
+        TransformD64Single(out, in);
+        out += 32;
+        in += 64;
+    }
+}
+
+CSHA256::CSHA256() : bytes(0) { memcpy(s, IV, sizeof(s)); }
+
+CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
+{
+    const unsigned char* end     = data + len;
+    size_t               bufsize = bytes % 64;
+    if (bufsize && bufsize + len >= 64) {
+        // fill the buffer, and process it
+        memcpy(buf + bufsize, data, 64 - bufsize);
+        bytes += 64 - bufsize;
+        data += 64 - bufsize;
+        Transform(s, buf, 1);
+        bufsize = 0;
+    }
+    if (end - data >= 64) {
+        // process full chunks directly from the source
+        const size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
+    }
+    if (end > data) {
+        // fill the buffer with what remains
+        memcpy(buf + bufsize, data, end - data);
+        bytes += end - data;
+    }
+    return *this;
+}
+
+void CSHA256::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    static const unsigned char pad[64] = {0x80};
+    unsigned char              sizedesc[8];
+    const uint64_t             nBits = bytes << 3;
+    WriteBE32(sizedesc, static_cast<uint32_t>(nBits >> 32));
+    WriteBE32(sizedesc + 4, static_cast<uint32_t>(nBits));
+    Write(pad, 1 + ((119 - (bytes % 64)) % 64));
+    Write(sizedesc, 8);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(hash + 4 * i, s[i]);
+}
+
+CSHA256& CSHA256::Reset()
+{
+    bytes = 0;
+    memcpy(s, IV, sizeof(s));
+    return *this;
+}
@@ -0,0 +1,43 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** A hasher class for SHA-256, using the fastest implementation that SHA256AutoDetect() found. */
+class CSHA256
+{
+private:
+    uint32_t      s[8];
+    unsigned char buf[64];
+    uint64_t      bytes;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    CSHA256();
+    CSHA256& Write(const unsigned char* data, size_t len);
+    void     Finalize(unsigned char hash[OUTPUT_SIZE]);
+    CSHA256& Reset();
+};
+
+/** The implementations that SHA256AutoDetect() may choose from, besides OpenSSL's */
+enum SHA256Implementation : unsigned int
+{
+    SHA256_USE_SSE41 = 1 << 0, // 4-way double-SHA256 of 64-byte inputs
+    SHA256_USE_AVX2  = 1 << 1, // 8-way double-SHA256 of 64-byte inputs
+    SHA256_USE_SHANI = 1 << 2, // the SHA extensions, for everything
+    SHA256_USE_ALL   = SHA256_USE_SSE41 | SHA256_USE_AVX2 | SHA256_USE_SHANI,
+};
+
+/** Selects the fastest of the allowed implementations that the CPU supports, and returns a
+ * description of it. Until this is called, OpenSSL's implementation is used. Must not be called
+ * while other threads are hashing. */
+std::string SHA256AutoDetect(unsigned int nAllowed = SHA256_USE_ALL);
+
+/** Computes the double-SHA256 of `blocks` 64-byte inputs, like the pairs of hashes of a merkle tree
+ * level, into `blocks` 32-byte outputs. `out` may be equal to `in`. */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
+#endif // SHA256_H
@@ -0,0 +1,186 @@
+#include "sigcache.h"
+
+#include "hash.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+
+CSignatureCache::CSignatureCache() : salt(GetRandHash()) {}
+
+void CSignatureCache::Setup(uint64_t nMaxBytes)
+{
+    boost::lock_guard<boost::mutex> lock(cs_insert);
+
+    const uint64_t nNewSlots = std::min<uint64_t>(nMaxBytes / sizeof(Slot), UINT32_MAX);
+    // value-initialization zeroes the slots, which marks them as empty
+    slots.reset(nNewSlots > 0 ? new Slot[nNewSlots]() : nullptr);
+    nSlots = static_cast<uint32_t>(nNewSlots);
+
+    // a bounded number of moves per insert; beyond that, the table is too full to be worth it
+    nMaxDepth = 1;
+    while (nMaxDepth < 32 && (UINT64_C(1) << nMaxDepth) < nNewSlots)
+        nMaxDepth++;
+
+    nHits      = 0;
+    nMisses    = 0;
+    nEntries   = 0;
+    nEvictions = 0;
+}
+
+uint256 CSignatureCache::ComputeEntry(const uint256& sighash, const std::vector<unsigned char>& vchSig,
+                                      const std::vector<unsigned char>& vchPubKey) const
+{
+    // the salt keeps anyone from crafting entries that compete for the same slots
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << salt << sighash << vchSig << vchPubKey;
+    return ss.GetHash();
+}
+
+void CSignatureCache::Locations(const uint256& entry, uint32_t (&locs)[LOCATIONS]) const
+{
+    // the entry is a hash already, so each 32-bit part of it is an independent uniform value that's
+    // mapped to [0, nSlots) with a multiply-shift instead of a modulo
+    static_assert(sizeof(uint32_t) * LOCATIONS == sizeof(uint256), "One 32-bit word per location");
+    uint32_t parts[LOCATIONS];
+    memcpy(parts, entry.begin(), sizeof(parts));
+    for (unsigned int i = 0; i < LOCATIONS; i++)
+        locs[i] = static_cast<uint32_t>((static_cast<uint64_t>(parts[i]) * nSlots) >> 32);
+}
+
+bool CSignatureCache::ReadSlot(uint32_t pos, uint256& entry) const
+{
+    const Slot&    slot = slots[pos];
+    const uint32_t seq  = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1)
+        return false;
+    uint64_t words[4];
+    for (unsigned int i = 0; i < 4; i++)
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq)
+        return false; // overwritten while it was read
+    if ((words[0] | words[1] | words[2] | words[3]) == 0)
+        return false; // empty
+    static_assert(sizeof(words) == sizeof(uint256), "An entry must fill a slot");
+    memcpy(entry.begin(), words, sizeof(words));
+    return true;
+}
+
+void CSignatureCache::WriteSlot(uint32_t pos, const uint256& entry)
+{
+    uint64_t words[4];
+    memcpy(words, entry.begin(), sizeof(words));
+
+    Slot&          slot = slots[pos];
+    const uint32_t seq  = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (unsigned int i = 0; i < 4; i++)
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+bool CSignatureCache::Contains(const uint256& entry) const
+{
+    uint32_t locs[LOCATIONS];
+    Locations(entry, locs);
+    for (uint32_t pos : locs) {
+        uint256 stored;
+        if (ReadSlot(pos, stored) && stored == entry)
+            return true;
+    }
+    return false;
+}
+
+bool CSignatureCache::Get(const uint256& entry)
+{
+    const bool found = nSlots > 0 && Contains(entry);
+    if (found)
+        nHits.fetch_add(1, std::memory_order_relaxed);
+    else
+        nMisses.fetch_add(1, std::memory_order_relaxed);
+    return found;
+}
+
+void CSignatureCache::Set(const uint256& entry)
+{
+    if (nSlots == 0 || entry == 0)
+        return;
+
+    boost::lock_guard<boost::mutex> lock(cs_insert);
+    if (Contains(entry))
+        return;
+
+    uint256  cur     = entry;
+    uint32_t lastPos = nSlots; // no slot
+    for (unsigned int depth = 0; depth < nMaxDepth; depth++) {
+        uint32_t locs[LOCATIONS];
+        Locations(cur, locs);
+        for (uint32_t pos : locs) {
+            uint256 occupant;
+            // only this thread writes, so a failed read means an empty slot
+            if (!ReadSlot(pos, occupant)) {
+                WriteSlot(pos, cur);
+                nEntries.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        // all candidate slots are taken: evict the occupant of the slot after the one that cur was
+        // just moved out of, and move it to one of its other slots in the next round
+        unsigned int victim = locs[0] % LOCATIONS;
+        for (unsigned int i = 0; i < LOCATIONS; i++) {
+            if (locs[i] == lastPos) {
+                victim = (i + 1) % LOCATIONS;
+                break;
+            }
+        }
+        uint256 displaced;
+        ReadSlot(locs[victim], displaced);
+        WriteSlot(locs[victim], cur);
+        cur     = displaced;
+        lastPos = locs[victim];
+    }
+    // cur didn't find a place and is dropped
+    nEvictions.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t CSignatureCache::GetSlotSize() { return sizeof(Slot); }
+
+uint64_t CSignatureCache::GetMemoryUsage() const { return static_cast<uint64_t>(nSlots) * sizeof(Slot); }
+
+uint32_t CSignatureCache::GetSlotCount() const { return nSlots; }
+
+uint64_t CSignatureCache::GetEntryCount() const { return nEntries.load(std::memory_order_relaxed); }
+
+uint64_t CSignatureCache::GetHits() const { return nHits.load(std::memory_order_relaxed); }
+
+uint64_t CSignatureCache::GetMisses() const { return nMisses.load(std::memory_order_relaxed); }
+
+uint64_t CSignatureCache::GetEvictions() const { return nEvictions.load(std::memory_order_relaxed); }
+
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache;
+    return signatureCache;
+}
+
+void InitSignatureCache()
+{
+    const uint64_t nSlotSize = CSignatureCache::GetSlotSize();
+    const uint64_t nMaxBytes = static_cast<uint64_t>(MAX_SIG_CACHE_MB) << 20;
+    uint64_t       nBytes;
+    if (mapArgs.exists("-sigcachemb") || !mapArgs.exists("-maxsigcachesize")) {
+        const int64_t nMiB = std::max<int64_t>(0, GetArg("-sigcachemb", DEFAULT_SIG_CACHE_MB));
+        nBytes             = std::min<uint64_t>(nMiB, MAX_SIG_CACHE_MB) << 20;
+    } else {
+        // the older option, which gives the number of signatures
+        const int64_t nCount = std::max<int64_t>(0, GetArg("-maxsigcachesize", 0));
+        nBytes               = std::min<uint64_t>(nCount, nMaxBytes / nSlotSize) * nSlotSize;
+    }
+    CSignatureCache& cache = GetSignatureCache();
+    cache.Setup(nBytes);
+    printf("Using %" PRIu64 " bytes for the signature cache, with room for %u signatures\n",
+           cache.GetMemoryUsage(), cache.GetSlotCount());
+}
@@ -0,0 +1,91 @@
+#ifndef SIGCACHE_H
+#define SIGCACHE_H
+
+#include "uint256.h"
+
+#include <atomic>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/** Default for -sigcachemb, the memory budget of the signature cache in MiB */
+static const int64_t DEFAULT_SIG_CACHE_MB = 32;
+/** Upper bound for the signature cache in MiB, whether it's set with -sigcachemb or -maxsigcachesize */
+static const int64_t MAX_SIG_CACHE_MB = 4096;
+
+/**
+ * Cache of valid signatures, to avoid doing expensive ECDSA signature checking twice for every
+ * transaction (once when accepted into memory pool, and again when accepted into the block chain).
+ *
+ * Entries are salted hashes of (signature hash, signature, public key), stored in a fixed-size
+ * cuckoo table: every entry has 8 candidate slots, and inserting into a full table moves entries to
+ * their alternative slots, dropping one after a bounded number of moves. Each slot is guarded by a
+ * sequence counter, so lookups don't take a lock and can't see a half-written entry; at worst they
+ * miss an entry that's being moved, which only costs a signature verification. Inserts are
+ * serialized by a mutex.
+ */
+class CSignatureCache
+{
+public:
+    static const unsigned int LOCATIONS = 8;
+
+private:
+    struct Slot
+    {
+        // odd while the slot is being written
+        std::atomic<uint32_t> seq;
+        std::atomic<uint64_t> words[4];
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    uint32_t                nSlots    = 0;
+    unsigned int            nMaxDepth = 0;
+    const uint256           salt;
+    boost::mutex            cs_insert;
+
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+    std::atomic<uint64_t> nEntries{0};
+    std::atomic<uint64_t> nEvictions{0};
+
+    void Locations(const uint256& entry, uint32_t (&locs)[LOCATIONS]) const;
+    bool ReadSlot(uint32_t pos, uint256& entry) const;
+    void WriteSlot(uint32_t pos, const uint256& entry);
+    bool Contains(const uint256& entry) const;
+
+public:
+    /** Creates a disabled cache; Setup() allocates it */
+    CSignatureCache();
+
+    /** Resizes the cache to at most nMaxBytes and empties it; 0 disables the cache.
+     * Must not be called while other threads use the cache. */
+    void Setup(uint64_t nMaxBytes);
+
+    /** The key under which a signature is stored */
+    uint256 ComputeEntry(const uint256& sighash, const std::vector<unsigned char>& vchSig,
+                         const std::vector<unsigned char>& vchPubKey) const;
+
+    bool Get(const uint256& entry);
+    void Set(const uint256& entry);
+
+    /** The memory that each signature takes */
+    static uint64_t GetSlotSize();
+
+    uint64_t GetMemoryUsage() const;
+    uint32_t GetSlotCount() const;
+    uint64_t GetEntryCount() const;
+    uint64_t GetHits() const;
+    uint64_t GetMisses() const;
+    uint64_t GetEvictions() const;
+};
+
+/** The signature cache used by script verification */
+CSignatureCache& GetSignatureCache();
+
+/** Allocates the signature cache, sized by -sigcachemb in MiB, or by -maxsigcachesize as a number of
+ * signatures when only that older option is given */
+void InitSignatureCache();
+
+#endif // SIGCACHE_H
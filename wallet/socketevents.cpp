@@ -0,0 +1,295 @@
+#include "socketevents.h"
+
+#include "util.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#ifndef WIN32
+#include <fcntl.h>
+#endif
+
+// the most events taken from epoll at once; more are taken by the next Wait()
+static const int MAX_EPOLL_EVENTS = 256;
+
+CSocketEvents::Backend CSocketEvents::DefaultBackend()
+{
+#ifdef __linux__
+    return BACKEND_EPOLL;
+#else
+    return BACKEND_POLL;
+#endif
+}
+
+CSocketEvents::CSocketEvents(Backend backendIn) : backend(backendIn)
+{
+#ifndef WIN32
+    if (pipe(wakeFds) == 0) {
+        fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+    } else {
+        printf("CSocketEvents() : pipe() failed with error %d\n", errno);
+        wakeFds[0] = wakeFds[1] = -1;
+    }
+#endif
+
+#ifdef __linux__
+    if (backend == BACKEND_EPOLL) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            printf("CSocketEvents() : epoll_create1() failed with error %d; using poll()\n", errno);
+            backend = BACKEND_POLL;
+        } else if (wakeFds[0] >= 0) {
+            struct epoll_event ev = {};
+            ev.events             = EPOLLIN;
+            ev.data.fd            = wakeFds[0];
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFds[0], &ev);
+        }
+    }
+#else
+    backend = BACKEND_POLL;
+#endif
+}
+
+CSocketEvents::~CSocketEvents()
+{
+#ifndef WIN32
+    if (epollFd >= 0)
+        close(epollFd);
+    for (int fd : wakeFds) {
+        if (fd >= 0)
+            close(fd);
+    }
+#endif
+}
+
+const char* CSocketEvents::GetBackendName() const
+{
+#ifdef WIN32
+    return "select";
+#else
+    return backend == BACKEND_EPOLL ? "epoll" : "poll";
+#endif
+}
+
+bool CSocketEvents::Add(SOCKET hSocket, void* pdata)
+{
+    LOCK(cs);
+    if (hSocket == INVALID_SOCKET || mapSockets.count(hSocket))
+        return false;
+#ifdef __linux__
+    if (backend == BACKEND_EPOLL) {
+        struct epoll_event ev = {};
+        ev.events             = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.fd            = hSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, hSocket, &ev) != 0)
+            return error("CSocketEvents::Add() : epoll_ctl() failed with error %d", errno);
+        mapSockets[hSocket] = Registration{pdata, false, 0};
+        return true;
+    }
+#endif
+#ifndef WIN32
+    struct pollfd pfd = {};
+    pfd.fd            = hSocket;
+    pfd.events        = POLLIN;
+    mapSockets[hSocket] = Registration{pdata, false, vPollFds.size()};
+    vPollFds.push_back(pfd);
+#else
+    mapSockets[hSocket] = Registration{pdata, false, vSockets.size()};
+    vSockets.push_back(hSocket);
+#endif
+    return true;
+}
+
+void CSocketEvents::Remove(SOCKET hSocket)
+{
+    LOCK(cs);
+    const auto it = mapSockets.find(hSocket);
+    if (it == mapSockets.end())
+        return;
+    const std::size_t nIndex = it->second.nIndex;
+    mapSockets.erase(it);
+#ifdef __linux__
+    if (backend == BACKEND_EPOLL) {
+        // old kernels want an event even though it's ignored
+        struct epoll_event ev = {};
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, hSocket, &ev);
+        return;
+    }
+#endif
+    // the last socket takes the place of the removed one
+#ifndef WIN32
+    if (nIndex + 1 < vPollFds.size()) {
+        vPollFds[nIndex]                       = vPollFds.back();
+        mapSockets[vPollFds[nIndex].fd].nIndex = nIndex;
+    }
+    vPollFds.pop_back();
+#else
+    if (nIndex + 1 < vSockets.size()) {
+        vSockets[nIndex]                   = vSockets.back();
+        mapSockets[vSockets[nIndex]].nIndex = nIndex;
+    }
+    vSockets.pop_back();
+#endif
+}
+
+void CSocketEvents::SetWantSend(SOCKET hSocket, bool fWantSend)
+{
+    // epoll reports every socket that gets room to send
+    if (backend == BACKEND_EPOLL)
+        return;
+
+    LOCK(cs);
+    const auto it = mapSockets.find(hSocket);
+    if (it == mapSockets.end() || it->second.fWantSend == fWantSend)
+        return;
+    it->second.fWantSend = fWantSend;
+#ifndef WIN32
+    // like select() before, a socket that drains its queue isn't read from
+    vPollFds[it->second.nIndex].events = fWantSend ? POLLOUT : POLLIN;
+#endif
+    // a wait in progress watches the old events
+    if (fWantSend)
+        Wakeup();
+}
+
+void CSocketEvents::Wakeup()
+{
+#ifndef WIN32
+    if (wakeFds[1] >= 0) {
+        const char c      = 0;
+        ssize_t    nBytes = write(wakeFds[1], &c, 1);
+        (void)nBytes; // a full pipe wakes the wait as well
+    }
+#endif
+}
+
+void CSocketEvents::DrainWakeup()
+{
+#ifndef WIN32
+    char buf[64];
+    while (read(wakeFds[0], buf, sizeof(buf)) > 0) {
+    }
+#endif
+}
+
+bool CSocketEvents::Wait(std::vector<Event>& vEvents, int nTimeoutMs)
+{
+    vEvents.clear();
+    return backend == BACKEND_EPOLL ? WaitEdgeTriggered(vEvents, nTimeoutMs)
+                                    : WaitLevelTriggered(vEvents, nTimeoutMs);
+}
+
+bool CSocketEvents::WaitEdgeTriggered(std::vector<Event>& vEvents, int nTimeoutMs)
+{
+#ifdef __linux__
+    struct epoll_event evs[MAX_EPOLL_EVENTS];
+    const int          nEvents = epoll_wait(epollFd, evs, MAX_EPOLL_EVENTS, nTimeoutMs);
+    if (nEvents < 0)
+        return errno == EINTR ||
+               error("CSocketEvents::Wait() : epoll_wait() failed with error %d", errno);
+
+    LOCK(cs);
+    for (int i = 0; i < nEvents; i++) {
+        const int fd = evs[i].data.fd;
+        if (fd == wakeFds[0]) {
+            DrainWakeup();
+            continue;
+        }
+        // removed since
+        const auto it = mapSockets.find(fd);
+        if (it == mapSockets.end())
+            continue;
+        const uint32_t flags = evs[i].events;
+        vEvents.push_back(Event{static_cast<SOCKET>(fd), it->second.pdata,
+                                (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0, (flags & EPOLLOUT) != 0,
+                                (flags & (EPOLLHUP | EPOLLERR)) != 0});
+    }
+    return true;
+#else
+    return WaitLevelTriggered(vEvents, nTimeoutMs);
+#endif
+}
+
+bool CSocketEvents::WaitLevelTriggered(std::vector<Event>& vEvents, int nTimeoutMs)
+{
+#ifndef WIN32
+    std::vector<struct pollfd> vFds;
+    {
+        LOCK(cs);
+        vFds.reserve(vPollFds.size() + 1);
+        if (wakeFds[0] >= 0) {
+            struct pollfd pfd = {};
+            pfd.fd            = wakeFds[0];
+            pfd.events        = POLLIN;
+            vFds.push_back(pfd);
+        }
+        vFds.insert(vFds.end(), vPollFds.begin(), vPollFds.end());
+    }
+
+    const int nReady = poll(vFds.data(), vFds.size(), nTimeoutMs);
+    if (nReady < 0)
+        return errno == EINTR || error("CSocketEvents::Wait() : poll() failed with error %d", errno);
+    if (nReady == 0)
+        return true;
+
+    LOCK(cs);
+    for (const struct pollfd& pfd : vFds) {
+        if (pfd.revents == 0)
+            continue;
+        if (pfd.fd == wakeFds[0]) {
+            DrainWakeup();
+            continue;
+        }
+        // removed since
+        const auto it = mapSockets.find(pfd.fd);
+        if (it == mapSockets.end())
+            continue;
+        const bool fError = (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+        vEvents.push_back(Event{static_cast<SOCKET>(pfd.fd), it->second.pdata,
+                                fError || (pfd.revents & POLLIN) != 0,
+                                it->second.fWantSend && (pfd.revents & POLLOUT) != 0, fError});
+    }
+    return true;
+#else
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    {
+        LOCK(cs);
+        for (SOCKET hSocket : vSockets) {
+            if (mapSockets[hSocket].fWantSend)
+                FD_SET(hSocket, &fdsetSend);
+            else
+                FD_SET(hSocket, &fdsetRecv);
+            FD_SET(hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, hSocket);
+        }
+    }
+    if (hSocketMax == 0) {
+        // select() fails without sockets
+        MilliSleep(nTimeoutMs);
+        return true;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec  = nTimeoutMs / 1000;
+    timeout.tv_usec = (nTimeoutMs % 1000) * 1000;
+    if (select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout) == SOCKET_ERROR)
+        return error("CSocketEvents::Wait() : select() failed with error %d", WSAGetLastError());
+
+    LOCK(cs);
+    for (SOCKET hSocket : vSockets) {
+        const bool fRecv  = FD_ISSET(hSocket, &fdsetRecv);
+        const bool fSend  = FD_ISSET(hSocket, &fdsetSend);
+        const bool fError = FD_ISSET(hSocket, &fdsetError);
+        if (fRecv || fSend || fError)
+            vEvents.push_back(Event{hSocket, mapSockets[hSocket].pdata, fRecv || fError, fSend, fError});
+    }
+    return true;
+#endif
+}
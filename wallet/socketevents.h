@@ -0,0 +1,97 @@
+#ifndef SOCKETEVENTS_H
+#define SOCKETEVENTS_H
+
+#ifndef WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "compat.h"
+#include "sync.h"
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Readiness of the sockets that ThreadSocketHandler serves. Sockets are registered when they're
+ * created and removed before they're closed, instead of being collected again for every wait, so a
+ * wait costs the number of ready sockets rather than the number of connections, and isn't limited to
+ * FD_SETSIZE.
+ *
+ * On Linux, epoll reports edges: a socket is reported when it gets new data or room to send, and the
+ * caller has to read or send until the socket would block, or remember it. Elsewhere, poll() (select()
+ * on Windows) reports levels, and a socket is watched for sending instead of receiving while it asks
+ * for it with SetWantSend(), as an idle socket can always send.
+ */
+class CSocketEvents
+{
+public:
+    enum Backend
+    {
+        BACKEND_EPOLL,
+        BACKEND_POLL,
+    };
+
+    struct Event
+    {
+        SOCKET hSocket;
+        void*  pdata;
+        bool   fRecv;
+        bool   fSend;
+        bool   fError;
+    };
+
+    /** The best backend of the platform */
+    static Backend DefaultBackend();
+
+    explicit CSocketEvents(Backend backendIn = DefaultBackend());
+    ~CSocketEvents();
+
+    Backend     GetBackend() const { return backend; }
+    const char* GetBackendName() const;
+
+    /** Watches the socket, which the events will report with pdata */
+    bool Add(SOCKET hSocket, void* pdata);
+
+    /** Stops watching the socket; must be called before it's closed, as its number may be reused */
+    void Remove(SOCKET hSocket);
+
+    /** Whether the level-triggered backends should watch the socket for sending instead of receiving */
+    void SetWantSend(SOCKET hSocket, bool fWantSend);
+
+    /** Makes a Wait() in another thread return now */
+    void Wakeup();
+
+    /** Waits up to nTimeoutMs for events of the watched sockets; returns false on errors */
+    bool Wait(std::vector<Event>& vEvents, int nTimeoutMs);
+
+private:
+    struct Registration
+    {
+        void*       pdata;
+        bool        fWantSend;
+        std::size_t nIndex; // in vPollFds
+    };
+
+    // falls back to poll() if epoll isn't available
+    Backend backend;
+
+    mutable CCriticalSection                 cs;
+    std::unordered_map<SOCKET, Registration> mapSockets;
+#ifndef WIN32
+    std::vector<struct pollfd> vPollFds;
+    int                        epollFd    = -1;
+    int                        wakeFds[2] = {-1, -1};
+#else
+    std::vector<SOCKET> vSockets;
+#endif
+
+    bool WaitLevelTriggered(std::vector<Event>& vEvents, int nTimeoutMs);
+    bool WaitEdgeTriggered(std::vector<Event>& vEvents, int nTimeoutMs);
+    void DrainWakeup();
+
+    CSocketEvents(const CSocketEvents&) = delete;
+    CSocketEvents& operator=(const CSocketEvents&) = delete;
+};
+
+#endif // SOCKETEVENTS_H
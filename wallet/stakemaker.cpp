@@ -32,19 +32,23 @@ bool IsStakeTxSizeValid(const CTransaction& stakeTx)
     return true;
 }
 
-boost::optional<StakeKernelData>
-TestAndCreateStakeKernel(const CTxDB& txdb, const StakeMaker::KeyGetterFunctorType& keyGetter,
-                         const unsigned int nBits, const int64_t nCoinstakeInitialTxTime,
-                         const int64_t                                       lastCoinStakeSearchTime,
-                         const ConstCBlockIndexSmartPtr&                     pindexPrev,
-                         const std::pair<const CTransaction*, unsigned int>& pcoin)
+// the kernel record of the output, from the cache or read from disk
+static boost::optional<StakeKernelRecord>
+GetStakeKernelRecord(const CTxDB& txdb, const std::pair<const CTransaction*, unsigned int>& pcoin)
 {
+    const COutPoint prevout(pcoin.first->GetHash(), pcoin.second);
+
+    LRUCache<COutPoint, StakeKernelRecord>& cache = GetStakeKernelRecordCache();
+    if (boost::optional<StakeKernelRecord> record = cache.get(prevout)) {
+        return record;
+    }
+
     CTxIndex txindex;
     CBlock   kernelBlock;
     {
         // LOCK(cs_main); // Seems unnecessary, since we only read from DB
 
-        if (!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex))
+        if (!txdb.ReadTxIndex(prevout.hash, txindex))
             return boost::none;
 
         // Read block header
@@ -52,55 +56,86 @@ TestAndCreateStakeKernel(const CTxDB& txdb, const StakeMaker::KeyGetterFunctorTy
             return boost::none;
     }
 
-    const int64_t nSearchInterval = nCoinstakeInitialTxTime - lastCoinStakeSearchTime;
+    StakeKernelRecord record;
+    if (!MakeStakeKernelRecord(txdb, kernelBlock, txindex.pos.nTxPos, *pcoin.first, prevout, record))
+        return boost::none;
 
-    const int          nMaxStakeSearchInterval = Params().MaxStakeSearchInterval();
-    const unsigned int nSMA                    = Params().StakeMinAge(txdb);
-    if (kernelBlock.GetBlockTime() + nSMA > nCoinstakeInitialTxTime - nMaxStakeSearchInterval)
-        return boost::none; // only count coins meeting min age requirement
-
-    for (unsigned int n = 0; n < std::min(nSearchInterval, (int64_t)nMaxStakeSearchInterval) &&
-                             !fShutdown && pindexPrev == txdb.GetBestBlockIndex();
-         n++) {
-        // Search backward in time from the given tx timestamp
-        // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-        uint256       hashProofOfStake = 0, targetProofOfStake = 0;
-        COutPoint     prevoutStake    = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        const int64_t txCoinstakeTime = nCoinstakeInitialTxTime - n;
-        if (!CheckStakeKernelHash(txdb, nBits, kernelBlock, txindex.pos.nTxPos, *pcoin.first,
-                                  prevoutStake, txCoinstakeTime, hashProofOfStake, targetProofOfStake)) {
-            continue;
-        }
+    cache.insert(prevout, record);
+    return record;
+}
 
-        // Found a kernel
+// whether the output is old enough to be searched for a kernel in this round
+static bool IsStakeKernelCandidate(const StakeKernelRecord& record, unsigned int nSMA,
+                                   int64_t nCoinstakeInitialTxTime)
+{
+    const int nMaxStakeSearchInterval = Params().MaxStakeSearchInterval();
+    // only count coins meeting min age requirement
+    return record.nTimeBlockFrom + nSMA <= nCoinstakeInitialTxTime - nMaxStakeSearchInterval;
+}
+
+static boost::optional<StakeKernelData>
+CreateStakeKernel(const CTxDB& txdb, const StakeMaker::KeyGetterFunctorType& keyGetter,
+                  const StakeKernelRecord& record, const int64_t txCoinstakeTime,
+                  const std::pair<const CTransaction*, unsigned int>& pcoin)
+{
+    // Found a kernel
+    if (fDebug)
+        printf("FindStakeKernel : kernel found\n");
+
+    const CScript& kernelScriptPubKey = pcoin.first->vout[pcoin.second].scriptPubKey;
+
+    const boost::optional<CScript> spkKernel =
+        StakeMaker::CalculateScriptPubKeyForStakeOutput(txdb, keyGetter, kernelScriptPubKey);
+
+    if (!spkKernel) {
         if (fDebug)
-            printf("FindStakeKernel : kernel found\n");
+            printf("FindStakeKernel : failed to get scriptPubKey for kernel");
+        return boost::none;
+    }
 
-        const CScript& kernelScriptPubKey = pcoin.first->vout[pcoin.second].scriptPubKey;
+    StakeKernelData coinStake;
 
-        const boost::optional<CScript> spkKernel =
-            StakeMaker::CalculateScriptPubKeyForStakeOutput(txdb, keyGetter, kernelScriptPubKey);
+    // Fill coin stake transaction
+    coinStake.kernelScriptPubKey      = kernelScriptPubKey;
+    coinStake.credit                  = pcoin.first->vout[pcoin.second].nValue;
+    coinStake.kernelTx                = pcoin.first;
+    coinStake.kernelBlockTime         = record.nTimeBlockFrom;
+    coinStake.kernelInput             = CTxIn(pcoin.first->GetHash(), pcoin.second);
+    coinStake.stakeTxTime             = txCoinstakeTime;
+    coinStake.stakeOutputScriptPubKey = *spkKernel;
 
-        if (!spkKernel) {
-            if (fDebug)
-                printf("FindStakeKernel : failed to get scriptPubKey for kernel");
-            continue;
-        }
+    return coinStake;
+}
 
-        StakeKernelData coinStake;
+boost::optional<StakeKernelData>
+TestAndCreateStakeKernel(const CTxDB& txdb, const StakeMaker::KeyGetterFunctorType& keyGetter,
+                         const unsigned int nBits, const int64_t nCoinstakeInitialTxTime,
+                         const int64_t                                       lastCoinStakeSearchTime,
+                         const ConstCBlockIndexSmartPtr&                     pindexPrev,
+                         const std::pair<const CTransaction*, unsigned int>& pcoin)
+{
+    const boost::optional<StakeKernelRecord> record = GetStakeKernelRecord(txdb, pcoin);
+    if (!record)
+        return boost::none;
 
-        // Fill coin stake transaction
-        coinStake.kernelScriptPubKey      = kernelScriptPubKey;
-        coinStake.credit                  = pcoin.first->vout[pcoin.second].nValue;
-        coinStake.kernelTx                = pcoin.first;
-        coinStake.kernelBlockTime         = kernelBlock.GetBlockTime();
-        coinStake.kernelInput             = CTxIn(pcoin.first->GetHash(), pcoin.second);
-        coinStake.stakeTxTime             = txCoinstakeTime;
-        coinStake.stakeOutputScriptPubKey = *spkKernel;
+    const unsigned int nSMA = Params().StakeMinAge(txdb);
+    if (!IsStakeKernelCandidate(*record, nSMA, nCoinstakeInitialTxTime))
+        return boost::none;
 
-        return coinStake;
-    }
-    return boost::none;
+    // Search backward in time from the given tx timestamp
+    // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
+    const int64_t nSearchInterval = nCoinstakeInitialTxTime - lastCoinStakeSearchTime;
+    const int64_t nSearchCount =
+        std::min(nSearchInterval, static_cast<int64_t>(Params().MaxStakeSearchInterval()));
+    if (nSearchCount <= 0)
+        return boost::none;
+
+    const boost::optional<unsigned int> txCoinstakeTime = SearchStakeKernelTime(
+        *record, nBits, nSMA, nCoinstakeInitialTxTime, static_cast<unsigned int>(nSearchCount));
+    if (!txCoinstakeTime || fShutdown || pindexPrev != txdb.GetBestBlockIndex())
+        return boost::none;
+
+    return CreateStakeKernel(txdb, keyGetter, *record, *txCoinstakeTime, pcoin);
 }
 
 boost::optional<CAmount> CalculateStakeReward(const ITxDB& txdb, const CTransaction& stakeTx,
@@ -475,10 +510,51 @@ StakeMaker::FindStakeKernel(const CKeyStore& keystore, const unsigned int nBits,
 
     ConstCBlockIndexSmartPtr pindexPrev = txdb.GetBestBlockIndex();
 
+    // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
+    const int64_t nSearchInterval = nCoinstakeInitialTxTime - nLastCoinStakeSearchTime;
+    const int64_t nSearchCount =
+        std::min(nSearchInterval, static_cast<int64_t>(Params().MaxStakeSearchInterval()));
+    if (nSearchCount <= 0)
+        return boost::none;
+
+    const unsigned int nSMA = Params().StakeMinAge(txdb);
+
+    // only the coins that weren't searched before are read from disk
+    std::vector<std::pair<const CTransaction*, unsigned int>> coins;
+    std::vector<StakeKernelRecord>                            records;
+    coins.reserve(setCoins.size());
+    records.reserve(setCoins.size());
     for (const auto& pcoin : setCoins) {
-        if (boost::optional<StakeKernelData> res = TestAndCreateStakeKernel(
-                txdb, StakeMaker::DefaultKeyGetter(keystore), nBits, nCoinstakeInitialTxTime,
-                nLastCoinStakeSearchTime, pindexPrev, pcoin)) {
+        const boost::optional<StakeKernelRecord> record = GetStakeKernelRecord(txdb, pcoin);
+        if (record && IsStakeKernelCandidate(*record, nSMA, nCoinstakeInitialTxTime)) {
+            coins.push_back(pcoin);
+            records.push_back(*record);
+        }
+    }
+
+    // the coins are searched in parallel; nothing is shared but the results
+    const unsigned nThreads = static_cast<unsigned>(std::max<std::size_t>(
+        1, std::min<std::size_t>(std::thread::hardware_concurrency(),
+                                 records.size() / STAKE_KERNEL_SEARCH_MIN_SHARD)));
+
+    std::vector<boost::optional<unsigned int>> found(records.size());
+    RunSharded(records.size(), nThreads, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end && !fShutdown; i++) {
+            found[i] = SearchStakeKernelTime(records[i], nBits, nSMA, nCoinstakeInitialTxTime,
+                                             static_cast<unsigned int>(nSearchCount));
+        }
+    });
+
+    if (fShutdown || pindexPrev != txdb.GetBestBlockIndex())
+        return boost::none;
+
+    // the first coin with a kernel wins, like when they're searched one after the other
+    for (std::size_t i = 0; i < records.size(); i++) {
+        if (!found[i])
+            continue;
+        if (boost::optional<StakeKernelData> res =
+                CreateStakeKernel(txdb, StakeMaker::DefaultKeyGetter(keystore), records[i],
+                                  *found[i], coins[i])) {
             return res;
         }
     }
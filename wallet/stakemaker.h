@@ -13,6 +13,9 @@ class CWallet;
 class CWalletTx;
 class CKeyStore;
 
+// the least number of coins that a thread searches for a stake kernel
+static const std::size_t STAKE_KERNEL_SEARCH_MIN_SHARD = 256;
+
 struct StakeKernelData
 {
     CScript             kernelScriptPubKey;
@@ -0,0 +1,147 @@
+#include "stakemodifierindex.h"
+
+#include "blockindex.h"
+
+#include <algorithm>
+#include <limits>
+
+StakeModifierIndexEntry StakeModifierIndex::MakeEntry(const CBlockIndexSmartPtr&     pindex,
+                                                      const StakeModifierIndexEntry* prev)
+{
+    StakeModifierIndexEntry entry;
+    entry.pindex                  = pindex;
+    entry.nTime                   = pindex->GetBlockTime();
+    entry.nStakeModifier          = pindex->nStakeModifier;
+    entry.nHeight                 = pindex->nHeight;
+    entry.fGeneratedStakeModifier = pindex->GeneratedStakeModifier();
+    entry.nMaxGeneratedTime =
+        prev ? prev->nMaxGeneratedTime : std::numeric_limits<int64_t>::min();
+    entry.nLastGeneratedHeight = prev ? prev->nLastGeneratedHeight : -1;
+    if (entry.fGeneratedStakeModifier) {
+        entry.nMaxGeneratedTime    = std::max(entry.nMaxGeneratedTime, entry.nTime);
+        entry.nLastGeneratedHeight = entry.nHeight;
+    }
+    return entry;
+}
+
+bool StakeModifierIndex::ContainsInner(const CBlockIndex* pindex) const
+{
+    return pindex && pindex->nHeight >= 0 && pindex->nHeight < static_cast<int>(entries.size()) &&
+           entries[pindex->nHeight].pindex.get() == pindex;
+}
+
+void StakeModifierIndex::Push(const CBlockIndexSmartPtr& pindex)
+{
+    {
+        LOCK(cs);
+        const bool fExtendsTip =
+            pindex->nHeight == static_cast<int>(entries.size()) &&
+            (entries.empty() ? !pindex->pprev : entries.back().pindex == pindex->pprev);
+        if (fExtendsTip) {
+            entries.push_back(MakeEntry(pindex, entries.empty() ? nullptr : &entries.back()));
+            return;
+        }
+    }
+    Reset(pindex);
+}
+
+void StakeModifierIndex::Truncate(int nHeight)
+{
+    LOCK(cs);
+    if (nHeight + 1 < static_cast<int>(entries.size())) {
+        entries.resize(std::max(nHeight + 1, 0));
+    }
+}
+
+void StakeModifierIndex::Reset(const CBlockIndexSmartPtr& pindexTip)
+{
+    std::vector<CBlockIndexSmartPtr> chain(pindexTip ? pindexTip->nHeight + 1 : 0);
+    for (CBlockIndexSmartPtr pindex = pindexTip; pindex; pindex = pindex->pprev) {
+        chain[pindex->nHeight] = pindex;
+    }
+
+    std::vector<StakeModifierIndexEntry> newEntries;
+    newEntries.reserve(chain.size());
+    for (const CBlockIndexSmartPtr& pindex : chain) {
+        newEntries.push_back(MakeEntry(pindex, newEntries.empty() ? nullptr : &newEntries.back()));
+    }
+
+    LOCK(cs);
+    entries.swap(newEntries);
+}
+
+void StakeModifierIndex::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+}
+
+int StakeModifierIndex::Height() const
+{
+    LOCK(cs);
+    return static_cast<int>(entries.size()) - 1;
+}
+
+CBlockIndexSmartPtr StakeModifierIndex::Get(int nHeight) const
+{
+    LOCK(cs);
+    if (nHeight < 0 || nHeight >= static_cast<int>(entries.size())) {
+        return nullptr;
+    }
+    return entries[nHeight].pindex;
+}
+
+bool StakeModifierIndex::Contains(const CBlockIndex* pindex) const
+{
+    LOCK(cs);
+    return ContainsInner(pindex);
+}
+
+boost::optional<StakeModifierIndexEntry>
+StakeModifierIndex::GetLastGenerated(const CBlockIndex* pindex) const
+{
+    LOCK(cs);
+    if (!ContainsInner(pindex) || entries[pindex->nHeight].nLastGeneratedHeight < 0) {
+        return boost::none;
+    }
+    return entries[entries[pindex->nHeight].nLastGeneratedHeight];
+}
+
+boost::optional<StakeModifierIndexEntry>
+StakeModifierIndex::FindGeneratedAfter(const CBlockIndexSmartPtr& pindexFrom, int64_t nTime,
+                                       CBlockIndexSmartPtr& pindexLast) const
+{
+    LOCK(cs);
+    if (!ContainsInner(pindexFrom.get())) {
+        pindexLast = pindexFrom;
+        return boost::none;
+    }
+    pindexLast = entries.back().pindex;
+
+    const int nHeightFrom = pindexFrom->nHeight;
+    const auto it         = std::lower_bound(entries.cbegin(), entries.cend(), nTime,
+                                     [](const StakeModifierIndexEntry& entry, int64_t t) {
+                                         return entry.nMaxGeneratedTime < t;
+                                     });
+    if (it == entries.cend()) {
+        return boost::none;
+    }
+    // the largest time only grows at blocks that generated a modifier, so unless it was reached up to
+    // pindexFrom, none of the blocks between it and pindexFrom has the time
+    if (it->nHeight > nHeightFrom) {
+        return *it;
+    }
+    // block times aren't ordered, so an earlier block may have had a later time
+    for (int i = nHeightFrom + 1; i < static_cast<int>(entries.size()); i++) {
+        if (entries[i].fGeneratedStakeModifier && entries[i].nTime >= nTime) {
+            return entries[i];
+        }
+    }
+    return boost::none;
+}
+
+StakeModifierIndex& GetStakeModifierIndex()
+{
+    static StakeModifierIndex index;
+    return index;
+}
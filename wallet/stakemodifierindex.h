@@ -0,0 +1,75 @@
+#ifndef STAKEMODIFIERINDEX_H
+#define STAKEMODIFIERINDEX_H
+
+#include "globals.h"
+#include "sync.h"
+
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <vector>
+
+/** What the stake modifier computations need from a block of the main chain */
+struct StakeModifierIndexEntry
+{
+    CBlockIndexSmartPtr pindex;
+    int64_t             nTime                   = 0;
+    uint64_t            nStakeModifier          = 0;
+    int                 nHeight                 = 0;
+    bool                fGeneratedStakeModifier = false;
+    // the largest time of the blocks up to this one that generated a stake modifier, which never
+    // decreases along the chain, and the height of the last of these blocks (-1 if none)
+    int64_t nMaxGeneratedTime    = 0;
+    int     nLastGeneratedHeight = -1;
+};
+
+/**
+ * The blocks of the main chain in a vector indexed by height, updated when blocks are connected and
+ * disconnected, so that finding the stake modifier of a kernel is a binary search instead of a walk
+ * along pnext, and finding a block by height is a lookup.
+ */
+class StakeModifierIndex
+{
+    mutable CCriticalSection             cs;
+    std::vector<StakeModifierIndexEntry> entries;
+
+    static StakeModifierIndexEntry MakeEntry(const CBlockIndexSmartPtr&     pindex,
+                                             const StakeModifierIndexEntry* prev);
+
+    // whether pindex is the block at its height; cs must be held
+    bool ContainsInner(const CBlockIndex* pindex) const;
+
+public:
+    /** Appends a block whose parent is the tip; anything else rebuilds the index from it */
+    void Push(const CBlockIndexSmartPtr& pindex);
+
+    /** Removes the blocks above nHeight */
+    void Truncate(int nHeight);
+
+    /** Rebuilds the index from the tip of the main chain by walking pprev */
+    void Reset(const CBlockIndexSmartPtr& pindexTip);
+
+    void Clear();
+
+    /** The height of the tip, or -1 if empty */
+    int Height() const;
+
+    /** The block at nHeight, or null if the chain isn't that high */
+    CBlockIndexSmartPtr Get(int nHeight) const;
+
+    bool Contains(const CBlockIndex* pindex) const;
+
+    /** The last block at or before pindex that generated a stake modifier; none if pindex isn't in
+     * the main chain or no block generated one */
+    boost::optional<StakeModifierIndexEntry> GetLastGenerated(const CBlockIndex* pindex) const;
+
+    /** The first block after pindexFrom that generated a stake modifier with a time of nTime or
+     * later. If there's none, pindexLast is set to where the walk along pnext would have stopped:
+     * the tip, or pindexFrom itself if it isn't in the main chain */
+    boost::optional<StakeModifierIndexEntry> FindGeneratedAfter(const CBlockIndexSmartPtr& pindexFrom,
+                                                                int64_t                    nTime,
+                                                                CBlockIndexSmartPtr& pindexLast) const;
+};
+
+StakeModifierIndex& GetStakeModifierIndex();
+
+#endif // STAKEMODIFIERINDEX_H
@@ -0,0 +1,260 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "blockdownload.h"
+#include "blockindex.h"
+#include "chain.h"
+
+#include <set>
+
+// linked headers after hashFrom, each adding nTrustPerBlock to the trust
+static std::vector<HeaderEntry> MakeHeaders(const uint256& hashFrom, int nHeightFrom, uint256 nTrustFrom,
+                                            int nCount, uint64_t nSalt, uint64_t nTrustPerBlock = 1)
+{
+    std::vector<HeaderEntry> vEntries;
+    uint256                  hashPrev = hashFrom;
+    for (int i = 0; i < nCount; i++) {
+        HeaderEntry entry;
+        entry.nHeight       = nHeightFrom + 1 + i;
+        entry.hash          = uint256(nSalt * 1000000 + entry.nHeight);
+        entry.hashPrevBlock = hashPrev;
+        entry.nChainTrust   = nTrustFrom + nTrustPerBlock * (i + 1);
+        hashPrev            = entry.hash;
+        vEntries.push_back(entry);
+    }
+    return vEntries;
+}
+
+TEST(blockdownload_tests, headers_and_forks)
+{
+    CBlockDownload download;
+    download.PeerConnected(1, 3000);
+    download.PeerConnected(2, 3000);
+
+    // the first request is always sent, and only one at a time
+    EXPECT_TRUE(download.ShouldRequestHeaders(1, 0, 100));
+    EXPECT_FALSE(download.ShouldRequestHeaders(1, 0, 101));
+
+    const std::vector<HeaderEntry> main = MakeHeaders(uint256(1), 0, 0, 2000, 1);
+    EXPECT_TRUE(download.AddHeaders(1, main, true, uint256(1)));
+    EXPECT_EQ(download.Height(), 2000);
+    EXPECT_TRUE(download.Contains(main[500].hash));
+
+    // the peer has more, but a peer that sent everything it has isn't asked again
+    EXPECT_TRUE(download.ShouldRequestHeaders(1, 0, 102));
+    download.PeerConnected(3, 1500);
+    EXPECT_TRUE(download.ShouldRequestHeaders(3, 0, 102));
+    const std::vector<HeaderEntry> shorter(main.begin(), main.begin() + 1500);
+    EXPECT_TRUE(download.AddHeaders(3, shorter, false, uint256(1)));
+    EXPECT_FALSE(download.ShouldRequestHeaders(3, 0, 103));
+
+    // a fork doesn't replace the headers, whatever trust it claims; the peer is asked again later
+    EXPECT_TRUE(download.ShouldRequestHeaders(2, 0, 104));
+    const std::vector<HeaderEntry> strongFork =
+        MakeHeaders(main[999].hash, 1000, main[999].nChainTrust, 100, 3, 100);
+    EXPECT_TRUE(download.AddHeaders(2, strongFork, true, uint256(1)));
+    EXPECT_FALSE(download.Contains(strongFork[0].hash));
+    EXPECT_TRUE(download.Contains(main[1000].hash));
+    EXPECT_EQ(download.Height(), 2000);
+    EXPECT_FALSE(download.ShouldRequestHeaders(2, 0, 105));
+    EXPECT_TRUE(download.ShouldRequestHeaders(2, 0, 104 + HEADERS_RESPONSE_TIMEOUT));
+
+    // an invalid block removes itself and what follows, and is never taken again
+    download.BlockRejected(main[1500].hash, true);
+    EXPECT_EQ(download.Height(), 1500);
+    EXPECT_FALSE(download.AddHeaders(2, main, false, uint256(1)));
+
+    // without headers, only a branch on the tip of the active chain is taken
+    download.Clear();
+    download.PeerConnected(1, 3000);
+    EXPECT_TRUE(download.AddHeaders(1, main, false, uint256(2)));
+    EXPECT_EQ(download.Height(), -1);
+    EXPECT_TRUE(download.AddHeaders(1, main, false, uint256(1)));
+    EXPECT_EQ(download.Height(), 2000);
+}
+
+TEST(blockdownload_tests, peers_leaving)
+{
+    const std::vector<HeaderEntry> main = MakeHeaders(uint256(1), 0, 0, 1000, 1);
+
+    CBlockDownload download;
+    for (int64_t nodeId = 1; nodeId <= 3; nodeId++)
+        download.PeerConnected(nodeId, 1500);
+    ASSERT_TRUE(download.AddHeaders(1, main, false, uint256(1)));
+    const std::vector<HeaderEntry> firstHalf(main.begin(), main.begin() + 500);
+    ASSERT_TRUE(download.AddHeaders(2, firstHalf, false, uint256(1)));
+    const std::vector<HeaderEntry> extension = MakeHeaders(main.back().hash, 1000, 0, 500, 1);
+    ASSERT_TRUE(download.AddHeaders(3, extension, false, uint256(1)));
+    EXPECT_EQ(download.Height(), 1500);
+
+    // the headers that only the peer sent leave with it
+    download.PeerDisconnected(3);
+    EXPECT_EQ(download.Height(), 1000);
+    download.PeerDisconnected(1);
+    EXPECT_EQ(download.Height(), 500);
+    download.PeerDisconnected(2);
+    EXPECT_EQ(download.Height(), -1);
+
+    // a peer that claims a branch with more trust than it has doesn't hold back the others for good
+    download.PeerConnected(4, 1000);
+    download.PeerConnected(5, 1000);
+    const std::vector<HeaderEntry> forged = MakeHeaders(uint256(1), 0, 0, 1000, 2, 1000);
+    ASSERT_TRUE(download.AddHeaders(4, forged, false, uint256(1)));
+    ASSERT_TRUE(download.AddHeaders(5, main, false, uint256(1)));
+    EXPECT_FALSE(download.Contains(main[0].hash));
+    download.PeerDisconnected(4);
+    EXPECT_EQ(download.Height(), -1);
+    EXPECT_TRUE(download.ShouldRequestHeaders(5, 0, 1));
+    ASSERT_TRUE(download.AddHeaders(5, main, false, uint256(1)));
+    EXPECT_TRUE(download.Contains(main[0].hash));
+}
+
+TEST(blockdownload_tests, request_blocks)
+{
+    const std::vector<HeaderEntry> headers = MakeHeaders(uint256(1), 0, 0, 2000, 1);
+
+    CBlockDownload download;
+    download.PeerConnected(1, 2000);
+    download.PeerConnected(2, 2000);
+    download.PeerConnected(3, 10);
+    ASSERT_TRUE(download.AddHeaders(1, headers, false, uint256(1)));
+
+    std::set<uint256> setHave;
+    const auto        fHave = [&setHave](const uint256& hash) { return setHave.count(hash) > 0; };
+
+    // each peer gets a few blocks, lowest first, and none twice
+    const std::vector<uint256> v1 = download.RequestBlocks(1, 0, fHave);
+    const std::vector<uint256> v2 = download.RequestBlocks(2, 0, fHave);
+    ASSERT_EQ(v1.size(), MAX_BLOCKS_IN_FLIGHT_PER_PEER);
+    ASSERT_EQ(v2.size(), MAX_BLOCKS_IN_FLIGHT_PER_PEER);
+    EXPECT_EQ(v1[0], headers[0].hash);
+    EXPECT_EQ(v2[0], headers[MAX_BLOCKS_IN_FLIGHT_PER_PEER].hash);
+    EXPECT_TRUE(download.RequestBlocks(1, 0, fHave).empty());
+
+    // a peer only gets blocks it has
+    EXPECT_TRUE(download.RequestBlocks(3, 0, fHave).empty());
+
+    EXPECT_TRUE(download.BlockReceived(v1[1]));
+    EXPECT_FALSE(download.BlockReceived(v1[1]));
+
+    // connected blocks leave the window, which moves up
+    setHave.insert(headers[0].hash);
+    setHave.insert(headers[1].hash);
+    const std::vector<uint256> v1b = download.RequestBlocks(1, 1, fHave);
+    ASSERT_EQ(v1b.size(), 2u);
+    EXPECT_EQ(v1b[0], headers[2 * MAX_BLOCKS_IN_FLIGHT_PER_PEER].hash);
+
+    // the blocks of a peer that left go to others
+    download.PeerDisconnected(2);
+    download.PeerConnected(4, 2000);
+    const std::vector<uint256> v4 = download.RequestBlocks(4, 2, fHave);
+    ASSERT_EQ(v4.size(), MAX_BLOCKS_IN_FLIGHT_PER_PEER);
+    EXPECT_EQ(v4[0], v2[0]);
+
+    // a peer that doesn't send what it was asked for in time
+    EXPECT_FALSE(download.IsStalling(1, BLOCK_DOWNLOAD_TIMEOUT));
+    EXPECT_TRUE(download.IsStalling(1, BLOCK_DOWNLOAD_TIMEOUT + 1));
+    EXPECT_FALSE(download.IsStalling(4, BLOCK_DOWNLOAD_TIMEOUT + 1));
+}
+
+TEST(blockdownload_tests, stalling_window)
+{
+    const int                      nCount  = BLOCK_DOWNLOAD_WINDOW;
+    const std::vector<HeaderEntry> headers = MakeHeaders(uint256(1), 0, 0, nCount, 1);
+    const auto                     fHave   = [](const uint256&) { return false; };
+
+    CBlockDownload download;
+    ASSERT_TRUE(download.AddHeaders(1, headers, false, uint256(1)));
+
+    // peer 1 has the first blocks of the window, the other peers fill the rest of it
+    download.PeerConnected(1, nCount);
+    ASSERT_EQ(download.RequestBlocks(1, 0, fHave).size(), MAX_BLOCKS_IN_FLIGHT_PER_PEER);
+    EXPECT_FALSE(download.IsStalling(1, BLOCK_STALLING_TIMEOUT + 1));
+    int nRequested = MAX_BLOCKS_IN_FLIGHT_PER_PEER;
+    for (int64_t nodeId = 2; nRequested < nCount; nodeId++) {
+        download.PeerConnected(nodeId, nCount);
+        nRequested += download.RequestBlocks(nodeId, 1, fHave).size();
+    }
+
+    // the whole window waits for peer 1
+    EXPECT_FALSE(download.IsStalling(1, BLOCK_STALLING_TIMEOUT));
+    EXPECT_TRUE(download.IsStalling(1, BLOCK_STALLING_TIMEOUT + 1));
+    EXPECT_FALSE(download.IsStalling(2, BLOCK_STALLING_TIMEOUT + 1));
+}
+
+TEST(blockdownload_tests, blocks_before_parent)
+{
+    // real blocks, because the blocks are identified by their hash
+    std::vector<CBlock>      vBlocks(3);
+    std::vector<HeaderEntry> vEntries;
+    uint256                  hashPrev = uint256(1);
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        vBlocks[i].hashPrevBlock = hashPrev;
+        vBlocks[i].nTime         = 1000 + i;
+        vBlocks[i].nBits         = 0x1e0fffff;
+        HeaderEntry entry;
+        entry.hash          = vBlocks[i].GetHash();
+        entry.hashPrevBlock = hashPrev;
+        entry.nHeight       = 1 + i;
+        entry.nChainTrust   = 1 + i;
+        vEntries.push_back(entry);
+        hashPrev = entry.hash;
+    }
+
+    CBlockDownload download;
+    download.PeerConnected(7, 3);
+    ASSERT_TRUE(download.AddHeaders(7, vEntries, false, uint256(1)));
+    const auto fHave = [](const uint256&) { return false; };
+    ASSERT_EQ(download.RequestBlocks(7, 0, fHave).size(), 3u);
+
+    EXPECT_TRUE(download.BlockReceived(vEntries[2].hash));
+    EXPECT_TRUE(download.AddReceivedBlock(vBlocks[2], 7));
+    EXPECT_TRUE(download.BlockReceived(vEntries[1].hash));
+    EXPECT_TRUE(download.AddReceivedBlock(vBlocks[1], 7));
+
+    // a block that isn't in the header chain goes elsewhere
+    CBlock other;
+    other.nTime = 5;
+    EXPECT_FALSE(download.AddReceivedBlock(other, 7));
+
+    // kept blocks aren't requested again
+    EXPECT_TRUE(download.RequestBlocks(7, 1, fHave).empty());
+
+    CBlock  block;
+    int64_t nodeId = 0;
+    EXPECT_FALSE(download.TakeReceivedChild(uint256(1), block, nodeId));
+    ASSERT_TRUE(download.TakeReceivedChild(vEntries[0].hash, block, nodeId));
+    EXPECT_EQ(block.GetHash(), vEntries[1].hash);
+    EXPECT_EQ(nodeId, 7);
+    ASSERT_TRUE(download.TakeReceivedChild(vEntries[1].hash, block, nodeId));
+    EXPECT_EQ(block.GetHash(), vEntries[2].hash);
+    EXPECT_FALSE(download.TakeReceivedChild(vEntries[2].hash, block, nodeId));
+}
+
+TEST(blockdownload_tests, locator)
+{
+    std::vector<CBlockIndexSmartPtr> vIndex;
+    for (int i = 0; i <= 100; i++) {
+        CBlockIndexSmartPtr pindex = boost::make_shared<CBlockIndex>();
+        pindex->nHeight            = i;
+        pindex->phashBlock         = uint256(5000 + i);
+        pindex->pprev              = vIndex.empty() ? nullptr : vIndex.back();
+        vIndex.push_back(pindex);
+    }
+    CChain chain;
+    chain.SetTip(vIndex.back().get());
+
+    CBlockDownload                 download;
+    const std::vector<HeaderEntry> headers = MakeHeaders(vIndex.back()->GetBlockHash(), 100, 0, 50, 1);
+    download.PeerConnected(1, 150);
+    ASSERT_TRUE(download.AddHeaders(1, headers, false, vIndex.back()->GetBlockHash()));
+
+    // the last headers one by one, then exponentially further back into the active chain
+    const std::vector<uint256> vHave = download.GetLocatorHashes(chain);
+    ASSERT_EQ(vHave.size(), 18u);
+    EXPECT_EQ(vHave[0], headers[49].hash);
+    EXPECT_EQ(vHave[10], headers[39].hash);
+    EXPECT_EQ(vHave[11], headers[37].hash);
+    EXPECT_EQ(vHave[14], headers[9].hash);
+    EXPECT_EQ(vHave[15], vIndex[78]->GetBlockHash());
+    EXPECT_EQ(vHave.back(), vIndex[0]->GetBlockHash());
+}
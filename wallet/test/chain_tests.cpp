@@ -0,0 +1,61 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "blockindex.h"
+#include "chain.h"
+
+static std::vector<CBlockIndexSmartPtr> MakeBranch(const CBlockIndexSmartPtr& pindexFrom, int nLength)
+{
+    std::vector<CBlockIndexSmartPtr> branch;
+    CBlockIndexSmartPtr              pprev = pindexFrom;
+    for (int i = 0; i < nLength; i++) {
+        CBlockIndexSmartPtr pindex = boost::make_shared<CBlockIndex>();
+        pindex->nHeight            = pprev ? pprev->nHeight + 1 : 0;
+        pindex->pprev              = pprev;
+        branch.push_back(pindex);
+        pprev = pindex;
+    }
+    return branch;
+}
+
+TEST(chain_tests, set_tip)
+{
+    const std::vector<CBlockIndexSmartPtr> main = MakeBranch(nullptr, 100);
+
+    CChain chain;
+    EXPECT_EQ(chain.Height(), -1);
+    EXPECT_EQ(chain.Tip(), nullptr);
+    EXPECT_FALSE(chain.Contains(main[0].get()));
+
+    chain.SetTip(main[49].get());
+    EXPECT_EQ(chain.Height(), 49);
+    EXPECT_EQ(chain.Genesis(), main[0].get());
+    EXPECT_EQ(chain[30], main[30].get());
+    EXPECT_EQ(chain[50], nullptr);
+    EXPECT_EQ(chain[-1], nullptr);
+    EXPECT_EQ(chain.Next(main[30].get()), main[31].get());
+    EXPECT_EQ(chain.Next(main[49].get()), nullptr);
+
+    // extending one block at a time
+    for (int i = 50; i < 100; i++) {
+        chain.SetTip(main[i].get());
+    }
+    EXPECT_EQ(chain.Tip(), main[99].get());
+    EXPECT_TRUE(chain.Contains(main[75].get()));
+
+    // a shorter fork from block 80 replaces the blocks above it
+    const std::vector<CBlockIndexSmartPtr> fork = MakeBranch(main[80], 5);
+    chain.SetTip(fork.back().get());
+    EXPECT_EQ(chain.Height(), 85);
+    EXPECT_EQ(chain.Next(main[80].get()), fork[0].get());
+    EXPECT_TRUE(chain.Contains(main[80].get()));
+    EXPECT_FALSE(chain.Contains(main[81].get()));
+    EXPECT_EQ(chain.Next(main[81].get()), nullptr);
+
+    // and back
+    chain.SetTip(main[99].get());
+    EXPECT_FALSE(chain.Contains(fork[0].get()));
+    EXPECT_EQ(chain[85], main[85].get());
+
+    chain.SetTip(nullptr);
+    EXPECT_EQ(chain.Height(), -1);
+}
@@ -0,0 +1,182 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "checkqueue.h"
+#include "key.h"
+#include "script.h"
+#include "sigcache.h"
+#include "transaction.h"
+#include "util.h"
+
+#include <atomic>
+#include <chrono>
+
+extern uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn,
+                             int nHashType);
+
+struct CountingCheck
+{
+    std::atomic<int>* pcounter = nullptr;
+    bool              fResult  = true;
+
+    CountingCheck() = default;
+    CountingCheck(std::atomic<int>& counter, bool fResultIn) : pcounter(&counter), fResult(fResultIn) {}
+
+    bool operator()() const
+    {
+        (*pcounter)++;
+        return fResult;
+    }
+
+    void swap(CountingCheck& other)
+    {
+        std::swap(pcounter, other.pcounter);
+        std::swap(fResult, other.fResult);
+    }
+};
+
+TEST(checkqueue_tests, results)
+{
+    CCheckQueue<CountingCheck> queue(16);
+    queue.Start(3);
+    EXPECT_TRUE(queue.HasThreads());
+
+    for (int round = 0; round < 3; round++) {
+        std::atomic<int>                  counter{0};
+        CCheckQueueControl<CountingCheck> control(&queue);
+        for (int i = 0; i < 100; i++) {
+            std::vector<CountingCheck> vChecks(10, CountingCheck(counter, true));
+            control.Add(vChecks);
+            EXPECT_TRUE(vChecks.empty());
+        }
+        EXPECT_TRUE(control.Wait());
+        EXPECT_EQ(counter.load(), 1000);
+    }
+
+    // one failure fails the whole batch, and the queue is reusable afterwards
+    {
+        std::atomic<int>                  counter{0};
+        CCheckQueueControl<CountingCheck> control(&queue);
+        std::vector<CountingCheck>        vChecks(500, CountingCheck(counter, true));
+        vChecks[250] = CountingCheck(counter, false);
+        control.Add(vChecks);
+        EXPECT_FALSE(control.Wait());
+    }
+    {
+        std::atomic<int>                  counter{0};
+        CCheckQueueControl<CountingCheck> control(&queue);
+        std::vector<CountingCheck>        vChecks(500, CountingCheck(counter, true));
+        control.Add(vChecks);
+        EXPECT_TRUE(control.Wait());
+    }
+
+    queue.Stop();
+    EXPECT_FALSE(queue.HasThreads());
+
+    // without a queue, checks run on the calling thread
+    std::atomic<int>                  counter{0};
+    CCheckQueueControl<CountingCheck> control(nullptr);
+    std::vector<CountingCheck>        vChecks(5, CountingCheck(counter, true));
+    control.Add(vChecks);
+    EXPECT_EQ(counter.load(), 5);
+    EXPECT_TRUE(control.Wait());
+}
+
+// txCount transactions that spend inputsPerTx P2PKH outputs of txFrom each
+static void MakeSignedTxs(const CKey& key, unsigned txCount, unsigned inputsPerTx, CTransaction& txFrom,
+                          std::vector<CTransaction>& vtx)
+{
+    const CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << key.GetPubKey().GetID()
+                                           << OP_EQUALVERIFY << OP_CHECKSIG;
+    txFrom = CTransaction();
+    txFrom.vout.resize(inputsPerTx * txCount);
+    for (CTxOut& out : txFrom.vout) {
+        out.nValue       = COIN;
+        out.scriptPubKey = scriptPubKey;
+    }
+    const uint256 hashFrom = txFrom.GetHash();
+
+    vtx.assign(txCount, CTransaction());
+    for (unsigned t = 0; t < txCount; t++) {
+        CTransaction& tx = vtx[t];
+        tx.vin.resize(inputsPerTx);
+        for (unsigned i = 0; i < inputsPerTx; i++) {
+            tx.vin[i].prevout = COutPoint(hashFrom, t * inputsPerTx + i);
+        }
+        tx.vout.resize(1);
+        tx.vout[0].nValue       = inputsPerTx * COIN;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        for (unsigned i = 0; i < inputsPerTx; i++) {
+            std::vector<unsigned char> vchSig;
+            ASSERT_TRUE(key.Sign(SignatureHash(scriptPubKey, tx, i, SIGHASH_ALL), vchSig));
+            vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+            tx.vin[i].scriptSig = CScript() << vchSig << key.GetPubKey();
+        }
+    }
+}
+
+static bool CheckScripts(CCheckQueue<CScriptCheck>* pqueue, const CTransaction& txFrom,
+                         const std::vector<CTransaction>& vtx)
+{
+    CCheckQueueControl<CScriptCheck> control(pqueue);
+    for (const CTransaction& tx : vtx) {
+        std::vector<CScriptCheck> vChecks;
+        for (unsigned i = 0; i < tx.vin.size(); i++) {
+            vChecks.push_back(CScriptCheck(txFrom, tx, i, true, false, 0));
+        }
+        control.Add(vChecks);
+    }
+    return control.Wait();
+}
+
+TEST(checkqueue_tests, script_checks)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CTransaction              txFrom;
+    std::vector<CTransaction> vtx;
+    MakeSignedTxs(key, 8, 4, txFrom, vtx);
+
+    CCheckQueue<CScriptCheck> queue(128);
+    queue.Start(3);
+    EXPECT_TRUE(CheckScripts(&queue, txFrom, vtx));
+    EXPECT_TRUE(CheckScripts(nullptr, txFrom, vtx));
+
+    // a bad signature is caught
+    vtx[5].vout[0].nValue--;
+    EXPECT_FALSE(CheckScripts(&queue, txFrom, vtx));
+    EXPECT_FALSE(CheckScripts(nullptr, txFrom, vtx));
+    queue.Stop();
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(checkqueue_tests, DISABLED_script_check_benchmark)
+{
+    // the signature cache would make every run after the first free
+    GetSignatureCache().Setup(0);
+
+    CKey key;
+    key.MakeNewKey(true);
+
+    // a block-like set of transactions: 200 transactions with 10 P2PKH inputs each
+    const unsigned            inputsPerTx = 10;
+    const unsigned            txCount     = 200;
+    CTransaction              txFrom;
+    std::vector<CTransaction> vtx;
+    MakeSignedTxs(key, txCount, inputsPerTx, txFrom, vtx);
+
+    const unsigned maxThreads = std::max(4u, boost::thread::hardware_concurrency());
+    for (unsigned nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        CCheckQueue<CScriptCheck> queue(128);
+        queue.Start(nThreads - 1);
+
+        const auto start = std::chrono::steady_clock::now();
+        EXPECT_TRUE(CheckScripts(nThreads > 1 ? &queue : nullptr, txFrom, vtx));
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Verified " << txCount * inputsPerTx << " signatures with " << nThreads
+                  << " threads in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms"
+                  << std::endl;
+    }
+
+    GetSignatureCache().Setup(static_cast<uint64_t>(DEFAULT_SIG_CACHE_MB) << 20);
+}
@@ -28,6 +28,12 @@ std::string RandomString(const int len)
 #define CUSTOM_LMDB_DB_SIZE (1 << 14)
 #include "../txdb-lmdb.h"
 
+#include "block.h"
+#include "main.h"
+#include "ntp1/ntp1transaction.h"
+#include <chrono>
+#include <random>
+
 TEST(lmdb_tests, basic)
 {
     std::cout << "LMDB DB size: " << DB_DEFAULT_MAPSIZE << std::endl;
@@ -84,6 +90,59 @@ TEST(lmdb_tests, basic_in_1_tx)
     db.Close();
 }
 
+TEST(lmdb_tests, nested_txs)
+{
+    CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
+
+    CTxDB::__deleteDb(); // clean up
+
+    CTxDB::QuickSyncHigherControl_Enabled = false;
+    CTxDB db;
+
+    EXPECT_FALSE(db.IsInTxn());
+    db.TxnBegin();
+    EXPECT_TRUE(db.test1_WriteStrKeyVal("outer", "val"));
+
+    // a committed nested transaction is kept with its parent, and sees what the parent wrote
+    EXPECT_TRUE(db.TxnBegin());
+    std::string out;
+    EXPECT_TRUE(db.test1_ReadStrKeyVal("outer", out));
+    EXPECT_EQ(out, "val");
+    EXPECT_TRUE(db.test1_WriteStrKeyVal("kept", "val"));
+    db.TxnCommit();
+    EXPECT_TRUE(db.IsInTxn());
+
+    // an aborted one only drops its own writes
+    EXPECT_TRUE(db.TxnBegin());
+    EXPECT_TRUE(db.test1_WriteStrKeyVal("dropped", "val"));
+    EXPECT_TRUE(db.test1_EraseStrKeyVal("outer"));
+    db.TxnAbort();
+    EXPECT_TRUE(db.test1_ExistsStrKeyVal("outer"));
+    EXPECT_TRUE(db.test1_ExistsStrKeyVal("kept"));
+    EXPECT_FALSE(db.test1_ExistsStrKeyVal("dropped"));
+
+    // nothing is visible outside before the outermost transaction is committed
+    {
+        CTxDB other;
+        EXPECT_FALSE(other.test1_ExistsStrKeyVal("kept"));
+    }
+    db.TxnCommit();
+    EXPECT_FALSE(db.IsInTxn());
+    EXPECT_TRUE(db.test1_ExistsStrKeyVal("outer"));
+    EXPECT_TRUE(db.test1_ExistsStrKeyVal("kept"));
+    EXPECT_FALSE(db.test1_ExistsStrKeyVal("dropped"));
+
+    // closing aborts the open transactions, innermost first
+    db.TxnBegin();
+    db.TxnBegin();
+    EXPECT_TRUE(db.test1_WriteStrKeyVal("closed", "val"));
+    db.Close();
+
+    CTxDB reopened;
+    EXPECT_FALSE(reopened.test1_ExistsStrKeyVal("closed"));
+    reopened.Close();
+}
+
 TEST(lmdb_tests, many_inputs)
 {
     CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
@@ -297,6 +356,592 @@ TEST(lmdb_tests, basic_multiple_many_inputs)
     db.Close();
 }
 
+static CBlock MakeBenchmarkBlock(unsigned txCount)
+{
+    CBlock block;
+    block.nVersion      = CBlock::CURRENT_VERSION;
+    block.hashPrevBlock = Hash(&txCount, &txCount + 1);
+    block.nTime         = 1500000000;
+    block.nBits         = 0x1e0fffff;
+    for (unsigned i = 0; i < txCount; i++) {
+        CTransaction tx;
+        tx.nTime = block.nTime;
+        tx.vin.resize(2);
+        for (unsigned j = 0; j < tx.vin.size(); j++) {
+            tx.vin[j].prevout = COutPoint(Hash(&i, &i + 1), j);
+            tx.vin[j].scriptSig << std::vector<unsigned char>(72, 0x30)
+                                << std::vector<unsigned char>(33, 0x02);
+        }
+        tx.vout.resize(2);
+        for (unsigned j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = 1000 * (i + 1) + j;
+            tx.vout[j].scriptPubKey << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j)
+                                    << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.GetMerkleRoot();
+    return block;
+}
+
+// the offsets of the transactions of a block as stored in the database, as done in CBlock::WriteToDisk()
+static std::vector<unsigned int> TxPositionsInBlock(const CBlock& block)
+{
+    std::vector<unsigned int> result;
+    unsigned int              nTxPos = ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) -
+                          (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(block.vtx.size());
+    for (const CTransaction& tx : block.vtx) {
+        result.push_back(nTxPos);
+        nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+    return result;
+}
+
+template <typename Func>
+static double TimeInMilliseconds(unsigned iterations, Func&& func)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; i++) {
+        func();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+TEST(lmdb_tests, zero_copy_reads)
+{
+    CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
+
+    CTxDB::__deleteDb(); // clean up
+
+    CTxDB::QuickSyncHigherControl_Enabled = false;
+    CTxDB db;
+
+    const CBlock  block     = MakeBenchmarkBlock(200);
+    const uint256 blockHash = block.GetHash();
+    ASSERT_TRUE(db.WriteBlock(blockHash, block));
+
+    // the position of the last transaction, the worst case for the copying path
+    const CDiskTxPos lastTxPos(blockHash, TxPositionsInBlock(block).back());
+
+    for (LmdbReadMode mode : {LmdbReadMode::Copy, LmdbReadMode::ZeroCopy}) {
+        db.SetReadMode(mode);
+
+        CBlock readBlock;
+        ASSERT_TRUE(db.ReadBlock(blockHash, readBlock));
+        EXPECT_EQ(readBlock.GetHash(), blockHash);
+        EXPECT_EQ(readBlock.vtx.size(), block.vtx.size());
+        EXPECT_EQ(readBlock.GetMerkleRoot(), block.hashMerkleRoot);
+
+        CBlock header;
+        ASSERT_TRUE(db.ReadBlock(blockHash, header, false));
+        EXPECT_EQ(header.GetHash(), blockHash);
+        EXPECT_TRUE(header.vtx.empty());
+
+        CTransaction tx;
+        ASSERT_TRUE(db.ReadTx(lastTxPos, tx));
+        EXPECT_EQ(tx.GetHash(), block.vtx.back().GetHash());
+    }
+
+    db.Close();
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(lmdb_tests, DISABLED_zero_copy_read_benchmark)
+{
+    CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
+
+    CTxDB::__deleteDb(); // clean up
+
+    CTxDB::QuickSyncHigherControl_Enabled = false;
+    CTxDB db;
+
+    const CBlock  block     = MakeBenchmarkBlock(2000);
+    const uint256 blockHash = block.GetHash();
+    ASSERT_TRUE(db.WriteBlock(blockHash, block));
+    const CDiskTxPos lastTxPos(blockHash, TxPositionsInBlock(block).back());
+
+    const unsigned iterations = 200;
+    for (LmdbReadMode mode : {LmdbReadMode::Copy, LmdbReadMode::ZeroCopy}) {
+        db.SetReadMode(mode);
+        const char* modeName = (mode == LmdbReadMode::Copy ? "copy" : "zero-copy");
+
+        CBlock       readBlock;
+        CBlock       header;
+        CTransaction tx;
+        const double fullMs =
+            TimeInMilliseconds(iterations, [&]() { db.ReadBlock(blockHash, readBlock, true); });
+        const double headerMs =
+            TimeInMilliseconds(iterations, [&]() { db.ReadBlock(blockHash, header, false); });
+        const double txMs = TimeInMilliseconds(iterations, [&]() { db.ReadTx(lastTxPos, tx); });
+
+        std::cout << "LMDB " << modeName << " reads (" << iterations << " iterations): "
+                  << "ReadBlock(full): " << fullMs << " ms; "
+                  << "ReadBlock(header): " << headerMs << " ms; "
+                  << "ReadTx(last): " << txMs << " ms" << std::endl;
+    }
+
+    db.Close();
+}
+
+// a chain where every transaction spends outputs of transactions from the last few blocks, stored
+// with its tx index like ConnectBlock() does
+static void WriteSpendingChain(CTxDB& db, unsigned blockCount, unsigned txsPerBlock,
+                               std::vector<CBlock>& blocks)
+{
+    const unsigned spendDistance = 5;
+    std::mt19937   gen(12345);
+    for (unsigned b = 0; b < blockCount; b++) {
+        CBlock block;
+        block.nVersion      = CBlock::CURRENT_VERSION;
+        block.hashPrevBlock = (blocks.empty() ? uint256(0) : blocks.back().GetHash());
+        block.nTime         = 1500000000 + b;
+        block.nBits         = 0x1e0fffff;
+        for (unsigned i = 0; i < txsPerBlock; i++) {
+            CTransaction tx;
+            tx.nTime = block.nTime;
+            tx.vin.resize(2);
+            for (CTxIn& in : tx.vin) {
+                if (b == 0) {
+                    in.prevout = COutPoint(Hash(BEGIN(i), END(i)), 0);
+                } else {
+                    const unsigned distance  = 1 + gen() % std::min(b, spendDistance);
+                    const CBlock&  prevBlock = blocks[b - distance];
+                    const uint256  prevHash  = prevBlock.vtx[gen() % txsPerBlock].GetHash();
+                    in.prevout               = COutPoint(prevHash, gen() % 2);
+                }
+                in.scriptSig << std::vector<unsigned char>(72, 0x30)
+                             << std::vector<unsigned char>(33, 0x02);
+            }
+            tx.vout.resize(2);
+            for (unsigned j = 0; j < tx.vout.size(); j++) {
+                tx.vout[j].nValue = 1000 * (i + 1) + j;
+                tx.vout[j].scriptPubKey << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j)
+                                        << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+            block.vtx.push_back(tx);
+        }
+        block.hashMerkleRoot = block.GetMerkleRoot();
+
+        const uint256                   blockHash   = block.GetHash();
+        const std::vector<unsigned int> txPositions = TxPositionsInBlock(block);
+        db.TxnBegin();
+        ASSERT_TRUE(db.WriteBlock(blockHash, block));
+        for (unsigned i = 0; i < block.vtx.size(); i++) {
+            const CTxIndex txindex(CDiskTxPos(blockHash, txPositions[i]), block.vtx[i].vout.size());
+            ASSERT_TRUE(db.UpdateTxIndex(block.vtx[i].GetHash(), txindex));
+        }
+        ASSERT_TRUE(db.TxnCommit());
+        blocks.push_back(block);
+    }
+}
+
+// fetches the inputs of every block the way CTransaction::FetchInputs() does
+static void ReplayInputs(CTxDB& db, const std::vector<CBlock>& blocks)
+{
+    for (unsigned b = 1; b < blocks.size(); b++) {
+        for (const CTransaction& tx : blocks[b].vtx) {
+            for (const CTxIn& in : tx.vin) {
+                CTxIndex     txindex;
+                CTransaction txPrev;
+                ASSERT_TRUE(db.ReadTxIndex(in.prevout.hash, txindex));
+                ASSERT_TRUE(txPrev.ReadFromDisk(txindex.pos, db));
+                ASSERT_EQ(txPrev.GetHash(), in.prevout.hash);
+            }
+        }
+    }
+}
+
+TEST(lmdb_tests, tx_read_cache_replay)
+{
+    CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
+
+    CTxDB::__deleteDb(); // clean up
+
+    CTxDB::QuickSyncHigherControl_Enabled = false;
+    CTxDB db;
+
+    const unsigned      blockCount  = 8;
+    const unsigned      txsPerBlock = 20;
+    std::vector<CBlock> blocks;
+    WriteSpendingChain(db, blockCount, txsPerBlock, blocks);
+
+    TxReadCacheType&  cache        = CTxDB::GetTxReadCache();
+    const std::size_t originalSize = cache.getMaxSize();
+    const unsigned    inputCount   = (blockCount - 1) * txsPerBlock * 2;
+
+    cache.clear();
+    cache.setMaxSize(0);
+    ReplayInputs(db, blocks);
+
+    cache.setMaxSize(DEFAULT_TX_READ_CACHE_SIZE);
+    cache.resetStats();
+    ReplayInputs(db, blocks);
+    EXPECT_EQ(cache.getHits() + cache.getMisses(), inputCount);
+    EXPECT_GT(cache.getHits(), 0u);
+
+    cache.setMaxSize(originalSize);
+    db.Close();
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(lmdb_tests, DISABLED_tx_read_cache_replay_benchmark)
+{
+    CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
+
+    CTxDB::__deleteDb(); // clean up
+
+    CTxDB::QuickSyncHigherControl_Enabled = false;
+    CTxDB db;
+
+    const unsigned      blockCount  = 60;
+    const unsigned      txsPerBlock = 200;
+    std::vector<CBlock> blocks;
+    WriteSpendingChain(db, blockCount, txsPerBlock, blocks);
+
+    TxReadCacheType&  cache        = CTxDB::GetTxReadCache();
+    const std::size_t originalSize = cache.getMaxSize();
+    const unsigned    inputCount   = (blockCount - 1) * txsPerBlock * 2;
+
+    cache.clear();
+    cache.setMaxSize(0);
+    const double uncachedMs = TimeInMilliseconds(1, [&]() { ReplayInputs(db, blocks); });
+
+    cache.setMaxSize(DEFAULT_TX_READ_CACHE_SIZE);
+    cache.resetStats();
+    const double cachedMs = TimeInMilliseconds(1, [&]() { ReplayInputs(db, blocks); });
+
+    std::cout << "Replaying " << blockCount - 1 << " blocks (" << inputCount << " inputs): "
+              << "without tx read cache: " << uncachedMs << " ms; "
+              << "with tx read cache: " << cachedMs << " ms (" << cache.getHits() << " hits, "
+              << cache.getMisses() << " misses)" << std::endl;
+
+    cache.setMaxSize(originalSize);
+    db.Close();
+}
+
+TEST(lmdb_tests, ntp1_resolved_tx_cache)
+{
+    CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
+
+    CTxDB::__deleteDb(); // clean up
+
+    CTxDB::QuickSyncHigherControl_Enabled = false;
+    CTxDB db;
+
+    // two NTP1 transactions; the first one is in the database, the second one is queued in a block
+    std::vector<CTransaction> parents(2);
+    for (unsigned i = 0; i < parents.size(); i++) {
+        CTransaction& tx = parents[i];
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(Hash(BEGIN(i), END(i)), 0);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = 1000;
+        tx.vout[0].scriptPubKey << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i)
+                                << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[1].scriptPubKey << OP_RETURN << ParseHex("4e5403100001");
+        ASSERT_TRUE(NTP1Transaction::IsTxNTP1(&tx));
+    }
+    NTP1Transaction storedNTP1Tx;
+    storedNTP1Tx.readNTP1DataFromTx_minimal(parents[0]);
+    ASSERT_TRUE(db.WriteNTP1Tx(parents[0].GetHash(), storedNTP1Tx));
+    NTP1Transaction queuedNTP1Tx;
+    queuedNTP1Tx.readNTP1DataFromTx_minimal(parents[1]);
+
+    CTransaction child;
+    MapPrevTx    mapInputs;
+    for (const CTransaction& parent : parents) {
+        child.vin.push_back(CTxIn(COutPoint(parent.GetHash(), 0)));
+        mapInputs[parent.GetHash()] = std::make_pair(CTxIndex(), parent);
+    }
+    std::map<uint256, CTxIndex> queuedAcceptedTxs;
+    queuedAcceptedTxs[parents[1].GetHash()] = CTxIndex();
+
+    NTP1TxCacheType&  cache        = NTP1Transaction::GetResolvedTxCache();
+    const std::size_t originalSize = cache.getMaxSize();
+    cache.setMaxSize(DEFAULT_NTP1_TX_CACHE_SIZE);
+    cache.clear();
+    cache.resetStats();
+
+    // the transaction from the database is read and cached, but the queued one can't be resolved
+    // here, because its inputs don't exist; it can only be found in the cache, where ConnectBlock()
+    // puts it after resolving it
+    EXPECT_ANY_THROW(
+        NTP1Transaction::StdFetchedInputTxsToNTP1(child, mapInputs, db, false, queuedAcceptedTxs));
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_EQ(cache.getMisses(), 2u);
+    cache.insert(parents[1].GetHash(), queuedNTP1Tx);
+
+    for (int i = 0; i < 3; i++) {
+        std::vector<std::pair<CTransaction, NTP1Transaction>> inputs =
+            NTP1Transaction::StdFetchedInputTxsToNTP1(child, mapInputs, db, false, queuedAcceptedTxs);
+        ASSERT_EQ(inputs.size(), 2u);
+        EXPECT_TRUE(inputs[0].second == storedNTP1Tx);
+        EXPECT_TRUE(inputs[1].second == queuedNTP1Tx);
+    }
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.getMisses(), 2u);
+    EXPECT_EQ(cache.getHits(), 6u);
+
+    // transactions that are neither in the database nor queued are never taken from the cache
+    cache.resetStats();
+    EXPECT_NO_THROW(NTP1Transaction::StdFetchedInputTxsToNTP1(child, mapInputs, db, false));
+    EXPECT_EQ(cache.getHits(), 1u);
+    EXPECT_EQ(cache.getMisses(), 0u);
+
+    cache.clear();
+    cache.setMaxSize(originalSize);
+    db.Close();
+}
+
+TEST(lmdb_tests, block_index_snapshot)
+{
+    // a synthetic chain; heights are far above any stake modifier checkpoint
+    const unsigned             count = 100000;
+    BlockIndexMapType::MapType blockIndex;
+    CBlockIndexSmartPtr        prev;
+    for (unsigned i = 0; i < count; i++) {
+        CBlockIndexSmartPtr index     = boost::make_shared<CBlockIndex>();
+        index->phashBlock             = Hash(BEGIN(i), END(i));
+        index->blockKeyInDB           = index->phashBlock;
+        index->nHeight                = 100000000 + i;
+        index->nChainTrust            = i + 1;
+        index->nMint                  = i * 3;
+        index->nMoneySupply           = i * 7;
+        index->nFlags                 = (i % 2 == 0 ? CBlockIndex::BLOCK_PROOF_OF_STAKE : 0);
+        index->nStakeModifier         = i * UINT64_C(0x100000001);
+        index->nStakeModifierChecksum = i ^ 0xABCD;
+        index->prevoutStake           = COutPoint(Hash(BEGIN(i), END(i)), i % 5);
+        index->nStakeTime             = i + 11;
+        index->nTime                  = i + 13;
+        index->nBits                  = i + 17;
+        index->nNonce                 = i + 19;
+        index->pprev                  = prev;
+        if (prev) {
+            prev->pnext = index;
+        }
+        blockIndex[index->phashBlock] = index;
+        prev                          = index;
+    }
+
+    const boost::filesystem::path path =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    BlockIndexSnapshotId id;
+    id.nDbTxnId      = 1234;
+    id.nDbVersion    = 5;
+    id.hashBestChain = prev->phashBlock;
+    ASSERT_TRUE(WriteBlockIndexSnapshot(path, blockIndex, id));
+
+    for (unsigned nThreads : {1u, 4u}) {
+        BlockIndexMapType::MapType                   loaded;
+        CBlockIndexSmartPtr                          genesis;
+        std::set<std::pair<COutPoint, unsigned int>> stakeSeen;
+
+        const auto start = std::chrono::steady_clock::now();
+        ASSERT_TRUE(LoadBlockIndexSnapshot(path, id, loaded, genesis, stakeSeen, nThreads));
+        const auto end = std::chrono::steady_clock::now();
+        std::cout << "Loaded " << count << " block index entries from snapshot with " << nThreads
+                  << " thread(s) in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms"
+                  << std::endl;
+
+        ASSERT_EQ(loaded.size(), blockIndex.size());
+        EXPECT_EQ(stakeSeen.size(), count / 2);
+        for (const auto& p : blockIndex) {
+            const CBlockIndexSmartPtr& a = p.second;
+            const CBlockIndexSmartPtr& b = loaded.at(p.first);
+            EXPECT_EQ(b->phashBlock, a->phashBlock);
+            EXPECT_EQ(b->blockKeyInDB, a->blockKeyInDB);
+            EXPECT_EQ(b->nHeight, a->nHeight);
+            EXPECT_EQ(b->nChainTrust, a->nChainTrust);
+            EXPECT_EQ(b->nMint, a->nMint);
+            EXPECT_EQ(b->nMoneySupply, a->nMoneySupply);
+            EXPECT_EQ(b->nFlags, a->nFlags);
+            EXPECT_EQ(b->nStakeModifier, a->nStakeModifier);
+            EXPECT_EQ(b->nStakeModifierChecksum, a->nStakeModifierChecksum);
+            EXPECT_EQ(b->prevoutStake, a->prevoutStake);
+            EXPECT_EQ(b->nStakeTime, a->nStakeTime);
+            EXPECT_EQ(b->nTime, a->nTime);
+            EXPECT_EQ(b->nBits, a->nBits);
+            EXPECT_EQ(b->nNonce, a->nNonce);
+            EXPECT_EQ(b->pprev ? b->pprev->phashBlock : 0, a->pprev ? a->pprev->phashBlock : 0);
+            EXPECT_EQ(b->pnext ? b->pnext->phashBlock : 0, a->pnext ? a->pnext->phashBlock : 0);
+            if (b->pprev) {
+                // links must point into the loaded map, not to copies
+                EXPECT_EQ(b->pprev.get(), loaded.at(b->pprev->phashBlock).get());
+            }
+        }
+    }
+
+    // any change in the database makes the snapshot stale
+    {
+        BlockIndexSnapshotId staleId = id;
+        staleId.nDbTxnId++;
+        BlockIndexMapType::MapType                   loaded;
+        CBlockIndexSmartPtr                          genesis;
+        std::set<std::pair<COutPoint, unsigned int>> stakeSeen;
+        EXPECT_FALSE(LoadBlockIndexSnapshot(path, staleId, loaded, genesis, stakeSeen));
+        EXPECT_TRUE(loaded.empty());
+        EXPECT_TRUE(stakeSeen.empty());
+    }
+
+    boost::filesystem::remove(path);
+    {
+        BlockIndexMapType::MapType                   loaded;
+        CBlockIndexSmartPtr                          genesis;
+        std::set<std::pair<COutPoint, unsigned int>> stakeSeen;
+        EXPECT_FALSE(LoadBlockIndexSnapshot(path, id, loaded, genesis, stakeSeen));
+    }
+}
+
+TEST(lmdb_tests, utxo_set)
+{
+    CTxDB::DB_DIR = "test-txdb"; // avoid writing to the main database
+    CTxDB::__deleteDb();         // clean up
+    CTxDB::QuickSyncHigherControl_Enabled = false;
+    CTxDB db;
+
+    CTransaction tx;
+    tx.nTime = 1234567;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(Hash(BEGIN(tx.nTime), END(tx.nTime)), 0);
+    tx.vout.resize(3);
+    for (unsigned i = 0; i < tx.vout.size(); i++) {
+        tx.vout[i].nValue       = (i + 1) * COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i)
+                                            << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    const uint256 txid = tx.GetHash();
+
+    // serialization round-trip keeps the ppcoin fields
+    CCoins coins(tx, 500);
+    coins.fCoinStake = true;
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << coins;
+        CCoins read;
+        ss >> read;
+        EXPECT_TRUE(read == coins);
+        EXPECT_TRUE(read.IsCoinStake());
+        EXPECT_EQ(read.nTime, tx.nTime);
+        EXPECT_EQ(read.nHeight, 500);
+    }
+
+    const uint256 hashBlock1 = Hash(BEGIN(txid), END(txid));
+    {
+        CCoinsViewDB    dbView(db);
+        CCoinsViewCache view(dbView);
+        EXPECT_FALSE(view.HaveCoins(txid));
+        view.SetCoins(txid, coins);
+        view.SetBestBlock(hashBlock1);
+        // nothing is written until the cache is flushed
+        EXPECT_FALSE(db.HaveCoins(txid));
+        EXPECT_TRUE(view.Flush());
+        EXPECT_EQ(view.GetCacheSize(), 0u);
+    }
+    EXPECT_TRUE(db.HaveCoins(txid));
+    EXPECT_EQ(CCoinsViewDB(db).GetBestBlock(), hashBlock1);
+
+    // spending in a batch
+    const uint256 hashBlock2 = Hash(BEGIN(hashBlock1), END(hashBlock1));
+    {
+        ASSERT_TRUE(db.TxnBegin());
+        CCoinsViewDB    dbView(db);
+        CCoinsViewCache view(dbView);
+        CTxInUndo       undo;
+        EXPECT_TRUE(view.GetCoins(txid).Spend(COutPoint(txid, 1), undo));
+        EXPECT_EQ(undo.txout.nValue, 2 * COIN);
+        EXPECT_FALSE(view.GetCoins(txid).Spend(COutPoint(txid, 1), undo));
+        view.SetBestBlock(hashBlock2);
+        EXPECT_TRUE(view.Flush());
+        ASSERT_TRUE(db.TxnCommit());
+    }
+    {
+        CCoins read;
+        ASSERT_TRUE(db.ReadCoins(txid, read));
+        EXPECT_TRUE(read.IsAvailable(0));
+        EXPECT_FALSE(read.IsAvailable(1));
+        EXPECT_TRUE(read.IsAvailable(2));
+        EXPECT_EQ(read.vout[2].nValue, 3 * COIN);
+        EXPECT_TRUE(read.IsCoinStake());
+        EXPECT_EQ(read.nTime, tx.nTime);
+    }
+    EXPECT_EQ(CCoinsViewDB(db).GetBestBlock(), hashBlock2);
+
+    // an aborted batch leaves the set untouched
+    {
+        ASSERT_TRUE(db.TxnBegin());
+        CCoinsViewDB    dbView(db);
+        CCoinsViewCache view(dbView);
+        EXPECT_TRUE(view.GetCoins(txid).Spend(0));
+        EXPECT_TRUE(view.Flush());
+        ASSERT_TRUE(db.TxnAbort());
+    }
+    {
+        CCoins read;
+        ASSERT_TRUE(db.ReadCoins(txid, read));
+        EXPECT_TRUE(read.IsAvailable(0));
+    }
+
+    // fully spent transactions are erased
+    {
+        CCoinsViewDB    dbView(db);
+        CCoinsViewCache view(dbView);
+        EXPECT_TRUE(view.GetCoins(txid).Spend(0));
+        EXPECT_TRUE(view.GetCoins(txid).Spend(2));
+        EXPECT_TRUE(view.GetCoins(txid).IsPruned());
+        EXPECT_TRUE(view.Flush());
+    }
+    EXPECT_FALSE(db.HaveCoins(txid));
+    CCoins read;
+    EXPECT_FALSE(db.ReadCoins(txid, read));
+
+    // the coins derived from a tx index entry, as ConnectBlock() writes them, leave out spent outputs
+    {
+        CTxIndex txindex(CDiskTxPos(hashBlock1, 100), tx.vout.size());
+        txindex.vSpent[2] = CDiskTxPos(hashBlock2, 200);
+        CCoins derived(tx, 500, txindex);
+        EXPECT_EQ(derived.nHeight, 500);
+        EXPECT_EQ(derived.vout.size(), 2u);
+        EXPECT_TRUE(derived.IsAvailable(0));
+        EXPECT_TRUE(derived.IsAvailable(1));
+        EXPECT_FALSE(derived.IsAvailable(2));
+        txindex.vSpent[0] = CDiskTxPos(hashBlock2, 200);
+        txindex.vSpent[1] = CDiskTxPos(hashBlock2, 200);
+        EXPECT_TRUE(CCoins(tx, 500, txindex).IsPruned());
+    }
+
+    // the cache's memory estimate follows the coins it holds, and is reset by flushing
+    {
+        CCoinsViewDB    dbView(db);
+        CCoinsViewCache view(dbView);
+        EXPECT_EQ(view.DynamicMemoryUsage(), 0u);
+        view.SetCoins(txid, coins);
+        const std::size_t usage = view.DynamicMemoryUsage();
+        EXPECT_GT(usage, coins.DynamicMemoryUsage());
+        view.SetCoins(txid, coins);
+        EXPECT_EQ(view.DynamicMemoryUsage(), usage);
+        view.SetCoins(Hash(BEGIN(hashBlock2), END(hashBlock2)), coins);
+        const std::size_t usageOfTwo = view.DynamicMemoryUsage();
+        EXPECT_GT(usageOfTwo, usage);
+        // changes through a reference are counted too
+        CCoins& cached = view.GetCoins(txid);
+        cached.vout.clear();
+        cached.vout.shrink_to_fit();
+        EXPECT_LT(view.DynamicMemoryUsage(), usageOfTwo);
+        EXPECT_TRUE(view.Flush());
+        EXPECT_EQ(view.DynamicMemoryUsage(), 0u);
+    }
+
+    // the set's version is kept next to its best block
+    ASSERT_TRUE(db.WriteUtxoSetVersion(UTXO_SET_VERSION));
+    int nVersion = 0;
+    ASSERT_TRUE(db.ReadUtxoSetVersion(nVersion));
+    EXPECT_EQ(nVersion, UTXO_SET_VERSION);
+
+    db.Close();
+}
+
 TEST(quicksync_tests, download_index_file)
 {
     std::string        s = cURLTools::GetFileFromHTTPS(QuickSyncDataLink, 30, false);
@@ -4,6 +4,7 @@
 #include "gtest/gtest.h"
 
 #include "chainparams.h"
+#include "sha256.h"
 #include <boost/core/ignore_unused.hpp>
 #include <fstream>
 #include <sstream>
@@ -18,6 +19,7 @@ public:
         // ::testing::GTEST_FLAG(catch_exceptions) = false;
         srand(time(nullptr));
         SelectParams(NetworkType::Mainnet);
+        SHA256AutoDetect();
     }
 
     virtual void TearDown() {}
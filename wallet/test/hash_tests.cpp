@@ -6,7 +6,11 @@
 #include "key.h"
 #include "base58.h"
 #include "main.h"
+#include "merkle.h"
+#include "sha256.h"
 
+#include <chrono>
+#include <openssl/sha.h>
 #include <vector>
 
 #include "googletest/googletest/include/gtest/gtest.h"
@@ -43,3 +47,126 @@ TEST(hash_tests, murmurhash3)
 
 #undef T
 }
+
+// every combination that SHA256AutoDetect() can end up with on a CPU that supports all of them
+static const unsigned int sha256Implementations[] = {
+    0, SHA256_USE_SSE41, SHA256_USE_AVX2, SHA256_USE_SSE41 | SHA256_USE_AVX2, SHA256_USE_SHANI,
+    SHA256_USE_ALL};
+
+static std::string SHA256Hex(const std::string& str)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)str.data(), str.size()).Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+TEST(hash_tests, sha256_implementations)
+{
+    std::vector<unsigned char> data(4096);
+    for (unsigned char& c : data) {
+        c = static_cast<unsigned char>(GetRand(256));
+    }
+
+    for (unsigned int allowed : sha256Implementations) {
+        const std::string name = SHA256AutoDetect(allowed);
+        SCOPED_TRACE(name);
+
+        // test vectors from FIPS 180-2
+        EXPECT_EQ(SHA256Hex(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        EXPECT_EQ(SHA256Hex("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        EXPECT_EQ(SHA256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+                  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        EXPECT_EQ(SHA256Hex(std::string(1000000, 'a')),
+                  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+        // any length, written in any pieces, matches OpenSSL
+        for (size_t len = 0; len < 300; len++) {
+            unsigned char expected[SHA256_DIGEST_LENGTH];
+            SHA256(data.data(), len, expected);
+            const size_t  split = len / 3;
+            unsigned char hash[CSHA256::OUTPUT_SIZE];
+            CSHA256()
+                .Write(data.data(), split)
+                .Write(data.data() + split, len - split)
+                .Finalize(hash);
+            EXPECT_EQ(HexStr(hash, hash + sizeof(hash)), HexStr(expected, expected + sizeof(expected)));
+        }
+
+        // batches of any size, including in place, match Hash()
+        for (size_t blocks = 0; blocks <= 20; blocks++) {
+            std::vector<unsigned char> out(32 * blocks);
+            SHA256D64(out.data(), data.data(), blocks);
+            std::vector<unsigned char> inPlace(data.begin(), data.begin() + 64 * blocks);
+            SHA256D64(inPlace.data(), inPlace.data(), blocks);
+            for (size_t i = 0; i < blocks; i++) {
+                const uint256 expected = Hash(data.begin() + 64 * i, data.begin() + 64 * (i + 1));
+                EXPECT_EQ(HexStr(out.begin() + 32 * i, out.begin() + 32 * (i + 1)),
+                          HexStr(expected.begin(), expected.end()));
+                EXPECT_EQ(HexStr(inPlace.begin() + 32 * i, inPlace.begin() + 32 * (i + 1)),
+                          HexStr(expected.begin(), expected.end()));
+            }
+        }
+
+        // merkle trees are computed level by level in batches
+        std::vector<uint256> leaves;
+        for (int i = 0; i < 37; i++) {
+            leaves.push_back(Hash(data.begin() + i, data.begin() + i + 1));
+            bool                 mutatedRoot = false, mutatedTree = false;
+            std::vector<uint256> tree = ConstructMerkleTree(leaves, &mutatedTree);
+            EXPECT_EQ(ComputeMerkleRoot(leaves, &mutatedRoot), tree.back());
+            EXPECT_EQ(mutatedRoot, mutatedTree);
+            if (leaves.size() == 2) {
+                EXPECT_EQ(tree.back(), Hash(leaves[0].begin(), leaves[0].end(), leaves[1].begin(),
+                                            leaves[1].end()));
+            }
+        }
+    }
+    SHA256AutoDetect();
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(hash_tests, DISABLED_sha256_benchmark)
+{
+    std::vector<unsigned char> data(1 << 20);
+    for (unsigned char& c : data) {
+        c = static_cast<unsigned char>(GetRand(256));
+    }
+    const int rounds = 20;
+
+    auto ms = [](std::chrono::steady_clock::time_point from) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                     from)
+            .count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < data.size() / 64; i++) {
+            unsigned char hash1[SHA256_DIGEST_LENGTH], hash2[SHA256_DIGEST_LENGTH];
+            SHA256(&data[64 * i], 64, hash1);
+            SHA256(hash1, sizeof(hash1), hash2);
+        }
+    }
+    std::cout << "OpenSSL: " << rounds << " MiB of 64-byte double-SHA256 in " << ms(start) << " ms"
+              << std::endl;
+
+    for (unsigned int allowed : sha256Implementations) {
+        const std::string name = SHA256AutoDetect(allowed);
+
+        start = std::chrono::steady_clock::now();
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        for (int r = 0; r < rounds; r++) {
+            CSHA256().Write(data.data(), data.size()).Finalize(hash);
+        }
+        const auto msStream = ms(start);
+
+        std::vector<unsigned char> out(data.size() / 2);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            SHA256D64(out.data(), data.data(), data.size() / 64);
+        }
+        std::cout << name << ": " << rounds << " MiB of SHA256 in " << msStream << " ms, " << rounds
+                  << " MiB of 64-byte double-SHA256 in " << ms(start) << " ms" << std::endl;
+    }
+    SHA256AutoDetect();
+}
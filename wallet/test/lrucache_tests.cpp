@@ -0,0 +1,63 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "LRUCache.h"
+
+#include <string>
+
+TEST(lrucache_tests, evicts_least_recently_used)
+{
+    LRUCache<int, std::string> cache(3);
+    cache.insert(1, "a");
+    cache.insert(2, "b");
+    cache.insert(3, "c");
+    EXPECT_EQ(cache.size(), 3u);
+
+    // touching 1 makes 2 the least recently used
+    EXPECT_EQ(cache.get(1).value_or(""), "a");
+    cache.insert(4, "d");
+    EXPECT_EQ(cache.size(), 3u);
+    EXPECT_FALSE(cache.get(2).is_initialized());
+    EXPECT_EQ(cache.get(1).value_or(""), "a");
+    EXPECT_EQ(cache.get(3).value_or(""), "c");
+    EXPECT_EQ(cache.get(4).value_or(""), "d");
+
+    // replacing a value doesn't grow the cache
+    cache.insert(3, "e");
+    EXPECT_EQ(cache.size(), 3u);
+    EXPECT_EQ(cache.get(3).value_or(""), "e");
+
+    EXPECT_EQ(cache.getHits(), 5u);
+    EXPECT_EQ(cache.getMisses(), 1u);
+
+    EXPECT_EQ(cache.erase(3), 1u);
+    EXPECT_EQ(cache.erase(3), 0u);
+    EXPECT_EQ(cache.size(), 2u);
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_FALSE(cache.get(1).is_initialized());
+}
+
+TEST(lrucache_tests, resize)
+{
+    LRUCache<int, int> cache(100);
+    for (int i = 0; i < 100; i++) {
+        cache.insert(i, i * 2);
+    }
+    EXPECT_EQ(cache.size(), 100u);
+
+    // shrinking keeps the most recently used entries
+    cache.setMaxSize(10);
+    EXPECT_EQ(cache.size(), 10u);
+    for (int i = 90; i < 100; i++) {
+        EXPECT_EQ(cache.get(i).value_or(-1), i * 2);
+    }
+    EXPECT_FALSE(cache.get(89).is_initialized());
+
+    // a zero size disables the cache
+    cache.setMaxSize(0);
+    EXPECT_EQ(cache.size(), 0u);
+    cache.insert(1, 1);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_FALSE(cache.get(1).is_initialized());
+}
@@ -0,0 +1,221 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "globals.h"
+#include "txmempool.h"
+
+// a transaction that spends the first outputs of the given transactions, and has two outputs
+static CTransaction MakeTx(const std::vector<const CTransaction*>& parents, unsigned salt)
+{
+    CTransaction tx;
+    for (const CTransaction* parent : parents) {
+        tx.vin.push_back(CTxIn(COutPoint(parent->GetHash(), 0)));
+    }
+    if (parents.empty()) {
+        tx.vin.push_back(CTxIn(COutPoint(Hash(BEGIN(salt), END(salt)), 0)));
+    }
+    tx.vout.resize(2);
+    for (CTxOut& out : tx.vout) {
+        out.nValue = 1000 + salt;
+        out.scriptPubKey << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, salt)
+                         << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return tx;
+}
+
+static CTxMemPoolEntry MakeEntry(const CTransaction& tx, int64_t fee, int64_t time = 0)
+{
+    return CTxMemPoolEntry(tx, fee, time, 100, 0, 0, 0, 0);
+}
+
+static const CTxMemPoolEntry& GetEntry(const CTxMemPool& pool, const CTransaction& tx)
+{
+    return *pool.mapTx.find(tx.GetHash());
+}
+
+TEST(mempool_tests, ancestors_and_descendants)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+
+    // a -> b -> d, a -> c -> d
+    const CTransaction a = MakeTx({}, 1);
+    const CTransaction b = MakeTx({&a}, 2);
+    CTransaction       c = MakeTx({}, 3);
+    c.vin[0]             = CTxIn(COutPoint(a.GetHash(), 1));
+    const CTransaction d = MakeTx({&b, &c}, 4);
+
+    pool.addUnchecked(MakeEntry(a, 1000));
+    pool.addUnchecked(MakeEntry(b, 2000));
+    pool.addUnchecked(MakeEntry(c, 3000));
+    pool.addUnchecked(MakeEntry(d, 4000));
+    ASSERT_EQ(pool.size(), 4u);
+
+    EXPECT_EQ(GetEntry(pool, a).GetCountWithAncestors(), 1u);
+    EXPECT_EQ(GetEntry(pool, a).GetCountWithDescendants(), 4u);
+    EXPECT_EQ(GetEntry(pool, a).GetFeesWithDescendants(), 10000);
+    EXPECT_EQ(GetEntry(pool, b).GetCountWithDescendants(), 2u);
+    EXPECT_EQ(GetEntry(pool, d).GetCountWithAncestors(), 4u);
+    EXPECT_EQ(GetEntry(pool, d).GetFeesWithAncestors(), 10000);
+    EXPECT_EQ(GetEntry(pool, d).GetSizeWithAncestors(),
+              GetEntry(pool, a).GetSizeWithDescendants());
+
+    // like when a is included in a block
+    pool.remove(a);
+    EXPECT_EQ(GetEntry(pool, d).GetCountWithAncestors(), 3u);
+    EXPECT_EQ(GetEntry(pool, d).GetFeesWithAncestors(), 9000);
+    EXPECT_EQ(GetEntry(pool, b).GetCountWithAncestors(), 1u);
+
+    // removing c with its descendants leaves b alone
+    pool.remove(c, true);
+    EXPECT_EQ(pool.size(), 1u);
+    EXPECT_EQ(GetEntry(pool, b).GetCountWithDescendants(), 1u);
+    EXPECT_EQ(GetEntry(pool, b).GetFeesWithDescendants(), 2000);
+    EXPECT_TRUE(pool.mapNextTx.count(COutPoint(a.GetHash(), 0)));
+    EXPECT_FALSE(pool.mapNextTx.count(COutPoint(a.GetHash(), 1)));
+}
+
+TEST(mempool_tests, parent_after_children)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+
+    // a -> b -> d, a -> c -> d, where a and b come back from a disconnected block after c and d
+    const CTransaction a = MakeTx({}, 1);
+    const CTransaction b = MakeTx({&a}, 2);
+    CTransaction       c = MakeTx({}, 3);
+    c.vin[0]             = CTxIn(COutPoint(a.GetHash(), 1));
+    const CTransaction d = MakeTx({&b, &c}, 4);
+
+    pool.addUnchecked(MakeEntry(c, 3000));
+    pool.addUnchecked(MakeEntry(d, 4000));
+    EXPECT_EQ(GetEntry(pool, d).GetCountWithAncestors(), 2u);
+    pool.addUnchecked(MakeEntry(a, 1000));
+    pool.addUnchecked(MakeEntry(b, 2000));
+
+    // the same as if they had come in order
+    EXPECT_EQ(GetEntry(pool, a).GetCountWithDescendants(), 4u);
+    EXPECT_EQ(GetEntry(pool, a).GetFeesWithDescendants(), 10000);
+    EXPECT_EQ(GetEntry(pool, b).GetCountWithDescendants(), 2u);
+    EXPECT_EQ(GetEntry(pool, c).GetCountWithAncestors(), 2u);
+    EXPECT_EQ(GetEntry(pool, c).GetCountWithDescendants(), 2u);
+    EXPECT_EQ(GetEntry(pool, d).GetCountWithAncestors(), 4u);
+    EXPECT_EQ(GetEntry(pool, d).GetFeesWithAncestors(), 10000);
+    EXPECT_EQ(GetEntry(pool, d).GetSizeWithAncestors(),
+              GetEntry(pool, a).GetSizeWithDescendants());
+
+    // and removing them leaves the totals of the others at their own
+    pool.remove(a);
+    pool.remove(b);
+    EXPECT_EQ(GetEntry(pool, c).GetCountWithDescendants(), 2u);
+    EXPECT_EQ(GetEntry(pool, d).GetCountWithAncestors(), 2u);
+    EXPECT_EQ(GetEntry(pool, d).GetFeesWithAncestors(), 7000);
+    pool.remove(c);
+    EXPECT_EQ(GetEntry(pool, d).GetCountWithAncestors(), 1u);
+    EXPECT_EQ(GetEntry(pool, d).GetSizeWithAncestors(), GetEntry(pool, d).GetTxSize());
+    EXPECT_EQ(GetEntry(pool, d).GetFeesWithAncestors(), 4000);
+}
+
+TEST(mempool_tests, indices)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+
+    const CTransaction parent = MakeTx({}, 1);
+    const CTransaction child  = MakeTx({&parent}, 2);
+    const CTransaction other  = MakeTx({}, 3);
+
+    // the child pays a lot, but its parent pays nothing
+    pool.addUnchecked(MakeEntry(parent, 0, 30));
+    pool.addUnchecked(MakeEntry(child, 30000, 10));
+    pool.addUnchecked(MakeEntry(other, 20000, 20));
+
+    const auto& byFeeRate = pool.mapTx.get<MempoolFeeRateTag>();
+    EXPECT_EQ(byFeeRate.begin()->GetHash(), child.GetHash());
+    EXPECT_EQ(byFeeRate.rbegin()->GetHash(), parent.GetHash());
+
+    // by ancestor score, the child is behind the one that pays for itself
+    const auto& byAncestorScore = pool.mapTx.get<MempoolAncestorScoreTag>();
+    EXPECT_EQ(byAncestorScore.begin()->GetHash(), other.GetHash());
+
+    const auto& byTime = pool.mapTx.get<MempoolEntryTimeTag>();
+    EXPECT_EQ(byTime.begin()->GetHash(), child.GetHash());
+    EXPECT_EQ(byTime.rbegin()->GetHash(), parent.GetHash());
+
+    // the parent being mined makes the child's score its own
+    pool.remove(parent);
+    EXPECT_EQ(byAncestorScore.begin()->GetHash(), child.GetHash());
+}
+
+TEST(mempool_tests, priority)
+{
+    const CTransaction tx = MakeTx({}, 1);
+    // entered at height 100 with a priority of 5000, with 2000 of its input value in the chain
+    const CTxMemPoolEntry entry(tx, 0, 0, 100, 5000, 2000, 3000, 0);
+    EXPECT_DOUBLE_EQ(entry.GetPriority(100), 5000);
+    EXPECT_DOUBLE_EQ(entry.GetPriority(110), 5000 + 10 * 2000.0 / entry.GetTxSize());
+    EXPECT_DOUBLE_EQ(entry.GetFeeRate(), 0);
+}
+
+TEST(mempool_tests, trim_to_size)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+
+    const CTransaction parent = MakeTx({}, 1);
+    const CTransaction child  = MakeTx({&parent}, 2);
+    const CTransaction other  = MakeTx({}, 3);
+
+    // the parent with its child have the lowest descendant score
+    pool.addUnchecked(MakeEntry(parent, 10000));
+    pool.addUnchecked(MakeEntry(child, 15000));
+    pool.addUnchecked(MakeEntry(other, 50000));
+    EXPECT_EQ(pool.GetTotalTxSize(), 3 * GetEntry(pool, other).GetTxSize());
+    EXPECT_EQ(pool.GetMinFee(1000000000), 0);
+
+    const std::size_t usage = pool.DynamicMemoryUsage();
+    pool.TrimToSize(usage);
+    EXPECT_EQ(pool.size(), 3u);
+
+    const double packageFeeRate = GetEntry(pool, parent).GetDescendantFeeRate();
+
+    std::vector<uint256> removed;
+    pool.TrimToSize(usage - 1, &removed);
+    EXPECT_EQ(pool.size(), 1u);
+    EXPECT_TRUE(pool.exists(other.GetHash()));
+    EXPECT_EQ(removed, std::vector<uint256>({parent.GetHash(), child.GetHash()}));
+    EXPECT_LT(pool.DynamicMemoryUsage(), usage);
+
+    // getting back in costs more than what the evicted package paid
+    const int64_t minFee = static_cast<int64_t>(packageFeeRate + MIN_RELAY_TX_FEE);
+    EXPECT_EQ(pool.GetMinFee(1000000000), minFee);
+
+    // after a block, it halves every quarter of the half-life when the pool is mostly empty
+    SetMockTime(1000000);
+    pool.removeForBlock(std::vector<CTransaction>());
+    SetMockTime(1000000 + CTxMemPool::ROLLING_FEE_HALFLIFE / 4);
+    EXPECT_NEAR(pool.GetMinFee(1000000000), minFee / 2, 1);
+    SetMockTime(1000000 + CTxMemPool::ROLLING_FEE_HALFLIFE * 4);
+    EXPECT_EQ(pool.GetMinFee(1000000000), 0);
+    SetMockTime(0);
+}
+
+TEST(mempool_tests, expire)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+
+    const CTransaction parent = MakeTx({}, 1);
+    const CTransaction child  = MakeTx({&parent}, 2);
+    const CTransaction other  = MakeTx({}, 3);
+
+    pool.addUnchecked(MakeEntry(parent, 0, 10));
+    pool.addUnchecked(MakeEntry(child, 0, 30));
+    pool.addUnchecked(MakeEntry(other, 0, 20));
+
+    // the child goes with its parent, even though it entered later
+    EXPECT_EQ(pool.Expire(15), 2);
+    EXPECT_EQ(pool.size(), 1u);
+    EXPECT_TRUE(pool.exists(other.GetHash()));
+    EXPECT_EQ(pool.Expire(15), 0);
+    EXPECT_EQ(pool.GetTotalTxSize(), GetEntry(pool, other).GetTxSize());
+}
@@ -34,6 +34,7 @@ struct mTxDB : public ITxDB
     MOCK_METHOD(bool, ReadDiskTx, (const COutPoint& outpoint, CTransaction& tx), (const, override));
     MOCK_METHOD(bool, ReadBlock, (const uint256& hash, CBlock& blk, bool fReadTransactions),
                 (const, override));
+    MOCK_METHOD(bool, ReadBlockRaw, (const uint256& hash, std::string& data), (const, override));
     MOCK_METHOD(bool, WriteBlock, (const uint256& hash, const CBlock& blk), (override));
     MOCK_METHOD(bool, WriteBlockIndex, (const CDiskBlockIndex& blockindex), (override));
     MOCK_METHOD(bool, ReadHashBestChain, (uint256 & hashBestChain), (const, override));
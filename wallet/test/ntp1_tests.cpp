@@ -21,6 +21,7 @@
 #include "ntp1/ntp1wallet.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/container/flat_map.hpp>
+#include <chrono>
 #include <fstream>
 #include <random>
 #include <unordered_map>
@@ -3944,3 +3945,184 @@ TEST(ntp1_tests, ntp1_metadata_parsing_8)
 //        std::cout << "\t Skip: " << script_issuance->getTransferInstruction(i).skipInput << std::endl;
 //    }
 //}
+
+static bool RegexClassifyOutput(const CScript& script, const boost::regex& regex, std::string& arg)
+{
+    boost::smatch match;
+    std::string   str = script.ToString();
+    if (!boost::regex_match(str, match, regex)) {
+        return false;
+    }
+    arg = match[1];
+    return true;
+}
+
+TEST(ntp1_tests, binary_op_return_classification)
+{
+    const std::vector<unsigned char> transfer = ParseHex("4e5401150069892a92");
+    const std::vector<unsigned char> transferV3 =
+        ParseHex("4e5403100201208e2b160000e6c2fc0dd1cba3ab5b2d8c92f60f1e91d8ffe9e5d8b3e8");
+
+    std::vector<CScript> scripts;
+    scripts.push_back(CScript() << OP_RETURN << transfer);
+    scripts.push_back(CScript() << OP_RETURN << transferV3);
+    scripts.push_back(CScript() << OP_RETURN);
+    scripts.push_back(CScript() << OP_RETURN << OP_0);
+    scripts.push_back(CScript() << OP_RETURN << OP_1 << transfer);
+    scripts.push_back(CScript() << OP_RETURN << transfer << OP_1);
+    scripts.push_back(CScript() << OP_RETURN << transfer << transfer);
+    scripts.push_back(CScript() << OP_DUP << OP_RETURN << transfer);
+    scripts.push_back(CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1)
+                                << OP_EQUALVERIFY << OP_CHECKSIG);
+    scripts.push_back(CScript());
+    // short pushes are shown as numbers, so the NTP1 regex never matched them
+    for (unsigned size = 1; size <= 6; size++) {
+        const std::vector<unsigned char> data(transfer.begin(), transfer.begin() + size);
+        scripts.push_back(CScript() << OP_RETURN << data);
+    }
+    // other protocol versions and prefixes
+    for (unsigned char version = 0; version < 5; version++) {
+        std::vector<unsigned char> data = transfer;
+        data[2]                         = version;
+        scripts.push_back(CScript() << OP_RETURN << data);
+        data[0] = 0x4f;
+        scripts.push_back(CScript() << OP_RETURN << data);
+    }
+    // the same data behind all the push opcodes
+    {
+        CScript script;
+        script.push_back(OP_RETURN);
+        script.push_back(OP_PUSHDATA1);
+        script.push_back(static_cast<unsigned char>(transfer.size()));
+        script.insert(script.end(), transfer.begin(), transfer.end());
+        scripts.push_back(script);
+        script.resize(script.size() - 1); // truncated push
+        scripts.push_back(script);
+    }
+    {
+        CScript script;
+        script.push_back(OP_RETURN);
+        script.push_back(OP_PUSHDATA4);
+        script.push_back(static_cast<unsigned char>(transfer.size()));
+        script.insert(script.end(), 3, 0);
+        script.insert(script.end(), transfer.begin(), transfer.end());
+        scripts.push_back(script);
+    }
+    // random scripts that start with OP_RETURN
+    std::mt19937 rng(12345);
+    for (int i = 0; i < 2000; i++) {
+        CScript script;
+        script.push_back(OP_RETURN);
+        const unsigned size = rng() % 16;
+        for (unsigned j = 0; j < size; j++) {
+            script.push_back(static_cast<unsigned char>(rng() % 8 == 0 ? 0x4e + rng() % 8 : rng()));
+        }
+        if (rng() % 2) {
+            script.insert(script.begin() + 1, 0x4e);
+            script.insert(script.begin() + 2, 0x54);
+            script.insert(script.begin() + 3, rng() % 2 ? 0x01 : 0x03);
+            script.insert(script.begin() + 1, static_cast<unsigned char>(script.size() - 1));
+        }
+        scripts.push_back(script);
+    }
+
+    int ntp1Count = 0;
+    for (const CScript& script : scripts) {
+        CTransaction tx;
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = script;
+
+        std::string regexArg;
+        std::string arg;
+        const bool  isNTP1 = RegexClassifyOutput(script, NTP1OpReturnRegex, regexArg);
+        EXPECT_EQ(NTP1Transaction::IsTxOutputNTP1OpRet(&tx, 0, &arg), isNTP1) << script.ToString();
+        if (isNTP1) {
+            EXPECT_EQ(arg, regexArg);
+            ntp1Count++;
+            EXPECT_TRUE(NTP1Transaction::IsTxNTP1(&tx));
+        }
+
+        arg.clear();
+        const bool isOpRet = RegexClassifyOutput(script, OpReturnRegex, regexArg);
+        EXPECT_EQ(NTP1Transaction::IsTxOutputOpRet(&tx.vout[0], &arg), isOpRet) << script.ToString();
+        if (isOpRet) {
+            EXPECT_EQ(arg, regexArg);
+        }
+    }
+    EXPECT_GT(ntp1Count, 100);
+
+    // the binary script parser gives the same as the hex one
+    CTransaction tx;
+    tx.vout.resize(2);
+    tx.vout[1].scriptPubKey = CScript() << OP_RETURN << transfer;
+    std::shared_ptr<NTP1Script> fromTx  = NTP1Transaction::ParseTxNTP1Script(tx);
+    std::shared_ptr<NTP1Script> fromHex = NTP1Script::ParseScript(HexStr(transfer));
+    EXPECT_EQ(fromTx->getParsedScriptHex(), HexStr(transfer));
+    EXPECT_EQ(fromTx->getTxType(), fromHex->getTxType());
+    EXPECT_EQ(fromTx->getProtocolVersion(), fromHex->getProtocolVersion());
+    EXPECT_EQ(fromTx->getOpCodeBin(), fromHex->getOpCodeBin());
+    tx.vout[1].scriptPubKey = CScript() << OP_RETURN << OP_1;
+    EXPECT_THROW(NTP1Transaction::ParseTxNTP1Script(tx), std::runtime_error);
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(ntp1_tests, DISABLED_binary_op_return_classification_benchmark)
+{
+    // a mainnet-like set of blocks: a coinstake and 20 transactions per block, most of them paying to
+    // two addresses, and one in ten being an NTP1 transfer
+    const std::vector<unsigned char> transfer = ParseHex("4e5401150069892a92");
+    std::mt19937                     rng(1);
+    std::vector<CTransaction>        txs;
+    for (int block = 0; block < 100; block++) {
+        CTransaction coinstake;
+        coinstake.vout.resize(3);
+        coinstake.vout[1].scriptPubKey = CScript() << std::vector<unsigned char>(33, 2) << OP_CHECKSIG;
+        coinstake.vout[2].scriptPubKey = coinstake.vout[1].scriptPubKey;
+        txs.push_back(coinstake);
+        for (int i = 0; i < 20; i++) {
+            CTransaction tx;
+            tx.vout.resize(2);
+            for (CTxOut& out : tx.vout) {
+                std::vector<unsigned char> keyID(20);
+                for (unsigned char& c : keyID) {
+                    c = static_cast<unsigned char>(rng());
+                }
+                out.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << keyID << OP_EQUALVERIFY
+                                             << OP_CHECKSIG;
+            }
+            if (i % 10 == 0) {
+                tx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << transfer));
+            }
+            txs.push_back(tx);
+        }
+    }
+
+    const auto regexStart = std::chrono::steady_clock::now();
+    int        regexCount = 0;
+    for (const CTransaction& tx : txs) {
+        for (const CTxOut& out : tx.vout) {
+            std::string arg;
+            if (RegexClassifyOutput(out.scriptPubKey, NTP1OpReturnRegex, arg)) {
+                regexCount++;
+                break;
+            }
+        }
+    }
+    const auto binaryStart = std::chrono::steady_clock::now();
+    int        binaryCount = 0;
+    for (const CTransaction& tx : txs) {
+        if (NTP1Transaction::IsTxNTP1(&tx)) {
+            binaryCount++;
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(regexCount, binaryCount);
+    EXPECT_EQ(binaryCount, 200);
+    typedef std::chrono::duration<double, std::nano> Nanoseconds;
+    const double regexNs  = Nanoseconds(binaryStart - regexStart).count() / txs.size();
+    const double binaryNs = Nanoseconds(end - binaryStart).count() / txs.size();
+    std::cout << "NTP1 classification of " << txs.size() << " transactions: " << regexNs
+              << " ns/tx with ToString() and regex, " << binaryNs << " ns/tx on the script bytes"
+              << std::endl;
+}
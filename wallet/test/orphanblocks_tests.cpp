@@ -0,0 +1,136 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "orphanblocks.h"
+
+// a proof-of-work block on hashPrev, padded to take about nPadding more bytes
+static std::unique_ptr<CBlock> MakeBlock(const uint256& hashPrev, std::size_t nPadding = 0)
+{
+    std::unique_ptr<CBlock> pblock(new CBlock);
+    pblock->hashPrevBlock = hashPrev;
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript(std::vector<unsigned char>(nPadding, 0x51));
+    pblock->vtx.push_back(tx);
+    return pblock;
+}
+
+// a proof-of-stake block on hashPrev that stakes the output prevout
+static std::unique_ptr<CBlock> MakeStakeBlock(const uint256& hashPrev, const COutPoint& prevout)
+{
+    std::unique_ptr<CBlock> pblock = MakeBlock(hashPrev);
+    CTransaction            coinstake;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = prevout;
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1].nValue = 1;
+    pblock->vtx.push_back(coinstake);
+    return pblock;
+}
+
+TEST(orphanblocks_tests, chains_and_children)
+{
+    COrphanBlocks orphans(100, 100000000);
+
+    // two chains waiting for block 1, one of them with a fork, and one chain waiting for block 2
+    EXPECT_TRUE(orphans.Add(MakeBlock(uint256(1)), uint256(11), 1));
+    EXPECT_TRUE(orphans.Add(MakeBlock(uint256(11)), uint256(12), 1));
+    EXPECT_TRUE(orphans.Add(MakeBlock(uint256(11)), uint256(13), 2));
+    EXPECT_TRUE(orphans.Add(MakeBlock(uint256(1)), uint256(14), 2));
+    EXPECT_TRUE(orphans.Add(MakeBlock(uint256(2)), uint256(21), 2));
+    EXPECT_FALSE(orphans.Add(MakeBlock(uint256(1)), uint256(11), 3));
+    EXPECT_EQ(orphans.Size(), 5u);
+    EXPECT_EQ(orphans.Bytes(), orphans.PeerBytes(1) + orphans.PeerBytes(2));
+    EXPECT_EQ(orphans.PeerBytes(3), 0u);
+
+    EXPECT_TRUE(orphans.Contains(uint256(12)));
+    EXPECT_FALSE(orphans.Contains(uint256(1)));
+    EXPECT_TRUE(orphans.HasChildren(uint256(11)));
+    EXPECT_FALSE(orphans.HasChildren(uint256(12)));
+    EXPECT_EQ(orphans.GetRoot(uint256(13)), uint256(11));
+    EXPECT_EQ(orphans.GetMissingParent(uint256(13)), uint256(1));
+    EXPECT_EQ(orphans.GetMissingParent(uint256(21)), uint256(2));
+
+    // the children of block 1, then theirs
+    std::vector<std::unique_ptr<CBlock>> vChildren = orphans.TakeChildren(uint256(1));
+    ASSERT_EQ(vChildren.size(), 2u);
+    for (const std::unique_ptr<CBlock>& pblock : vChildren)
+        EXPECT_EQ(pblock->hashPrevBlock, uint256(1));
+    EXPECT_FALSE(orphans.Contains(uint256(11)));
+    EXPECT_EQ(orphans.GetRoot(uint256(13)), uint256(13));
+    EXPECT_EQ(orphans.TakeChildren(uint256(11)).size(), 2u);
+    EXPECT_TRUE(orphans.TakeChildren(uint256(11)).empty());
+
+    EXPECT_EQ(orphans.Size(), 1u);
+    EXPECT_EQ(orphans.Bytes(), orphans.PeerBytes(2));
+    EXPECT_EQ(orphans.PeerBytes(1), 0u);
+
+    orphans.Clear();
+    EXPECT_EQ(orphans.Size(), 0u);
+    EXPECT_EQ(orphans.Bytes(), 0u);
+}
+
+TEST(orphanblocks_tests, stakes)
+{
+    COrphanBlocks   orphans(100, 100000000);
+    const COutPoint prevout(uint256(77), 1);
+
+    std::unique_ptr<CBlock>                  pblock = MakeStakeBlock(uint256(1), prevout);
+    const std::pair<COutPoint, unsigned int> stake  = pblock->GetProofOfStake();
+    EXPECT_FALSE(orphans.HasStake(stake));
+    EXPECT_TRUE(orphans.Add(std::move(pblock), uint256(11), 1));
+    EXPECT_TRUE(orphans.HasStake(stake));
+
+    // a stake stays known while any orphan has it
+    EXPECT_TRUE(orphans.Add(MakeStakeBlock(uint256(2), prevout), uint256(21), 1));
+    orphans.TakeChildren(uint256(1));
+    EXPECT_TRUE(orphans.HasStake(stake));
+    orphans.TakeChildren(uint256(2));
+    EXPECT_FALSE(orphans.HasStake(stake));
+}
+
+TEST(orphanblocks_tests, eviction)
+{
+    const std::size_t nBlockBytes =
+        ::GetSerializeSize(*MakeBlock(uint256(0), 1000), SER_NETWORK, PROTOCOL_VERSION);
+
+    // room for ten blocks
+    COrphanBlocks orphans(100, nBlockBytes * 10);
+
+    // peer 1 sends a chain of six, which is never cut in the middle
+    for (int i = 0; i < 6; i++)
+        EXPECT_TRUE(orphans.Add(MakeBlock(uint256(100 + i), 1000), uint256(101 + i), 1));
+    // peer 2 sends four blocks that don't connect to anything
+    for (int i = 0; i < 4; i++)
+        EXPECT_TRUE(orphans.Add(MakeBlock(uint256(200 + 2 * i), 1000), uint256(201 + 2 * i), 2));
+    EXPECT_EQ(orphans.Size(), 10u);
+    EXPECT_EQ(orphans.Bytes(), nBlockBytes * 10);
+
+    // peer 2 floods more; it has fewer bytes, so peer 1 loses its last block first, then peer 2 its
+    // oldest
+    EXPECT_TRUE(orphans.Add(MakeBlock(uint256(300), 1000), uint256(301), 2));
+    EXPECT_FALSE(orphans.Contains(uint256(106)));
+    EXPECT_TRUE(orphans.Contains(uint256(105)));
+    EXPECT_TRUE(orphans.Add(MakeBlock(uint256(302), 1000), uint256(303), 2));
+    EXPECT_FALSE(orphans.Contains(uint256(201)));
+    EXPECT_TRUE(orphans.Contains(uint256(301)));
+    EXPECT_LE(orphans.Bytes(), nBlockBytes * 10);
+    EXPECT_EQ(orphans.PeerBytes(1), nBlockBytes * 5);
+
+    // a block bigger than the limit isn't kept
+    EXPECT_FALSE(orphans.Add(MakeBlock(uint256(400), nBlockBytes * 11), uint256(401), 3));
+    EXPECT_FALSE(orphans.Contains(uint256(401)));
+    EXPECT_EQ(orphans.Size(), 10u);
+
+    // the count is limited as well, and a parent whose children were evicted can be evicted next
+    COrphanBlocks small(2, 100000000);
+    EXPECT_TRUE(small.Add(MakeBlock(uint256(1)), uint256(11), 1));
+    EXPECT_TRUE(small.Add(MakeBlock(uint256(11)), uint256(12), 1));
+    EXPECT_TRUE(small.Add(MakeBlock(uint256(2)), uint256(21), 1));
+    EXPECT_EQ(small.Size(), 2u);
+    EXPECT_TRUE(small.Contains(uint256(11)));
+    EXPECT_FALSE(small.Contains(uint256(12)));
+    EXPECT_TRUE(small.Add(MakeBlock(uint256(3)), uint256(31), 1));
+    EXPECT_FALSE(small.Contains(uint256(11)));
+    EXPECT_TRUE(small.Contains(uint256(21)));
+}
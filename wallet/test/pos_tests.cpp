@@ -1,10 +1,13 @@
 #include "googletest/googletest/include/gtest/gtest.h"
 
 #include "base58.h"
+#include "bignum.h"
 #include "block.h"
+#include "kernel.h"
 #include "stakemaker.h"
 #include "test/mocks/mtxdb.h"
 #include "wallet.h"
+#include <chrono>
 
 class PoS_CollectInputsTestFixture : public ::testing::Test
 {
@@ -678,3 +681,151 @@ TEST(PoS_tests, scripts_p2cs_scriptSig_test)
         EXPECT_EQ(pubKeyReturned, boost::none);
     }
 }
+
+static StakeKernelRecord RandomStakeKernelRecord(int64_t now, unsigned int nSMA)
+{
+    StakeKernelRecord record;
+    record.hashBlockFrom  = GetRandHash();
+    record.nTimeBlockFrom = static_cast<unsigned int>(now - nSMA - GetRand(30 * 24 * 60 * 60));
+    record.nTxPrevOffset  = static_cast<unsigned int>(GetRand(1000000));
+    record.nTimeTxPrev    = record.nTimeBlockFrom - static_cast<unsigned int>(GetRand(600));
+    record.nPrevout       = static_cast<unsigned int>(GetRand(10));
+    record.nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+    record.nValueIn       = 1 + GetRand(100000 * COIN);
+    return record;
+}
+
+// what CheckStakeKernelHash() computes for every time
+static boost::optional<unsigned int> SearchStakeKernelTimeByStream(const StakeKernelRecord& record,
+                                                                   unsigned int nBits, unsigned int nSMA,
+                                                                   int64_t      nTimeTxFrom,
+                                                                   unsigned int nCount)
+{
+    CBigNum bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    for (unsigned int n = 0; n < nCount; n++) {
+        const unsigned int nTimeTx = static_cast<unsigned int>(nTimeTxFrom - n);
+        if (nTimeTx < record.nTimeTxPrev || record.nTimeBlockFrom + nSMA > nTimeTx) {
+            continue;
+        }
+        const int64_t nWeight = std::min<int64_t>(
+            (int64_t)nTimeTx - (int64_t)record.nTimeTxPrev - nSMA, Params().StakeMaxAge());
+        const CBigNum bnCoinDayWeight = CBigNum(record.nValueIn) * nWeight / COIN / (24 * 60 * 60);
+
+        CDataStream ss(SER_GETHASH, 0);
+        ss << record.nStakeModifier << record.nTimeBlockFrom << record.nTxPrevOffset
+           << record.nTimeTxPrev << record.nPrevout << nTimeTx;
+        const uint256 hashProofOfStake = Hash(ss.begin(), ss.end());
+        if (CBigNum(hashProofOfStake) > bnCoinDayWeight * bnTargetPerCoinDay) {
+            continue;
+        }
+        return nTimeTx;
+    }
+    return boost::none;
+}
+
+TEST(PoS_tests, kernel_hasher)
+{
+    SelectParams(NetworkType::Regtest);
+
+    for (int i = 0; i < 100; i++) {
+        const StakeKernelRecord record  = RandomStakeKernelRecord(1600000000, 24 * 60 * 60);
+        const unsigned int      nTimeTx = 1600000000 - static_cast<unsigned int>(GetRand(1000));
+
+        CDataStream ss(SER_GETHASH, 0);
+        ss << record.nStakeModifier << record.nTimeBlockFrom << record.nTxPrevOffset
+           << record.nTimeTxPrev << record.nPrevout << nTimeTx;
+        ASSERT_EQ(ss.size(), 28u);
+        EXPECT_EQ(StakeKernelHasher(record)(nTimeTx), Hash(ss.begin(), ss.end()));
+    }
+}
+
+TEST(PoS_tests, kernel_search)
+{
+    SelectParams(NetworkType::Regtest);
+
+    const int64_t      now   = 1600000000;
+    const unsigned int nSMA  = 24 * 60 * 60;
+    const unsigned int nBits = CBigNum(~uint256(0) >> 24).GetCompact();
+
+    int                                        found = 0;
+    std::vector<StakeKernelRecord>             records;
+    std::vector<boost::optional<unsigned int>> expected;
+    for (int i = 0; i < 2000; i++) {
+        StakeKernelRecord record = RandomStakeKernelRecord(now, nSMA);
+        if (i % 10 == 0) {
+            // reaches the min age in the middle of the search
+            record.nTimeBlockFrom = static_cast<unsigned int>(now - nSMA - 30);
+            record.nTimeTxPrev    = record.nTimeBlockFrom;
+        }
+        records.push_back(record);
+        expected.push_back(SearchStakeKernelTimeByStream(record, nBits, nSMA, now, 64));
+        EXPECT_EQ(SearchStakeKernelTime(record, nBits, nSMA, now, 64), expected.back());
+        found += expected.back() ? 1 : 0;
+    }
+    // the target is high enough for some of them to be found
+    EXPECT_GT(found, 0);
+
+    // the same, searched in threads
+    std::vector<boost::optional<unsigned int>> parallel(records.size());
+    RunSharded(records.size(), 4, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+            parallel[i] = SearchStakeKernelTime(records[i], nBits, nSMA, now, 64);
+        }
+    });
+    EXPECT_EQ(parallel, expected);
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(PoS_tests, DISABLED_kernel_search_benchmark)
+{
+    SelectParams(NetworkType::Regtest);
+
+    const int64_t      now    = 1600000000;
+    const unsigned int nSMA   = 24 * 60 * 60;
+    const unsigned int nBits  = CBigNum(~uint256(0) >> 32).GetCompact();
+    const unsigned int nCount = 16;
+    const std::size_t  nCoins = 20000;
+
+    std::vector<StakeKernelRecord> records;
+    for (std::size_t i = 0; i < nCoins; i++) {
+        records.push_back(RandomStakeKernelRecord(now, nSMA));
+    }
+
+    auto ms = [](std::chrono::steady_clock::time_point from) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                     from)
+            .count();
+    };
+
+    std::vector<boost::optional<unsigned int>> byStream(nCoins);
+    auto                                       start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < nCoins; i++) {
+        byStream[i] = SearchStakeKernelTimeByStream(records[i], nBits, nSMA, now, nCount);
+    }
+    const auto msStream = ms(start);
+
+    std::vector<boost::optional<unsigned int>> byRecord(nCoins);
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < nCoins; i++) {
+        byRecord[i] = SearchStakeKernelTime(records[i], nBits, nSMA, now, nCount);
+    }
+    const auto msRecord = ms(start);
+
+    const unsigned nThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<boost::optional<unsigned int>> parallel(nCoins);
+    start = std::chrono::steady_clock::now();
+    RunSharded(nCoins, nThreads, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+            parallel[i] = SearchStakeKernelTime(records[i], nBits, nSMA, now, nCount);
+        }
+    });
+    const auto msParallel = ms(start);
+
+    EXPECT_EQ(byRecord, byStream);
+    EXPECT_EQ(parallel, byStream);
+    std::cout << "Stake kernel search of " << nCoins << " coins, " << nCount
+              << " seconds each: serialized per time in " << msStream << " ms, from records in "
+              << msRecord << " ms, from records in " << nThreads << " threads in " << msParallel
+              << " ms" << std::endl;
+}
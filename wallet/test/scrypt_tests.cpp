@@ -0,0 +1,69 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "scrypt.h"
+
+#include <chrono>
+
+static std::vector<unsigned char> TestHeaders(size_t n)
+{
+    std::vector<unsigned char> headers(80 * n);
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i] = static_cast<unsigned char>(i * 131 + 7);
+    }
+    return headers;
+}
+
+TEST(scrypt_tests, blockhash_many)
+{
+    // the neblio genesis block header, and its hash
+    const std::string genesisHeader =
+        "0100000000000000000000000000000000000000000000000000000000000000000000"
+        "00e7ae9132c789d33c38b735ae562ef57c9780c7328b0d1cb0121a321432d13f20137a"
+        "7259ffff7f2025210000";
+    std::vector<unsigned char> header = ParseHex(genesisHeader);
+    ASSERT_EQ(header.size(), 80u);
+    const uint256 genesisHash("0x7286972be4dbc1463d256049b7471c252e6557e222cab9be73181d359cd28bcc");
+    EXPECT_EQ(scrypt_blockhash(header.data()), genesisHash);
+    uint256 hash;
+    scrypt_blockhash_many(header.data(), 1, &hash);
+    EXPECT_EQ(hash, genesisHash);
+
+    // every batch size, including partial groups of lanes, gives the same hashes as one by one
+    const size_t                     maxCount = 20;
+    const std::vector<unsigned char> headers  = TestHeaders(maxCount);
+    std::vector<uint256>             expected(maxCount);
+    for (size_t i = 0; i < maxCount; i++) {
+        expected[i] = scrypt_blockhash(&headers[80 * i]);
+    }
+    for (size_t n = 0; n <= maxCount; n++) {
+        std::vector<uint256> hashes(n);
+        scrypt_blockhash_many(headers.data(), n, hashes.data());
+        for (size_t i = 0; i < n; i++) {
+            EXPECT_EQ(hashes[i], expected[i]) << "header " << i << " of " << n;
+        }
+    }
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(scrypt_tests, DISABLED_blockhash_many_benchmark)
+{
+    const size_t                     count   = 256;
+    const std::vector<unsigned char> headers = TestHeaders(count);
+    std::vector<uint256>             single(count);
+    std::vector<uint256>             many(count);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        single[i] = scrypt_blockhash(&headers[80 * i]);
+    }
+    const auto middle = std::chrono::steady_clock::now();
+    scrypt_blockhash_many(headers.data(), count, many.data());
+    const auto end = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(single, many);
+    std::cout << "scrypt_blockhash of " << count << " headers: one by one in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count()
+              << " ms, together in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - middle).count() << " ms"
+              << std::endl;
+}
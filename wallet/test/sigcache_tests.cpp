@@ -0,0 +1,169 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "hash.h"
+#include "sigcache.h"
+#include "util.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static uint256 TestEntry(uint64_t i) { return Hash(BEGIN(i), END(i)); }
+
+TEST(sigcache_tests, insert_and_find)
+{
+    CSignatureCache cache;
+    cache.Setup(1 << 20);
+    const uint32_t capacity = cache.GetSlotCount();
+    EXPECT_GT(capacity, 0u);
+    EXPECT_LE(cache.GetMemoryUsage(), 1u << 20);
+
+    // salted: the same signature maps to different entries in different caches
+    std::vector<unsigned char> sig(72, 1);
+    std::vector<unsigned char> pubKey(33, 2);
+    CSignatureCache            otherCache;
+    otherCache.Setup(0);
+    EXPECT_EQ(cache.ComputeEntry(1, sig, pubKey), cache.ComputeEntry(1, sig, pubKey));
+    EXPECT_NE(cache.ComputeEntry(1, sig, pubKey), otherCache.ComputeEntry(1, sig, pubKey));
+    EXPECT_NE(cache.ComputeEntry(1, sig, pubKey), cache.ComputeEntry(2, sig, pubKey));
+
+    // half full: everything fits
+    const uint64_t half = capacity / 2;
+    for (uint64_t i = 0; i < half; i++) {
+        cache.Set(TestEntry(i));
+    }
+    EXPECT_EQ(cache.GetEntryCount(), half);
+    EXPECT_EQ(cache.GetEvictions(), 0u);
+    for (uint64_t i = 0; i < half; i++) {
+        EXPECT_TRUE(cache.Get(TestEntry(i)));
+    }
+    EXPECT_FALSE(cache.Get(TestEntry(capacity * 2)));
+    EXPECT_EQ(cache.GetHits(), half);
+    EXPECT_EQ(cache.GetMisses(), 1u);
+
+    // inserting twice doesn't take more room
+    cache.Set(TestEntry(0));
+    EXPECT_EQ(cache.GetEntryCount(), half);
+
+    // overfilled: the memory stays fixed, and most entries are kept
+    for (uint64_t i = half; i < uint64_t(capacity) * 2; i++) {
+        cache.Set(TestEntry(i));
+    }
+    EXPECT_LE(cache.GetEntryCount(), capacity);
+    EXPECT_GT(cache.GetEntryCount(), capacity * 9 / 10);
+    EXPECT_GT(cache.GetEvictions(), 0u);
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < uint64_t(capacity) * 2; i++) {
+        found += cache.Get(TestEntry(i));
+    }
+    EXPECT_EQ(found, cache.GetEntryCount());
+
+    // disabled
+    cache.Setup(0);
+    cache.Set(TestEntry(0));
+    EXPECT_FALSE(cache.Get(TestEntry(0)));
+    EXPECT_EQ(cache.GetEntryCount(), 0u);
+}
+
+TEST(sigcache_tests, size_option)
+{
+    // nothing is allocated before the cache is set up
+    CSignatureCache unused;
+    EXPECT_EQ(unused.GetMemoryUsage(), 0u);
+    EXPECT_FALSE(unused.Get(TestEntry(0)));
+
+    InitSignatureCache();
+    EXPECT_LE(GetSignatureCache().GetMemoryUsage(), uint64_t(DEFAULT_SIG_CACHE_MB) << 20);
+    EXPECT_GT(GetSignatureCache().GetMemoryUsage(), uint64_t(DEFAULT_SIG_CACHE_MB - 1) << 20);
+
+    mapArgs.set("-sigcachemb", "2");
+    InitSignatureCache();
+    EXPECT_LE(GetSignatureCache().GetMemoryUsage(), 2u << 20);
+    EXPECT_GT(GetSignatureCache().GetMemoryUsage(), 1u << 20);
+
+    // -sigcachemb wins over the older option
+    mapArgs.set("-maxsigcachesize", "1000");
+    InitSignatureCache();
+    EXPECT_GT(GetSignatureCache().GetMemoryUsage(), 1u << 20);
+
+    mapArgs.set("-sigcachemb", "100000000000");
+    InitSignatureCache();
+    EXPECT_LE(GetSignatureCache().GetMemoryUsage(), uint64_t(MAX_SIG_CACHE_MB) << 20);
+
+    // on its own, -maxsigcachesize is a number of signatures, however small
+    mapArgs.erase("-sigcachemb");
+    InitSignatureCache();
+    EXPECT_EQ(GetSignatureCache().GetSlotCount(), 1000u);
+
+    mapArgs.set("-maxsigcachesize", "50000");
+    InitSignatureCache();
+    EXPECT_EQ(GetSignatureCache().GetSlotCount(), 50000u);
+
+    mapArgs.erase("-maxsigcachesize");
+    InitSignatureCache();
+}
+
+// looks up cached entries from nThreads threads, each inserting one new entry per 16 lookups, like
+// block validation does for signatures that weren't in the mempool; returns the number of misses
+static int LookUpConcurrently(CSignatureCache& cache, uint64_t entriesCount, unsigned nThreads,
+                              uint64_t lookupsPerThread)
+{
+    std::atomic<int>         missing{0};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nThreads; t++) {
+        threads.emplace_back([&, t]() {
+            for (uint64_t i = 0; i < lookupsPerThread; i++) {
+                if (!cache.Get(TestEntry((i * 7919 + t) % entriesCount))) {
+                    missing++;
+                }
+                if (i % 16 == 0) {
+                    cache.Set(TestEntry(entriesCount + (uint64_t(t) << 32) + i));
+                }
+            }
+        });
+    }
+    for (std::thread& th : threads) {
+        th.join();
+    }
+    return missing.load();
+}
+
+TEST(sigcache_tests, concurrent_access)
+{
+    CSignatureCache cache;
+    cache.Setup(1 << 20);
+
+    const uint64_t entriesCount = cache.GetSlotCount() / 2;
+    for (uint64_t i = 0; i < entriesCount; i++) {
+        cache.Set(TestEntry(i));
+    }
+
+    const uint64_t lookupsPerThread = 20000;
+    const int      missing          = LookUpConcurrently(cache, entriesCount, 4, lookupsPerThread);
+    // the cache is only half full, so few of the original entries were evicted
+    EXPECT_LT(missing, static_cast<int>(lookupsPerThread));
+    EXPECT_EQ(cache.GetHits() + cache.GetMisses(), 4 * lookupsPerThread);
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(sigcache_tests, DISABLED_contention_benchmark)
+{
+    CSignatureCache cache;
+    cache.Setup(32 << 20);
+
+    const uint64_t entriesCount = cache.GetSlotCount() / 2;
+    for (uint64_t i = 0; i < entriesCount; i++) {
+        cache.Set(TestEntry(i));
+    }
+
+    const uint64_t lookupsPerThread = 200000;
+    const unsigned maxThreads       = std::max(4u, std::thread::hardware_concurrency());
+    for (unsigned nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        const auto start   = std::chrono::steady_clock::now();
+        const int  missing = LookUpConcurrently(cache, entriesCount, nThreads, lookupsPerThread);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const auto ms      = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        std::cout << nThreads << " threads: " << nThreads * lookupsPerThread << " lookups in " << ms
+                  << " ms, " << missing << " misses" << std::endl;
+    }
+}
@@ -0,0 +1,230 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "socketevents.h"
+
+#ifndef WIN32
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <iostream>
+
+// connected loopback TCP sockets; the first of each pair is the accepted one, non-blocking
+static std::vector<std::pair<SOCKET, SOCKET>> MakeLoopbackPairs(std::size_t nCount)
+{
+    std::vector<std::pair<SOCKET, SOCKET>> vPairs;
+
+    struct sockaddr_in addr = {};
+    addr.sin_family         = AF_INET;
+    addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+    addr.sin_port           = 0;
+    socklen_t len           = sizeof(addr);
+
+    SOCKET hListen = socket(AF_INET, SOCK_STREAM, 0);
+    if (hListen == INVALID_SOCKET || bind(hListen, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(hListen, SOMAXCONN) != 0 || getsockname(hListen, (struct sockaddr*)&addr, &len) != 0) {
+        closesocket(hListen);
+        return vPairs;
+    }
+
+    for (std::size_t i = 0; i < nCount; i++) {
+        SOCKET hClient = socket(AF_INET, SOCK_STREAM, 0);
+        if (hClient == INVALID_SOCKET)
+            break;
+        if (connect(hClient, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            closesocket(hClient);
+            break;
+        }
+        SOCKET hServer = accept(hListen, nullptr, nullptr);
+        if (hServer == INVALID_SOCKET) {
+            closesocket(hClient);
+            break;
+        }
+        fcntl(hServer, F_SETFL, O_NONBLOCK);
+        vPairs.push_back(std::make_pair(hServer, hClient));
+    }
+    closesocket(hListen);
+    return vPairs;
+}
+
+static void ClosePairs(std::vector<std::pair<SOCKET, SOCKET>>& vPairs)
+{
+    for (auto& p : vPairs) {
+        closesocket(p.first);
+        closesocket(p.second);
+    }
+    vPairs.clear();
+}
+
+static std::vector<CSocketEvents::Backend> AvailableBackends()
+{
+    std::vector<CSocketEvents::Backend> vBackends;
+    if (CSocketEvents::DefaultBackend() == CSocketEvents::BACKEND_EPOLL)
+        vBackends.push_back(CSocketEvents::BACKEND_EPOLL);
+    vBackends.push_back(CSocketEvents::BACKEND_POLL);
+    return vBackends;
+}
+
+static std::size_t CountRecvEvents(const std::vector<CSocketEvents::Event>& vEvents)
+{
+    std::size_t nCount = 0;
+    for (const CSocketEvents::Event& event : vEvents)
+        if (event.fRecv)
+            nCount++;
+    return nCount;
+}
+
+TEST(socketevents_tests, receive_and_remove)
+{
+    for (CSocketEvents::Backend backend : AvailableBackends()) {
+        CSocketEvents events(backend);
+        ASSERT_EQ(events.GetBackend(), backend);
+
+        std::vector<std::pair<SOCKET, SOCKET>> vPairs = MakeLoopbackPairs(3);
+        ASSERT_EQ(vPairs.size(), 3u);
+        int vData[3];
+        for (int i = 0; i < 3; i++)
+            EXPECT_TRUE(events.Add(vPairs[i].first, &vData[i]));
+        EXPECT_FALSE(events.Add(vPairs[0].first, &vData[0]));
+
+        std::vector<CSocketEvents::Event> vEvents;
+        ASSERT_TRUE(events.Wait(vEvents, 0));
+        EXPECT_EQ(CountRecvEvents(vEvents), 0u);
+
+        // the socket that got data is reported with its data
+        ASSERT_EQ(send(vPairs[1].second, "x", 1, 0), 1);
+        ASSERT_TRUE(events.Wait(vEvents, 1000));
+        ASSERT_EQ(CountRecvEvents(vEvents), 1u);
+        for (const CSocketEvents::Event& event : vEvents) {
+            if (event.fRecv) {
+                EXPECT_EQ(event.hSocket, vPairs[1].first);
+                EXPECT_EQ(event.pdata, &vData[1]);
+            }
+        }
+
+        // epoll doesn't report what wasn't read again, poll does until it's read
+        ASSERT_TRUE(events.Wait(vEvents, 0));
+        EXPECT_EQ(CountRecvEvents(vEvents), backend == CSocketEvents::BACKEND_EPOLL ? 0u : 1u);
+        char c;
+        EXPECT_EQ(recv(vPairs[1].first, &c, 1, 0), 1);
+        ASSERT_TRUE(events.Wait(vEvents, 0));
+        EXPECT_EQ(CountRecvEvents(vEvents), 0u);
+
+        // removed sockets aren't reported, and the others still are
+        events.Remove(vPairs[0].first);
+        ASSERT_EQ(send(vPairs[0].second, "x", 1, 0), 1);
+        ASSERT_EQ(send(vPairs[2].second, "x", 1, 0), 1);
+        ASSERT_TRUE(events.Wait(vEvents, 1000));
+        ASSERT_EQ(CountRecvEvents(vEvents), 1u);
+        for (const CSocketEvents::Event& event : vEvents) {
+            if (event.fRecv) {
+                EXPECT_EQ(event.pdata, &vData[2]);
+            }
+        }
+
+        // a closed peer is reported
+        closesocket(vPairs[1].second);
+        ASSERT_TRUE(events.Wait(vEvents, 1000));
+        bool fFound = false;
+        for (const CSocketEvents::Event& event : vEvents)
+            if (event.pdata == &vData[1] && event.fRecv)
+                fFound = true;
+        EXPECT_TRUE(fFound);
+
+        events.Remove(vPairs[1].first);
+        events.Remove(vPairs[2].first);
+        ClosePairs(vPairs);
+    }
+}
+
+TEST(socketevents_tests, send_and_wakeup)
+{
+    for (CSocketEvents::Backend backend : AvailableBackends()) {
+        CSocketEvents events(backend);
+
+        std::vector<std::pair<SOCKET, SOCKET>> vPairs = MakeLoopbackPairs(1);
+        ASSERT_EQ(vPairs.size(), 1u);
+        int nData = 0;
+        ASSERT_TRUE(events.Add(vPairs[0].first, &nData));
+
+        // epoll reports the room to send once; poll only when asked to
+        std::vector<CSocketEvents::Event> vEvents;
+        ASSERT_TRUE(events.Wait(vEvents, 0));
+        const bool fEdgeTriggered = backend == CSocketEvents::BACKEND_EPOLL;
+        EXPECT_EQ(vEvents.size() == 1 && vEvents[0].fSend, fEdgeTriggered);
+        ASSERT_TRUE(events.Wait(vEvents, 0));
+        EXPECT_TRUE(vEvents.empty());
+
+        events.SetWantSend(vPairs[0].first, true);
+        ASSERT_TRUE(events.Wait(vEvents, 0));
+        EXPECT_EQ(vEvents.size() == 1 && vEvents[0].fSend, !fEdgeTriggered);
+        events.SetWantSend(vPairs[0].first, false);
+
+        // a wakeup ends the wait long before its timeout
+        const auto start = std::chrono::steady_clock::now();
+        events.Wakeup();
+        ASSERT_TRUE(events.Wait(vEvents, 5000));
+        EXPECT_TRUE(vEvents.empty());
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+
+        events.Remove(vPairs[0].first);
+        ClosePairs(vPairs);
+    }
+}
+
+// a timing run, not a check; run it with --gtest_also_run_disabled_tests
+TEST(socketevents_tests, DISABLED_connection_scaling_benchmark)
+{
+    // each pair takes two descriptors
+    struct rlimit limit;
+    std::size_t   nMaxPairs = 480;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        nMaxPairs = std::min<std::size_t>(nMaxPairs, (limit.rlim_cur - 32) / 2);
+
+    // a few busy peers among many idle connections, like a node with many inbound peers
+    const int         nRounds      = 200;
+    const std::size_t nActivePeers = 8;
+
+    for (std::size_t nPairs : {16, 128, 480}) {
+        if (nPairs > nMaxPairs)
+            break;
+        std::vector<std::pair<SOCKET, SOCKET>> vPairs = MakeLoopbackPairs(nPairs);
+        ASSERT_EQ(vPairs.size(), nPairs);
+
+        for (CSocketEvents::Backend backend : AvailableBackends()) {
+            CSocketEvents events(backend);
+            for (auto& p : vPairs)
+                ASSERT_TRUE(events.Add(p.first, &p));
+            std::vector<CSocketEvents::Event> vEvents;
+            events.Wait(vEvents, 0);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (int nRound = 0; nRound < nRounds; nRound++) {
+                for (std::size_t i = 0; i < nActivePeers; i++)
+                    ASSERT_EQ(send(vPairs[(nRound * 7 + i * 13) % nPairs].second, "x", 1, 0), 1);
+
+                std::size_t nReceived = 0;
+                while (nReceived < nActivePeers) {
+                    ASSERT_TRUE(events.Wait(vEvents, 1000));
+                    ASSERT_FALSE(vEvents.empty());
+                    for (const CSocketEvents::Event& event : vEvents) {
+                        char buf[16];
+                        if (event.fRecv && recv(event.hSocket, buf, sizeof(buf), 0) > 0)
+                            nReceived++;
+                    }
+                }
+            }
+            const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+            std::cout << nPairs << " connections, " << events.GetBackendName() << ": "
+                      << us / nRounds << " us per round of " << nActivePeers << " messages" << std::endl;
+
+            for (auto& p : vPairs)
+                events.Remove(p.first);
+        }
+        ClosePairs(vPairs);
+    }
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "blockindex.h"
+#include "stakemodifierindex.h"
+
+#include <random>
+
+// a chain with unordered block times, where every third block generates a modifier
+static std::vector<CBlockIndexSmartPtr> MakeChain(int nLength, std::mt19937& gen)
+{
+    std::vector<CBlockIndexSmartPtr> chain;
+    for (int i = 0; i < nLength; i++) {
+        CBlockIndexSmartPtr pindex = boost::make_shared<CBlockIndex>();
+        pindex->nHeight            = i;
+        pindex->nTime              = 1000000 + 60 * i + std::uniform_int_distribution<int>(-300, 300)(gen);
+        pindex->pprev              = chain.empty() ? nullptr : chain.back();
+        pindex->SetStakeModifier(i, i == 0 || std::uniform_int_distribution<int>(0, 2)(gen) == 0);
+        chain.push_back(pindex);
+    }
+    return chain;
+}
+
+// the walk along pnext that the index replaces
+static CBlockIndexSmartPtr FindGeneratedAfterByWalking(const std::vector<CBlockIndexSmartPtr>& chain,
+                                                       int nHeightFrom, int64_t nTime)
+{
+    for (int i = nHeightFrom + 1; i < static_cast<int>(chain.size()); i++) {
+        if (chain[i]->GeneratedStakeModifier() && chain[i]->GetBlockTime() >= nTime) {
+            return chain[i];
+        }
+    }
+    return nullptr;
+}
+
+TEST(stakemodifierindex_tests, find_generated_after)
+{
+    std::mt19937                           gen(12345);
+    const std::vector<CBlockIndexSmartPtr> chain = MakeChain(2000, gen);
+
+    StakeModifierIndex index;
+    for (const CBlockIndexSmartPtr& pindex : chain) {
+        index.Push(pindex);
+    }
+    ASSERT_EQ(index.Height(), 1999);
+    EXPECT_EQ(index.Get(1234), chain[1234]);
+    EXPECT_EQ(index.Get(2000), nullptr);
+
+    for (int nHeightFrom = 0; nHeightFrom < 2000; nHeightFrom += 7) {
+        for (int64_t nInterval : {0, 100, 600, 5000, 200000}) {
+            const int64_t       nTime = chain[nHeightFrom]->GetBlockTime() + nInterval;
+            CBlockIndexSmartPtr pindexLast;
+            const auto          found = index.FindGeneratedAfter(chain[nHeightFrom], nTime, pindexLast);
+            const CBlockIndexSmartPtr expected = FindGeneratedAfterByWalking(chain, nHeightFrom, nTime);
+            if (expected) {
+                ASSERT_TRUE(!!found);
+                EXPECT_EQ(found->pindex, expected);
+                EXPECT_EQ(found->nStakeModifier, expected->nStakeModifier);
+            } else {
+                EXPECT_FALSE(!!found);
+                EXPECT_EQ(pindexLast, chain.back());
+            }
+        }
+    }
+}
+
+TEST(stakemodifierindex_tests, reorganize)
+{
+    std::mt19937                     gen(54321);
+    std::vector<CBlockIndexSmartPtr> chain = MakeChain(100, gen);
+
+    StakeModifierIndex index;
+    index.Reset(chain.back());
+    ASSERT_EQ(index.Height(), 99);
+
+    // a fork from block 80
+    CBlockIndexSmartPtr fork = boost::make_shared<CBlockIndex>();
+    fork->nHeight            = 81;
+    fork->nTime              = chain[80]->nTime + 1;
+    fork->pprev              = chain[80];
+    fork->SetStakeModifier(777, true);
+
+    index.Truncate(80);
+    index.Push(fork);
+    EXPECT_EQ(index.Height(), 81);
+    EXPECT_TRUE(index.Contains(fork.get()));
+    EXPECT_FALSE(index.Contains(chain[81].get()));
+    EXPECT_EQ(index.GetLastGenerated(fork.get())->pindex, fork);
+
+    // a block off the main chain stops the search at itself
+    CBlockIndexSmartPtr pindexLast;
+    EXPECT_FALSE(!!index.FindGeneratedAfter(chain[85], 0, pindexLast));
+    EXPECT_EQ(pindexLast, chain[85]);
+    EXPECT_EQ(index.FindGeneratedAfter(chain[10], fork->GetBlockTime(), pindexLast)->pindex, fork);
+
+    // a block that doesn't extend the tip rebuilds the index from it
+    index.Push(chain[99]);
+    EXPECT_EQ(index.Height(), 99);
+    EXPECT_TRUE(index.Contains(chain[81].get()));
+    EXPECT_FALSE(index.Contains(fork.get()));
+}
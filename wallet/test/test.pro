@@ -42,9 +42,12 @@ SOURCES += \
     base58_tests.cpp      \
     base64_tests.cpp      \
     bignum_tests.cpp      \
+    blockdownload_tests.cpp \
     bloom_tests.cpp       \
     canonical_tests.cpp   \
+    chain_tests.cpp       \
     checkpoints_tests.cpp \
+    checkqueue_tests.cpp  \
     compress_tests.cpp    \
     crypter_tests.cpp     \
     db_tests.cpp          \
@@ -52,23 +55,31 @@ SOURCES += \
     getarg_tests.cpp      \
     hash_tests.cpp        \
     key_tests.cpp         \
+    lrucache_tests.cpp    \
+    mempool_tests.cpp     \
     merkle_tests.cpp      \
     miner_tests.cpp       \
     mruset_tests.cpp      \
     netbase_tests.cpp     \
     ntp1_selection_tests.cpp \
     ntp1_tests.cpp        \
+    orphanblocks_tests.cpp \
     pmt_tests.cpp         \
     pos_tests.cpp         \
     rpc_tests.cpp         \
     result_tests.cpp      \
     script_tests.cpp      \
+    scrypt_tests.cpp      \
     serialize_tests.cpp   \
+    sigcache_tests.cpp    \
     sigopcount_tests.cpp  \
+    socketevents_tests.cpp \
+    stakemodifierindex_tests.cpp \
     transaction_tests.cpp \
     uint160_tests.cpp     \
     uint256_tests.cpp     \
     util_tests.cpp        \
+    validationqueue_tests.cpp \
     wallet_tests.cpp      \
     environment.cpp
 
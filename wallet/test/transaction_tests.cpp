@@ -537,3 +537,35 @@ TEST(genesis, genesis_block_tests_regtest)
     EXPECT_EQ(Params().GenesisBlock().hashMerkleRoot,
               uint256("0x7f1bebe1b7fd896ebacb63834ee0b4e55880975aba163047fe061c86911b5749"));
 }
+
+TEST(genesis, block_hash_memo)
+{
+    SwitchNetworkTypeTemporarily state_holder(NetworkType::Mainnet);
+    CBlock block = Params().GenesisBlock();
+
+    // the scrypt hash is computed once per header
+    const uint64_t nPoWBefore = CBlock::nPoWHashComputations.load();
+    const uint256  hash       = block.GetHash();
+    EXPECT_EQ(block.GetHash(), hash);
+    EXPECT_EQ(block.GetPoWHash(), hash);
+    EXPECT_EQ(CBlock::nPoWHashComputations.load() - nPoWBefore, 1u);
+
+    // changing the header recomputes it, and changing it back gives the original hash
+    block.nNonce++;
+    EXPECT_NE(block.GetHash(), hash);
+    block.nNonce--;
+    EXPECT_EQ(block.GetHash(), hash);
+    EXPECT_EQ(CBlock::nPoWHashComputations.load() - nPoWBefore, 3u);
+
+    // copies carry the memo along with the header
+    CBlock copy = block;
+    EXPECT_EQ(copy.GetHash(), hash);
+    EXPECT_EQ(CBlock::nPoWHashComputations.load() - nPoWBefore, 3u);
+
+    // without CheckBlock(), transaction hashes are computed from the transactions
+    const uint64_t nTxBefore = CTransaction::nHashComputations.load();
+    ASSERT_EQ(block.vtx.size(), 1u);
+    EXPECT_EQ(block.GetTxHash(0), block.vtx[0].GetHash());
+    EXPECT_EQ(block.GetTxHash(0), block.hashMerkleRoot);
+    EXPECT_EQ(CTransaction::nHashComputations.load() - nTxBefore, 3u);
+}
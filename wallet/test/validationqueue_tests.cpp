@@ -0,0 +1,73 @@
+#include "googletest/googletest/include/gtest/gtest.h"
+
+#include "validationqueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST(validationqueue_tests, order_and_pending)
+{
+    CValidationQueue queue;
+    std::vector<int> vRun;
+
+    EXPECT_FALSE(queue.RunNext(0));
+    EXPECT_EQ(queue.Pending(1), 0u);
+
+    queue.Push(1, [&]() { vRun.push_back(1); });
+    queue.Push(2, [&]() { vRun.push_back(2); });
+    queue.Push(1, [&]() {
+        // a running task is still pending
+        EXPECT_EQ(queue.Pending(1), 1u);
+        vRun.push_back(3);
+    });
+    EXPECT_EQ(queue.Size(), 3u);
+    EXPECT_EQ(queue.Pending(1), 2u);
+    EXPECT_EQ(queue.Pending(2), 1u);
+    EXPECT_EQ(queue.Pending(3), 0u);
+
+    EXPECT_TRUE(queue.RunNext(0));
+    EXPECT_EQ(queue.Pending(1), 1u);
+    EXPECT_TRUE(queue.RunNext(0));
+    EXPECT_EQ(queue.Pending(2), 0u);
+    EXPECT_TRUE(queue.RunNext(0));
+    EXPECT_EQ(queue.Pending(1), 0u);
+    EXPECT_FALSE(queue.RunNext(0));
+
+    EXPECT_EQ(vRun, std::vector<int>({1, 2, 3}));
+    EXPECT_EQ(queue.Size(), 0u);
+}
+
+TEST(validationqueue_tests, wait_timeout)
+{
+    CValidationQueue queue;
+    const auto       start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(queue.RunNext(50));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(40));
+}
+
+TEST(validationqueue_tests, worker_thread)
+{
+    CValidationQueue  queue;
+    std::atomic<bool> fStop(false);
+    std::atomic<int>  nRun(0);
+    std::thread       worker([&]() {
+        while (!fStop)
+            queue.RunNext(10);
+    });
+
+    // the worker picks up tasks pushed while it waits
+    const int nTasks = 1000;
+    for (int i = 0; i < nTasks; i++)
+        queue.Push(i % 7, [&]() { nRun++; });
+    for (int i = 0; i < 500 && nRun < nTasks; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    fStop = true;
+    worker.join();
+
+    EXPECT_EQ(nRun, nTasks);
+    EXPECT_EQ(queue.Size(), 0u);
+    for (int64_t nodeId = 0; nodeId < 7; nodeId++)
+        EXPECT_EQ(queue.Pending(nodeId), 0u);
+}
@@ -21,7 +21,13 @@ void CTransaction::SetNull()
     nDoS      = 0; // Denial-of-service prevention
 }
 
-uint256 CTransaction::GetHash() const { return SerializeHash(*this); }
+std::atomic<uint64_t> CTransaction::nHashComputations{0};
+
+uint256 CTransaction::GetHash() const
+{
+    nHashComputations.fetch_add(1, std::memory_order_relaxed);
+    return SerializeHash(*this);
+}
 
 bool CTransaction::IsNewerThan(const CTransaction& old) const
 {
@@ -489,7 +495,8 @@ Result<void, TxValidationState> CTransaction::ConnectInputs(const ITxDB& txdb, M
                                                             const CDiskTxPos&               posThisTx,
                                                             const ConstCBlockIndexSmartPtr& pindexBlock,
                                                             bool fBlock, bool fMiner,
-                                                            CBlock* sourceBlockPtr) const
+                                                            CBlock* sourceBlockPtr,
+                                                            std::vector<CScriptCheck>* pvChecks) const
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the
@@ -589,37 +596,44 @@ Result<void, TxValidationState> CTransaction::ConnectInputs(const ITxDB& txdb, M
             if (!(fBlock &&
                   (txdb.GetBestChainHeight().value_or(0) < Checkpoints::GetTotalBlocksEstimate()))) {
                 // Verify signature
-                bool       fStrictPayToScriptHash = true;
-                const auto verifyRes =
-                    VerifySignature(txPrev, *this, i, fStrictPayToScriptHash, false, 0);
-                if (verifyRes.isErr()) {
-                    // only during transition phase for P2SH: do not invoke anti-DoS code for
-                    // potentially old clients relaying bad P2SH transactions
-                    if (fStrictPayToScriptHash) {
-                        const auto verifyResP2SH = VerifySignature(txPrev, *this, i, false, false, 0);
-                        if (verifyResP2SH.isOk()) {
-                            return Err(MakeInvalidTxState(
-                                TxValidationResult::TX_NOT_STANDARD,
-                                strprintf("non-mandatory-script-verify-flag (%s)",
-                                          ScriptErrorString(verifyResP2SH.unwrapErr())),
-                                strprintf("ConnectInputs() : %s P2SH VerifySignature failed",
-                                          GetHash().ToString().c_str())));
+                bool fStrictPayToScriptHash = true;
+                if (pvChecks) {
+                    // deferred to the caller's check queue
+                    pvChecks->push_back(
+                        CScriptCheck(txPrev, *this, i, fStrictPayToScriptHash, false, 0));
+                } else {
+                    const auto verifyRes =
+                        VerifySignature(txPrev, *this, i, fStrictPayToScriptHash, false, 0);
+                    if (verifyRes.isErr()) {
+                        // only during transition phase for P2SH: do not invoke anti-DoS code for
+                        // potentially old clients relaying bad P2SH transactions
+                        if (fStrictPayToScriptHash) {
+                            const auto verifyResP2SH =
+                                VerifySignature(txPrev, *this, i, false, false, 0);
+                            if (verifyResP2SH.isOk()) {
+                                return Err(MakeInvalidTxState(
+                                    TxValidationResult::TX_NOT_STANDARD,
+                                    strprintf("non-mandatory-script-verify-flag (%s)",
+                                              ScriptErrorString(verifyResP2SH.unwrapErr())),
+                                    strprintf("ConnectInputs() : %s P2SH VerifySignature failed",
+                                              GetHash().ToString().c_str())));
+                            }
                         }
-                    }
 
-                    const std::string msg = strprintf("mandatory-script-verify-flag-failed (%s)",
-                                                      ScriptErrorString(verifyRes.unwrapErr()));
+                        const std::string msg = strprintf("mandatory-script-verify-flag-failed (%s)",
+                                                          ScriptErrorString(verifyRes.unwrapErr()));
 
-                    if (sourceBlockPtr) {
-                        sourceBlockPtr->reject =
-                            CBlock::CBlockReject(REJECT_INVALID, msg, sourceBlockPtr->GetHash());
+                        if (sourceBlockPtr) {
+                            sourceBlockPtr->reject =
+                                CBlock::CBlockReject(REJECT_INVALID, msg, sourceBlockPtr->GetHash());
+                        }
+                        this->reject = CTransaction::CTxReject(REJECT_INVALID, msg, GetHash());
+                        DoS(100, false);
+                        return Err(
+                            MakeInvalidTxState(TxValidationResult::TX_CONSENSUS, msg,
+                                               strprintf("ConnectInputs() : %s VerifySignature failed",
+                                                         GetHash().ToString().c_str())));
                     }
-                    this->reject = CTransaction::CTxReject(REJECT_INVALID, msg, GetHash());
-                    DoS(100, false);
-                    return Err(
-                        MakeInvalidTxState(TxValidationResult::TX_CONSENSUS, msg,
-                                           strprintf("ConnectInputs() : %s VerifySignature failed",
-                                                     GetHash().ToString().c_str())));
                 }
             }
 
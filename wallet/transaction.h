@@ -11,9 +11,11 @@
 #include "txout.h"
 #include "uint256.h"
 #include "validation.h"
+#include <atomic>
 #include <vector>
 
 class CTransaction;
+class CScriptCheck;
 
 enum GetMinFee_mode
 {
@@ -78,6 +80,9 @@ public:
 
     uint256 GetHash() const;
 
+    /** The number of times GetHash() hashed a transaction, for measuring how often it's called */
+    static std::atomic<uint64_t> nHashComputations;
+
     bool IsNewerThan(const CTransaction& old) const;
 
     bool IsCoinBase() const { return (vin.size() == 1 && vin[0].prevout.IsNull() && vout.size() >= 1); }
@@ -169,12 +174,14 @@ public:
         @param[in] pindexBlock
         @param[in] fBlock	true if called from ConnectBlock
         @param[in] fMiner	true if called from CreateNewBlock
+        @param[out] pvChecks	if not null, script checks are appended here instead of being run
         @return Returns true if all checks succeed
         */
     Result<void, TxValidationState>
     ConnectInputs(const ITxDB& txdb, MapPrevTx inputs, std::map<uint256, CTxIndex>& mapTestPool,
                   const CDiskTxPos& posThisTx, const ConstCBlockIndexSmartPtr& pindexBlock, bool fBlock,
-                  bool fMiner, CBlock* sourceBlockPtr = nullptr) const;
+                  bool fMiner, CBlock* sourceBlockPtr = nullptr,
+                  std::vector<CScriptCheck>* pvChecks = nullptr) const;
     Result<void, TxValidationState> CheckTransaction(const ITxDB& txdb,
                                                      CBlock*      sourceBlock = nullptr) const;
     bool GetCoinAge(const ITxDB& txdb, uint64_t& nCoinAge) const; // ppcoin: get transaction coin age
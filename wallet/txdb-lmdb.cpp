@@ -3,6 +3,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file license.txt or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
 #include <map>
 
 #include <boost/filesystem.hpp>
@@ -14,9 +15,11 @@
 #include <future>
 #include <random>
 
+#include "chain.h"
 #include "globals.h"
 #include "kernel.h"
 #include "main.h"
+#include "stakemodifierindex.h"
 #include "txdb.h"
 #include "util.h"
 
@@ -31,6 +34,7 @@ DbSmartPtrType glob_db_tx(nullptr, [](MDB_dbi*) {});
 DbSmartPtrType glob_db_ntp1Tx(nullptr, [](MDB_dbi*) {});
 DbSmartPtrType glob_db_ntp1tokenNames(nullptr, [](MDB_dbi*) {});
 DbSmartPtrType glob_db_addrsVsPubKeys(nullptr, [](MDB_dbi*) {});
+DbSmartPtrType glob_db_utxo(nullptr, [](MDB_dbi*) {});
 
 using namespace std;
 using namespace boost;
@@ -38,6 +42,8 @@ using namespace boost;
 boost::filesystem::path CTxDB::DB_DIR                         = "txlmdb";
 bool                    CTxDB::QuickSyncHigherControl_Enabled = true;
 
+static TxReadCacheType txReadCache(DEFAULT_TX_READ_CACHE_SIZE);
+
 std::atomic<uint64_t> mdb_txn_safe::num_active_txns{0};
 std::atomic_flag      mdb_txn_safe::creation_gate = ATOMIC_FLAG_INIT;
 
@@ -545,14 +551,16 @@ CTxDB::CTxDB(const char* pszMode)
 
 void CTxDB::Close()
 {
-    if (activeBatch) {
-        activeBatch->abort();
-        activeBatch.reset();
+    while (activeBatch) {
+        TxnAbort();
     }
     resetDbPointers();
     resetGlobalDbPointers();
+    txReadCache.clear();
 }
 
+TxReadCacheType& CTxDB::GetTxReadCache() { return txReadCache; }
+
 void CTxDB::OpenDatabase()
 {
     const filesystem::path directory = GetDataDir() / DB_DIR;
@@ -617,6 +625,7 @@ void CTxDB::OpenDatabase()
     glob_db_ntp1Tx         = DbSmartPtrType(new MDB_dbi, dbDeleter);
     glob_db_ntp1tokenNames = DbSmartPtrType(new MDB_dbi, dbDeleter);
     glob_db_addrsVsPubKeys = DbSmartPtrType(new MDB_dbi, dbDeleter);
+    glob_db_utxo           = DbSmartPtrType(new MDB_dbi, dbDeleter);
 
     // MDB_CREATE: Create the named database if it doesn't exist.
     CTxDB::lmdb_db_open(txn, LMDB_MAINDB.c_str(), MDB_CREATE, *glob_db_main,
@@ -633,6 +642,8 @@ void CTxDB::OpenDatabase()
                         *glob_db_ntp1tokenNames, "Failed to open db handle for glob_db_ntp1Tx");
     CTxDB::lmdb_db_open(txn, LMDB_ADDRSVSPUBKEYSDB.c_str(), MDB_CREATE, *glob_db_addrsVsPubKeys,
                         "Failed to open db handle for glob_db_ntp1Tx");
+    CTxDB::lmdb_db_open(txn, LMDB_UTXODB.c_str(), MDB_CREATE, *glob_db_utxo,
+                        "Failed to open db handle for glob_db_utxo");
 
     // commit the transaction
     txn.commit();
@@ -658,6 +669,9 @@ void CTxDB::OpenDatabase()
     if (!glob_db_addrsVsPubKeys) {
         throw std::runtime_error("LMDB nullptr after opening the db_addrsVsPubKeys database.");
     }
+    if (!glob_db_utxo) {
+        throw std::runtime_error("LMDB nullptr after opening the db_utxo database.");
+    }
 
     printf("Done opening the database\n");
     uiInterface.InitMessage("Done opening the database");
@@ -665,6 +679,7 @@ void CTxDB::OpenDatabase()
 
 void CTxDB::__deleteDb()
 {
+    txReadCache.clear();
     try {
         boost::filesystem::remove_all(GetDataDir() / DB_DIR);
     } catch (...) {
@@ -673,7 +688,17 @@ void CTxDB::__deleteDb()
 
 bool CTxDB::TxnBegin(size_t required_size)
 {
-    assert(activeBatch == nullptr);
+    if (activeBatch) {
+        std::unique_ptr<mdb_txn_safe> nestedBatch(new mdb_txn_safe);
+        if (auto res = lmdb_txn_begin(dbEnv.get(), *activeBatch, 0, *nestedBatch)) {
+            printf("Failed to begin nested transaction with error code %i; with error: %s\n", res,
+                   mdb_strerror(res));
+            return false;
+        }
+        parentBatches.push_back(std::move(activeBatch));
+        activeBatch = std::move(nestedBatch);
+        return true;
+    }
     if (CTxDB::need_resize(required_size)) {
         printf("LMDB memory map needs to be resized, doing that now.\n");
         CTxDB::do_resize(required_size);
@@ -694,6 +719,10 @@ bool CTxDB::TxnCommit()
         activeBatch->commit();
         activeBatch.reset();
     }
+    if (!parentBatches.empty()) {
+        activeBatch = std::move(parentBatches.back());
+        parentBatches.pop_back();
+    }
     return true;
 }
 
@@ -704,6 +733,10 @@ bool CTxDB::TxnAbort()
         activeBatch->abort();
         activeBatch.reset();
     }
+    if (!parentBatches.empty()) {
+        activeBatch = std::move(parentBatches.back());
+        parentBatches.pop_back();
+    }
     return true;
 }
 
@@ -755,8 +788,19 @@ bool CTxDB::UpdateTxIndex(const uint256& hash, const CTxIndex& txindex)
 
 bool CTxDB::ReadTx(const CDiskTxPos& txPos, CTransaction& tx) const
 {
+    // Blocks are keyed by their hash and never modified, so a cached transaction can't go stale. This
+    // holds even for reads inside a batch that is later aborted, since the block can only be written
+    // again with the same contents.
+    if (boost::optional<CTransaction> cachedTx = txReadCache.get(txPos)) {
+        tx = std::move(*cachedTx);
+        return true;
+    }
     tx.SetNull();
-    return Read(txPos.nBlockPos, tx, db_blocks, 0, txPos.nTxPos);
+    if (!Read(txPos.nBlockPos, tx, db_blocks, 0, txPos.nTxPos)) {
+        return false;
+    }
+    txReadCache.insert(txPos, tx);
+    return true;
 }
 
 bool CTxDB::ReadNTP1Tx(const uint256& hash, NTP1Transaction& ntp1tx) const
@@ -842,6 +886,13 @@ bool CTxDB::ReadBlock(const uint256& hash, CBlock& blk, bool fReadTransactions)
     return Read(hash, blk, db_blocks, modifiers);
 }
 
+bool CTxDB::ReadBlockRaw(const uint256& hash, std::string& data) const
+{
+    data.clear();
+    LmdbRawValue raw{data};
+    return Read(hash, raw, db_blocks);
+}
+
 bool CTxDB::WriteBlock(const uint256& hash, const CBlock& blk)
 {
     assert(blk.GetHash() != 0);
@@ -904,186 +955,302 @@ bool CTxDB::WriteBestInvalidTrust(const CBigNum& bnBestInvalidTrust)
     return Write(string("bnBestInvalidTrust"), bnBestInvalidTrust, db_main);
 }
 
-static CBlockIndexSmartPtr InsertBlockIndex(const uint256&              hash,
-                                            BlockIndexMapType::MapType& blockIndexMap)
+bool CTxDB::ReadCoins(const uint256& txid, CCoins& coins) const
 {
-    if (hash == 0)
-        return nullptr;
+    // fully spent transactions aren't in the set; checking first avoids logging a failed read for them
+    return Exists(txid, db_utxo) && Read(txid, coins, db_utxo);
+}
 
-    // Return existing
-    BlockIndexMapType::MapType::iterator mi = blockIndexMap.find(hash);
-    if (mi != blockIndexMap.end())
-        return mi->second;
+bool CTxDB::WriteCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned()) {
+        return !Exists(txid, db_utxo) || Erase(txid, db_utxo);
+    }
+    return Write(txid, coins, db_utxo);
+}
 
-    // Create new
-    CBlockIndexSmartPtr pindexNew = boost::make_shared<CBlockIndex>();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
-    mi                    = blockIndexMap.insert(make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = mi->first;
+bool CTxDB::HaveCoins(const uint256& txid) const { return Exists(txid, db_utxo); }
 
-    return pindexNew;
+bool CTxDB::ReadCoinsBestBlock(uint256& hashBlock) const
+{
+    return Read(string("hashCoinsBestBlock"), hashBlock, db_main);
 }
 
-std::string LmdbValToString(const MDB_val& val)
+bool CTxDB::WriteCoinsBestBlock(const uint256& hashBlock)
 {
-    return std::string((const char*)val.mv_data, val.mv_size);
+    return Write(string("hashCoinsBestBlock"), hashBlock, db_main);
 }
 
-bool CTxDB::LoadBlockIndex()
+bool CTxDB::ReadUtxoSetVersion(int& nVersion) const
 {
-    if (mapBlockIndex.size() > 0) {
-        // Already loaded once in this session. It can happen during migration
-        // from BDB.
-        return true;
-    }
+    return Read(string("utxoSetVersion"), nVersion, db_main);
+}
 
-    // The block index is an in-memory structure that maps hashes to on-disk
-    // locations where the contents of the block can be found. Here, we scan it
-    // out of the DB and into mapBlockIndex.
+bool CTxDB::WriteUtxoSetVersion(int nVersion)
+{
+    return Write(string("utxoSetVersion"), nVersion, db_main);
+}
 
-    MDB_cursor*  cursorRawPtr = nullptr;
+bool CTxDB::ReadTxIndexChunk(bool fromStart, uint256& lastKey, unsigned maxCount,
+                             std::vector<std::pair<uint256, CTxIndex>>& chunk, bool& reachedEnd) const
+{
     mdb_txn_safe localTxn;
     if (auto res = lmdb_txn_begin(dbEnv.get(), nullptr, MDB_RDONLY, localTxn)) {
-        return error("Failed to begin transaction at read with error code %i; and error: %s\n", res,
-                     mdb_strerror(res));
+        return error("ReadTxIndexChunk() : failed to begin transaction with error code %i; "
+                     "and error: %s",
+                     res, mdb_strerror(res));
     }
-    if (auto rc = mdb_cursor_open(localTxn, *db_blockIndex, &cursorRawPtr)) {
-        return error(
-            "CTxDB::LoadBlockIndex() : Failed to open lmdb cursor with error code %d; and error: %s\n",
-            rc, mdb_strerror(rc));
+    MDB_cursor* cursorRawPtr = nullptr;
+    if (auto rc = mdb_cursor_open(localTxn, *db_tx, &cursorRawPtr)) {
+        return error("ReadTxIndexChunk() : failed to open lmdb cursor with error code %d; and error: %s",
+                     rc, mdb_strerror(rc));
     }
     std::unique_ptr<MDB_cursor, void (*)(MDB_cursor*)> cursorPtr(cursorRawPtr, [](MDB_cursor* p) {
         if (p)
             mdb_cursor_close(p);
     });
 
-    // Seek to start key.
     CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-    ssStartKey << uint256(0);
+    ssStartKey << lastKey;
     std::string&& keyBin = ssStartKey.str();
-    MDB_val       key    = {(size_t)ssStartKey.size(), (void*)keyBin.data()};
+    MDB_val       key    = {keyBin.size(), (void*)keyBin.data()};
     MDB_val       data;
 
-    int itemRes = mdb_cursor_get(cursorPtr.get(), &key, &data, MDB_FIRST);
+    int itemRes = mdb_cursor_get(cursorPtr.get(), &key, &data, fromStart ? MDB_FIRST : MDB_SET_RANGE);
+    // the previous chunk ended at lastKey, so it's skipped
+    if (!fromStart && itemRes == 0 && key.mv_size == keyBin.size() &&
+        memcmp(key.mv_data, keyBin.data(), keyBin.size()) == 0) {
+        itemRes = mdb_cursor_get(cursorPtr.get(), &key, &data, MDB_NEXT);
+    }
+
+    while (itemRes == 0 && chunk.size() < maxCount) {
+        uint256  txid;
+        CTxIndex txindex;
+        try {
+            LmdbDeserializeValue(key, txid, SER_DISK, readMode);
+            LmdbDeserializeValue(data, txindex, SER_DISK, readMode);
+        } catch (const std::exception& ex) {
+            return error("ReadTxIndexChunk() : failed to deserialize tx index entry; error: %s",
+                         ex.what());
+        }
+        lastKey = txid;
+        chunk.push_back(std::make_pair(txid, txindex));
+        itemRes = mdb_cursor_get(cursorPtr.get(), &key, &data, MDB_NEXT);
+    }
     if (itemRes != 0 && itemRes != MDB_NOTFOUND) {
-        return error("Error while opening cursor to load index. Error code %i, and error: %s\n", itemRes,
-                     mdb_strerror(itemRes));
+        return error("ReadTxIndexChunk() : failed to read the tx index with error code %i; "
+                     "and error: %s",
+                     itemRes, mdb_strerror(itemRes));
     }
+    reachedEnd = (itemRes == MDB_NOTFOUND);
+    return true;
+}
 
-    uint64_t loadedCount = 0;
+bool CTxDB::BuildUtxoSetIfNeeded()
+{
+    uint256 hashBestChain = 0;
+    if (!Exists(string("hashBestChain"), db_main) || !ReadHashBestChain(hashBestChain)) {
+        // nothing is connected yet; the genesis block will start the UTXO set
+        return WriteUtxoSetVersion(UTXO_SET_VERSION);
+    }
+    int     nUtxoSetVersion    = 0;
+    uint256 hashCoinsBestBlock = 0;
+    if (Exists(string("utxoSetVersion"), db_main) && !ReadUtxoSetVersion(nUtxoSetVersion)) {
+        return error("BuildUtxoSetIfNeeded() : failed to read the UTXO set version");
+    }
+    if (Exists(string("hashCoinsBestBlock"), db_main) && !ReadCoinsBestBlock(hashCoinsBestBlock)) {
+        return error("BuildUtxoSetIfNeeded() : failed to read the UTXO set best block");
+    }
+    if (nUtxoSetVersion == UTXO_SET_VERSION && hashCoinsBestBlock == hashBestChain) {
+        printf("The UTXO set (version %i) is at the best block %s\n", nUtxoSetVersion,
+               hashBestChain.ToString().c_str());
+        return true;
+    }
 
-    BlockIndexMapType::MapType loadedBlockIndex;
+    if (nUtxoSetVersion != UTXO_SET_VERSION) {
+        printf("The UTXO set has version %i instead of %i; rebuilding it from the transaction index\n",
+               nUtxoSetVersion, UTXO_SET_VERSION);
+    } else {
+        printf("The UTXO set is at block %s instead of the best block %s; rebuilding it from the "
+               "transaction index\n",
+               hashCoinsBestBlock.ToString().c_str(), hashBestChain.ToString().c_str());
+    }
+    uiInterface.InitMessage(_("Building the UTXO set..."));
 
-    // Now read each entry.
-    do {
-        // if the first item is empty, break immediately
-        if (itemRes) {
-            break;
+    // the set is marked unbuilt first, so that a build that's cut short starts over on the next run
+    const bool fHadBestBlock = Exists(string("hashCoinsBestBlock"), db_main);
+    const bool fHadVersion   = Exists(string("utxoSetVersion"), db_main);
+    if ((fHadBestBlock && !Erase(string("hashCoinsBestBlock"), db_main)) ||
+        (fHadVersion && !Erase(string("utxoSetVersion"), db_main))) {
+        return error("BuildUtxoSetIfNeeded() : failed to clear the UTXO set best block and version");
+    }
+
+    {
+        mdb_txn_safe txn;
+        if (auto res = lmdb_txn_begin(dbEnv.get(), nullptr, 0, txn)) {
+            return error("BuildUtxoSetIfNeeded() : failed to begin transaction with error code %i; "
+                         "and error: %s",
+                         res, mdb_strerror(res));
+        }
+        if (auto res = mdb_drop(txn, *db_utxo, 0)) {
+            return error("BuildUtxoSetIfNeeded() : failed to clear the UTXO set with error code %i; "
+                         "and error: %s",
+                         res, mdb_strerror(res));
+        }
+        txn.commit();
+    }
+
+    // The tx index is walked in chunks, each in its own read transaction, so that the coins of every
+    // chunk can be written in a write transaction without keeping a reader open
+    static const unsigned CHUNK_SIZE   = 10000;
+    uint64_t              txCount      = 0;
+    uint64_t              coinsCount   = 0;
+    uint256               lastKey      = 0;
+    bool                  reachedEnd   = false;
+    bool                  isFirstChunk = true;
+    while (!reachedEnd) {
+        if (fRequestShutdown) {
+            printf("Building the UTXO set was interrupted; it will start over on the next run\n");
+            return true;
         }
 
-        std::string keyStr = LmdbValToString(key);
-        std::string valStr = LmdbValToString(data);
+        std::vector<std::pair<uint256, CTxIndex>> chunk;
+        if (!ReadTxIndexChunk(isFirstChunk, lastKey, CHUNK_SIZE, chunk, reachedEnd)) {
+            return false;
+        }
+        isFirstChunk = false;
+        txCount += chunk.size();
 
-        // Unpack keys and values.
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(keyStr.data(), keyStr.size());
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.write(valStr.data(), valStr.size());
+        if (!TxnBegin()) {
+            return error("BuildUtxoSetIfNeeded() : TxnBegin failed");
+        }
+        for (const std::pair<uint256, CTxIndex>& entry : chunk) {
+            const CTxIndex& txindex = entry.second;
+            bool            hasUnspentOutputs =
+                std::any_of(txindex.vSpent.cbegin(), txindex.vSpent.cend(),
+                            [](const CDiskTxPos& pos) { return pos.IsNull(); });
+            if (!hasUnspentOutputs) {
+                continue;
+            }
 
-        if (fRequestShutdown)
-            break;
+            const CBlockIndexSmartPtr pindex =
+                mapBlockIndex.get(txindex.pos.nBlockPos).value_or(nullptr);
+            CTransaction tx;
+            if (!pindex || !ReadTx(txindex.pos, tx)) {
+                TxnAbort();
+                return error("BuildUtxoSetIfNeeded() : failed to read transaction %s",
+                             entry.first.ToString().c_str());
+            }
 
-        uint256 blockHash;
-        ssKey >> blockHash;
+            if (!WriteCoins(entry.first, CCoins(tx, pindex->nHeight, txindex))) {
+                TxnAbort();
+                return error("BuildUtxoSetIfNeeded() : failed to write coins of %s",
+                             entry.first.ToString().c_str());
+            }
+            coinsCount++;
+        }
+        if (!TxnCommit()) {
+            return error("BuildUtxoSetIfNeeded() : TxnCommit failed");
+        }
 
-        CDiskBlockIndex diskindex;
-        ssValue >> diskindex;
+        uiInterface.InitMessage(_("Building the UTXO set...") + " (" + std::to_string(txCount) +
+                                " transactions)");
+    }
 
-        // (Changed by Sam) previously, using diskindex.GetBlockHash retrieved the block hash AND set it
-        // inside the diskindex object with a const_cast. Now this is fixed to be correct
-        diskindex.SetBlockHash(blockHash);
+    if (!TxnBegin()) {
+        return error("BuildUtxoSetIfNeeded() : TxnBegin failed");
+    }
+    if (!WriteCoinsBestBlock(hashBestChain) || !WriteUtxoSetVersion(UTXO_SET_VERSION)) {
+        TxnAbort();
+        return error("BuildUtxoSetIfNeeded() : failed to write the UTXO set best block and version");
+    }
+    if (!TxnCommit()) {
+        return error("BuildUtxoSetIfNeeded() : TxnCommit failed");
+    }
+    printf("Built the UTXO set (version %i) at the best block %s with %" PRIu64 " transactions with "
+           "unspent outputs out of %" PRIu64 "\n",
+           UTXO_SET_VERSION, hashBestChain.ToString().c_str(), coinsCount, txCount);
+    return true;
+}
 
-        // Construct block index object
-        CBlockIndexSmartPtr pindexNew = InsertBlockIndex(blockHash, loadedBlockIndex);
-        pindexNew->pprev              = InsertBlockIndex(diskindex.hashPrev, loadedBlockIndex);
-        pindexNew->pnext              = InsertBlockIndex(diskindex.hashNext, loadedBlockIndex);
-        pindexNew->blockKeyInDB       = diskindex.blockKeyInDB;
-        pindexNew->nHeight            = diskindex.nHeight;
-        pindexNew->nMint              = diskindex.nMint;
-        pindexNew->nMoneySupply       = diskindex.nMoneySupply;
-        pindexNew->nFlags             = diskindex.nFlags;
-        pindexNew->nStakeModifier     = diskindex.nStakeModifier;
-        pindexNew->prevoutStake       = diskindex.prevoutStake;
-        pindexNew->nStakeTime         = diskindex.nStakeTime;
-        pindexNew->hashProof          = diskindex.hashProof;
-        pindexNew->nVersion           = diskindex.nVersion;
-        pindexNew->hashMerkleRoot     = diskindex.hashMerkleRoot;
-        pindexNew->nTime              = diskindex.nTime;
-        pindexNew->nBits              = diskindex.nBits;
-        pindexNew->nNonce             = diskindex.nNonce;
+static CBlockIndexSmartPtr InsertBlockIndex(const uint256&              hash,
+                                            BlockIndexMapType::MapType& blockIndexMap)
+{
+    if (hash == 0)
+        return nullptr;
 
-        // Watch for genesis block
-        if (pindexGenesisBlock == nullptr && blockHash == Params().GenesisBlockHash())
-            pindexGenesisBlock = pindexNew;
+    // Return existing
+    BlockIndexMapType::MapType::iterator mi = blockIndexMap.find(hash);
+    if (mi != blockIndexMap.end())
+        return mi->second;
 
-        if (!pindexNew->CheckIndex()) {
-            cursorPtr.reset();
-            return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
-        }
+    // Create new
+    CBlockIndexSmartPtr pindexNew = boost::make_shared<CBlockIndex>();
+    if (!pindexNew)
+        throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    mi                    = blockIndexMap.insert(make_pair(hash, pindexNew)).first;
+    pindexNew->phashBlock = mi->first;
 
-        // NovaCoin: build setStakeSeen
-        if (pindexNew->IsProofOfStake())
-            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    return pindexNew;
+}
 
-        itemRes = mdb_cursor_get(cursorRawPtr, &key, &data, MDB_NEXT);
+boost::filesystem::path CTxDB::GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / DB_DIR / BLOCKINDEX_SNAPSHOT_FILENAME;
+}
 
-        loadedCount++;
-        if (loadedCount % 10000 == 0) {
-            uiInterface.InitMessage(_("Loading block index...") +
-                                    " (block: " + std::to_string(loadedCount) + ")");
-        }
-        //        std::cout << "Read status: " << itemRes << "\t" << mdb_strerror(itemRes) << std::endl;
-    } while (itemRes == 0);
-    printf("Done reading block index\n");
-    uiInterface.InitMessage(_("Loading block index...") + " (done reading block index)");
+BlockIndexSnapshotId CTxDB::GetBlockIndexSnapshotId() const
+{
+    MDB_envinfo mei;
+    mdb_env_info(dbEnv.get(), &mei);
 
-    cursorPtr.reset();
-    localTxn.commit();
+    BlockIndexSnapshotId id;
+    id.nDbTxnId      = mei.me_last_txnid;
+    id.nDbVersion    = DATABASE_VERSION;
+    id.hashBestChain = 0;
+    ReadHashBestChain(id.hashBestChain);
+    return id;
+}
 
-    if (fRequestShutdown)
+bool CTxDB::WriteBlockIndexSnapshot() const
+{
+    if (!GetBoolArg("-blockindexsnapshot", true) || mapBlockIndex.size() == 0) {
         return true;
+    }
+    const auto lock = mapBlockIndex.get_shared_lock();
+    return ::WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath(), mapBlockIndex.getInternalMap(),
+                                     GetBlockIndexSnapshotId());
+}
 
-    // Calculate nChainTrust
-    vector<pair<int, CBlockIndex*>> vSortedByHeight;
-    vSortedByHeight.reserve(loadedBlockIndex.size());
-    uiInterface.InitMessage("Building chain trust... (allocating memory...)");
-    for (const PAIRTYPE(const uint256, CBlockIndexSmartPtr) & item : loadedBlockIndex) {
-        CBlockIndex* pindex = item.second.get();
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+bool CTxDB::LoadBlockIndex()
+{
+    if (mapBlockIndex.size() > 0) {
+        // Already loaded once in this session. It can happen during migration
+        // from BDB.
+        return true;
     }
-    // use heap-sort to guarantee O(n*log(n)) performance, since std::sort() can have O(n^2) complexity
-    uiInterface.InitMessage("Building chain trust... (sorting...)");
-    std::make_heap(vSortedByHeight.begin(), vSortedByHeight.end());
-    std::sort_heap(vSortedByHeight.begin(), vSortedByHeight.end());
-    loadedCount = 0;
-    for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
-        loadedCount++;
-        if (loadedCount % 50000 == 0) {
-            uiInterface.InitMessage(
-                "Building chain trust... (chaining block: " + std::to_string(loadedCount) + "/" +
-                std::to_string(vSortedByHeight.size()) + ")");
-        }
-        CBlockIndex* pindex = item.second;
-        pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + pindex->GetBlockTrust();
-        // NovaCoin: calculate stake modifier checksum
-        pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
-        if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
-            return error("CTxDB::LoadBlockIndex() : Failed stake modifier checkpoint height=%d, "
-                         "modifier=0x%016" PRIx64,
-                         pindex->nHeight, pindex->nStakeModifier);
+
+    BlockIndexMapType::MapType loadedBlockIndex;
+
+    // A snapshot written on the last clean shutdown is only used if nothing was written to the
+    // database after it. It's removed either way, since the next write would make it stale.
+    bool loadedFromSnapshot = false;
+    if (GetBoolArg("-blockindexsnapshot", true)) {
+        uiInterface.InitMessage(_("Loading block index...") + " (from snapshot)");
+        const boost::filesystem::path snapshotPath = GetBlockIndexSnapshotPath();
+        loadedFromSnapshot = LoadBlockIndexSnapshot(snapshotPath, GetBlockIndexSnapshotId(),
+                                                    loadedBlockIndex, pindexGenesisBlock, setStakeSeen);
+        boost::system::error_code ec;
+        boost::filesystem::remove(snapshotPath, ec);
     }
 
+    if (!loadedFromSnapshot && !ReadBlockIndexFromDb(loadedBlockIndex)) {
+        return false;
+    }
+
+    if (fRequestShutdown)
+        return true;
+
     // Load hashBestChain pointer to end of best chain
     uint256 hashBestChainTemp = 0;
     if (!ReadHashBestChain(hashBestChainTemp)) {
@@ -1094,6 +1261,8 @@ bool CTxDB::LoadBlockIndex()
     if (!loadedBlockIndex.count(hashBestChainTemp))
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
     //    bestChain.setBestChain(loadedBlockIndex.at(hashBestChainTemp), false);
+    chainActive.SetTip(loadedBlockIndex.at(hashBestChainTemp).get());
+    GetStakeModifierIndex().Reset(loadedBlockIndex.at(hashBestChainTemp));
 
     const int bestHeight = loadedBlockIndex.at(hashBestChainTemp)->nHeight;
 
@@ -1119,7 +1288,7 @@ bool CTxDB::LoadBlockIndex()
     printf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CBlockIndexSmartPtr              pindexFork = nullptr;
     map<uint256, const CBlockIndex*> mapBlockPos;
-    loadedCount = 0;
+    uint64_t loadedCount = 0;
     for (ConstCBlockIndexSmartPtr pindex = loadedBlockIndex.at(hashBestChainTemp);
          pindex && pindex->pprev; pindex = pindex->pprev) {
 
@@ -1246,6 +1415,154 @@ bool CTxDB::LoadBlockIndex()
     return true;
 }
 
+bool CTxDB::ReadBlockIndexFromDb(BlockIndexMapType::MapType& loadedBlockIndex)
+{
+    // The block index is an in-memory structure that maps hashes to on-disk
+    // locations where the contents of the block can be found. Here, we scan it
+    // out of the DB and into mapBlockIndex.
+
+    MDB_cursor*  cursorRawPtr = nullptr;
+    mdb_txn_safe localTxn;
+    if (auto res = lmdb_txn_begin(dbEnv.get(), nullptr, MDB_RDONLY, localTxn)) {
+        return error("Failed to begin transaction at read with error code %i; and error: %s\n", res,
+                     mdb_strerror(res));
+    }
+    if (auto rc = mdb_cursor_open(localTxn, *db_blockIndex, &cursorRawPtr)) {
+        return error(
+            "CTxDB::LoadBlockIndex() : Failed to open lmdb cursor with error code %d; and error: %s\n",
+            rc, mdb_strerror(rc));
+    }
+    std::unique_ptr<MDB_cursor, void (*)(MDB_cursor*)> cursorPtr(cursorRawPtr, [](MDB_cursor* p) {
+        if (p)
+            mdb_cursor_close(p);
+    });
+
+    // Seek to start key.
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << uint256(0);
+    std::string&& keyBin = ssStartKey.str();
+    MDB_val       key    = {(size_t)ssStartKey.size(), (void*)keyBin.data()};
+    MDB_val       data;
+
+    int itemRes = mdb_cursor_get(cursorPtr.get(), &key, &data, MDB_FIRST);
+    if (itemRes != 0 && itemRes != MDB_NOTFOUND) {
+        return error("Error while opening cursor to load index. Error code %i, and error: %s\n", itemRes,
+                     mdb_strerror(itemRes));
+    }
+
+    uint64_t loadedCount = 0;
+
+    // Now read each entry.
+    do {
+        // if the first item is empty, break immediately
+        if (itemRes) {
+            break;
+        }
+
+        if (fRequestShutdown)
+            break;
+
+        // Unpack keys and values directly from the mapped pages; the read transaction is alive until
+        // the cursor walk is done.
+        uint256         blockHash;
+        CDiskBlockIndex diskindex;
+        try {
+            LmdbDeserializeValue(key, blockHash, SER_DISK, readMode);
+            LmdbDeserializeValue(data, diskindex, SER_DISK, readMode);
+        } catch (const std::exception& ex) {
+            cursorPtr.reset();
+            return error("LoadBlockIndex() : failed to deserialize block index entry number %" PRIu64
+                         "; error: %s",
+                         loadedCount, ex.what());
+        }
+
+        // (Changed by Sam) previously, using diskindex.GetBlockHash retrieved the block hash AND set it
+        // inside the diskindex object with a const_cast. Now this is fixed to be correct
+        diskindex.SetBlockHash(blockHash);
+
+        // Construct block index object
+        CBlockIndexSmartPtr pindexNew = InsertBlockIndex(blockHash, loadedBlockIndex);
+        pindexNew->pprev              = InsertBlockIndex(diskindex.hashPrev, loadedBlockIndex);
+        pindexNew->pnext              = InsertBlockIndex(diskindex.hashNext, loadedBlockIndex);
+        pindexNew->blockKeyInDB       = diskindex.blockKeyInDB;
+        pindexNew->nHeight            = diskindex.nHeight;
+        pindexNew->nMint              = diskindex.nMint;
+        pindexNew->nMoneySupply       = diskindex.nMoneySupply;
+        pindexNew->nFlags             = diskindex.nFlags;
+        pindexNew->nStakeModifier     = diskindex.nStakeModifier;
+        pindexNew->prevoutStake       = diskindex.prevoutStake;
+        pindexNew->nStakeTime         = diskindex.nStakeTime;
+        pindexNew->hashProof          = diskindex.hashProof;
+        pindexNew->nVersion           = diskindex.nVersion;
+        pindexNew->hashMerkleRoot     = diskindex.hashMerkleRoot;
+        pindexNew->nTime              = diskindex.nTime;
+        pindexNew->nBits              = diskindex.nBits;
+        pindexNew->nNonce             = diskindex.nNonce;
+
+        // Watch for genesis block
+        if (pindexGenesisBlock == nullptr && blockHash == Params().GenesisBlockHash())
+            pindexGenesisBlock = pindexNew;
+
+        if (!pindexNew->CheckIndex()) {
+            cursorPtr.reset();
+            return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
+        }
+
+        // NovaCoin: build setStakeSeen
+        if (pindexNew->IsProofOfStake())
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+        itemRes = mdb_cursor_get(cursorRawPtr, &key, &data, MDB_NEXT);
+
+        loadedCount++;
+        if (loadedCount % 10000 == 0) {
+            uiInterface.InitMessage(_("Loading block index...") +
+                                    " (block: " + std::to_string(loadedCount) + ")");
+        }
+        //        std::cout << "Read status: " << itemRes << "\t" << mdb_strerror(itemRes) << std::endl;
+    } while (itemRes == 0);
+    printf("Done reading block index\n");
+    uiInterface.InitMessage(_("Loading block index...") + " (done reading block index)");
+
+    cursorPtr.reset();
+    localTxn.commit();
+
+    if (fRequestShutdown)
+        return true;
+
+    // Calculate nChainTrust
+    vector<pair<int, CBlockIndex*>> vSortedByHeight;
+    vSortedByHeight.reserve(loadedBlockIndex.size());
+    uiInterface.InitMessage("Building chain trust... (allocating memory...)");
+    for (const PAIRTYPE(const uint256, CBlockIndexSmartPtr) & item : loadedBlockIndex) {
+        CBlockIndex* pindex = item.second.get();
+        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+    }
+    // use heap-sort to guarantee O(n*log(n)) performance, since std::sort() can have O(n^2) complexity
+    uiInterface.InitMessage("Building chain trust... (sorting...)");
+    std::make_heap(vSortedByHeight.begin(), vSortedByHeight.end());
+    std::sort_heap(vSortedByHeight.begin(), vSortedByHeight.end());
+    loadedCount = 0;
+    for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
+        loadedCount++;
+        if (loadedCount % 50000 == 0) {
+            uiInterface.InitMessage(
+                "Building chain trust... (chaining block: " + std::to_string(loadedCount) + "/" +
+                std::to_string(vSortedByHeight.size()) + ")");
+        }
+        CBlockIndex* pindex = item.second;
+        pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + pindex->GetBlockTrust();
+        // NovaCoin: calculate stake modifier checksum
+        pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
+        if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
+            return error("CTxDB::LoadBlockIndex() : Failed stake modifier checkpoint height=%d, "
+                         "modifier=0x%016" PRIx64,
+                         pindex->nHeight, pindex->nStakeModifier);
+    }
+
+    return true;
+}
+
 boost::optional<int> CTxDB::GetBestChainHeight() const
 {
     uint256 bestChainHash = 0;
@@ -18,6 +18,8 @@
 
 #include "liblmdb/lmdb.h"
 
+#include "LRUCache.h"
+#include "blockindexsnapshot.h"
 #include "diskblockindex.h"
 #include "disktxpos.h"
 #include "itxdb.h"
@@ -44,6 +46,7 @@ extern DbSmartPtrType glob_db_tx;
 extern DbSmartPtrType glob_db_ntp1Tx;
 extern DbSmartPtrType glob_db_ntp1tokenNames;
 extern DbSmartPtrType glob_db_addrsVsPubKeys;
+extern DbSmartPtrType glob_db_utxo;
 
 const std::string LMDB_MAINDB           = "MainDb";
 const std::string LMDB_BLOCKINDEXDB     = "BlockIndexDb";
@@ -52,10 +55,27 @@ const std::string LMDB_TXDB             = "TxDb";
 const std::string LMDB_NTP1TXDB         = "Ntp1txDb";
 const std::string LMDB_NTP1TOKENNAMESDB = "Ntp1NamesDb";
 const std::string LMDB_ADDRSVSPUBKEYSDB = "AddrsVsPubKeysDb";
+const std::string LMDB_UTXODB           = "UtxoDb";
 
 constexpr static float    DB_RESIZE_PERCENT     = 0.9f;
 constexpr static uint64_t MIN_MAP_SIZE_INCREASE = UINT64_C(1) << 28; // ~256 MiB
 
+// number of decoded transactions kept by CTxDB::ReadTx()
+constexpr static std::size_t DEFAULT_TX_READ_CACHE_SIZE = 20000;
+
+class CCoins;
+class CTransaction;
+
+struct DiskTxPosHasher
+{
+    std::size_t operator()(const CDiskTxPos& pos) const
+    {
+        return std::hash<uint256>()(pos.nBlockPos) ^ std::hash<unsigned int>()(pos.nTxPos);
+    }
+};
+
+using TxReadCacheType = LRUCache<CDiskTxPos, CTransaction, DiskTxPosHasher>;
+
 const std::string QuickSyncDataLink =
     "https://raw.githubusercontent.com/NeblioTeam/neblio-quicksync/master/download.json";
 
@@ -139,6 +159,54 @@ KeyAsString(const T& /*t*/, const std::string& keyStr)
 
 class CTxDB;
 
+/**
+ * Selects how a value fetched from LMDB is handed to the deserializer.
+ */
+enum class LmdbReadMode
+{
+    // copy the value into a heap-allocated CDataStream, then deserialize
+    Copy,
+    // deserialize directly from the memory-mapped page while the read transaction is still alive
+    ZeroCopy,
+};
+
+/**
+ * Deserializes an LMDB value, starting at offset, into value. With LmdbReadMode::ZeroCopy, this
+ * must be called before the transaction that produced val is committed or aborted.
+ */
+template <typename T>
+void LmdbDeserializeValue(const MDB_val& val, T& value, int nType, LmdbReadMode mode,
+                          size_t offset = 0)
+{
+    assert(offset <= val.mv_size);
+    assert(val.mv_data != nullptr);
+    const char* pbegin = static_cast<const char*>(val.mv_data) + offset;
+    const char* pend   = static_cast<const char*>(val.mv_data) + val.mv_size;
+    if (mode == LmdbReadMode::ZeroCopy) {
+        CSpanReadStream ssValue(pbegin, pend, nType, CLIENT_VERSION);
+        ssValue >> value;
+    } else {
+        CDataStream ssValue(pbegin, pend, nType, CLIENT_VERSION);
+        ssValue >> value;
+    }
+}
+
+/**
+ * Stands for a value whose stored bytes are wanted as they are, for Read()
+ */
+struct LmdbRawValue
+{
+    std::string& bytes;
+};
+
+inline void LmdbDeserializeValue(const MDB_val& val, LmdbRawValue& value, int /*nType*/,
+                                 LmdbReadMode /*mode*/, size_t offset = 0)
+{
+    assert(offset <= val.mv_size);
+    assert(val.mv_data != nullptr);
+    value.bytes.assign(static_cast<const char*>(val.mv_data) + offset, val.mv_size - offset);
+}
+
 void lmdb_resized(MDB_env* env);
 
 inline int lmdb_txn_begin(MDB_env* env, MDB_txn* parent, unsigned int flags, MDB_txn** txn)
@@ -236,12 +304,17 @@ private:
     MDB_dbi* db_ntp1Tx;
     MDB_dbi* db_ntp1tokenNames;
     MDB_dbi* db_addrsVsPubKeys;
+    MDB_dbi* db_utxo;
 
+    // The batches that activeBatch is nested in, innermost last. Declared before activeBatch, so that a
+    // nested batch is aborted before its parents on destruction.
+    std::vector<std::unique_ptr<mdb_txn_safe>> parentBatches;
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
     std::unique_ptr<mdb_txn_safe> activeBatch;
     bool                          fReadOnly;
     int                           nVersion;
+    LmdbReadMode                  readMode = LmdbReadMode::ZeroCopy;
 
     void (*dbDeleter)(MDB_dbi*) = [](MDB_dbi* p) {
         if (p) {
@@ -294,15 +367,13 @@ protected:
             return false;
         }
         // Unserialize value
-        assert(offset <= vS.mv_size);
-        assert(vS.mv_data != nullptr);
         try {
-            CDataStream ssValue(static_cast<const char*>(vS.mv_data) + offset,
-                                static_cast<const char*>(vS.mv_data) + vS.mv_size,
-                                SER_DISK | serializationTypeModifiers, CLIENT_VERSION);
-            ssValue >> value;
+            LmdbDeserializeValue(vS, value, SER_DISK | serializationTypeModifiers, readMode, offset);
         } catch (const std::exception& e) {
             printf("Failed to deserialized data when reading for key %s\n", ssKey.str().c_str());
+            if (localTxn.rawPtr()) {
+                localTxn.abort();
+            }
             return false;
         }
         if (localTxn.rawPtr()) {
@@ -374,20 +445,14 @@ protected:
             // Unserialize value
             assert(vS.mv_data != nullptr);
             try {
-                CDataStream ssKeyFound(static_cast<const char*>(kS.mv_data),
-                                       static_cast<const char*>(kS.mv_data) + kS.mv_size, SER_DISK,
-                                       CLIENT_VERSION);
                 std::string keyFound;
-                ssKeyFound >> keyFound;
+                LmdbDeserializeValue(kS, keyFound, SER_DISK, readMode);
                 if (keyFound != key) {
                     break;
                 }
-                CDataStream ssValue(static_cast<const char*>(vS.mv_data),
-                                    static_cast<const char*>(vS.mv_data) + vS.mv_size, SER_DISK,
-                                    CLIENT_VERSION);
-                T           value;
-                ssValue >> value;
-                values.insert(values.end(), value);
+                T value;
+                LmdbDeserializeValue(vS, value, SER_DISK, readMode);
+                values.insert(values.end(), std::move(value));
             } catch (const std::exception& e) {
                 unsigned int sz = static_cast<unsigned int>(values.size());
                 printf("Failed to deserialized element number %u in lmdb ReadMultiple() data when "
@@ -462,18 +527,12 @@ protected:
             // Unserialize value
             assert(vS.mv_data != nullptr);
             try {
-                CDataStream ssKey(static_cast<const char*>(kS.mv_data),
-                                  static_cast<const char*>(kS.mv_data) + kS.mv_size, SER_DISK,
-                                  CLIENT_VERSION);
                 std::string key;
-                ssKey >> key;
-                CDataStream ssValue(static_cast<const char*>(vS.mv_data),
-                                    static_cast<const char*>(vS.mv_data) + vS.mv_size, SER_DISK,
-                                    CLIENT_VERSION);
-                T           value;
-                ssValue >> value;
+                LmdbDeserializeValue(kS, key, SER_DISK, readMode);
+                T value;
+                LmdbDeserializeValue(vS, value, SER_DISK, readMode);
                 Container<T>& cont = values[key];
-                cont.insert(cont.end(), value);
+                cont.insert(cont.end(), std::move(value));
             } catch (const std::exception& e) {
                 unsigned int sz = static_cast<unsigned int>(values.size());
                 printf("Failed to deserialized element number %u in lmdb ReadMultipleWithKeys() data\n",
@@ -727,9 +786,17 @@ public:
 
     static bool need_resize(uint64_t threshold_size = 0);
     void        do_resize(uint64_t increase_size = 0);
+    // Starts a batch; within a batch, this starts a nested one, whose writes are only kept if it's
+    // committed and then its parent is. The map can't be resized while a batch is open, so
+    // required_size of the outermost batch must make room for the nested ones.
     bool        TxnBegin(std::size_t required_size = 0);
     bool        TxnCommit();
     bool        TxnAbort();
+    bool        IsInTxn() const { return activeBatch != nullptr; }
+
+    // the copying mode is kept for comparison in tests/benchmarks
+    void         SetReadMode(LmdbReadMode mode) { readMode = mode; }
+    LmdbReadMode GetReadMode() const { return readMode; }
 
     // for tests
     bool test1_WriteStrKeyVal(const std::string& key, const std::string& val);
@@ -764,6 +831,7 @@ public:
     bool ReadDiskTx(const COutPoint& outpoint, CTransaction& tx, CTxIndex& txindex) const override;
     bool ReadDiskTx(const COutPoint& outpoint, CTransaction& tx) const override;
     bool ReadBlock(const uint256& hash, CBlock& blk, bool fReadTransactions = true) const override;
+    bool ReadBlockRaw(const uint256& hash, std::string& data) const override;
     bool WriteBlock(const uint256& hash, const CBlock& blk) override;
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex) override;
     bool ReadHashBestChain(uint256& hashBestChain) const override;
@@ -771,17 +839,42 @@ public:
     bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust) const override;
     bool WriteBestInvalidTrust(const CBigNum& bnBestInvalidTrust) override;
     bool LoadBlockIndex() override;
+    // writes the block index snapshot that the next LoadBlockIndex() loads instead of the database
+    bool                           WriteBlockIndexSnapshot() const;
     boost::optional<int>           GetBestChainHeight() const override;
     boost::optional<uint256>       GetBestChainTrust() const override;
     boost::shared_ptr<CBlockIndex> GetBestBlockIndex() const override;
     uint256                        GetBestBlockHash() const override;
 
+    // the UTXO set, kept in sync with the best chain by ConnectBlock() and DisconnectBlock()
+    bool ReadCoins(const uint256& txid, CCoins& coins) const;
+    // fully spent coins are erased
+    bool WriteCoins(const uint256& txid, const CCoins& coins);
+    bool HaveCoins(const uint256& txid) const;
+    bool ReadCoinsBestBlock(uint256& hashBlock) const;
+    bool WriteCoinsBestBlock(const uint256& hashBlock);
+    bool ReadUtxoSetVersion(int& nVersion) const;
+    bool WriteUtxoSetVersion(int nVersion);
+    // builds the UTXO set from the tx index if its version isn't UTXO_SET_VERSION or it doesn't match
+    // the best chain, e.g. after an upgrade
+    bool BuildUtxoSetIfNeeded();
+
     static uintmax_t GetCurrentDiskUsage();
 
     void init_blockindex(bool fRemoveOld = false);
 
+    static boost::filesystem::path GetBlockIndexSnapshotPath();
+
+    // the cache of transactions decoded by ReadTx(), shared by all instances
+    static TxReadCacheType& GetTxReadCache();
+
 private:
     inline void        loadDbPointers();
+    BlockIndexSnapshotId GetBlockIndexSnapshotId() const;
+    bool                 ReadBlockIndexFromDb(BlockIndexMapType::MapType& loadedBlockIndex);
+    // reads up to maxCount tx index entries after lastKey (or from the first one), updating lastKey
+    bool ReadTxIndexChunk(bool fromStart, uint256& lastKey, unsigned maxCount,
+                          std::vector<std::pair<uint256, CTxIndex>>& chunk, bool& reachedEnd) const;
     inline void        resetDbPointers();
     static inline void resetGlobalDbPointers();
 };
@@ -795,6 +888,7 @@ void CTxDB::loadDbPointers()
     db_ntp1Tx         = glob_db_ntp1Tx.get();
     db_ntp1tokenNames = glob_db_ntp1tokenNames.get();
     db_addrsVsPubKeys = glob_db_addrsVsPubKeys.get();
+    db_utxo           = glob_db_utxo.get();
 }
 
 void CTxDB::resetDbPointers()
@@ -806,6 +900,7 @@ void CTxDB::resetDbPointers()
     db_ntp1Tx         = nullptr;
     db_ntp1tokenNames = nullptr;
     db_addrsVsPubKeys = nullptr;
+    db_utxo           = nullptr;
 }
 
 void CTxDB::resetGlobalDbPointers()
@@ -817,6 +912,7 @@ void CTxDB::resetGlobalDbPointers()
     glob_db_ntp1Tx.reset();
     glob_db_ntp1tokenNames.reset();
     glob_db_addrsVsPubKeys.reset();
+    glob_db_utxo.reset();
 
     dbEnv.reset();
 }
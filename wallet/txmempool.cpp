@@ -4,11 +4,103 @@
 
 #include "ntp1/ntp1transaction.h"
 
-bool CTxMemPool::addUnchecked(const uint256& hash, const CTransaction& tx)
+#include <cmath>
+
+// the heap memory of a transaction, beyond sizeof(CTransaction)
+static std::size_t TxInnerUsage(const CTransaction& tx)
+{
+    std::size_t result = tx.vin.capacity() * sizeof(CTxIn) + tx.vout.capacity() * sizeof(CTxOut);
+    for (const CTxIn& txin : tx.vin) {
+        result += txin.scriptSig.capacity();
+    }
+    for (const CTxOut& txout : tx.vout) {
+        result += txout.scriptPubKey.capacity();
+    }
+    return result;
+}
+
+// a node of mapTx has a pointer for the hashed index and three for each of the four ordered ones, and
+// the hash table has about a bucket per entry; a node of mapNextTx has three pointers and a color
+static const std::size_t MAPTX_ENTRY_OVERHEAD     = 14 * sizeof(void*);
+static const std::size_t MAPNEXTTX_ENTRY_OVERHEAD = 4 * sizeof(void*);
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& Tx, int64_t Fee, int64_t Time,
+                                 unsigned int Height, double EntryPriority, int64_t InChainInputValue,
+                                 int64_t ValueIn, unsigned int SigOps)
+    : tx(Tx), hash(Tx.GetHash()), nFee(Fee),
+      nTxSize(::GetSerializeSize(Tx, SER_NETWORK, PROTOCOL_VERSION)), nTime(Time), nHeight(Height),
+      dEntryPriority(EntryPriority), nInChainInputValue(InChainInputValue), nValueIn(ValueIn),
+      nSigOps(SigOps)
+{
+    nUsageSize = sizeof(CTxMemPoolEntry) + TxInnerUsage(tx);
+
+    nCountWithAncestors   = 1;
+    nSizeWithAncestors    = nTxSize;
+    nFeesWithAncestors    = nFee;
+    nCountWithDescendants = 1;
+    nSizeWithDescendants  = nTxSize;
+    nFeesWithDescendants  = nFee;
+}
+
+double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
+{
+    if (currentHeight <= nHeight) {
+        return dEntryPriority;
+    }
+    // every block on top of nHeight adds a confirmation to each input that was in the chain
+    const double deltaPriority =
+        double(currentHeight - nHeight) * double(nInChainInputValue) / double(nTxSize);
+    return dEntryPriority + deltaPriority;
+}
+
+double CTxMemPoolEntry::GetFeeRate() const { return double(nFee) / (double(nTxSize) / 1000.0); }
+
+double CTxMemPoolEntry::GetAncestorScore() const
+{
+    const double ancestorFeeRate =
+        double(nFeesWithAncestors) / (double(nSizeWithAncestors) / 1000.0);
+    return std::min(GetFeeRate(), ancestorFeeRate);
+}
+
+double CTxMemPoolEntry::GetDescendantFeeRate() const
+{
+    return double(nFeesWithDescendants) / (double(nSizeWithDescendants) / 1000.0);
+}
+
+double CTxMemPoolEntry::GetDescendantScore() const
+{
+    return std::max(GetFeeRate(), GetDescendantFeeRate());
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, int64_t modifyFee, int64_t modifyCount)
+{
+    nSizeWithAncestors += modifySize;
+    nFeesWithAncestors += modifyFee;
+    nCountWithAncestors += modifyCount;
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, int64_t modifyFee,
+                                            int64_t modifyCount)
+{
+    nSizeWithDescendants += modifySize;
+    nFeesWithDescendants += modifyFee;
+    nCountWithDescendants += modifyCount;
+}
+
+CTxMemPool::CTxMemPool()
+    : totalTxSize(0), cachedInnerUsage(0), rollingMinimumFeeRate(0), lastRollingFeeUpdate(GetTime()),
+      blockSinceLastRollingFeeBump(false)
+{
+}
+
+bool CTxMemPool::addUnchecked(const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.  Don't call this directly,
     // call AcceptToMemoryPool to properly check the transaction first.
     {
+        const CTransaction& tx   = entry.GetTx();
+        const uint256&      hash = entry.GetHash();
+
         // add token symbol
         if (const boost::optional<std::string> symbol = GetTokenSymbolIfIssuance(tx)) {
             const std::string processedSymbol             = ConvertSymbolToComparableString(*symbol);
@@ -16,11 +108,65 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTransaction& tx)
             issuedNTP1TokenSymbolsToTxid[processedSymbol] = hash;
         }
 
+        const std::set<uint256> ancestors = calculateAncestors_unsafe(tx);
+
+        // when it comes back from a disconnected block, the transactions that spend it may be in the
+        // pool already; they're linked to it and to its ancestors below, as far as they weren't before
+        const std::set<uint256>              descendants = calculateDescendants_unsafe(tx);
+        std::map<uint256, std::set<uint256>> descendantsAncestors;
+        for (const uint256& descendantHash : descendants) {
+            descendantsAncestors[descendantHash] =
+                calculateAncestors_unsafe(mapTx.find(descendantHash)->GetTx());
+        }
+
         // add the tx
-        mapTx[hash] = tx;
+        const auto it = mapTx.insert(entry).first;
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
-            mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
+            mapNextTx[tx.vin[i].prevout] = CInPoint(&it->GetTx(), i);
+        }
+
+        // account for it in the totals of its ancestors, and theirs in its own
+        const int64_t size          = it->GetTxSize();
+        const int64_t fee           = it->GetFee();
+        int64_t       ancestorsSize = 0;
+        int64_t       ancestorsFees = 0;
+        for (const uint256& ancestorHash : ancestors) {
+            const auto ancestorIt = mapTx.find(ancestorHash);
+            ancestorsSize += ancestorIt->GetTxSize();
+            ancestorsFees += ancestorIt->GetFee();
+            mapTx.modify(ancestorIt, [&](CTxMemPoolEntry& e) { e.UpdateDescendantState(size, fee, 1); });
+        }
+        mapTx.modify(it, [&](CTxMemPoolEntry& e) {
+            e.UpdateAncestorState(ancestorsSize, ancestorsFees, ancestors.size());
+        });
+
+        // each of its descendants gets it and its ancestors that it didn't have, and they get it
+        std::set<uint256> linkedAncestors(ancestors);
+        linkedAncestors.insert(hash);
+        for (const auto& p : descendantsAncestors) {
+            const auto    descendantIt   = mapTx.find(p.first);
+            const int64_t descendantSize = descendantIt->GetTxSize();
+            const int64_t descendantFee  = descendantIt->GetFee();
+            int64_t       gainedSize     = 0;
+            int64_t       gainedFees     = 0;
+            int64_t       gainedCount    = 0;
+            for (const uint256& ancestorHash : linkedAncestors) {
+                if (p.second.count(ancestorHash))
+                    continue;
+                const auto ancestorIt = mapTx.find(ancestorHash);
+                gainedSize += ancestorIt->GetTxSize();
+                gainedFees += ancestorIt->GetFee();
+                gainedCount++;
+                mapTx.modify(ancestorIt, [&](CTxMemPoolEntry& e) {
+                    e.UpdateDescendantState(descendantSize, descendantFee, 1);
+                });
+            }
+            mapTx.modify(descendantIt, [&](CTxMemPoolEntry& e) {
+                e.UpdateAncestorState(gainedSize, gainedFees, gainedCount);
+            });
         }
+        totalTxSize += it->GetTxSize();
+        cachedInnerUsage += it->GetUsageSize();
 
         nTransactionsUpdated++;
     }
@@ -33,7 +179,8 @@ bool CTxMemPool::remove(const CTransaction& tx, bool fRecursive)
     LOCK(cs);
     {
         const uint256 hash = tx.GetHash();
-        if (mapTx.count(hash)) {
+        const auto    txIt = mapTx.find(hash);
+        if (txIt != mapTx.end()) {
             if (fRecursive) {
                 for (unsigned int i = 0; i < tx.vout.size(); i++) {
                     std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
@@ -41,9 +188,24 @@ bool CTxMemPool::remove(const CTransaction& tx, bool fRecursive)
                         remove(*it->second.ptx, true);
                 }
             }
+
+            // the transactions that stay lose it from their totals
+            const int64_t size = txIt->GetTxSize();
+            const int64_t fee  = txIt->GetFee();
+            for (const uint256& ancestorHash : calculateAncestors_unsafe(tx)) {
+                mapTx.modify(mapTx.find(ancestorHash),
+                             [&](CTxMemPoolEntry& e) { e.UpdateDescendantState(-size, -fee, -1); });
+            }
+            for (const uint256& descendantHash : calculateDescendants_unsafe(tx)) {
+                mapTx.modify(mapTx.find(descendantHash),
+                             [&](CTxMemPoolEntry& e) { e.UpdateAncestorState(-size, -fee, -1); });
+            }
+
             for (const CTxIn& txin : tx.vin)
                 mapNextTx.erase(txin.prevout);
-            mapTx.erase(hash);
+            totalTxSize -= txIt->GetTxSize();
+            cachedInnerUsage -= txIt->GetUsageSize();
+            mapTx.erase(txIt);
             nTransactionsUpdated++;
         }
         {
@@ -58,19 +220,119 @@ bool CTxMemPool::remove(const CTransaction& tx, bool fRecursive)
     return true;
 }
 
-bool CTxMemPool::removeConflicts(const CTransaction& tx)
+void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx)
 {
-    // Remove transactions which depend on inputs of tx, recursively
     LOCK(cs);
-    for (const CTxIn& txin : tx.vin) {
-        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
-        if (it != mapNextTx.end()) {
-            const CTransaction& txConflict = *it->second.ptx;
-            if (txConflict != tx)
-                remove(txConflict, true);
+    for (const CTransaction& tx : vtx) {
+        remove(tx);
+    }
+    lastRollingFeeUpdate         = GetTime();
+    blockSinceLastRollingFeeBump = true;
+}
+
+void CTxMemPool::TrimToSize(std::size_t sizelimit, std::vector<uint256>* pvRemoved)
+{
+    LOCK(cs);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        const CTxMemPoolEntry& worst = *mapTx.get<MempoolDescendantScoreTag>().begin();
+
+        // to get back in, the package has to pay more than what it paid, by the relay fee rate
+        trackPackageRemoved(worst.GetDescendantFeeRate() + MIN_RELAY_TX_FEE);
+
+        const CTransaction tx = worst.GetTx();
+        if (pvRemoved) {
+            pvRemoved->push_back(tx.GetHash());
+            const std::set<uint256> descendants = calculateDescendants_unsafe(tx);
+            pvRemoved->insert(pvRemoved->end(), descendants.cbegin(), descendants.cend());
         }
+        remove(tx, true);
     }
-    return true;
+}
+
+int CTxMemPool::Expire(int64_t time)
+{
+    LOCK(cs);
+    std::vector<CTransaction> toRemove;
+    const auto&               byTime = mapTx.get<MempoolEntryTimeTag>();
+    for (auto it = byTime.cbegin(); it != byTime.cend() && it->GetTime() < time; ++it) {
+        toRemove.push_back(it->GetTx());
+    }
+    const unsigned long sizeBefore = mapTx.size();
+    for (const CTransaction& tx : toRemove) {
+        // a no-op for the ones that were removed as descendants of earlier ones
+        remove(tx, true);
+    }
+    return static_cast<int>(sizeBefore - mapTx.size());
+}
+
+int64_t CTxMemPool::GetMinFee(std::size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return static_cast<int64_t>(rollingMinimumFeeRate);
+
+    const int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        // decay faster while the pool is far from full
+        double            halflife = ROLLING_FEE_HALFLIFE;
+        const std::size_t usage    = DynamicMemoryUsage();
+        if (usage < sizelimit / 4)
+            halflife /= 4;
+        else if (usage < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate /= std::pow(2.0, double(time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < MIN_RELAY_TX_FEE / 2) {
+            rollingMinimumFeeRate = 0;
+            return 0;
+        }
+    }
+    return std::max(static_cast<int64_t>(rollingMinimumFeeRate), MIN_RELAY_TX_FEE);
+}
+
+void CTxMemPool::trackPackageRemoved(double rate)
+{
+    if (rate > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate        = rate;
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+std::set<uint256> CTxMemPool::calculateAncestors_unsafe(const CTransaction& tx) const
+{
+    std::set<uint256>                result;
+    std::vector<const CTransaction*> toVisit{&tx};
+    while (!toVisit.empty()) {
+        const CTransaction* curr = toVisit.back();
+        toVisit.pop_back();
+        for (const CTxIn& txin : curr->vin) {
+            const auto it = mapTx.find(txin.prevout.hash);
+            if (it != mapTx.end() && result.insert(it->GetHash()).second) {
+                toVisit.push_back(&it->GetTx());
+            }
+        }
+    }
+    return result;
+}
+
+std::set<uint256> CTxMemPool::calculateDescendants_unsafe(const CTransaction& tx) const
+{
+    std::set<uint256>                result;
+    std::vector<const CTransaction*> toVisit{&tx};
+    while (!toVisit.empty()) {
+        const CTransaction* curr     = toVisit.back();
+        const uint256       currHash = curr->GetHash();
+        toVisit.pop_back();
+        for (unsigned int i = 0; i < curr->vout.size(); i++) {
+            const auto it = mapNextTx.find(COutPoint(currHash, i));
+            if (it != mapNextTx.end() && result.insert(it->second.ptx->GetHash()).second) {
+                toVisit.push_back(it->second.ptx);
+            }
+        }
+    }
+    return result;
 }
 
 void CTxMemPool::clear()
@@ -78,6 +340,8 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    totalTxSize      = 0;
+    cachedInnerUsage = 0;
     ++nTransactionsUpdated;
 }
 
@@ -87,8 +351,8 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (std::map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back((*mi).first);
+    for (const CTxMemPoolEntry& entry : mapTx)
+        vtxid.push_back(entry.GetHash());
 }
 
 unsigned long CTxMemPool::size() const
@@ -97,6 +361,20 @@ unsigned long CTxMemPool::size() const
     return mapTx.size();
 }
 
+uint64_t CTxMemPool::GetTotalTxSize() const
+{
+    LOCK(cs);
+    return totalTxSize;
+}
+
+std::size_t CTxMemPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return mapTx.size() * MAPTX_ENTRY_OVERHEAD + cachedInnerUsage +
+           mapNextTx.size() * (sizeof(std::map<COutPoint, CInPoint>::value_type) +
+                               MAPNEXTTX_ENTRY_OVERHEAD);
+}
+
 bool CTxMemPool::exists(uint256 hash) const
 {
     LOCK(cs);
@@ -106,10 +384,10 @@ bool CTxMemPool::exists(uint256 hash) const
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
-    std::map<uint256, CTransaction>::const_iterator i = mapTx.find(hash);
+    const auto i = mapTx.find(hash);
     if (i == mapTx.end())
         return false;
-    result = i->second;
+    result = i->GetTx();
     return true;
 }
 
@@ -147,7 +425,7 @@ const CTransaction* CTxMemPool::lookup_unsafe(const uint256& hash) const
 {
     auto it = mapTx.find(hash);
     if (it != mapTx.cend())
-        return &it->second;
+        return &it->GetTx();
     else
         return nullptr;
 }
@@ -161,9 +439,8 @@ std::string CTxMemPool::ConvertSymbolToComparableString(std::string symbol)
 boost::optional<std::string> CTxMemPool::GetTokenSymbolIfIssuance(const CTransaction& tx)
 {
     try {
-        std::string opRet;
-        if (NTP1Transaction::IsTxNTP1(&tx, &opRet)) {
-            auto scriptPtr = NTP1Script::ParseScript(opRet);
+        if (NTP1Transaction::IsTxNTP1(&tx)) {
+            auto scriptPtr = NTP1Transaction::ParseTxNTP1Script(tx);
             if (scriptPtr->getTxType() == NTP1Script::TxType_Issuance) {
                 std::shared_ptr<const NTP1Script_Issuance> scriptPtrD =
                     std::dynamic_pointer_cast<const NTP1Script_Issuance>(scriptPtr);
@@ -3,28 +3,170 @@
 
 #include "transaction.h"
 #include "util.h"
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index_container.hpp>
 #include <map>
+#include <set>
 
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/**
+ * A transaction in the memory pool, with what's needed to assemble blocks from it computed once when
+ * it's accepted, so that this doesn't require reading its inputs again. It also keeps the totals of
+ * the transaction together with its in-mempool ancestors, and with its in-mempool descendants.
+ */
+class CTxMemPoolEntry
+{
+    CTransaction tx;
+    uint256      hash;
+    int64_t      nFee;
+    unsigned int nTxSize;
+    int64_t      nTime;              // when it entered the memory pool
+    unsigned int nHeight;            // the height of the best block when it entered the memory pool
+    double       dEntryPriority;     // the priority at nHeight
+    int64_t      nInChainInputValue; // the value of the inputs that were already in the chain
+    int64_t      nValueIn;
+    unsigned int nSigOps;
+    std::size_t  nUsageSize; // an estimate of the memory this entry takes
+
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    int64_t  nFeesWithAncestors;
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    int64_t  nFeesWithDescendants;
+
+public:
+    CTxMemPoolEntry(const CTransaction& Tx, int64_t Fee, int64_t Time, unsigned int Height,
+                    double EntryPriority, int64_t InChainInputValue, int64_t ValueIn,
+                    unsigned int SigOps);
+
+    const CTransaction& GetTx() const { return tx; }
+    const uint256&      GetHash() const { return hash; }
+    int64_t             GetFee() const { return nFee; }
+    unsigned int        GetTxSize() const { return nTxSize; }
+    int64_t             GetTime() const { return nTime; }
+    unsigned int        GetHeight() const { return nHeight; }
+    int64_t             GetValueIn() const { return nValueIn; }
+    unsigned int        GetSigOps() const { return nSigOps; }
+    std::size_t         GetUsageSize() const { return nUsageSize; }
+
+    /** sum(value in * confirmations) / size, as of a best block at currentHeight; the inputs that
+     * were in the memory pool when this entered it count as unconfirmed */
+    double GetPriority(unsigned int currentHeight) const;
+    /** fee per 1000 bytes */
+    double GetFeeRate() const;
+    /** the fee rate of the transaction with all its in-mempool ancestors, or its own if lower; what
+     * a block gets for including it */
+    double GetAncestorScore() const;
+    /** the fee rate of the transaction with all its in-mempool descendants */
+    double GetDescendantFeeRate() const;
+    /** the fee rate of the transaction with all its in-mempool descendants, or its own if higher; what
+     * evicting it together with its descendants loses */
+    double GetDescendantScore() const;
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    int64_t  GetFeesWithAncestors() const { return nFeesWithAncestors; }
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    int64_t  GetFeesWithDescendants() const { return nFeesWithDescendants; }
+
+    void UpdateAncestorState(int64_t modifySize, int64_t modifyFee, int64_t modifyCount);
+    void UpdateDescendantState(int64_t modifySize, int64_t modifyFee, int64_t modifyCount);
+};
+
+// tags of the indices of CTxMemPool::mapTx
+struct MempoolTxidTag;
+struct MempoolFeeRateTag;
+struct MempoolAncestorScoreTag;
+struct MempoolDescendantScoreTag;
+struct MempoolEntryTimeTag;
+
 class CTxMemPool
 {
+    uint64_t totalTxSize;      // the sum of the sizes of the transactions
+    uint64_t cachedInnerUsage; // the sum of the usage sizes of the entries
+
+    // the minimum fee rate for entering the pool, raised by evictions and decaying after blocks
+    mutable double  rollingMinimumFeeRate;
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool    blockSinceLastRollingFeeBump;
+
 public:
-    mutable CCriticalSection        cs;
-    std::map<uint256, CTransaction> mapTx;
-    std::map<COutPoint, CInPoint>   mapNextTx;
+    /** the time it takes the rolling minimum fee rate to halve, in seconds, when the pool is at least
+     * half full */
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
+    using indexed_transaction_set = boost::multi_index_container<
+        CTxMemPoolEntry,
+        boost::multi_index::indexed_by<
+            boost::multi_index::hashed_unique<
+                boost::multi_index::tag<MempoolTxidTag>,
+                boost::multi_index::const_mem_fun<CTxMemPoolEntry, const uint256&,
+                                                  &CTxMemPoolEntry::GetHash>,
+                std::hash<uint256>>,
+            // highest fee rate first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<MempoolFeeRateTag>,
+                boost::multi_index::const_mem_fun<CTxMemPoolEntry, double,
+                                                  &CTxMemPoolEntry::GetFeeRate>,
+                std::greater<double>>,
+            // highest ancestor score first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<MempoolAncestorScoreTag>,
+                boost::multi_index::const_mem_fun<CTxMemPoolEntry, double,
+                                                  &CTxMemPoolEntry::GetAncestorScore>,
+                std::greater<double>>,
+            // lowest descendant score first, the first to be evicted
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<MempoolDescendantScoreTag>,
+                boost::multi_index::const_mem_fun<CTxMemPoolEntry, double,
+                                                  &CTxMemPoolEntry::GetDescendantScore>>,
+            // oldest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<MempoolEntryTimeTag>,
+                boost::multi_index::const_mem_fun<CTxMemPoolEntry, int64_t,
+                                                  &CTxMemPoolEntry::GetTime>>>>;
+
+    mutable CCriticalSection      cs;
+    indexed_transaction_set       mapTx;
+    std::map<COutPoint, CInPoint> mapNextTx;
 
     // bi-directional mapping of the txid and NTP1 token symbol
     std::map<uint256, std::string> txidToissuedNTP1TokenSymbols;
     std::map<std::string, uint256> issuedNTP1TokenSymbolsToTxid;
 
-    bool addUnchecked(const uint256& hash, const CTransaction& tx);
+    CTxMemPool();
+
+    bool addUnchecked(const CTxMemPoolEntry& entry);
     bool remove(const CTransaction& tx, bool fRecursive = false);
+    /** removes the transactions of a block that was connected, and lets the minimum fee rate decay */
+    void removeForBlock(const std::vector<CTransaction>& vtx);
     bool removeConflicts(const CTransaction& tx);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
 
     unsigned long size() const;
+    uint64_t      GetTotalTxSize() const;
+
+    /** an estimate of the memory that the pool takes, in bytes */
+    std::size_t DynamicMemoryUsage() const;
+
+    /** evicts the transactions with the lowest descendant score, together with their descendants,
+     * until the pool takes at most sizelimit bytes; the txids of the evicted ones are appended to
+     * pvRemoved, if given */
+    void TrimToSize(std::size_t sizelimit, std::vector<uint256>* pvRemoved = nullptr);
+
+    /** removes the transactions that entered the pool before time, with their descendants, and returns
+     * how many were removed */
+    int Expire(int64_t time);
+
+    /** the minimum fee per 1000 bytes for entering a pool limited to sizelimit bytes; zero if there's
+     * no minimum beyond the relay fee */
+    int64_t GetMinFee(std::size_t sizelimit) const;
 
     bool exists(uint256 hash) const;
 
@@ -46,6 +188,13 @@ public:
     const CTransaction* lookup_unsafe(const uint256& hash) const;
 
 private:
+    void trackPackageRemoved(double rate);
+
+    /** the txids of the in-mempool transactions that tx spends outputs of, and theirs, recursively */
+    std::set<uint256> calculateAncestors_unsafe(const CTransaction& tx) const;
+    /** the txids of the in-mempool transactions that spend outputs of tx, and theirs, recursively */
+    std::set<uint256> calculateDescendants_unsafe(const CTransaction& tx) const;
+
     static std::string                  ConvertSymbolToComparableString(std::string symbol);
     static boost::optional<std::string> GetTokenSymbolIfIssuance(const CTransaction& tx);
 };
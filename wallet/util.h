@@ -387,6 +387,13 @@ inline int64_t GetTimeMillis()
         .total_milliseconds();
 }
 
+inline int64_t GetTimeMicros()
+{
+    return (boost::posix_time::ptime(boost::posix_time::microsec_clock::universal_time()) -
+            boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1)))
+        .total_microseconds();
+}
+
 inline std::string DateTimeStrFormat(const char* pszFormat, int64_t nTime)
 {
     time_t     n       = nTime;
@@ -602,6 +609,27 @@ std::string GeneratePseudoRandomString(const int len);
 
 std::string GeneratePseudoRandomHex(const int len);
 
+/** Runs func(begin, end) over [0, count) split in nThreads contiguous shards */
+template <typename Func>
+void RunSharded(uint64_t count, unsigned nThreads, Func&& func)
+{
+    if (nThreads <= 1) {
+        func(UINT64_C(0), count);
+        return;
+    }
+    const uint64_t           shardSize = (count + nThreads - 1) / nThreads;
+    std::vector<std::thread> threads;
+    threads.reserve(nThreads);
+    for (unsigned t = 0; t < nThreads; t++) {
+        const uint64_t begin = std::min<uint64_t>(count, shardSize * t);
+        const uint64_t end   = std::min<uint64_t>(count, begin + shardSize);
+        threads.emplace_back([begin, end, &func]() { func(begin, end); });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
 template <typename T>
 void SwapEndianness(T& var)
 {
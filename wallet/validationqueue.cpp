@@ -0,0 +1,48 @@
+#include "validationqueue.h"
+
+void CValidationQueue::Push(int64_t nodeId, Task task)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        queue.push_back(QueuedTask{nodeId, std::move(task)});
+        mapPending[nodeId]++;
+    }
+    cond.notify_one();
+}
+
+bool CValidationQueue::RunNext(int nTimeoutMs)
+{
+    QueuedTask next;
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        const boost::system_time         deadline =
+            boost::get_system_time() + boost::posix_time::milliseconds(nTimeoutMs);
+        while (queue.empty()) {
+            if (!cond.timed_wait(lock, deadline))
+                return false;
+        }
+        next = std::move(queue.front());
+        queue.pop_front();
+    }
+
+    next.task();
+
+    boost::unique_lock<boost::mutex> lock(mtx);
+    const auto                       it = mapPending.find(next.nodeId);
+    if (it != mapPending.end() && --it->second == 0)
+        mapPending.erase(it);
+    return true;
+}
+
+unsigned int CValidationQueue::Pending(int64_t nodeId) const
+{
+    boost::unique_lock<boost::mutex> lock(mtx);
+    const auto                       it = mapPending.find(nodeId);
+    return it == mapPending.end() ? 0 : it->second;
+}
+
+std::size_t CValidationQueue::Size() const
+{
+    boost::unique_lock<boost::mutex> lock(mtx);
+    return queue.size();
+}
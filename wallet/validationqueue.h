@@ -0,0 +1,51 @@
+#ifndef VALIDATIONQUEUE_H
+#define VALIDATIONQUEUE_H
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+
+/**
+ * The messages of peers that need to be validated, like blocks and transactions, which are run one at
+ * a time, in the order they came, by a thread of their own. Meanwhile the message handler keeps
+ * serving the peers. It holds back the messages of a peer that need the chain while that peer has
+ * something pending here, so those still see the chain as the peer's earlier blocks and transactions
+ * left it; the messages that don't need the chain, like getdata, addr and ping, aren't held back and
+ * may be processed before a block or transaction that came earlier.
+ */
+class CValidationQueue
+{
+public:
+    typedef std::function<void()> Task;
+
+private:
+    struct QueuedTask
+    {
+        int64_t nodeId;
+        Task    task;
+    };
+
+    mutable boost::mutex      mtx;
+    boost::condition_variable cond;
+    std::deque<QueuedTask>    queue;
+    // the tasks of each peer that are queued or running
+    std::map<int64_t, unsigned int> mapPending;
+
+public:
+    void Push(int64_t nodeId, Task task);
+
+    /** Waits up to nTimeoutMs for a task and runs it; returns whether one was run */
+    bool RunNext(int nTimeoutMs);
+
+    /** The tasks of the peer that are queued or running */
+    unsigned int Pending(int64_t nodeId) const;
+
+    /** The tasks that are queued */
+    std::size_t Size() const;
+};
+
+#endif // VALIDATIONQUEUE_H
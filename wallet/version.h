@@ -28,6 +28,10 @@ extern const std::string CLIENT_DATE;
 //
 static const int DATABASE_VERSION = 70516;
 
+// version of the UTXO set records; the set is rebuilt from the transaction index at startup when the
+// one in the database has a different version, without touching the rest of the database
+static const int UTXO_SET_VERSION = 1;
+
 //
 // network protocol versioning
 //
@@ -593,6 +593,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
             wtx.WriteToDisk(&walletdb);
+            NotifyTxChanged(now, CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them
             // conflicted too
             auto                     txSpends = mapTxSpends.get();
@@ -613,6 +614,34 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
     }
 }
 
+void CWallet::NotifyTxChanged(const uint256& hashTx, ChangeType status)
+{
+    {
+        LOCK(cs_wallet);
+        const auto it = mapTxLastChange.find(hashTx);
+        if (it != mapTxLastChange.end())
+            mapTxChanges.erase(it->second);
+        mapTxChanges[++nLastTxChange] = hashTx;
+        mapTxLastChange[hashTx]       = nLastTxChange;
+    }
+    NotifyTransactionChanged(this, hashTx, status);
+}
+
+uint64_t CWallet::GetLastTxChange() const
+{
+    LOCK(cs_wallet);
+    return nLastTxChange;
+}
+
+std::vector<uint256> CWallet::GetTxsChangedSince(uint64_t nSequence) const
+{
+    LOCK(cs_wallet);
+    std::vector<uint256> vHashes;
+    for (auto it = mapTxChanges.upper_bound(nSequence); it != mapTxChanges.end(); ++it)
+        vHashes.push_back(it->second);
+    return vHashes;
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     auto lock = mapTxSpends.get_lock();
@@ -719,7 +748,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         wtx.MarkDirty();
 
         // Notify UI of new or updated transaction
-        NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
+        NotifyTxChanged(hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
         // notify an external script when a wallet transaction comes in or is updated
         std::string strCmd = GetArg("-walletnotify", "");
@@ -1317,69 +1346,77 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, bool
         LOCK2(cs_main, cs_wallet);
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end();
              ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+            AvailableCoinsOfTx(it->second, vCoins, fOnlyConfirmed, fIncludeColdStaking,
+                               fIncludeDelegated, coinControl);
+        }
+    }
+}
 
-            if (!IsFinalTx(*pcoin))
-                continue;
+void CWallet::AvailableCoinsOfTx(const CWalletTx& wtx, vector<COutput>& vCoins, bool fOnlyConfirmed,
+                                 bool fIncludeColdStaking, bool fIncludeDelegated,
+                                 const CCoinControl* coinControl) const
+{
+    AssertLockHeld(cs_wallet);
+    const CWalletTx* pcoin = &wtx;
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+    if (!IsFinalTx(*pcoin))
+        return;
 
-            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+    if (fOnlyConfirmed && !pcoin->IsTrusted())
+        return;
 
-            if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+    if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+        return;
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth == 0 && !pcoin->InMempool())
-                continue;
+    if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0)
+        return;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (mine == ISMINE_NO)
-                    continue;
+    int nDepth = pcoin->GetDepthInMainChain();
+    if (nDepth == 0 && !pcoin->InMempool())
+        return;
 
-                if (IsMineCheck(mine, ISMINE_WATCH_ONLY))
-                    continue;
+    for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+        isminetype mine = IsMine(pcoin->vout[i]);
+        if (mine == ISMINE_NO)
+            continue;
 
-                if (pcoin->vout[i].nValue < nMinimumInputValue)
-                    continue;
+        if (IsMineCheck(mine, ISMINE_WATCH_ONLY))
+            continue;
 
-                if (IsSpent(pcoin->GetHash(), i))
-                    continue;
+        if (pcoin->vout[i].nValue < nMinimumInputValue)
+            continue;
 
-                if (!(!coinControl || !coinControl->HasSelected() ||
-                      coinControl->IsSelected((*it).first, i)))
-                    continue;
+        if (IsSpent(pcoin->GetHash(), i))
+            continue;
 
-                // --Skip P2CS outputs
-                // skip cold coins
-                if (mine == ISMINE_COLD && (!fIncludeColdStaking || !HasDelegator(pcoin->vout[i])))
-                    continue;
-                // skip delegated coins
-                if (mine == ISMINE_SPENDABLE_DELEGATED && !fIncludeDelegated)
-                    continue;
-                // skip auto-delegated coins
-                if (mine == ISMINE_SPENDABLE_STAKEABLE && !fIncludeColdStaking && !fIncludeDelegated)
-                    continue;
+        if (coinControl && coinControl->HasSelected() && !coinControl->IsSelected(pcoin->GetHash(), i))
+            continue;
 
-                // bool fIsValid =
-                //     (((mine &
-                //        ISMINE_SPENDABLE) !=
-                //       ISMINE_NO) ||
-                //      ((mine &
-                //        (ISMINE_MULTISIG |
-                //         (fIncludeColdStaking ? ISMINE_COLD
-                //                              : ISMINE_NO) |
-                //         (fIncludeDelegated
-                //              ? ISMINE_SPENDABLE_DELEGATED
-                //              : ISMINE_NO))) !=
-                //       ISMINE_NO));
+        // --Skip P2CS outputs
+        // skip cold coins
+        if (mine == ISMINE_COLD && (!fIncludeColdStaking || !HasDelegator(pcoin->vout[i])))
+            continue;
+        // skip delegated coins
+        if (mine == ISMINE_SPENDABLE_DELEGATED && !fIncludeDelegated)
+            continue;
+        // skip auto-delegated coins
+        if (mine == ISMINE_SPENDABLE_STAKEABLE && !fIncludeColdStaking && !fIncludeDelegated)
+            continue;
 
-                vCoins.push_back(COutput(pcoin, i, nDepth));
-            }
-        }
+        // bool fIsValid =
+        //     (((mine &
+        //        ISMINE_SPENDABLE) !=
+        //       ISMINE_NO) ||
+        //      ((mine &
+        //        (ISMINE_MULTISIG |
+        //         (fIncludeColdStaking ? ISMINE_COLD
+        //                              : ISMINE_NO) |
+        //         (fIncludeDelegated
+        //              ? ISMINE_SPENDABLE_DELEGATED
+        //              : ISMINE_NO))) !=
+        //       ISMINE_NO));
+
+        vCoins.push_back(COutput(pcoin, i, nDepth));
     }
 }
 
@@ -2415,7 +2452,7 @@ bool CWallet::CommitTransaction(const CWalletTx& wtxNew, CReserveKey& reservekey
                 if (it != mapWallet.end()) {
                     CWalletTx& coin = it->second;
                     coin.BindWallet(this);
-                    NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
+                    NotifyTxChanged(coin.GetHash(), CT_UPDATED);
                 } else {
                     printf("Failed to commit transaction %s. An input was not found in the local wallet",
                            wtxNew.GetHash().ToString().c_str());
@@ -3083,7 +3120,7 @@ void CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end())
-            NotifyTransactionChanged(this, hashTx, CT_UPDATED);
+            NotifyTxChanged(hashTx, CT_UPDATED);
     }
 }
 
@@ -3183,7 +3220,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.setAbandoned();
             wtx.MarkDirty();
             wtx.WriteToDisk(&walletdb);
-            NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
+            NotifyTxChanged(wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them
             // abandoned too
             auto                     txSpends = mapTxSpends.get();
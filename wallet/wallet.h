@@ -115,6 +115,15 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    // the last change of each wallet transaction since the wallet was loaded, by its sequence number,
+    // for GetTxsChangedSince(); guarded by cs_wallet
+    uint64_t                    nLastTxChange;
+    std::map<uint64_t, uint256> mapTxChanges;
+    std::map<uint256, uint64_t> mapTxLastChange;
+
+    /** Records the change of the transaction for GetTxsChangedSince(), and tells the UI */
+    void NotifyTxChanged(const uint256& hashTx, ChangeType status);
+
 public:
     /// Main wallet lock.
     /// This lock protects all the fields added by CWallet
@@ -164,6 +173,7 @@ public:
         pwalletdbEncryption = nullptr;
         nOrderPosNext       = 0;
         nTimeFirstKey       = 0;
+        nLastTxChange       = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -192,6 +202,18 @@ public:
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true,
                         bool fIncludeColdStaking = false, bool fIncludeDelegated = true,
                         const CCoinControl* coinControl = nullptr) const;
+    /** Appends the outputs of the wallet transaction that AvailableCoins() gives; requires
+     * LOCK2(cs_main, cs_wallet) */
+    void AvailableCoinsOfTx(const CWalletTx& wtx, std::vector<COutput>& vCoins,
+                            bool fOnlyConfirmed = true, bool fIncludeColdStaking = false,
+                            bool                fIncludeDelegated = true,
+                            const CCoinControl* coinControl       = nullptr) const;
+
+    /** The sequence number of the last change of a wallet transaction since the wallet was loaded */
+    uint64_t GetLastTxChange() const;
+    /** The wallet transactions that were added or changed after the change nSequence, like by being
+     * included in a block, disconnected, spent, conflicted or abandoned */
+    std::vector<uint256> GetTxsChangedSince(uint64_t nSequence) const;
 
     // Get available p2cs utxo
     bool GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const;
@@ -17,6 +17,7 @@ HEADERS += qt/bitcoingui.h \
     base58.h \
     bignum.h \
     checkpoints.h \
+    checkqueue.h \
     compat.h \
     coincontrol.h \
     sync.h \
@@ -24,6 +25,7 @@ HEADERS += qt/bitcoingui.h \
     hash.h \
     uint256.h \
     kernel.h \
+    stakemodifierindex.h \
     scrypt.h \
     pbkdf2.h \
     serialize.h \
@@ -35,8 +37,10 @@ HEADERS += qt/bitcoingui.h \
     txdb.h \
     walletdb.h \
     script.h \
+    sigcache.h \
     init.h \
     hash.h \
+    sha256.h \
     bloom.h \
     mruset.h \
     json/json_spirit_writer_template.h \
@@ -111,6 +115,7 @@ HEADERS += qt/bitcoingui.h \
     ntp1/ntp1wallet.h \
     qt/ntp1/ntp1tokenlistitemdelegate.h \
     ThreadSafeHashMap.h \
+    LRUCache.h \
     qt/ntp1sendtokensfeewidget.h \
     ntp1/ntp1script_burn.h \
     ntp1/ntp1tokenminimalmetadata.h \
@@ -131,6 +136,12 @@ HEADERS += qt/bitcoingui.h \
     SerializationTester.h \
     blockindexcatalog.h   \
     blockindex.h          \
+    blockindexsnapshot.h  \
+    blockdownload.h       \
+    socketevents.h        \
+    validationqueue.h     \
+    orphanblocks.h        \
+    chain.h               \
     outpoint.h            \
     inpoint.h             \
     block.h               \
@@ -203,9 +214,11 @@ SOURCES += qt/bitcoin.cpp \
     sync.cpp \
     util.cpp \
     hash.cpp \
+    sha256.cpp \
     netbase.cpp \
     key.cpp \
     script.cpp \
+    sigcache.cpp \
     main.cpp \
     miner.cpp \
     init.cpp \
@@ -254,6 +267,7 @@ SOURCES += qt/bitcoin.cpp \
     qt/messageboxwithtimer.cpp \
     noui.cpp \
     kernel.cpp \
+    stakemodifierindex.cpp \
     scrypt-arm.S \
     scrypt-x86.S \
     scrypt-x86_64.S \
@@ -292,6 +306,12 @@ SOURCES += qt/bitcoin.cpp \
     SerializationTester.cpp \
     blockindexcatalog.cpp \
     blockindex.cpp        \
+    blockindexsnapshot.cpp \
+    blockdownload.cpp     \
+    socketevents.cpp      \
+    validationqueue.cpp   \
+    orphanblocks.cpp      \
+    chain.cpp             \
     outpoint.cpp          \
     inpoint.cpp           \
     block.cpp             \